@@ -7,6 +7,9 @@
 
 void _al_acodec_start_feed_thread(ALLEGRO_AUDIO_STREAM *stream)
 {
+   if (_al_kcm_add_to_feed_pool(stream))
+      return;
+
    stream->feed_thread = al_create_thread(_al_kcm_feed_stream, stream);
    stream->feed_thread_started_cond = al_create_cond();
    stream->feed_thread_started_mutex = al_create_mutex();
@@ -17,6 +20,11 @@ void _al_acodec_stop_feed_thread(ALLEGRO_AUDIO_STREAM *stream)
 {
    ALLEGRO_EVENT quit_event;
 
+   if (stream->feed_pooled) {
+      _al_kcm_remove_from_feed_pool(stream);
+      return;
+   }
+
    /* Need to wait for the thread to start, otherwise the quit event may be
     * sent before the event source is registered with the queue. */
    al_lock_mutex(stream->feed_thread_started_mutex);
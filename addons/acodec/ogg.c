@@ -5,12 +5,16 @@
  */
 
 
+#define ALLEGRO_INTERNAL_UNSTABLE
+
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_acodec.h"
 #include "allegro5/allegro_audio.h"
 #include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_atomicops.h"
 #include "allegro5/internal/aintern_audio.h"
 #include "allegro5/internal/aintern_exitfunc.h"
+#include "allegro5/internal/aintern_parallel.h"
 #include "allegro5/internal/aintern_system.h"
 #include "acodec.h"
 #include "helper.h"
@@ -40,6 +44,32 @@ struct AL_OV_DATA {
 };
 
 
+/* A whole Ogg file read into memory, for decoding from several threads. */
+typedef struct AL_OV_MEMORY {
+   const char *data;
+   int64_t size;
+   int64_t pos;
+} AL_OV_MEMORY;
+
+
+typedef struct OGG_DECODE_JOB {
+   const char *data;
+   int64_t size;
+   int channels;
+   bool use_float;
+   long total_samples;
+   long chunk_samples;
+   char *buffer;
+   volatile _AL_ATOMIC failed;   /* Number of chunks which failed. */
+} OGG_DECODE_JOB;
+
+
+/* Samples with at least this many samples per thread are decoded in
+ * parallel.
+ */
+#define MIN_CHUNK_SAMPLES  (1 << 16)
+
+
 /* dynamic loading support (Windows only currently) */
 #ifdef ALLEGRO_CFG_ACODEC_VORBISFILE_DLL
 static void *ov_dll = NULL;
@@ -51,12 +81,15 @@ static struct
    int (*ov_clear)(OggVorbis_File *);
    ogg_int64_t (*ov_pcm_total)(OggVorbis_File *, int);
    vorbis_info *(*ov_info)(OggVorbis_File *, int);
+   long (*ov_streams)(OggVorbis_File *);
+   int (*ov_pcm_seek)(OggVorbis_File *, ogg_int64_t);
 #ifndef TREMOR
    int (*ov_open_callbacks)(void *, OggVorbis_File *, const char *, long, ov_callbacks);
    double (*ov_time_total)(OggVorbis_File *, int);
    int (*ov_time_seek_lap)(OggVorbis_File *, double);
    double (*ov_time_tell)(OggVorbis_File *);
    long (*ov_read)(OggVorbis_File *, char *, int, int, int, int, int *);
+   long (*ov_read_float)(OggVorbis_File *, float ***, int, int *);
 #else
    int (*ov_open_callbacks)(void *, OggVorbis_File *, const char *, long, ov_callbacks);
    ogg_int64_t (*ov_time_total)(OggVorbis_File *, int);
@@ -119,11 +152,14 @@ static bool init_dynlib(void)
    INITSYM(ov_open_callbacks);
    INITSYM(ov_pcm_total);
    INITSYM(ov_info);
+   INITSYM(ov_streams);
+   INITSYM(ov_pcm_seek);
 #ifndef TREMOR
    INITSYM(ov_time_total);
    INITSYM(ov_time_seek_lap);
    INITSYM(ov_time_tell);
    INITSYM(ov_read);
+   INITSYM(ov_read_float);
 #else
    INITSYM(ov_time_total);
    INITSYM(ov_time_seek);
@@ -195,6 +231,240 @@ static ov_callbacks callbacks = {
 };
 
 
+static size_t memory_read_callback(void *ptr, size_t size, size_t nmemb,
+   void *dptr)
+{
+   AL_OV_MEMORY *mem = (AL_OV_MEMORY *)dptr;
+   size_t bytes = size * nmemb;
+
+   if ((int64_t)bytes > mem->size - mem->pos)
+      bytes = mem->size - mem->pos;
+   memcpy(ptr, mem->data + mem->pos, bytes);
+   mem->pos += bytes;
+
+   return bytes;
+}
+
+
+static int memory_seek_callback(void *dptr, ogg_int64_t offset, int whence)
+{
+   AL_OV_MEMORY *mem = (AL_OV_MEMORY *)dptr;
+   int64_t pos;
+
+   switch(whence) {
+      case SEEK_SET: pos = offset; break;
+      case SEEK_CUR: pos = mem->pos + offset; break;
+      case SEEK_END: pos = mem->size + offset; break;
+      default: return -1;
+   }
+
+   if (pos < 0 || pos > mem->size) {
+      return -1;
+   }
+
+   mem->pos = pos;
+   return 0;
+}
+
+
+static long memory_tell_callback(void *dptr)
+{
+   AL_OV_MEMORY *mem = (AL_OV_MEMORY *)dptr;
+
+   return (long)mem->pos;
+}
+
+
+static ov_callbacks memory_callbacks = {
+   memory_read_callback,
+   memory_seek_callback,
+   close_callback,
+   memory_tell_callback
+};
+
+
+/* Reads the rest of the file into memory. Returns NULL, leaving the file
+ * position alone, if that isn't possible.
+ */
+static char *read_whole_file(ALLEGRO_FILE *file, int64_t *size)
+{
+   int64_t start = al_ftell(file);
+   int64_t file_size = al_fsize(file);
+   char *data;
+
+   if (start < 0 || file_size <= start)
+      return NULL;
+
+   *size = file_size - start;
+   data = al_malloc(*size);
+   if (!data)
+      return NULL;
+
+   if (al_fread(file, data, *size) != (size_t)*size) {
+      al_free(data);
+      al_fseek(file, start, ALLEGRO_SEEK_SET);
+      return NULL;
+   }
+
+   return data;
+}
+
+
+/* Returns the rest of the file in memory, pointing into it directly if the
+ * file is in memory already. Otherwise *copy is set to the copy that must be
+ * freed.
+ */
+static const char *get_rest_of_file(ALLEGRO_FILE *file, int64_t *size,
+   char **copy)
+{
+   int64_t start = al_ftell(file);
+   const char *memory;
+   int64_t memory_size;
+
+   memory = al_get_file_memory(file, &memory_size);
+   if (memory && start >= 0 && start < memory_size) {
+      *copy = NULL;
+      *size = memory_size - start;
+      al_fseek(file, 0, ALLEGRO_SEEK_END);
+      return memory + start;
+   }
+
+   *copy = read_whole_file(file, size);
+   return *copy;
+}
+
+
+/* Decodes up to 'samples' samples from the current position into buffer,
+ * interleaved as int16 or float32. Returns the number of samples decoded.
+ */
+static long decode_samples(OggVorbis_File *vf, char *buffer, long samples,
+   int channels, bool use_float)
+{
+#ifdef ALLEGRO_LITTLE_ENDIAN
+   const int endian = 0; /* 0 for Little-Endian, 1 for Big-Endian */
+#else
+   const int endian = 1; /* 0 for Little-Endian, 1 for Big-Endian */
+#endif
+   const int word_size = 2; /* 1 = 8bit, 2 = 16-bit. nothing else */
+   const int signedness = 1; /* 0  for unsigned, 1 for signed */
+   const int packet_size = 4096; /* suggestion for size to read at a time */
+   const long total_size = samples * channels * word_size;
+   int bitstream = -1;
+   long pos = 0;
+   long read;
+
+#ifndef TREMOR
+   if (use_float) {
+      float *out = (float *)buffer;
+
+      while (pos < samples) {
+         float **pcm;
+         const int read_samples = _ALLEGRO_MIN(packet_size, samples - pos);
+         long i;
+         int c;
+
+         read = lib.ov_read_float(vf, &pcm, read_samples, &bitstream);
+         if (read == OV_HOLE)
+            continue;
+         if (read <= 0)
+            break;
+
+         for (i = 0; i < read; i++) {
+            for (c = 0; c < channels; c++) {
+               *out++ = pcm[c][i];
+            }
+         }
+         pos += read;
+      }
+
+      return pos;
+   }
+#else
+   (void)use_float;
+#endif
+
+   while (pos < total_size) {
+      const int read_size = _ALLEGRO_MIN(packet_size, total_size - pos);
+      ASSERT(pos + read_size <= total_size);
+
+#ifndef TREMOR
+      read = lib.ov_read(vf, buffer + pos, read_size, endian, word_size,
+         signedness, &bitstream);
+#else
+      (void)endian;
+      (void)signedness;
+      read = lib.ov_read(vf, buffer + pos, read_size, &bitstream);
+#endif
+      if (read == OV_HOLE)
+         continue;
+      if (read <= 0)
+         break;
+      pos += read;
+   }
+
+   return pos / (channels * word_size);
+}
+
+
+/* Decodes the chunks [begin, end) of a sample, each with its own decoder
+ * seeked to the start of the chunk.
+ */
+static void decode_chunks(void *arg, int begin, int end)
+{
+   OGG_DECODE_JOB *job = arg;
+   const int sample_size = job->channels * (job->use_float ? 4 : 2);
+   int i;
+
+   /* Once a chunk has failed the whole sample is decoded again sequentially,
+    * so the other workers stop early.
+    */
+   for (i = begin; i < end && job->failed == 0; i++) {
+      AL_OV_MEMORY mem;
+      OggVorbis_File vf;
+      const long start = i * job->chunk_samples;
+      const long samples = _ALLEGRO_MIN(job->chunk_samples,
+         job->total_samples - start);
+      long decoded;
+
+      mem.data = job->data;
+      mem.size = job->size;
+      mem.pos = 0;
+      if (lib.ov_open_callbacks(&mem, &vf, NULL, 0, memory_callbacks) < 0) {
+         _al_fetch_and_add1(&job->failed);
+         break;
+      }
+
+      if (lib.ov_pcm_seek(&vf, start) < 0) {
+         _al_fetch_and_add1(&job->failed);
+      }
+      else {
+         decoded = decode_samples(&vf, job->buffer + start * sample_size,
+            samples, job->channels, job->use_float);
+         if (decoded != samples)
+            _al_fetch_and_add1(&job->failed);
+      }
+
+      lib.ov_clear(&vf);
+   }
+}
+
+
+/* The [acodec] ogg_sample_depth config key selects float32 samples, which
+ * avoids converting Vorbis' float output to int16 and back for a float32
+ * mixer. Tremor only decodes to integers.
+ */
+static bool want_float_samples(void)
+{
+#ifndef TREMOR
+   const char *value = al_get_config_value(al_get_system_config(),
+      "acodec", "ogg_sample_depth");
+   return value && !_al_stricmp(value, "float32");
+#else
+   return false;
+#endif
+}
+
+
 ALLEGRO_SAMPLE *_al_load_ogg_vorbis(const char *filename)
 {
    ALLEGRO_FILE *f;
@@ -218,38 +488,46 @@ ALLEGRO_SAMPLE *_al_load_ogg_vorbis(const char *filename)
 
 ALLEGRO_SAMPLE *_al_load_ogg_vorbis_f(ALLEGRO_FILE *file)
 {
-   /* Note: decoding library returns floats.  I always return 16-bit (most
-    * commonly supported).
+   /* Note: decoding library returns floats.  They are returned as 16-bit
+    * samples (most commonly supported), unless float32 is asked for.
     */
-#ifdef ALLEGRO_LITTLE_ENDIAN
-   const int endian = 0; /* 0 for Little-Endian, 1 for Big-Endian */
-#else
-   const int endian = 1; /* 0 for Little-Endian, 1 for Big-Endian */
-#endif
-   int word_size = 2; /* 1 = 8bit, 2 = 16-bit. nothing else */
-   int signedness = 1; /* 0  for unsigned, 1 for signed */
-   const int packet_size = 4096; /* suggestion for size to read at a time */
+   const bool use_float = want_float_samples();
+   const int word_size = use_float ? 4 : 2;
    OggVorbis_File vf;
    vorbis_info* vi;
    char *buffer;
-   long pos;
    ALLEGRO_SAMPLE *sample;
    int channels;
    long rate;
    long total_samples;
-   int bitstream;
    long total_size;
    AL_OV_DATA ov;
-   long read;
+   AL_OV_MEMORY mem;
+   char *copy;
+   int chunks = 1;
 
    if (!init_dynlib()) {
       return NULL;
    }
 
-   ov.file = file;
-   if (lib.ov_open_callbacks(&ov, &vf, NULL, 0, callbacks) < 0) {
-      ALLEGRO_ERROR("Audio file does not appear to be an Ogg bitstream.\n");
-      return NULL;
+   /* Decode from memory if possible, so that several threads can share the
+    * data.
+    */
+   mem.data = get_rest_of_file(file, &mem.size, &copy);
+   mem.pos = 0;
+   if (mem.data) {
+      if (lib.ov_open_callbacks(&mem, &vf, NULL, 0, memory_callbacks) < 0) {
+         ALLEGRO_ERROR("Audio file does not appear to be an Ogg bitstream.\n");
+         al_free(copy);
+         return NULL;
+      }
+   }
+   else {
+      ov.file = file;
+      if (lib.ov_open_callbacks(&ov, &vf, NULL, 0, callbacks) < 0) {
+         ALLEGRO_ERROR("Audio file does not appear to be an Ogg bitstream.\n");
+         return NULL;
+      }
    }
 
    vi = lib.ov_info(&vf, -1);
@@ -257,7 +535,6 @@ ALLEGRO_SAMPLE *_al_load_ogg_vorbis_f(ALLEGRO_FILE *file)
    channels = vi->channels;
    rate = vi->rate;
    total_samples = lib.ov_pcm_total(&vf, -1);
-   bitstream = -1;
    total_size = total_samples * channels * word_size;
 
    ALLEGRO_DEBUG("channels %d\n", channels);
@@ -268,33 +545,53 @@ ALLEGRO_SAMPLE *_al_load_ogg_vorbis_f(ALLEGRO_FILE *file)
 
    buffer = al_malloc(total_size);
    if (!buffer) {
-      ALLEGRO_ERROR("Unable to allocate buffer (%d).\n", total_size);
+      ALLEGRO_ERROR("Unable to allocate buffer (%ld).\n", total_size);
+      lib.ov_clear(&vf);
+      al_free(copy);
       return NULL;
    }
 
-   pos = 0;
-   while (pos < total_size) {
-      const int read_size = _ALLEGRO_MIN(packet_size, total_size - pos);
-      ASSERT(pos + read_size <= total_size);
+   /* Long samples are split into chunks decoded in parallel, each seeking
+    * to its start. Chained files may change the channel count between
+    * links, so they are always decoded in one go.
+    */
+   if (mem.data && lib.ov_streams(&vf) == 1) {
+      chunks = _ALLEGRO_MIN(_al_get_parallel_thread_count(),
+         total_samples / MIN_CHUNK_SAMPLES);
+   }
+
+   if (chunks > 1) {
+      OGG_DECODE_JOB job;
+
+      job.data = mem.data;
+      job.size = mem.size;
+      job.channels = channels;
+      job.use_float = use_float;
+      job.total_samples = total_samples;
+      job.chunk_samples = (total_samples + chunks - 1) / chunks;
+      job.buffer = buffer;
+      job.failed = 0;
+
+      ALLEGRO_DEBUG("decoding in %d chunks\n", chunks);
+      _al_parallel_for(chunks, 1, decode_chunks, &job);
+
+      if (job.failed > 0) {
+         ALLEGRO_WARN("Parallel decoding failed, decoding sequentially.\n");
+         lib.ov_pcm_seek(&vf, 0);
+         chunks = 1;
+      }
+   }
 
+   if (chunks <= 1) {
       /* XXX error handling */
-#ifndef TREMOR
-      read = lib.ov_read(&vf, buffer + pos, read_size, endian, word_size,
-         signedness, &bitstream);
-#else
-      (void)endian;
-      (void)signedness;
-      read = lib.ov_read(&vf, buffer + pos, read_size, &bitstream);
-#endif
-      pos += read;
-      if (read == 0)
-         break;
+      decode_samples(&vf, buffer, total_samples, channels, use_float);
    }
 
    lib.ov_clear(&vf);
+   al_free(copy);
 
    sample = al_create_sample(buffer, total_samples, rate,
-      _al_word_size_to_depth_conf(word_size),
+      use_float ? ALLEGRO_AUDIO_DEPTH_FLOAT32 : _al_word_size_to_depth_conf(word_size),
       _al_count_to_channel_conf(channels), true);
 
    if (!sample) {
@@ -154,6 +154,18 @@ struct ALLEGRO_SAMPLE_ID {
 };
 
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
+/* Enum: ALLEGRO_SAMPLE_STEAL_POLICY
+ */
+typedef enum ALLEGRO_SAMPLE_STEAL_POLICY {
+   ALLEGRO_SAMPLE_STEAL_NONE,
+   ALLEGRO_SAMPLE_STEAL_LOWEST_PRIORITY,
+   ALLEGRO_SAMPLE_STEAL_OLDEST,
+   ALLEGRO_SAMPLE_STEAL_QUIETEST
+} ALLEGRO_SAMPLE_STEAL_POLICY;
+#endif
+
+
 /* Type: ALLEGRO_SAMPLE_INSTANCE
  */
 typedef struct ALLEGRO_SAMPLE_INSTANCE ALLEGRO_SAMPLE_INSTANCE;
@@ -178,6 +190,10 @@ typedef struct ALLEGRO_VOICE ALLEGRO_VOICE;
 /* Type: ALLEGRO_AUDIO_RECORDER
  */
 typedef struct ALLEGRO_AUDIO_RECORDER ALLEGRO_AUDIO_RECORDER;
+
+/* Type: ALLEGRO_COMPRESSED_SAMPLE
+ */
+typedef struct ALLEGRO_COMPRESSED_SAMPLE ALLEGRO_COMPRESSED_SAMPLE;
 #endif
 
 
@@ -292,6 +308,7 @@ ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_EVENT_SOURCE *, al_get_audio_stream_event_source,
 
 #if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
 ALLEGRO_KCM_AUDIO_FUNC(bool, al_set_audio_stream_channel_matrix, (ALLEGRO_AUDIO_STREAM *stream, const float *matrix));
+ALLEGRO_KCM_AUDIO_FUNC(unsigned int, al_get_audio_stream_underruns, (const ALLEGRO_AUDIO_STREAM *stream));
 #endif
 
 /* Mixer functions */
@@ -370,6 +387,12 @@ ALLEGRO_KCM_AUDIO_FUNC(void, al_set_default_voice, (ALLEGRO_VOICE *voice));
 #if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_KCM_AUDIO_SRC)
 ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_SAMPLE_INSTANCE*, al_lock_sample_id, (ALLEGRO_SAMPLE_ID *spl_id));
 ALLEGRO_KCM_AUDIO_FUNC(void, al_unlock_sample_id, (ALLEGRO_SAMPLE_ID *spl_id));
+ALLEGRO_KCM_AUDIO_FUNC(bool, al_play_sample_with_priority, (ALLEGRO_SAMPLE *data,
+      float gain, float pan, float speed, ALLEGRO_PLAYMODE loop, int priority, ALLEGRO_SAMPLE_ID *ret_id));
+ALLEGRO_KCM_AUDIO_FUNC(void, al_set_sample_steal_policy, (ALLEGRO_SAMPLE_STEAL_POLICY policy));
+ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_SAMPLE_STEAL_POLICY, al_get_sample_steal_policy, (void));
+ALLEGRO_KCM_AUDIO_FUNC(void, al_set_sample_max_instances, (ALLEGRO_SAMPLE *spl, int max_instances));
+ALLEGRO_KCM_AUDIO_FUNC(int, al_get_sample_max_instances, (const ALLEGRO_SAMPLE *spl));
 #endif
 
 /* File type handlers */
@@ -415,6 +438,24 @@ ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_EVENT_SOURCE *, al_get_audio_recorder_event_sourc
 ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_AUDIO_RECORDER_EVENT *, al_get_audio_recorder_event, (ALLEGRO_EVENT *event));
 ALLEGRO_KCM_AUDIO_FUNC(void, al_destroy_audio_recorder, (ALLEGRO_AUDIO_RECORDER *r));
 
+/* Compressed samples */
+ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_COMPRESSED_SAMPLE *, al_load_compressed_sample, (const char *filename));
+ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_COMPRESSED_SAMPLE *, al_load_compressed_sample_f, (ALLEGRO_FILE *fp, const char *ident));
+ALLEGRO_KCM_AUDIO_FUNC(void, al_destroy_compressed_sample, (ALLEGRO_COMPRESSED_SAMPLE *spl));
+ALLEGRO_KCM_AUDIO_FUNC(size_t, al_get_compressed_sample_size, (const ALLEGRO_COMPRESSED_SAMPLE *spl));
+ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_AUDIO_STREAM *, al_create_compressed_sample_stream, (ALLEGRO_COMPRESSED_SAMPLE *spl,
+   size_t buffer_count, unsigned int samples));
+
+/* Asynchronous loading, the loader API is only visible to unstable users. */
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE)
+ALLEGRO_KCM_AUDIO_FUNC(ALLEGRO_LOAD_REQUEST *, al_load_sample_async, (ALLEGRO_LOADER *loader,
+   const char *filename, int priority));
+#endif
+
+/* Offline driver */
+ALLEGRO_KCM_AUDIO_FUNC(void, al_set_offline_audio_callback, (void (*callback)(ALLEGRO_VOICE *voice,
+   const void *buf, unsigned int samples, void *data), void *data));
+
 #endif
    
 #ifdef __cplusplus
@@ -6,6 +6,7 @@
 #define AINTERN_AUDIO_H
 
 #include "allegro5/allegro.h"
+#include "allegro5/internal/aintern_atomicops.h"
 #include "allegro5/internal/aintern_list.h"
 #include "allegro5/internal/aintern_vector.h"
 #include "../allegro_audio.h"
@@ -57,7 +58,8 @@ typedef enum ALLEGRO_AUDIO_DRIVER_ENUM
    ALLEGRO_AUDIO_DRIVER_AQUEUE     = 0x20005,
    ALLEGRO_AUDIO_DRIVER_PULSEAUDIO = 0x20006,
    ALLEGRO_AUDIO_DRIVER_OPENSL     = 0x20007,
-   ALLEGRO_AUDIO_DRIVER_SDL        = 0x20008
+   ALLEGRO_AUDIO_DRIVER_SDL        = 0x20008,
+   ALLEGRO_AUDIO_DRIVER_OFFLINE    = 0x20009
 } ALLEGRO_AUDIO_DRIVER_ENUM;
 
 typedef struct ALLEGRO_AUDIO_DRIVER ALLEGRO_AUDIO_DRIVER;
@@ -88,6 +90,8 @@ struct ALLEGRO_AUDIO_DRIVER {
 
 extern ALLEGRO_AUDIO_DRIVER *_al_kcm_driver;
 
+extern volatile _AL_ATOMIC _al_kcm_instances_stopped;
+
 const void *_al_voice_update(ALLEGRO_VOICE *voice, ALLEGRO_MUTEX *mutex,
    unsigned int *samples);
 bool _al_kcm_set_voice_playing(ALLEGRO_VOICE *voice, ALLEGRO_MUTEX *mutex,
@@ -150,6 +154,16 @@ struct ALLEGRO_SAMPLE {
                         /* Whether `buffer' needs to be freed when the sample
                          * is destroyed, or when `buffer' changes.
                          */
+   int                  max_instances;
+                        /* Maximum number of instances started by
+                         * al_play_sample playing this sample at once, or 0
+                         * for no limit.
+                         */
+   int                  num_instances;
+                        /* Number of instances started by al_play_sample
+                         * which are playing this sample or have not been
+                         * reaped since they stopped.
+                         */
    _AL_LIST_ITEM        *dtor_item;
 };
 
@@ -313,6 +327,29 @@ struct ALLEGRO_AUDIO_STREAM {
                           * streams don't need to be fed by the user.
                           */
 
+   bool                  feed_pooled;
+   volatile _AL_ATOMIC   feed_notify;
+   bool                  feed_requested;
+   bool                  feed_busy;
+   bool                  feed_draining;
+   bool                  feed_finished_event_sent;
+   unsigned int          feed_queued;
+                         /* State of a stream fed by the shared feeder pool
+                          * instead of its own thread, protected by the pool
+                          * mutex. 'feed_queued' is the number of fragments
+                          * waiting to be played, the most urgent stream is
+                          * the one with the fewest. 'feed_notify' is cleared
+                          * when the pool shuts down, after which the stream
+                          * stays pooled but no longer signals the pool. It
+                          * is atomic as the mixer reads it before taking the
+                          * pool mutex.
+                          */
+
+   unsigned int          underruns;
+                         /* Number of times the mixer ran out of fragments
+                          * while the stream was playing and not draining.
+                          */
+
    _AL_LIST_ITEM        *dtor_item;
 
    void                  *extra;
@@ -368,6 +405,12 @@ ALLEGRO_KCM_AUDIO_FUNC(void*, _al_kcm_feed_stream, (ALLEGRO_THREAD *self, void *
 /* Helper to emit an event that the stream has got a buffer ready to be refilled. */
 void _al_kcm_emit_stream_events(ALLEGRO_AUDIO_STREAM *stream);
 
+/* Shared feeder pool, used instead of _al_kcm_feed_stream threads if enabled. */
+void _al_kcm_init_feed_pool(void);
+void _al_kcm_shutdown_feed_pool(void);
+ALLEGRO_KCM_AUDIO_FUNC(bool, _al_kcm_add_to_feed_pool, (ALLEGRO_AUDIO_STREAM *stream));
+ALLEGRO_KCM_AUDIO_FUNC(void, _al_kcm_remove_from_feed_pool, (ALLEGRO_AUDIO_STREAM *stream));
+
 void _al_kcm_init_destructors(void);
 void _al_kcm_shutdown_destructors(void);
 _AL_LIST_ITEM *_al_kcm_register_destructor(char const *name, void *object,
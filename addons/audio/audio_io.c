@@ -2,6 +2,8 @@
  * Allegro audio codec table.
  */
 
+#define ALLEGRO_INTERNAL_UNSTABLE
+
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_audio.h"
 #include "allegro5/internal/aintern.h"
@@ -274,6 +276,33 @@ ALLEGRO_SAMPLE *al_load_sample(const char *filename)
 }
 
 
+static void *async_sample_load(const char *filename, void *arg)
+{
+   (void)arg;
+   return al_load_sample(filename);
+}
+
+
+static void async_sample_destroy(void *result, void *arg)
+{
+   (void)arg;
+   al_destroy_sample(result);
+}
+
+
+/* Function: al_load_sample_async
+ */
+ALLEGRO_LOAD_REQUEST *al_load_sample_async(ALLEGRO_LOADER *loader,
+   const char *filename, int priority)
+{
+   ASSERT(loader);
+   ASSERT(filename);
+
+   return al_queue_load(loader, filename, priority, async_sample_load, NULL,
+      async_sample_destroy, NULL);
+}
+
+
 /* Function: al_load_sample_f
  */
 ALLEGRO_SAMPLE *al_load_sample_f(ALLEGRO_FILE* fp, const char *ident)
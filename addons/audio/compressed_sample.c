@@ -0,0 +1,392 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Compressed samples: encoded audio files kept in memory and
+ *      decoded as they are played.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+/* Title: Compressed samples
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_audio.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_audio.h"
+
+ALLEGRO_DEBUG_CHANNEL("audio")
+
+
+#define MAX_IDENT_LENGTH   32
+
+/* The encoded data is shared by all streams playing the sample. It is freed
+ * once the sample has been destroyed and all of its streams are closed.
+ */
+struct ALLEGRO_COMPRESSED_SAMPLE {
+   char ident[MAX_IDENT_LENGTH];
+   char *data;
+   int64_t size;
+   ALLEGRO_MUTEX *mutex;
+   int refcount;
+   _AL_LIST_ITEM *dtor_item;
+};
+
+
+/* Read-only file handle over the data of a compressed sample, handed to
+ * the stream loaders of the codecs.
+ */
+typedef struct COMPRESSED_FILE {
+   ALLEGRO_COMPRESSED_SAMPLE *spl;
+   int64_t pos;
+   bool eof;
+} COMPRESSED_FILE;
+
+
+static void release_compressed_sample(ALLEGRO_COMPRESSED_SAMPLE *spl)
+{
+   int refcount;
+
+   al_lock_mutex(spl->mutex);
+   refcount = --spl->refcount;
+   al_unlock_mutex(spl->mutex);
+
+   if (refcount == 0) {
+      al_destroy_mutex(spl->mutex);
+      al_free(spl->data);
+      al_free(spl);
+   }
+}
+
+
+static bool compressed_fclose(ALLEGRO_FILE *fp)
+{
+   COMPRESSED_FILE *cf = al_get_file_userdata(fp);
+
+   release_compressed_sample(cf->spl);
+   al_free(cf);
+   return true;
+}
+
+
+static size_t compressed_fread(ALLEGRO_FILE *fp, void *ptr, size_t size)
+{
+   COMPRESSED_FILE *cf = al_get_file_userdata(fp);
+   size_t n = size;
+
+   if (cf->spl->size - cf->pos < (int64_t)size) {
+      n = cf->spl->size - cf->pos;
+      cf->eof = true;
+   }
+
+   memcpy(ptr, cf->spl->data + cf->pos, n);
+   cf->pos += n;
+
+   return n;
+}
+
+
+static size_t compressed_fwrite(ALLEGRO_FILE *fp, const void *ptr,
+   size_t size)
+{
+   (void)fp;
+   (void)ptr;
+   (void)size;
+   al_set_errno(EPERM);
+   return 0;
+}
+
+
+static bool compressed_fflush(ALLEGRO_FILE *fp)
+{
+   (void)fp;
+   return true;
+}
+
+
+static int64_t compressed_ftell(ALLEGRO_FILE *fp)
+{
+   COMPRESSED_FILE *cf = al_get_file_userdata(fp);
+
+   return cf->pos;
+}
+
+
+static bool compressed_fseek(ALLEGRO_FILE *fp, int64_t offset, int whence)
+{
+   COMPRESSED_FILE *cf = al_get_file_userdata(fp);
+   int64_t pos = cf->pos;
+
+   switch (whence) {
+      case ALLEGRO_SEEK_SET:
+         pos = offset;
+         break;
+
+      case ALLEGRO_SEEK_CUR:
+         pos = cf->pos + offset;
+         break;
+
+      case ALLEGRO_SEEK_END:
+         pos = cf->spl->size + offset;
+         break;
+   }
+
+   if (pos < 0 || pos > cf->spl->size)
+      return false;
+
+   cf->pos = pos;
+   cf->eof = false;
+
+   return true;
+}
+
+
+static bool compressed_feof(ALLEGRO_FILE *fp)
+{
+   COMPRESSED_FILE *cf = al_get_file_userdata(fp);
+
+   return cf->eof;
+}
+
+
+static int compressed_ferror(ALLEGRO_FILE *fp)
+{
+   (void)fp;
+   return 0;
+}
+
+
+static const char *compressed_ferrmsg(ALLEGRO_FILE *fp)
+{
+   (void)fp;
+   return "";
+}
+
+
+static void compressed_fclearerr(ALLEGRO_FILE *fp)
+{
+   COMPRESSED_FILE *cf = al_get_file_userdata(fp);
+
+   cf->eof = false;
+}
+
+
+static off_t compressed_fsize(ALLEGRO_FILE *fp)
+{
+   COMPRESSED_FILE *cf = al_get_file_userdata(fp);
+
+   return cf->spl->size;
+}
+
+
+static const ALLEGRO_FILE_INTERFACE compressed_vtable = {
+   NULL,    /* open */
+   compressed_fclose,
+   compressed_fread,
+   compressed_fwrite,
+   compressed_fflush,
+   compressed_ftell,
+   compressed_fseek,
+   compressed_feof,
+   compressed_ferror,
+   compressed_ferrmsg,
+   compressed_fclearerr,
+   NULL,    /* ungetc */
+   compressed_fsize
+};
+
+
+/* Reads the rest of the file into memory. */
+static char *read_rest_of_file(ALLEGRO_FILE *fp, int64_t *size)
+{
+   int64_t pos = al_ftell(fp);
+   int64_t file_size = al_fsize(fp);
+   char *data = NULL;
+   int64_t capacity;
+
+   *size = 0;
+
+   if (pos >= 0 && file_size > pos) {
+      capacity = file_size - pos;
+   }
+   else {
+      capacity = 64 * 1024;
+   }
+
+   for (;;) {
+      char *new_data = al_realloc(data, capacity);
+      if (!new_data) {
+         al_free(data);
+         return NULL;
+      }
+      data = new_data;
+
+      *size += al_fread(fp, data + *size, capacity - *size);
+      if (*size < capacity)
+         break;
+      /* The size was unknown or wrong, keep going until the end. */
+      if (al_feof(fp))
+         break;
+      capacity *= 2;
+   }
+
+   if (*size == 0) {
+      al_free(data);
+      return NULL;
+   }
+
+   return data;
+}
+
+
+/* Function: al_load_compressed_sample
+ */
+ALLEGRO_COMPRESSED_SAMPLE *al_load_compressed_sample(const char *filename)
+{
+   ALLEGRO_FILE *fp;
+   ALLEGRO_COMPRESSED_SAMPLE *spl;
+   const char *ext;
+
+   ASSERT(filename);
+
+   ext = strrchr(filename, '.');
+   if (ext == NULL) {
+      ALLEGRO_ERROR("Unable to determine extension for %s.\n", filename);
+      return NULL;
+   }
+
+   fp = al_fopen(filename, "rb");
+   if (!fp) {
+      ALLEGRO_ERROR("Unable to open %s for reading.\n", filename);
+      return NULL;
+   }
+
+   spl = al_load_compressed_sample_f(fp, ext);
+   al_fclose(fp);
+
+   return spl;
+}
+
+
+/* Function: al_load_compressed_sample_f
+ */
+ALLEGRO_COMPRESSED_SAMPLE *al_load_compressed_sample_f(ALLEGRO_FILE *fp,
+   const char *ident)
+{
+   ALLEGRO_COMPRESSED_SAMPLE *spl;
+
+   ASSERT(fp);
+   ASSERT(ident);
+
+   if (strlen(ident) >= MAX_IDENT_LENGTH) {
+      ALLEGRO_ERROR("Extension too long: %s\n", ident);
+      return NULL;
+   }
+
+   spl = al_calloc(1, sizeof(*spl));
+   if (!spl) {
+      _al_set_error(ALLEGRO_GENERIC_ERROR,
+         "Out of memory allocating compressed sample object");
+      return NULL;
+   }
+
+   spl->data = read_rest_of_file(fp, &spl->size);
+   if (!spl->data) {
+      ALLEGRO_ERROR("Unable to read compressed sample data.\n");
+      al_free(spl);
+      return NULL;
+   }
+
+   spl->mutex = al_create_mutex();
+   if (!spl->mutex) {
+      al_free(spl->data);
+      al_free(spl);
+      return NULL;
+   }
+
+   strcpy(spl->ident, ident);
+   spl->refcount = 1;
+   spl->dtor_item = _al_kcm_register_destructor("compressed_sample", spl,
+      (void (*)(void *)) al_destroy_compressed_sample);
+
+   ALLEGRO_DEBUG("Loaded %s compressed sample, %ld bytes.\n", spl->ident,
+      (long)spl->size);
+
+   return spl;
+}
+
+
+/* Function: al_destroy_compressed_sample
+ */
+void al_destroy_compressed_sample(ALLEGRO_COMPRESSED_SAMPLE *spl)
+{
+   if (spl) {
+      _al_kcm_unregister_destructor(spl->dtor_item);
+      release_compressed_sample(spl);
+   }
+}
+
+
+/* Function: al_get_compressed_sample_size
+ */
+size_t al_get_compressed_sample_size(const ALLEGRO_COMPRESSED_SAMPLE *spl)
+{
+   ASSERT(spl);
+
+   return spl->size;
+}
+
+
+/* Function: al_create_compressed_sample_stream
+ */
+ALLEGRO_AUDIO_STREAM *al_create_compressed_sample_stream(
+   ALLEGRO_COMPRESSED_SAMPLE *spl, size_t buffer_count, unsigned int samples)
+{
+   COMPRESSED_FILE *cf;
+   ALLEGRO_FILE *fp;
+   ALLEGRO_AUDIO_STREAM *stream;
+
+   ASSERT(spl);
+
+   cf = al_calloc(1, sizeof(*cf));
+   if (!cf) {
+      _al_set_error(ALLEGRO_GENERIC_ERROR,
+         "Out of memory allocating compressed sample file");
+      return NULL;
+   }
+
+   al_lock_mutex(spl->mutex);
+   spl->refcount++;
+   al_unlock_mutex(spl->mutex);
+   cf->spl = spl;
+
+   fp = al_create_file_handle(&compressed_vtable, cf);
+   if (!fp) {
+      release_compressed_sample(spl);
+      al_free(cf);
+      return NULL;
+   }
+
+   /* The stream closes the file, and so releases the sample, when it is
+    * destroyed.
+    */
+   stream = al_load_audio_stream_f(fp, spl->ident, buffer_count, samples);
+   if (!stream) {
+      al_fclose(fp);
+   }
+
+   return stream;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
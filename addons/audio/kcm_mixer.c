@@ -8,6 +8,8 @@
 /* Title: Mixer functions
  */
 
+#define ALLEGRO_INTERNAL_UNSTABLE
+
 #include <math.h>
 #include <stdio.h>
 
@@ -15,6 +17,7 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_audio.h"
 #include "allegro5/internal/aintern_audio_cfg.h"
+#include "allegro5/internal/aintern_simd.h"
 
 ALLEGRO_DEBUG_CHANNEL("audio")
 
@@ -220,6 +223,7 @@ static bool fix_looped_position(ALLEGRO_SAMPLE_INSTANCE *spl)
          }
          spl->pos = 0;
          spl->is_playing = false;
+         _al_fetch_and_add1(&_al_kcm_instances_stopped);
          return false;
 
       case _ALLEGRO_PLAYMODE_STREAM_ONCE:
@@ -345,6 +349,298 @@ MAKE_MIXER(read_to_mixer_linear_int16_t_16, linear_spl16, int16_t)
 #undef MAKE_MIXER
 
 
+/* Block mixers for float32 mixers.
+ *
+ * These resample up to MIXER_BLOCK frames at a time, for as long as no
+ * looping can happen, and then apply the channel matrix to the whole block.
+ * If the sample is float32 and plays at the mixer frequency the frames are
+ * read straight from the sample buffer instead.  The matrix kernels do the
+ * same additions in the same order as MAKE_MIXER so the output is identical.
+ * Anything the block mixers do not handle falls back to the frame by frame
+ * mixers above.
+ */
+#define MIXER_BLOCK  256
+
+typedef void (*MIX_BLOCK)(float *buf, const float *s, unsigned int n,
+   const float *m, size_t maxc, size_t dest_maxc);
+
+
+static void mix_block_any(float *buf, const float *s, unsigned int n,
+   const float *m, size_t maxc, size_t dest_maxc)
+{
+   unsigned int k;
+   size_t c, i;
+
+   for (k = 0; k < n; k++, s += maxc) {
+      for (c = 0; c < dest_maxc; c++) {
+         const float *mc = m + c*maxc;
+         for (i = maxc; i-- > 0;) {
+            *buf += s[i] * mc[i];
+         }
+         buf++;
+      }
+   }
+}
+
+
+static void mix_block_mono_stereo(float *buf, const float *s, unsigned int n,
+   const float *m, size_t maxc, size_t dest_maxc)
+{
+   const float m0 = m[0], m1 = m[1];
+   unsigned int k;
+   (void)maxc;
+   (void)dest_maxc;
+
+   for (k = 0; k < n; k++, buf += 2) {
+      buf[0] += s[k] * m0;
+      buf[1] += s[k] * m1;
+   }
+}
+
+
+static void mix_block_stereo_stereo(float *buf, const float *s, unsigned int n,
+   const float *m, size_t maxc, size_t dest_maxc)
+{
+   unsigned int k;
+   (void)maxc;
+   (void)dest_maxc;
+
+   for (k = 0; k < n; k++, s += 2, buf += 2) {
+      buf[0] += s[1] * m[1];
+      buf[0] += s[0] * m[0];
+      buf[1] += s[1] * m[3];
+      buf[1] += s[0] * m[2];
+   }
+}
+
+
+static void mix_block_51_stereo(float *buf, const float *s, unsigned int n,
+   const float *m, size_t maxc, size_t dest_maxc)
+{
+   unsigned int k;
+   int i;
+   (void)maxc;
+   (void)dest_maxc;
+
+   for (k = 0; k < n; k++, s += 6, buf += 2) {
+      for (i = 5; i >= 0; i--) {
+         buf[0] += s[i] * m[i];
+         buf[1] += s[i] * m[6 + i];
+      }
+   }
+}
+
+
+#ifdef _AL_SIMD_SSE2
+
+/* Two output frames per vector, [L0 R0 L1 R1]. */
+
+_AL_SIMD_TARGET("sse2")
+static void mix_block_mono_stereo_sse2(float *buf, const float *s,
+   unsigned int n, const float *m, size_t maxc, size_t dest_maxc)
+{
+   const __m128 mv = _mm_setr_ps(m[0], m[1], m[0], m[1]);
+   unsigned int k;
+
+   for (k = 0; k + 4 <= n; k += 4, buf += 8) {
+      const __m128 sv = _mm_loadu_ps(s + k);
+      __m128 b0 = _mm_loadu_ps(buf);
+      __m128 b1 = _mm_loadu_ps(buf + 4);
+      b0 = _mm_add_ps(b0, _mm_mul_ps(_mm_unpacklo_ps(sv, sv), mv));
+      b1 = _mm_add_ps(b1, _mm_mul_ps(_mm_unpackhi_ps(sv, sv), mv));
+      _mm_storeu_ps(buf, b0);
+      _mm_storeu_ps(buf + 4, b1);
+   }
+   mix_block_mono_stereo(buf, s + k, n - k, m, maxc, dest_maxc);
+}
+
+
+_AL_SIMD_TARGET("sse2")
+static void mix_block_stereo_stereo_sse2(float *buf, const float *s,
+   unsigned int n, const float *m, size_t maxc, size_t dest_maxc)
+{
+   const __m128 m0 = _mm_setr_ps(m[0], m[2], m[0], m[2]);
+   const __m128 m1 = _mm_setr_ps(m[1], m[3], m[1], m[3]);
+   unsigned int k;
+
+   for (k = 0; k + 2 <= n; k += 2, s += 4, buf += 4) {
+      const __m128 sv = _mm_loadu_ps(s);
+      const __m128 s0 = _mm_shuffle_ps(sv, sv, _MM_SHUFFLE(2, 2, 0, 0));
+      const __m128 s1 = _mm_shuffle_ps(sv, sv, _MM_SHUFFLE(3, 3, 1, 1));
+      __m128 b = _mm_loadu_ps(buf);
+      b = _mm_add_ps(b, _mm_mul_ps(s1, m1));
+      b = _mm_add_ps(b, _mm_mul_ps(s0, m0));
+      _mm_storeu_ps(buf, b);
+   }
+   mix_block_stereo_stereo(buf, s, n - k, m, maxc, dest_maxc);
+}
+
+
+_AL_SIMD_TARGET("sse2")
+static void mix_block_51_stereo_sse2(float *buf, const float *s,
+   unsigned int n, const float *m, size_t maxc, size_t dest_maxc)
+{
+   __m128 mv[6];
+   unsigned int k;
+   int i;
+
+   for (i = 0; i < 6; i++) {
+      mv[i] = _mm_setr_ps(m[i], m[6 + i], m[i], m[6 + i]);
+   }
+
+   for (k = 0; k + 2 <= n; k += 2, s += 12, buf += 4) {
+      __m128 b = _mm_loadu_ps(buf);
+      for (i = 5; i >= 0; i--) {
+         const __m128 si = _mm_setr_ps(s[i], s[i], s[6 + i], s[6 + i]);
+         b = _mm_add_ps(b, _mm_mul_ps(si, mv[i]));
+      }
+      _mm_storeu_ps(buf, b);
+   }
+   mix_block_51_stereo(buf, s, n - k, m, maxc, dest_maxc);
+}
+
+#endif
+
+
+static MIX_BLOCK get_mix_block(size_t maxc, size_t dest_maxc)
+{
+#ifdef _AL_SIMD_SSE2
+   const bool sse2 = (al_get_cpu_features() & ALLEGRO_CPU_SSE2) != 0;
+#else
+   const bool sse2 = false;
+#endif
+
+   if (dest_maxc != 2)
+      return mix_block_any;
+
+   switch (maxc) {
+#ifdef _AL_SIMD_SSE2
+      case 1:
+         return sse2 ? mix_block_mono_stereo_sse2 : mix_block_mono_stereo;
+      case 2:
+         return sse2 ? mix_block_stereo_stereo_sse2 : mix_block_stereo_stereo;
+      case 6:
+         return sse2 ? mix_block_51_stereo_sse2 : mix_block_51_stereo;
+#else
+      case 1:
+         return mix_block_mono_stereo;
+      case 2:
+         return mix_block_stereo_stereo;
+      case 6:
+         return mix_block_51_stereo;
+#endif
+      default:
+         (void)sse2;
+         return mix_block_any;
+   }
+}
+
+
+/* Returns how many frames starting from the current position can be mixed
+ * without any of them needing fix_looped_position, or reading past the end
+ * of the data.  MARGIN is the number of frames the resampler reads ahead of
+ * the position.
+ */
+static unsigned int block_frames(const ALLEGRO_SAMPLE_INSTANCE *spl,
+   int delta, int delta_error, int margin, size_t samples_l)
+{
+   const int limit = (spl->loop == ALLEGRO_PLAYMODE_LOOP)
+      ? spl->loop_end : spl->spl_data.len;
+   const int max_step = delta + (delta_error > 0 ? 1 : 0);
+   const int room = limit - margin - 1 - spl->pos;
+   size_t n;
+
+   if (room < 0)
+      return 0;
+
+   n = room / max_step + 1;
+   n = _ALLEGRO_MIN(n, samples_l);
+   return _ALLEGRO_MIN(n, MIXER_BLOCK);
+}
+
+
+/* NAME mixes like FALLBACK, using RESAMPLE_BLOCK and NEXT_SAMPLE_VALUE for
+ * the same interpolation.  MARGIN and LAG say which frames the interpolator
+ * reads relative to the position: [pos - LAG, pos + MARGIN].
+ */
+#define MAKE_BLOCK_MIXER(NAME, FALLBACK, RESAMPLE_BLOCK, NEXT_SAMPLE_VALUE,   \
+   MARGIN, LAG)                                                               \
+static void NAME(void *source, void **vbuf, unsigned int *samples,            \
+   ALLEGRO_AUDIO_DEPTH buffer_depth, size_t dest_maxc)                        \
+{                                                                             \
+   ALLEGRO_SAMPLE_INSTANCE *spl = (ALLEGRO_SAMPLE_INSTANCE *)source;          \
+   float *buf = *vbuf;                                                        \
+   size_t maxc = al_get_channel_count(spl->spl_data.chan_conf);               \
+   size_t samples_l = *samples;                                               \
+   int delta, delta_error;                                                    \
+   MIX_BLOCK mix_block;                                                       \
+   float frames[MIXER_BLOCK * ALLEGRO_MAX_CHANNELS];                          \
+   SAMP_BUF samp_buf;                                                         \
+                                                                              \
+   if (spl->step <= 0 || spl->loop == ALLEGRO_PLAYMODE_BIDIR ||               \
+         (spl->loop == ALLEGRO_PLAYMODE_LOOP &&                               \
+          spl->loop_end - spl->loop_start == 0)) {                            \
+      FALLBACK(source, vbuf, samples, buffer_depth, dest_maxc);               \
+      return;                                                                 \
+   }                                                                          \
+                                                                              \
+   if (!spl->is_playing)                                                      \
+      return;                                                                 \
+                                                                              \
+   BRESENHAM;                                                                 \
+   mix_block = get_mix_block(maxc, dest_maxc);                                \
+                                                                              \
+   while (samples_l > 0) {                                                    \
+      unsigned int n;                                                         \
+                                                                              \
+      if (!fix_looped_position(spl))                                          \
+         return;                                                              \
+                                                                              \
+      n = block_frames(spl, delta, delta_error, MARGIN, samples_l);           \
+      if (n == 0) {                                                           \
+         /* Close to the loop point, do a single frame. */                    \
+         const float *s = NEXT_SAMPLE_VALUE(&samp_buf, spl, maxc);            \
+         mix_block(buf, s, 1, spl->matrix, maxc, dest_maxc);                  \
+         spl->pos += delta;                                                   \
+         spl->pos_bresenham_error += delta_error;                             \
+         if (spl->pos_bresenham_error >= spl->step_denom) {                   \
+            spl->pos++;                                                       \
+            spl->pos_bresenham_error -= spl->step_denom;                      \
+         }                                                                    \
+         n = 1;                                                               \
+      }                                                                       \
+      else if (delta == 1 && delta_error == 0 &&                              \
+            spl->pos_bresenham_error == 0 &&                                  \
+            spl->spl_data.depth == ALLEGRO_AUDIO_DEPTH_FLOAT32) {             \
+         /* No resampling needed. */                                          \
+         const float *s = spl->spl_data.buffer.f32 + (spl->pos - LAG) * maxc; \
+         mix_block(buf, s, n, spl->matrix, maxc, dest_maxc);                  \
+         spl->pos += n;                                                       \
+      }                                                                       \
+      else {                                                                  \
+         RESAMPLE_BLOCK(frames, spl, maxc, n, delta, delta_error);            \
+         mix_block(buf, frames, n, spl->matrix, maxc, dest_maxc);             \
+      }                                                                       \
+      buf += n * dest_maxc;                                                   \
+      samples_l -= n;                                                         \
+   }                                                                          \
+   fix_looped_position(spl);                                                  \
+}
+
+#define STREAM_LAG(spl)                                                       \
+   ((spl)->loop == _ALLEGRO_PLAYMODE_STREAM_ONCE ||                           \
+    (spl)->loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR ? 1 : 0)
+
+MAKE_BLOCK_MIXER(read_to_mixer_point_block_float_32,
+   read_to_mixer_point_float_32, point_block32, point_spl32, 0, 0)
+MAKE_BLOCK_MIXER(read_to_mixer_linear_block_float_32,
+   read_to_mixer_linear_float_32, linear_block32, linear_spl32,
+   1 - STREAM_LAG(spl), STREAM_LAG(spl))
+
+#undef MAKE_BLOCK_MIXER
+#undef STREAM_LAG
+
+
 /* _al_kcm_mixer_read:
  *  Mixes the streams attached to the mixer and writes additively to the
  *  specified buffer (or if *buf is NULL, indicating a voice, convert it and
@@ -737,10 +1033,10 @@ bool al_attach_sample_instance_to_mixer(ALLEGRO_SAMPLE_INSTANCE *spl,
          case ALLEGRO_AUDIO_DEPTH_FLOAT32:
             switch (mixer->quality) {
                case ALLEGRO_MIXER_QUALITY_POINT:
-                  spl->spl_read = read_to_mixer_point_float_32;
+                  spl->spl_read = read_to_mixer_point_block_float_32;
                   break;
                case ALLEGRO_MIXER_QUALITY_LINEAR:
-                  spl->spl_read = read_to_mixer_linear_float_32;
+                  spl->spl_read = read_to_mixer_linear_block_float_32;
                   break;
                case ALLEGRO_MIXER_QUALITY_CUBIC:
                   spl->spl_read = read_to_mixer_cubic_float_32;
@@ -36,10 +36,35 @@ typedef struct AUTO_SAMPLE {
    ALLEGRO_SAMPLE_INSTANCE *instance;
    int id;
    bool locked;
+   bool active;               /* in active_slots rather than free_slots */
+   int priority;
+   ALLEGRO_SAMPLE *sample;
+   int prev, next;            /* indices into auto_samples, or -1 */
 } AUTO_SAMPLE;
 
+/* Doubly linked list of auto_samples entries. */
+typedef struct SLOT_LIST {
+   int head, tail;
+} SLOT_LIST;
+
 static _AL_VECTOR auto_samples = _AL_VECTOR_INITIALIZER(AUTO_SAMPLE);
 
+/* Slots known to be free, and slots started by al_play_sample from oldest to
+ * newest. Slots in the active list may have stopped playing by themselves
+ * since; they are returned to the free list by the next reap_slots.
+ */
+static SLOT_LIST free_slots = {-1, -1};
+static SLOT_LIST active_slots = {-1, -1};
+
+/* Counts sample instances which stopped at the end of their sample, raised by
+ * the mixer. The active list only needs to be reaped when it has changed.
+ */
+volatile _AL_ATOMIC _al_kcm_instances_stopped = 0;
+static _AL_ATOMIC reaped_stops = 0;
+
+static int next_id = 0;
+static ALLEGRO_SAMPLE_STEAL_POLICY steal_policy = ALLEGRO_SAMPLE_STEAL_NONE;
+
 
 static bool create_default_mixer(void);
 static bool do_play_sample(ALLEGRO_SAMPLE_INSTANCE *spl, ALLEGRO_SAMPLE *data,
@@ -47,6 +72,102 @@ static bool do_play_sample(ALLEGRO_SAMPLE_INSTANCE *spl, ALLEGRO_SAMPLE *data,
 static void free_sample_vector(void);
 
 
+static void slot_list_remove(SLOT_LIST *list, int index)
+{
+   AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, index);
+
+   if (slot->prev >= 0)
+      ((AUTO_SAMPLE *)_al_vector_ref(&auto_samples, slot->prev))->next = slot->next;
+   else
+      list->head = slot->next;
+
+   if (slot->next >= 0)
+      ((AUTO_SAMPLE *)_al_vector_ref(&auto_samples, slot->next))->prev = slot->prev;
+   else
+      list->tail = slot->prev;
+
+   slot->prev = slot->next = -1;
+}
+
+
+static void slot_list_append(SLOT_LIST *list, int index)
+{
+   AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, index);
+
+   slot->prev = list->tail;
+   slot->next = -1;
+   if (list->tail >= 0)
+      ((AUTO_SAMPLE *)_al_vector_ref(&auto_samples, list->tail))->next = index;
+   else
+      list->head = index;
+   list->tail = index;
+}
+
+
+/* Each sample counts the active slots playing it, for max_instances. */
+static void count_slot(AUTO_SAMPLE *slot, int delta)
+{
+   if (slot->active && slot->sample)
+      slot->sample->num_instances += delta;
+}
+
+
+/* Moves a slot to the end of the active or free list. */
+static void move_slot(int index, bool active)
+{
+   AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, index);
+
+   slot_list_remove(slot->active ? &active_slots : &free_slots, index);
+   count_slot(slot, -1);
+   slot->active = active;
+   count_slot(slot, 1);
+   slot_list_append(active ? &active_slots : &free_slots, index);
+}
+
+
+static void reset_slot_lists(void)
+{
+   int i;
+
+   free_slots.head = free_slots.tail = -1;
+   active_slots.head = active_slots.tail = -1;
+   for (i = 0; i < (int) _al_vector_size(&auto_samples); i++) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
+      count_slot(slot, -1);
+      slot->active = false;
+      slot_list_append(&free_slots, i);
+   }
+}
+
+
+static bool slot_in_use(AUTO_SAMPLE *slot)
+{
+   return slot->locked || al_get_sample_instance_playing(slot->instance);
+}
+
+
+/* Returns the slots which have stopped playing since the last call to the
+ * free list, if any sample instance has stopped by itself in the meantime.
+ */
+static void reap_slots(void)
+{
+   _AL_ATOMIC stops = _al_kcm_instances_stopped;
+   int i;
+
+   if (stops == reaped_stops)
+      return;
+   reaped_stops = stops;
+
+   for (i = active_slots.head; i >= 0; ) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
+      int next = slot->next;
+      if (!slot_in_use(slot))
+         move_slot(i, false);
+      i = next;
+   }
+}
+
+
 static int string_to_depth(const char *s)
 {
    // FIXME: fill in the rest
@@ -188,10 +309,21 @@ static void stop_sample_instances_helper(void *object, void (*func)(void *),
 void al_destroy_sample(ALLEGRO_SAMPLE *spl)
 {
    if (spl) {
+      int i;
+
       _al_kcm_foreach_destructor(stop_sample_instances_helper,
          al_get_sample_data(spl));
       _al_kcm_unregister_destructor(spl->dtor_item);
 
+      /* Forget the sample in the slots which played it. */
+      for (i = 0; i < (int) _al_vector_size(&auto_samples); i++) {
+         AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
+         if (slot->sample == spl) {
+            count_slot(slot, -1);
+            slot->sample = NULL;
+         }
+      }
+
       if (spl->free_buf && spl->buffer.ptr) {
          al_free(spl->buffer.ptr);
       }
@@ -227,6 +359,10 @@ bool al_reserve_samples(int reserve_samples)
          slot->id = 0;
          slot->instance = al_create_sample_instance(NULL);
          slot->locked = false;
+         slot->active = false;
+         slot->priority = 0;
+         slot->sample = NULL;
+         slot_list_append(&free_slots, _al_vector_size(&auto_samples) - 1);
          if (!slot->instance) {
             ALLEGRO_ERROR("al_create_sample failed\n");
             goto Error;
@@ -241,6 +377,9 @@ bool al_reserve_samples(int reserve_samples)
       /* We need to reserve fewer samples than currently are reserved. */
       while (current_samples_count-- > reserve_samples) {
          AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, current_samples_count);
+         slot_list_remove(slot->active ? &active_slots : &free_slots,
+            current_samples_count);
+         count_slot(slot, -1);
          al_destroy_sample_instance(slot->instance);
          _al_vector_delete_at(&auto_samples, current_samples_count);
       }
@@ -282,6 +421,8 @@ bool al_set_default_mixer(ALLEGRO_MIXER *mixer)
          slot->id = 0;
          al_destroy_sample_instance(slot->instance);
          slot->locked = false;
+         count_slot(slot, -1);
+         slot->sample = NULL;
 
          slot->instance = al_create_sample_instance(NULL);
          if (!slot->instance) {
@@ -292,7 +433,8 @@ bool al_set_default_mixer(ALLEGRO_MIXER *mixer)
             ALLEGRO_ERROR("al_attach_mixer_to_sample failed\n");
             goto Error;
          }
-      }      
+      }
+      reset_slot_lists();
    }
 
    return true;
@@ -337,14 +479,96 @@ void al_set_default_voice(ALLEGRO_VOICE *voice)
 }
 
 
+/* Returns the slot in use to take over for playing a sample with the given
+ * priority according to the steal policy, or -1. If spl is not NULL, only
+ * slots playing that sample are considered.
+ */
+static int find_slot_to_steal(ALLEGRO_SAMPLE *spl, int priority)
+{
+   int best = -1;
+   float best_value = 0;
+   int i;
+
+   if (steal_policy == ALLEGRO_SAMPLE_STEAL_NONE)
+      return -1;
+
+   /* The active list is ordered from oldest to newest, so ties go to the
+    * oldest slot.
+    */
+   for (i = active_slots.head; i >= 0; ) {
+      AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
+      int next = slot->next;
+      float value;
+
+      if (slot->locked || slot->priority > priority ||
+            (spl && slot->sample != spl)) {
+         i = next;
+         continue;
+      }
+
+      switch (steal_policy) {
+         case ALLEGRO_SAMPLE_STEAL_OLDEST:
+            return i;
+         case ALLEGRO_SAMPLE_STEAL_LOWEST_PRIORITY:
+            value = slot->priority;
+            break;
+         case ALLEGRO_SAMPLE_STEAL_QUIETEST:
+         default:
+            value = al_get_sample_instance_gain(slot->instance);
+            break;
+      }
+      if (best < 0 || value < best_value) {
+         best = i;
+         best_value = value;
+      }
+      i = next;
+   }
+
+   return best;
+}
+
+
+/* Returns the slot to play a sample with the given priority on, or -1. */
+static int acquire_slot(ALLEGRO_SAMPLE *spl, int priority)
+{
+   int i;
+
+   reap_slots();
+
+   if (spl->max_instances > 0 && spl->num_instances >= spl->max_instances)
+      return find_slot_to_steal(spl, priority);
+
+   /* Slots may have been locked or restarted through their id after
+    * al_stop_samples put them in the free list.
+    */
+   while (free_slots.head >= 0) {
+      i = free_slots.head;
+      if (!slot_in_use(_al_vector_ref(&auto_samples, i)))
+         return i;
+      move_slot(i, true);
+   }
+
+   return find_slot_to_steal(NULL, priority);
+}
+
+
 /* Function: al_play_sample
  */
 bool al_play_sample(ALLEGRO_SAMPLE *spl, float gain, float pan, float speed,
    ALLEGRO_PLAYMODE loop, ALLEGRO_SAMPLE_ID *ret_id)
 {
-   static int next_id = 0;
-   unsigned int i;
-   
+   return al_play_sample_with_priority(spl, gain, pan, speed, loop, 0, ret_id);
+}
+
+
+/* Function: al_play_sample_with_priority
+ */
+bool al_play_sample_with_priority(ALLEGRO_SAMPLE *spl, float gain, float pan,
+   float speed, ALLEGRO_PLAYMODE loop, int priority, ALLEGRO_SAMPLE_ID *ret_id)
+{
+   AUTO_SAMPLE *slot;
+   int i;
+
    ASSERT(spl);
 
    if (ret_id != NULL) {
@@ -352,23 +576,66 @@ bool al_play_sample(ALLEGRO_SAMPLE *spl, float gain, float pan, float speed,
       ret_id->_index = 0;
    }
 
-   for (i = 0; i < _al_vector_size(&auto_samples); i++) {
-      AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
+   i = acquire_slot(spl, priority);
+   if (i < 0)
+      return false;
 
-      if (!al_get_sample_instance_playing(slot->instance) && !slot->locked) {
-         if (!do_play_sample(slot->instance, spl, gain, pan, speed, loop))
-            break;
+   slot = _al_vector_ref(&auto_samples, i);
+   if (!do_play_sample(slot->instance, spl, gain, pan, speed, loop))
+      return false;
 
-         if (ret_id != NULL) {
-            ret_id->_index = (int) i;
-            ret_id->_id = slot->id = ++next_id;
-         }
+   /* Taken out of the active list first so the count of the sample a stolen
+    * slot played goes down.
+    */
+   move_slot(i, false);
+   slot->sample = spl;
+   move_slot(i, true);
+   slot->priority = priority;
+   slot->id = ++next_id;
 
-         return true;
-      }
+   if (ret_id != NULL) {
+      ret_id->_index = i;
+      ret_id->_id = slot->id;
    }
 
-   return false;
+   return true;
+}
+
+
+/* Function: al_set_sample_steal_policy
+ */
+void al_set_sample_steal_policy(ALLEGRO_SAMPLE_STEAL_POLICY policy)
+{
+   steal_policy = policy;
+}
+
+
+/* Function: al_get_sample_steal_policy
+ */
+ALLEGRO_SAMPLE_STEAL_POLICY al_get_sample_steal_policy(void)
+{
+   return steal_policy;
+}
+
+
+/* Function: al_set_sample_max_instances
+ */
+void al_set_sample_max_instances(ALLEGRO_SAMPLE *spl, int max_instances)
+{
+   ASSERT(spl);
+   ASSERT(max_instances >= 0);
+
+   spl->max_instances = max_instances;
+}
+
+
+/* Function: al_get_sample_max_instances
+ */
+int al_get_sample_max_instances(const ALLEGRO_SAMPLE *spl)
+{
+   ASSERT(spl);
+
+   return spl->max_instances;
 }
 
 
@@ -408,6 +675,8 @@ void al_stop_sample(ALLEGRO_SAMPLE_ID *spl_id)
    slot = _al_vector_ref(&auto_samples, spl_id->_index);
    if (slot->id == spl_id->_id) {
       al_stop_sample_instance(slot->instance);
+      if (slot->active && !slot->locked)
+         move_slot(spl_id->_index, false);
    }
 }
 
@@ -442,6 +711,8 @@ void al_unlock_sample_id(ALLEGRO_SAMPLE_ID *spl_id)
    slot = _al_vector_ref(&auto_samples, spl_id->_index);
    if (slot->id == spl_id->_id) {
       slot->locked = false;
+      if (slot->active && !slot_in_use(slot))
+         move_slot(spl_id->_index, false);
    }
 }
 
@@ -455,6 +726,8 @@ void al_stop_samples(void)
    for (i = 0; i < _al_vector_size(&auto_samples); i++) {
       AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, i);
       al_stop_sample_instance(slot->instance);
+      if (slot->active && !slot->locked)
+         move_slot(i, false);
    }
 }
 
@@ -516,9 +789,12 @@ static void free_sample_vector(void)
 
    for (j = 0; j < (int) _al_vector_size(&auto_samples); j++) {
       AUTO_SAMPLE *slot = _al_vector_ref(&auto_samples, j);
+      count_slot(slot, -1);
       al_destroy_sample_instance(slot->instance);
    }
    _al_vector_free(&auto_samples);
+   free_slots.head = free_slots.tail = -1;
+   active_slots.head = active_slots.tail = -1;
 }
 
 
@@ -9,6 +9,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "allegro5/allegro_audio.h"
 #include "allegro5/internal/aintern_audio.h"
@@ -146,7 +147,7 @@ ALLEGRO_AUDIO_STREAM *al_create_audio_stream(size_t fragment_count,
 void al_destroy_audio_stream(ALLEGRO_AUDIO_STREAM *stream)
 {
    if (stream) {
-      if (stream->feed_thread) {
+      if (stream->feed_thread || stream->feed_pooled) {
          stream->unload_feeder(stream);
       }
       /* See commented out call to _al_kcm_register_destructor. */
@@ -639,6 +640,9 @@ bool _al_kcm_refill_stream(ALLEGRO_AUDIO_STREAM *stream)
    stream->spl.spl_data.buffer.ptr = new_buf;
    if (!new_buf) {
       ALLEGRO_WARN("Out of buffers\n");
+      /* Only count running out, not every call while starved. */
+      if (old_buf && !stream->is_draining)
+         stream->underruns++;
       return false;
    }
 
@@ -663,6 +667,75 @@ bool _al_kcm_refill_stream(ALLEGRO_AUDIO_STREAM *stream)
 }
 
 
+/* Fills the next used fragment of a stream from its feeder and hands it back
+ * to the stream. Returns false if there was no fragment to fill. Sets
+ * *finished if the feeder ran out of data for a stream playing once.
+ */
+static bool feed_fragment(ALLEGRO_AUDIO_STREAM *stream, bool *finished)
+{
+   char *fragment;
+   unsigned long bytes;
+   unsigned long bytes_written;
+   ALLEGRO_MUTEX *stream_mutex;
+
+   *finished = false;
+
+   fragment = al_get_audio_stream_fragment(stream);
+   if (!fragment) {
+      /* This is not an error. */
+      return false;
+   }
+
+   bytes = (stream->spl.spl_data.len) *
+         al_get_channel_count(stream->spl.spl_data.chan_conf) *
+         al_get_audio_depth_size(stream->spl.spl_data.depth);
+
+   stream_mutex = maybe_lock_mutex(stream->spl.mutex);
+   bytes_written = stream->feeder(stream, fragment, bytes);
+   maybe_unlock_mutex(stream_mutex);
+
+   if (stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR) {
+      /* Keep rewinding until the fragment is filled. */
+      while (bytes_written < bytes &&
+               stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR) {
+         size_t bw;
+         al_rewind_audio_stream(stream);
+         stream_mutex = maybe_lock_mutex(stream->spl.mutex);
+         bw = stream->feeder(stream, fragment + bytes_written,
+            bytes - bytes_written);
+         bytes_written += bw;
+         maybe_unlock_mutex(stream_mutex);
+      }
+   }
+   else if (bytes_written < bytes) {
+      /* Fill the rest of the fragment with silence. */
+      int silence_samples = (bytes - bytes_written) /
+         (al_get_channel_count(stream->spl.spl_data.chan_conf) *
+          al_get_audio_depth_size(stream->spl.spl_data.depth));
+      al_fill_silence(fragment + bytes_written, silence_samples,
+                      stream->spl.spl_data.depth, stream->spl.spl_data.chan_conf);
+   }
+
+   if (!al_set_audio_stream_fragment(stream, fragment)) {
+      ALLEGRO_ERROR("Error setting stream buffer.\n");
+      return false;
+   }
+
+   *finished = (bytes_written != bytes &&
+      stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONCE);
+   return true;
+}
+
+
+static void emit_finished_event(ALLEGRO_AUDIO_STREAM *stream)
+{
+   ALLEGRO_EVENT fin_event;
+   fin_event.user.type = ALLEGRO_EVENT_AUDIO_STREAM_FINISHED;
+   fin_event.user.timestamp = al_get_time();
+   al_emit_user_event(&stream->spl.es, &fin_event, NULL);
+}
+
+
 /* _al_kcm_feed_stream:
  * A routine running in another thread that feeds the stream buffers as
  * necessary, usually getting data from some file reader backend.
@@ -687,70 +760,25 @@ void *_al_kcm_feed_stream(ALLEGRO_THREAD *self, void *vstream)
    stream->quit_feed_thread = false;
 
    while (!stream->quit_feed_thread) {
-      char *fragment;
       ALLEGRO_EVENT event;
 
       al_wait_for_event(queue, &event);
 
       if (event.type == ALLEGRO_EVENT_AUDIO_STREAM_FRAGMENT
           && !stream->is_draining) {
-         unsigned long bytes;
-         unsigned long bytes_written;
-         ALLEGRO_MUTEX *stream_mutex;
-
-         fragment = al_get_audio_stream_fragment(stream);
-         if (!fragment) {
-            /* This is not an error. */
-            continue;
-         }
-
-         bytes = (stream->spl.spl_data.len) *
-               al_get_channel_count(stream->spl.spl_data.chan_conf) *
-               al_get_audio_depth_size(stream->spl.spl_data.depth);
-
-         stream_mutex = maybe_lock_mutex(stream->spl.mutex);
-         bytes_written = stream->feeder(stream, fragment, bytes);
-         maybe_unlock_mutex(stream_mutex);
-
-         if (stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR) {
-            /* Keep rewinding until the fragment is filled. */
-            while (bytes_written < bytes &&
-                     stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR) {
-               size_t bw;
-               al_rewind_audio_stream(stream);
-               stream_mutex = maybe_lock_mutex(stream->spl.mutex);
-               bw = stream->feeder(stream, fragment + bytes_written,
-                  bytes - bytes_written);
-               bytes_written += bw;
-               maybe_unlock_mutex(stream_mutex);
-            }
-         }
-         else if (bytes_written < bytes) {
-            /* Fill the rest of the fragment with silence. */
-            int silence_samples = (bytes - bytes_written) /
-               (al_get_channel_count(stream->spl.spl_data.chan_conf) *
-                al_get_audio_depth_size(stream->spl.spl_data.depth));
-            al_fill_silence(fragment + bytes_written, silence_samples,
-                            stream->spl.spl_data.depth, stream->spl.spl_data.chan_conf);
-         }
+         bool finished;
 
-         if (!al_set_audio_stream_fragment(stream, fragment)) {
-            ALLEGRO_ERROR("Error setting stream buffer.\n");
+         if (!feed_fragment(stream, &finished))
             continue;
-         }
 
          /* The streaming source doesn't feed any more, so drain buffers.
           * Don't quit in case the user decides to seek and then restart the
           * stream. */
-         if (bytes_written != bytes &&
-            stream->spl.loop == _ALLEGRO_PLAYMODE_STREAM_ONCE) {
+         if (finished) {
             al_drain_audio_stream(stream);
 
             if (!finished_event_sent) {
-               ALLEGRO_EVENT fin_event;
-               fin_event.user.type = ALLEGRO_EVENT_AUDIO_STREAM_FINISHED;
-               fin_event.user.timestamp = al_get_time();
-               al_emit_user_event(&stream->spl.es, &fin_event, NULL);
+               emit_finished_event(stream);
                finished_event_sent = true;
             }
          } else {
@@ -758,12 +786,8 @@ void *_al_kcm_feed_stream(ALLEGRO_THREAD *self, void *vstream)
          }
       }
       else if (event.type == _KCM_STREAM_FEEDER_QUIT_EVENT_TYPE) {
-         ALLEGRO_EVENT fin_event;
          stream->quit_feed_thread = true;
-
-         fin_event.user.type = ALLEGRO_EVENT_AUDIO_STREAM_FINISHED;
-         fin_event.user.timestamp = al_get_time();
-         al_emit_user_event(&stream->spl.es, &fin_event, NULL);
+         emit_finished_event(stream);
       }
    }
 
@@ -775,6 +799,312 @@ void *_al_kcm_feed_stream(ALLEGRO_THREAD *self, void *vstream)
 }
 
 
+/* The shared feeder pool.
+ *
+ * If stream_feeder_threads in the [audio] section of allegro5.cfg is set,
+ * streams loaded with al_load_audio_stream are fed by that many threads
+ * shared between all streams, instead of by one thread each. Rather than
+ * going through event queues, the mixer marks a pooled stream as requesting
+ * data when it has fragments to refill, and each pool thread repeatedly
+ * fills one fragment of the requesting stream with the fewest fragments
+ * queued for playback.
+ *
+ * Lock order is stream (mixer) mutex, then pool mutex. The pool threads
+ * never hold the pool mutex while feeding a stream.
+ */
+#define MAX_FEED_POOL_THREADS 64
+
+typedef struct FEED_POOL {
+   ALLEGRO_MUTEX *mutex;
+   ALLEGRO_COND *cond;
+   ALLEGRO_THREAD **threads;
+   int num_threads;           /* -1 if not started yet */
+   _AL_VECTOR streams;        /* ALLEGRO_AUDIO_STREAM * */
+   int num_draining;
+   bool quit;
+} FEED_POOL;
+
+static FEED_POOL feed_pool;
+
+
+/* Called with the pool mutex held. */
+static ALLEGRO_AUDIO_STREAM *most_urgent_stream(void)
+{
+   ALLEGRO_AUDIO_STREAM *best = NULL;
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&feed_pool.streams); i++) {
+      ALLEGRO_AUDIO_STREAM **slot = _al_vector_ref(&feed_pool.streams, i);
+      ALLEGRO_AUDIO_STREAM *stream = *slot;
+
+      if (!stream->feed_requested || stream->feed_busy ||
+            stream->feed_draining || stream->is_draining)
+         continue;
+      if (!best || stream->feed_queued < best->feed_queued)
+         best = stream;
+   }
+
+   return best;
+}
+
+
+/* Called with the pool mutex held. Draining streams stop requesting data
+ * until they have finished playing, which the mixer doesn't tell us about,
+ * so they are polled.
+ */
+static void update_draining_streams(void)
+{
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&feed_pool.streams); i++) {
+      ALLEGRO_AUDIO_STREAM **slot = _al_vector_ref(&feed_pool.streams, i);
+      ALLEGRO_AUDIO_STREAM *stream = *slot;
+
+      if (stream->feed_draining && !stream->spl.is_playing) {
+         stream->feed_draining = false;
+         stream->feed_requested = false;
+         stream->is_draining = false;
+         feed_pool.num_draining--;
+         if (!stream->feed_finished_event_sent) {
+            emit_finished_event(stream);
+            stream->feed_finished_event_sent = true;
+         }
+      }
+   }
+}
+
+
+static void *feed_pool_thread(ALLEGRO_THREAD *self, void *arg)
+{
+   (void)self;
+   (void)arg;
+
+   al_lock_mutex(feed_pool.mutex);
+   while (!feed_pool.quit) {
+      ALLEGRO_AUDIO_STREAM *stream;
+      bool filled, finished;
+      unsigned int available;
+
+      if (feed_pool.num_draining > 0)
+         update_draining_streams();
+
+      stream = most_urgent_stream();
+      if (!stream) {
+         if (feed_pool.num_draining > 0) {
+            ALLEGRO_TIMEOUT timeout;
+            al_init_timeout(&timeout, 0.01);
+            al_wait_cond_until(feed_pool.cond, feed_pool.mutex, &timeout);
+         }
+         else {
+            al_wait_cond(feed_pool.cond, feed_pool.mutex);
+         }
+         continue;
+      }
+
+      stream->feed_requested = false;
+      stream->feed_busy = true;
+      al_unlock_mutex(feed_pool.mutex);
+
+      filled = feed_fragment(stream, &finished);
+      if (filled && finished) {
+         /* Same as al_drain_audio_stream, except that the finished event of
+          * an attached stream is only sent once it has stopped playing, by
+          * update_draining_streams.
+          */
+         if (al_get_audio_stream_attached(stream)) {
+            stream->is_draining = true;
+         }
+         else {
+            al_set_audio_stream_playing(stream, false);
+            if (!stream->feed_finished_event_sent) {
+               emit_finished_event(stream);
+               stream->feed_finished_event_sent = true;
+            }
+         }
+      }
+      else if (filled) {
+         stream->feed_finished_event_sent = false;
+      }
+      available = al_get_available_audio_stream_fragments(stream);
+
+      al_lock_mutex(feed_pool.mutex);
+      stream->feed_busy = false;
+      stream->feed_queued = stream->buf_count - available;
+      if (filled && finished) {
+         if (stream->is_draining) {
+            stream->feed_draining = true;
+            feed_pool.num_draining++;
+         }
+      }
+      else if (filled && available > 0) {
+         stream->feed_requested = true;
+      }
+      al_broadcast_cond(feed_pool.cond);
+   }
+   al_unlock_mutex(feed_pool.mutex);
+
+   return NULL;
+}
+
+
+/* Called with the pool mutex held. */
+static void start_feed_pool_threads(int threads)
+{
+   int i;
+
+   feed_pool.num_threads = 0;
+   feed_pool.threads = al_calloc(threads, sizeof(*feed_pool.threads));
+   if (!feed_pool.threads)
+      return;
+
+   for (i = 0; i < threads; i++) {
+      ALLEGRO_THREAD *thread = al_create_thread(feed_pool_thread, NULL);
+      if (!thread)
+         break;
+      feed_pool.threads[feed_pool.num_threads++] = thread;
+      al_start_thread(thread);
+   }
+
+   ALLEGRO_INFO("Started %d stream feeder threads.\n", feed_pool.num_threads);
+}
+
+
+void _al_kcm_init_feed_pool(void)
+{
+   if (feed_pool.mutex)
+      return;
+
+   feed_pool.mutex = al_create_mutex();
+   feed_pool.cond = al_create_cond();
+   feed_pool.threads = NULL;
+   feed_pool.num_threads = -1;
+   feed_pool.num_draining = 0;
+   feed_pool.quit = false;
+   _al_vector_init(&feed_pool.streams, sizeof(ALLEGRO_AUDIO_STREAM *));
+}
+
+
+void _al_kcm_shutdown_feed_pool(void)
+{
+   int i;
+
+   if (!feed_pool.mutex)
+      return;
+
+   al_lock_mutex(feed_pool.mutex);
+   feed_pool.quit = true;
+   al_broadcast_cond(feed_pool.cond);
+   al_unlock_mutex(feed_pool.mutex);
+
+   for (i = 0; i < feed_pool.num_threads; i++) {
+      al_join_thread(feed_pool.threads[i], NULL);
+      al_destroy_thread(feed_pool.threads[i]);
+   }
+   al_free(feed_pool.threads);
+   feed_pool.threads = NULL;
+   feed_pool.num_threads = -1;
+
+   /* Streams still in the pool are no longer fed; they are only taken out
+    * of it when they are destroyed. They must not touch the pool mutex any
+    * more, which is why this runs after the voices have been stopped.
+    */
+   for (i = 0; i < (int)_al_vector_size(&feed_pool.streams); i++) {
+      ALLEGRO_AUDIO_STREAM **slot = _al_vector_ref(&feed_pool.streams, i);
+      (*slot)->feed_notify = 0;
+   }
+   _al_vector_free(&feed_pool.streams);
+   al_destroy_cond(feed_pool.cond);
+   al_destroy_mutex(feed_pool.mutex);
+   feed_pool.cond = NULL;
+   feed_pool.mutex = NULL;
+}
+
+
+/* _al_kcm_add_to_feed_pool:
+ *  Makes the shared feeder pool feed the stream, starting the pool threads
+ *  if necessary. Returns false if the pool is disabled, in which case the
+ *  stream needs a thread running _al_kcm_feed_stream.
+ */
+bool _al_kcm_add_to_feed_pool(ALLEGRO_AUDIO_STREAM *stream)
+{
+   ALLEGRO_AUDIO_STREAM **slot;
+   ASSERT(stream);
+   ASSERT(stream->feeder);
+
+   if (!feed_pool.mutex)
+      return false;
+
+   al_lock_mutex(feed_pool.mutex);
+
+   if (feed_pool.num_threads < 0) {
+      const char *value = al_get_config_value(al_get_system_config(),
+         "audio", "stream_feeder_threads");
+      int threads = value ? atoi(value) : 0;
+      if (threads > MAX_FEED_POOL_THREADS)
+         threads = MAX_FEED_POOL_THREADS;
+      if (threads > 0) {
+         start_feed_pool_threads(threads);
+      }
+      else {
+         feed_pool.num_threads = 0;
+      }
+   }
+
+   if (feed_pool.num_threads == 0) {
+      al_unlock_mutex(feed_pool.mutex);
+      return false;
+   }
+
+   slot = _al_vector_alloc_back(&feed_pool.streams);
+   *slot = stream;
+   stream->feed_pooled = true;
+   stream->feed_notify = 1;
+   stream->feed_busy = false;
+   stream->feed_draining = false;
+   stream->feed_finished_event_sent = false;
+   stream->feed_queued = stream->buf_count -
+      al_get_available_audio_stream_fragments(stream);
+   stream->feed_requested = (stream->feed_queued < stream->buf_count);
+   al_broadcast_cond(feed_pool.cond);
+
+   al_unlock_mutex(feed_pool.mutex);
+
+   return true;
+}
+
+
+/* _al_kcm_remove_from_feed_pool:
+ *  Stops feeding the stream, waiting for a fragment being filled to finish.
+ *  Like the quit event of a feeder thread, this emits
+ *  ALLEGRO_EVENT_AUDIO_STREAM_FINISHED.
+ */
+void _al_kcm_remove_from_feed_pool(ALLEGRO_AUDIO_STREAM *stream)
+{
+   ASSERT(stream);
+
+   if (!stream->feed_pooled)
+      return;
+
+   if (feed_pool.mutex) {
+      al_lock_mutex(feed_pool.mutex);
+      while (stream->feed_busy) {
+         al_wait_cond(feed_pool.cond, feed_pool.mutex);
+      }
+      if (stream->feed_draining)
+         feed_pool.num_draining--;
+      _al_vector_find_and_delete(&feed_pool.streams, &stream);
+      stream->feed_notify = 0;
+      al_unlock_mutex(feed_pool.mutex);
+   }
+
+   stream->feed_pooled = false;
+   stream->feed_requested = false;
+   stream->feed_draining = false;
+
+   emit_finished_event(stream);
+}
+
+
 void _al_kcm_emit_stream_events(ALLEGRO_AUDIO_STREAM *stream)
 {
    /* Emit one event for each stream fragment available right now.
@@ -790,6 +1120,22 @@ void _al_kcm_emit_stream_events(ALLEGRO_AUDIO_STREAM *stream)
     */
    int count = al_get_available_audio_stream_fragments(stream);
 
+   /* Pooled streams are fed without going through events. The flag is
+    * checked again with the lock held, as the stream may have left the
+    * pool in the meantime.
+    */
+   if (stream->feed_notify) {
+      al_lock_mutex(feed_pool.mutex);
+      if (stream->feed_notify) {
+         stream->feed_queued = stream->buf_count - count;
+         if (count > 0 && !stream->feed_requested) {
+            stream->feed_requested = true;
+            al_broadcast_cond(feed_pool.cond);
+         }
+      }
+      al_unlock_mutex(feed_pool.mutex);
+   }
+
    while (count--) {
       ALLEGRO_EVENT event;
       event.user.type = ALLEGRO_EVENT_AUDIO_STREAM_FRAGMENT;
@@ -896,6 +1242,16 @@ ALLEGRO_EVENT_SOURCE *al_get_audio_stream_event_source(
    return &stream->spl.es;
 }
 
+
+/* Function: al_get_audio_stream_underruns
+ */
+unsigned int al_get_audio_stream_underruns(const ALLEGRO_AUDIO_STREAM *stream)
+{
+   ASSERT(stream);
+
+   return stream->underruns;
+}
+
 bool al_set_audio_stream_channel_matrix(ALLEGRO_AUDIO_STREAM *stream, const float *matrix)
 {
    ASSERT(stream);
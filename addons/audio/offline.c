@@ -0,0 +1,571 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Offline sound driver.
+ *
+ *      Renders voices without a sound device, as fast as possible or at a
+ *      fixed multiple of real time, and writes the result to a WAV file
+ *      and/or passes it to a user callback.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_audio.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_audio.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+ALLEGRO_DEBUG_CHANNEL("offline")
+
+enum OFFLINE_VOICE_STATUS {
+   OV_IDLE,
+   OV_PLAYING,
+   OV_JOIN
+};
+
+typedef struct OFFLINE_VOICE
+{
+   unsigned int buffer_size_in_frames;
+   unsigned int frame_size_in_bytes;
+   double speed;
+
+   ALLEGRO_THREAD *poll_thread;
+   /* status_cond and status are protected by voice->mutex, like in the
+    * PulseAudio driver.
+    */
+   ALLEGRO_COND *status_cond;
+   enum OFFLINE_VOICE_STATUS status;
+
+   void (*callback)(ALLEGRO_VOICE *voice, const void *buf,
+      unsigned int samples, void *data);
+   void *callback_data;
+
+   /* Only used by the poll thread. */
+   void *buffer;
+   double start_time;
+   uint64_t frames_since_start;
+
+   /* The WAV file, if this voice writes one. */
+   ALLEGRO_FILE *file;
+   int bits;
+   uint32_t data_size;
+   bool file_full;
+} OFFLINE_VOICE;
+
+#define DEFAULT_BUFFER_SIZE   1024
+#define MIN_BUFFER_SIZE       128
+
+/* The RIFF chunk size, 36 + data_size, has to fit into 32 bits. */
+#define MAX_WAV_DATA_SIZE     (0xFFFFFFFFu - 36)
+
+static void (*offline_callback)(ALLEGRO_VOICE *voice, const void *buf,
+   unsigned int samples, void *data) = NULL;
+static void *offline_callback_data = NULL;
+
+/* Only one voice at a time writes to the file. */
+static ALLEGRO_VOICE *file_voice = NULL;
+
+
+static unsigned int get_buffer_size(const ALLEGRO_CONFIG *config)
+{
+   if (config) {
+      const char *val = al_get_config_value(config,
+         "offline", "buffer_size");
+      if (val && val[0] != '\0') {
+         int n = atoi(val);
+         if (n < MIN_BUFFER_SIZE)
+            n = MIN_BUFFER_SIZE;
+         return n;
+      }
+   }
+
+   return DEFAULT_BUFFER_SIZE;
+}
+
+
+static double get_speed(const ALLEGRO_CONFIG *config)
+{
+   if (config) {
+      const char *val = al_get_config_value(config, "offline", "speed");
+      if (val && val[0] != '\0') {
+         double speed = atof(val);
+         if (speed > 0)
+            return speed;
+      }
+   }
+
+   return 0;
+}
+
+
+static const char *get_file_name(const ALLEGRO_CONFIG *config)
+{
+   if (config) {
+      const char *val = al_get_config_value(config, "offline", "file");
+      if (val && val[0] != '\0')
+         return val;
+   }
+
+   return NULL;
+}
+
+
+static int offline_open(void)
+{
+   return 0;
+}
+
+
+static void offline_close(void)
+{
+}
+
+
+/* The file is written in the same format as al_save_sample uses for WAV
+ * files, i.e. 8 bit for 8 bit voices and 16 bit PCM otherwise. The sizes in
+ * the header are filled in when the voice is destroyed.
+ */
+static void write_wav_header(ALLEGRO_FILE *f, ALLEGRO_VOICE *voice, int bits,
+   uint32_t data_size)
+{
+   const int channels = al_get_channel_count(voice->chan_conf);
+
+   al_fputs(f, "RIFF");
+   al_fwrite32le(f, 36 + data_size);
+   al_fputs(f, "WAVE");
+
+   al_fputs(f, "fmt ");
+   al_fwrite32le(f, 16);
+   al_fwrite16le(f, 1);
+   al_fwrite16le(f, (int16_t)channels);
+   al_fwrite32le(f, voice->frequency);
+   al_fwrite32le(f, voice->frequency * channels * bits / 8);
+   al_fwrite16le(f, (int16_t)(channels * bits / 8));
+   al_fwrite16le(f, (int16_t)bits);
+
+   al_fputs(f, "data");
+   al_fwrite32le(f, data_size);
+}
+
+
+static void write_wav_data(OFFLINE_VOICE *ov, ALLEGRO_VOICE *voice,
+   const void *data, unsigned int frames)
+{
+   ALLEGRO_FILE *f = ov->file;
+   const int channels = al_get_channel_count(voice->chan_conf);
+   const uint32_t room = (MAX_WAV_DATA_SIZE - ov->data_size) /
+      (channels * ov->bits / 8);
+   size_t n;
+   size_t i;
+
+   if (frames > room) {
+      ALLEGRO_ERROR("The WAV file has reached the 4 GiB limit of the format, "
+         "no longer writing to it.\n");
+      frames = room;
+      ov->file_full = true;
+   }
+   n = frames * channels;
+
+   switch (voice->depth) {
+      case ALLEGRO_AUDIO_DEPTH_UINT8:
+         al_fwrite(f, data, n);
+         break;
+
+      case ALLEGRO_AUDIO_DEPTH_INT8: {
+         const int8_t *p = data;
+         for (i = 0; i < n; i++) {
+            al_fputc(f, *p++ + 0x80);
+         }
+         break;
+      }
+
+      case ALLEGRO_AUDIO_DEPTH_INT16: {
+#ifdef ALLEGRO_LITTLE_ENDIAN
+         al_fwrite(f, data, n * 2);
+#else
+         const int16_t *p = data;
+         for (i = 0; i < n; i++) {
+            al_fwrite16le(f, *p++);
+         }
+#endif
+         break;
+      }
+
+      case ALLEGRO_AUDIO_DEPTH_UINT16: {
+         const uint16_t *p = data;
+         for (i = 0; i < n; i++) {
+            al_fwrite16le(f, *p++ - 0x8000);
+         }
+         break;
+      }
+
+      case ALLEGRO_AUDIO_DEPTH_INT24: {
+         const int32_t *p = data;
+         for (i = 0; i < n; i++) {
+            al_fwrite16le(f, *p++ >> 8);
+         }
+         break;
+      }
+
+      case ALLEGRO_AUDIO_DEPTH_UINT24: {
+         const uint32_t *p = data;
+         for (i = 0; i < n; i++) {
+            al_fwrite16le(f, ((int32_t)*p++ - 0x800000) >> 8);
+         }
+         break;
+      }
+
+      case ALLEGRO_AUDIO_DEPTH_FLOAT32: {
+         const float *p = data;
+         for (i = 0; i < n; i++) {
+            const float s = _ALLEGRO_CLAMP(-1.0f, *p++, 1.0f);
+            al_fwrite16le(f, (int16_t)(s * 0x7FFF));
+         }
+         break;
+      }
+   }
+
+   ov->data_size += n * ov->bits / 8;
+}
+
+
+/* Hands a chunk of rendered audio to the callback and the file, then waits
+ * if rendering faster than the configured speed.
+ */
+static void output(ALLEGRO_VOICE *voice, OFFLINE_VOICE *ov, const void *data,
+   unsigned int frames)
+{
+   if (ov->callback)
+      ov->callback(voice, data, frames, ov->callback_data);
+
+   if (ov->file && !ov->file_full)
+      write_wav_data(ov, voice, data, frames);
+
+   ov->frames_since_start += frames;
+   if (ov->speed > 0) {
+      double due = ov->start_time +
+         ov->frames_since_start / (voice->frequency * ov->speed);
+      double now = al_get_time();
+      if (due > now)
+         al_rest(due - now);
+   }
+}
+
+
+/* Copies the next frames of a non-streaming voice into ov->buffer. Called
+ * with voice->mutex held. Returns the number of frames copied.
+ */
+static unsigned int read_direct(ALLEGRO_VOICE *voice, OFFLINE_VOICE *ov)
+{
+   ALLEGRO_SAMPLE_INSTANCE *spl = voice->attached_stream;
+   const char *src = spl->spl_data.buffer.ptr;
+   char *dst = ov->buffer;
+   unsigned int frames = 0;
+
+   while (frames < ov->buffer_size_in_frames) {
+      int end = (spl->loop == ALLEGRO_PLAYMODE_LOOP)
+         ? spl->loop_end : spl->spl_data.len;
+      int n = _ALLEGRO_MIN(end - spl->pos,
+         (int)(ov->buffer_size_in_frames - frames));
+
+      if (n > 0) {
+         memcpy(dst, src + spl->pos * ov->frame_size_in_bytes,
+            n * ov->frame_size_in_bytes);
+         dst += n * ov->frame_size_in_bytes;
+         frames += n;
+         spl->pos += n;
+      }
+
+      if (spl->pos >= end) {
+         if (spl->loop == ALLEGRO_PLAYMODE_LOOP && spl->loop_end > spl->loop_start) {
+            spl->pos = spl->loop_start;
+         }
+         else {
+            spl->pos = 0;
+            ov->status = OV_IDLE;
+            al_broadcast_cond(ov->status_cond);
+            break;
+         }
+      }
+   }
+
+   return frames;
+}
+
+
+static void *offline_update(ALLEGRO_THREAD *self, void *data)
+{
+   ALLEGRO_VOICE *voice = data;
+   OFFLINE_VOICE *ov = voice->extra;
+   (void)self;
+
+   for (;;) {
+      enum OFFLINE_VOICE_STATUS status;
+      bool restart = false;
+
+      al_lock_mutex(voice->mutex);
+      while ((status = ov->status) == OV_IDLE) {
+         al_wait_cond(ov->status_cond, voice->mutex);
+         restart = true;
+      }
+      al_unlock_mutex(voice->mutex);
+
+      if (status == OV_JOIN) {
+         break;
+      }
+
+      /* Pacing starts over whenever the voice is (re)started. */
+      if (restart || ov->frames_since_start == 0) {
+         ov->start_time = al_get_time();
+         ov->frames_since_start = 0;
+      }
+
+      if (voice->is_streaming) {
+         unsigned int frames = ov->buffer_size_in_frames;
+         const void *buf = _al_voice_update(voice, voice->mutex, &frames);
+         if (!buf) {
+            al_fill_silence(ov->buffer, frames, voice->depth,
+               voice->chan_conf);
+            buf = ov->buffer;
+         }
+         output(voice, ov, buf, frames);
+      }
+      else {
+         unsigned int frames;
+
+         al_lock_mutex(voice->mutex);
+         frames = read_direct(voice, ov);
+         al_unlock_mutex(voice->mutex);
+
+         if (frames > 0)
+            output(voice, ov, ov->buffer, frames);
+      }
+   }
+
+   return NULL;
+}
+
+
+static bool open_file(ALLEGRO_VOICE *voice, OFFLINE_VOICE *ov,
+   const char *filename)
+{
+   ov->file = al_fopen(filename, "wb");
+   if (!ov->file) {
+      ALLEGRO_ERROR("Failed to open %s.\n", filename);
+      return false;
+   }
+
+   ov->bits = (voice->depth == ALLEGRO_AUDIO_DEPTH_INT8 ||
+      voice->depth == ALLEGRO_AUDIO_DEPTH_UINT8) ? 8 : 16;
+   ov->data_size = 0;
+   ov->file_full = false;
+   write_wav_header(ov->file, voice, ov->bits, 0);
+
+   ALLEGRO_INFO("Writing voice to %s.\n", filename);
+   return true;
+}
+
+
+static void close_file(ALLEGRO_VOICE *voice, OFFLINE_VOICE *ov)
+{
+   if (al_fseek(ov->file, 0, ALLEGRO_SEEK_SET)) {
+      write_wav_header(ov->file, voice, ov->bits, ov->data_size);
+   }
+   else {
+      ALLEGRO_WARN("Could not write the final WAV header.\n");
+   }
+   al_fclose(ov->file);
+   ov->file = NULL;
+}
+
+
+static int offline_allocate_voice(ALLEGRO_VOICE *voice)
+{
+   const ALLEGRO_CONFIG *config = al_get_system_config();
+   const char *filename = get_file_name(config);
+   OFFLINE_VOICE *ov = al_calloc(1, sizeof(OFFLINE_VOICE));
+
+   if (!ov)
+      return 1;
+
+   ov->buffer_size_in_frames = get_buffer_size(config);
+   ov->frame_size_in_bytes = al_get_channel_count(voice->chan_conf) *
+      al_get_audio_depth_size(voice->depth);
+   ov->speed = get_speed(config);
+   ov->buffer = al_malloc(ov->buffer_size_in_frames * ov->frame_size_in_bytes);
+   if (!ov->buffer) {
+      al_free(ov);
+      return 1;
+   }
+
+   ov->callback = offline_callback;
+   ov->callback_data = offline_callback_data;
+
+   if (filename) {
+      if (!file_voice) {
+         if (open_file(voice, ov, filename))
+            file_voice = voice;
+      }
+      else {
+         ALLEGRO_WARN("Only the first voice is written to %s.\n", filename);
+      }
+   }
+
+   voice->extra = ov;
+
+   ov->status = OV_IDLE;
+   ov->status_cond = al_create_cond();
+
+   ov->poll_thread = al_create_thread(offline_update, (void*)voice);
+   al_start_thread(ov->poll_thread);
+
+   return 0;
+}
+
+
+static void offline_deallocate_voice(ALLEGRO_VOICE *voice)
+{
+   OFFLINE_VOICE *ov = voice->extra;
+
+   al_lock_mutex(voice->mutex);
+   ov->status = OV_JOIN;
+   al_broadcast_cond(ov->status_cond);
+   al_unlock_mutex(voice->mutex);
+
+   /* We do NOT hold the voice mutex here, so this does NOT result in a
+    * deadlock when the thread calls _al_voice_update.
+    */
+   al_join_thread(ov->poll_thread, NULL);
+   al_destroy_thread(ov->poll_thread);
+   al_destroy_cond(ov->status_cond);
+
+   if (ov->file) {
+      close_file(voice, ov);
+      file_voice = NULL;
+   }
+
+   al_free(ov->buffer);
+   al_free(ov);
+   voice->extra = NULL;
+}
+
+
+static int offline_load_voice(ALLEGRO_VOICE *voice, const void *data)
+{
+   (void)data;
+
+   if (voice->attached_stream->loop == ALLEGRO_PLAYMODE_BIDIR) {
+      ALLEGRO_INFO("Backwards playing not supported by the driver.\n");
+      return 1;
+   }
+
+   voice->attached_stream->pos = 0;
+   return 0;
+}
+
+
+static void offline_unload_voice(ALLEGRO_VOICE *voice)
+{
+   (void) voice;
+}
+
+
+static int offline_start_voice(ALLEGRO_VOICE *voice)
+{
+   OFFLINE_VOICE *ov = voice->extra;
+
+   /* We hold the voice->mutex already. */
+
+   if (ov->status == OV_IDLE) {
+      ov->status = OV_PLAYING;
+      al_broadcast_cond(ov->status_cond);
+      return 0;
+   }
+
+   return 1;
+}
+
+
+static int offline_stop_voice(ALLEGRO_VOICE *voice)
+{
+   OFFLINE_VOICE *ov = voice->extra;
+
+   /* We hold the voice->mutex already, and the poll thread only changes the
+    * status while holding it too.
+    */
+
+   if (ov->status == OV_PLAYING) {
+      ov->status = OV_IDLE;
+      al_broadcast_cond(ov->status_cond);
+   }
+
+   return 0;
+}
+
+
+static bool offline_voice_is_playing(const ALLEGRO_VOICE *voice)
+{
+   OFFLINE_VOICE *ov = voice->extra;
+   return (ov->status == OV_PLAYING);
+}
+
+
+static unsigned int offline_get_voice_position(const ALLEGRO_VOICE *voice)
+{
+   return voice->attached_stream->pos;
+}
+
+
+static int offline_set_voice_position(ALLEGRO_VOICE *voice, unsigned int pos)
+{
+   voice->attached_stream->pos = pos;
+   return 0;
+}
+
+
+ALLEGRO_AUDIO_DRIVER _al_kcm_offline_driver =
+{
+   "Offline",
+
+   offline_open,
+   offline_close,
+
+   offline_allocate_voice,
+   offline_deallocate_voice,
+
+   offline_load_voice,
+   offline_unload_voice,
+
+   offline_start_voice,
+   offline_stop_voice,
+
+   offline_voice_is_playing,
+
+   offline_get_voice_position,
+   offline_set_voice_position,
+
+   NULL,
+   NULL
+};
+
+
+/* Function: al_set_offline_audio_callback
+ */
+void al_set_offline_audio_callback(void (*callback)(ALLEGRO_VOICE *voice,
+   const void *buf, unsigned int samples, void *data), void *data)
+{
+   offline_callback = callback;
+   offline_callback_data = data;
+}
+
+/* vim: set sts=3 sw=3 et: */
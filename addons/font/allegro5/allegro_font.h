@@ -138,6 +138,23 @@ ALLEGRO_FONT_FUNC(void, al_set_fallback_font, (ALLEGRO_FONT *font,
 ALLEGRO_FONT_FUNC(ALLEGRO_FONT *, al_get_fallback_font, (
    ALLEGRO_FONT *font));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_FONT_SRC)
+/* Type: ALLEGRO_PREPARED_TEXT
+*/
+typedef struct ALLEGRO_PREPARED_TEXT ALLEGRO_PREPARED_TEXT;
+
+ALLEGRO_FONT_FUNC(ALLEGRO_PREPARED_TEXT *, al_prepare_text, (const ALLEGRO_FONT *font, int flags, char const *text));
+ALLEGRO_FONT_FUNC(ALLEGRO_PREPARED_TEXT *, al_prepare_ustr, (const ALLEGRO_FONT *font, int flags, ALLEGRO_USTR const *ustr));
+ALLEGRO_FONT_FUNC(ALLEGRO_PREPARED_TEXT *, al_prepare_justified_text, (const ALLEGRO_FONT *font, float width, float diff, int flags, char const *text));
+ALLEGRO_FONT_FUNC(ALLEGRO_PREPARED_TEXT *, al_prepare_justified_ustr, (const ALLEGRO_FONT *font, float width, float diff, int flags, ALLEGRO_USTR const *ustr));
+ALLEGRO_FONT_FUNC(ALLEGRO_PREPARED_TEXT *, al_prepare_multiline_text, (const ALLEGRO_FONT *font, float max_width, float line_height, int flags, char const *text));
+ALLEGRO_FONT_FUNC(ALLEGRO_PREPARED_TEXT *, al_prepare_multiline_ustr, (const ALLEGRO_FONT *font, float max_width, float line_height, int flags, ALLEGRO_USTR const *ustr));
+ALLEGRO_FONT_FUNC(void, al_destroy_prepared_text, (ALLEGRO_PREPARED_TEXT *text));
+ALLEGRO_FONT_FUNC(void, al_draw_prepared_text, (const ALLEGRO_PREPARED_TEXT *text, ALLEGRO_COLOR color, float x, float y));
+ALLEGRO_FONT_FUNC(int, al_get_prepared_text_width, (const ALLEGRO_PREPARED_TEXT *text));
+ALLEGRO_FONT_FUNC(void, al_get_prepared_text_dimensions, (const ALLEGRO_PREPARED_TEXT *text, int *bbx, int *bby, int *bbw, int *bbh));
+#endif
+
 #ifdef __cplusplus
    }
 #endif
@@ -22,8 +22,6 @@ typedef struct {
    int xoffset, yoffset;
    int xadvance;
    int chnl;
-   int kerning_pairs;
-   BMFONT_KERNING *kerning;
 } BMFONT_CHAR;
 
 typedef struct BMFONT_RANGE BMFONT_RANGE;
@@ -45,6 +43,14 @@ typedef struct {
 
    int kerning_pairs;
    BMFONT_KERNING *kerning;
+
+   _AL_FONT_LOOKUP *lookup;
+
+   /* Open addressing hash of the kerning pairs, first < 0 marks a free
+    * slot. The size is a power of two.
+    */
+   BMFONT_KERNING *kerning_hash;
+   unsigned int kerning_hash_size;
 } BMFONT_DATA;
 
 typedef struct {
@@ -139,7 +145,8 @@ static void add_codepoint(BMFONT_PARSER *parser, int codepoint) {
    insert_new_range(parser, prev, codepoint);
 }
 
-static BMFONT_CHAR *find_codepoint(BMFONT_DATA *data, int codepoint) {
+static BMFONT_CHAR *find_codepoint_in_ranges(BMFONT_DATA *data,
+      int codepoint) {
    BMFONT_RANGE *range = data->range_first;
    while (range) {
       if (codepoint >= range->first &&
@@ -151,6 +158,20 @@ static BMFONT_CHAR *find_codepoint(BMFONT_DATA *data, int codepoint) {
    return NULL;
 }
 
+static BMFONT_CHAR *find_codepoint(BMFONT_DATA *data, int codepoint) {
+   if (!data->lookup)
+      return find_codepoint_in_ranges(data, codepoint);
+   return _al_font_lookup_get(data->lookup, codepoint);
+}
+
+static unsigned int kerning_hash(int first, int second) {
+   uint32_t h = (uint32_t)first * 0x9E3779B1u ^ (uint32_t)second;
+   h ^= h >> 16;
+   h *= 0x85EBCA6Bu;
+   h ^= h >> 13;
+   return h;
+}
+
 static void add_page(BMFONT_PARSER *parser, char const *filename) {
    ALLEGRO_FONT *font = parser->font;
    BMFONT_DATA *data = font->data;
@@ -243,14 +264,15 @@ static int font_descent(const ALLEGRO_FONT *f) {
    return data->line_height - data->base;
 }
 
-static int get_kerning(BMFONT_CHAR *prev, int c) {
-   if (!prev) return 0;
-   int i;
-   for (i = 0; i < prev->kerning_pairs; i++) {
-      if (prev->kerning[i].second == c) {
-         int a = prev->kerning[i].amount;
-         return a;
-      }
+static int get_kerning(BMFONT_DATA *data, int prev, int c) {
+   if (data->kerning_hash_size == 0 || prev < 0) return 0;
+   unsigned int mask = data->kerning_hash_size - 1;
+   unsigned int i = kerning_hash(prev, c) & mask;
+   while (data->kerning_hash[i].first >= 0) {
+      BMFONT_KERNING *k = data->kerning_hash + i;
+      if (k->first == prev && k->second == c)
+         return k->amount;
+      i = (i + 1) & mask;
    }
    return 0;
 }
@@ -267,8 +289,7 @@ static int each_character(const ALLEGRO_FONT *f, ALLEGRO_COLOR color,
       int c = al_ustr_get_next(text, &pos);
       if (c < 0) break;
       if (prev) {
-         BMFONT_CHAR *pc = find_codepoint(data, prev);
-         advance += get_kerning(pc, c);
+         advance += get_kerning(data, prev, c);
       }
       advance += cb(f, color, c, x + advance, y, glyph);
       prev = c;
@@ -336,7 +357,7 @@ static int get_glyph_advance(const ALLEGRO_FONT *f,
    }
 
    if (codepoint2 != ALLEGRO_NO_KERNING)
-      kerning = get_kerning(c, codepoint2);
+      kerning = get_kerning(data, codepoint1, codepoint2);
 
    return c->xadvance + kerning;
 }
@@ -344,7 +365,6 @@ static int get_glyph_advance(const ALLEGRO_FONT *f,
 static bool get_glyph(const ALLEGRO_FONT *f, int prev_codepoint,
       int codepoint, ALLEGRO_GLYPH *glyph) {
    BMFONT_DATA *data = f->data;
-   BMFONT_CHAR *prev = find_codepoint(data, prev_codepoint);
    BMFONT_CHAR *c = find_codepoint(data, codepoint);
    if (c) {
       glyph->bitmap = data->pages[c->page];
@@ -352,7 +372,7 @@ static bool get_glyph(const ALLEGRO_FONT *f, int prev_codepoint,
       glyph->y = c->y;
       glyph->w = c->width;
       glyph->h = c->height;
-      glyph->kerning = get_kerning(prev, codepoint);
+      glyph->kerning = get_kerning(data, prev_codepoint, codepoint);
       glyph->offset_x = c->xoffset;
       glyph->offset_y = c->yoffset;
       glyph->advance = c->xadvance + glyph->kerning;
@@ -404,9 +424,9 @@ static void destroy_range(BMFONT_RANGE *range) {
    int i;
    for (i = 0; i < range->count; i++) {
       BMFONT_CHAR *c = range->characters[i];
-      al_free(c->kerning);
       al_free(c);
    }
+   al_free(range->characters);
    al_free(range);
 }
 
@@ -426,6 +446,9 @@ static void destroy(ALLEGRO_FONT *f) {
    al_free(data->pages);
    
    al_free(data->kerning);
+   al_free(data->kerning_hash);
+   _al_font_lookup_destroy(data->lookup);
+   al_free(data);
    al_free(f);
 }
 
@@ -460,6 +483,67 @@ static int get_font_ranges(ALLEGRO_FONT *f,
    return i;
 }
 
+/* Indexes all characters. Without the index characters are still found,
+ * just more slowly.
+ */
+static void build_lookup(BMFONT_DATA *data) {
+   BMFONT_RANGE *range;
+   int i;
+   data->lookup = _al_font_lookup_create();
+   if (!data->lookup) return;
+   for (range = data->range_first; range; range = range->next) {
+      for (i = 0; i < range->count; i++) {
+         if (!_al_font_lookup_set(data->lookup, range->first + i,
+               range->characters[i])) {
+            ALLEGRO_WARN("Could not index character %d.\n",
+               range->first + i);
+            _al_font_lookup_destroy(data->lookup);
+            data->lookup = NULL;
+            return;
+         }
+      }
+   }
+}
+
+/* Pairs whose first character is missing are dropped, they could never
+ * apply. If a pair is listed twice the first one is used.
+ */
+static void build_kerning_hash(BMFONT_DATA *data) {
+   unsigned int size = 8;
+   unsigned int mask;
+   int i;
+   if (data->kerning_pairs == 0) return;
+   /* Keep the load factor at or below one half. */
+   while (size < (unsigned int)data->kerning_pairs * 2)
+      size *= 2;
+   data->kerning_hash = al_malloc(size * sizeof *data->kerning_hash);
+   if (!data->kerning_hash) {
+      ALLEGRO_WARN("Not enough memory for %d kerning pairs.\n",
+         data->kerning_pairs);
+      return;
+   }
+   data->kerning_hash_size = size;
+   mask = size - 1;
+   for (i = 0; i < (int)size; i++) {
+      data->kerning_hash[i].first = -1;
+   }
+   for (i = 0; i < data->kerning_pairs; i++) {
+      BMFONT_KERNING *k = data->kerning + i;
+      unsigned int j;
+      if (k->first < 0 || !find_codepoint(data, k->first))
+         continue;
+      j = kerning_hash(k->first, k->second) & mask;
+      while (data->kerning_hash[j].first >= 0) {
+         if (data->kerning_hash[j].first == k->first &&
+               data->kerning_hash[j].second == k->second)
+            break;
+         j = (j + 1) & mask;
+      }
+      if (data->kerning_hash[j].first < 0)
+         data->kerning_hash[j] = *k;
+   }
+}
+
 static ALLEGRO_FONT_VTABLE _al_font_vtable_xml = {
    font_height,
    font_ascent, 
@@ -501,15 +585,8 @@ ALLEGRO_FONT *_al_load_bmfont_xml(const char *filename, int size,
 
    _al_xml_parse(f, xml_callback, parser);
 
-   int i;
-   for (i = 0; i < data->kerning_pairs; i++) {
-      BMFONT_KERNING *k = data->kerning + i;
-      BMFONT_CHAR *c = find_codepoint(data, k->first);
-      c->kerning_pairs++;
-      c->kerning = al_realloc(c->kerning, c->kerning_pairs *
-         sizeof *c->kerning);
-      c->kerning[c->kerning_pairs - 1] = *k;
-   }
+   build_lookup(data);
+   build_kerning_hash(data);
 
    al_ustr_free(parser->tag);
    al_ustr_free(parser->attribute);
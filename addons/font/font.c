@@ -108,28 +108,18 @@ static void color_get_text_dimensions(ALLEGRO_FONT const *f,
 
 
 
-static ALLEGRO_FONT_COLOR_DATA *_al_font_find_page(
-   ALLEGRO_FONT_COLOR_DATA *cf, int ch)
-{
-    while (cf) {
-        if (ch >= cf->begin && ch < cf->end)
-            return cf;
-        cf = cf->next;
-    }
-    return NULL;
-}
-
-
 /* _color_find_glyph:
  *  Helper for color vtable entries, below.
  */
 static ALLEGRO_BITMAP* _al_font_color_find_glyph(const ALLEGRO_FONT* f, int ch)
 {
     ALLEGRO_FONT_COLOR_DATA* cf = (ALLEGRO_FONT_COLOR_DATA*)(f->data);
+    ALLEGRO_BITMAP *g = NULL;
 
-    cf = _al_font_find_page(cf, ch);
-    if (cf) {
-        return cf->bitmaps[ch - cf->begin];
+    if (cf)
+        g = _al_font_lookup_get(cf->lookup, ch);
+    if (g) {
+        return g;
     }
 
     /* if we don't find the character, then search for the missing
@@ -246,8 +236,10 @@ static void color_destroy(ALLEGRO_FONT* f)
 
     cf = (ALLEGRO_FONT_COLOR_DATA*)(f->data);
 
-    if (cf)
+    if (cf) {
         glyphs = cf->glyphs;
+        _al_font_lookup_destroy(cf->lookup);
+    }
 
     while (cf) {
         ALLEGRO_FONT_COLOR_DATA* next = cf->next;
@@ -5,11 +5,15 @@
 
 extern ALLEGRO_FONT_VTABLE _al_font_vtable_color;
 
+/* Maps codepoints to glyph pointers in constant time. */
+typedef struct _AL_FONT_LOOKUP _AL_FONT_LOOKUP;
+
 typedef struct ALLEGRO_FONT_COLOR_DATA
 {
    int begin, end;                   /* first char and one-past-the-end char */
    ALLEGRO_BITMAP *glyphs;           /* our glyphs */
    ALLEGRO_BITMAP **bitmaps;         /* sub bitmaps pointing to our glyphs */
+   _AL_FONT_LOOKUP *lookup;          /* bitmaps of all ranges, first range only */
    struct ALLEGRO_FONT_COLOR_DATA *next;  /* linked list structure */
 } ALLEGRO_FONT_COLOR_DATA;
 
@@ -18,5 +22,13 @@ ALLEGRO_FONT *_al_load_bitmap_font(const char *filename,
 ALLEGRO_FONT *_al_load_bmfont_xml(const char *filename,
    int size, int flags);
 
+_AL_FONT_LOOKUP *_al_font_lookup_create(void);
+void _al_font_lookup_destroy(_AL_FONT_LOOKUP *lookup);
+bool _al_font_lookup_set(_AL_FONT_LOOKUP *lookup, int codepoint, void *glyph);
+void *_al_font_lookup_get(const _AL_FONT_LOOKUP *lookup, int codepoint);
+
+void _al_font_align_to_integer_pixel(ALLEGRO_TRANSFORM const *fwd,
+   ALLEGRO_TRANSFORM const *inv, float *x, float *y);
+
 
 #endif
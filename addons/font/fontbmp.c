@@ -201,6 +201,41 @@ ALLEGRO_FONT *al_load_bitmap_font_flags(const char *fname, int flags)
 
 
 
+/* build_lookup:
+ *  Indexes the glyphs of all ranges, so they can be found without walking
+ *  the range list. Like the list walk, the first range containing a
+ *  codepoint wins.
+ */
+static bool build_lookup(ALLEGRO_FONT *f)
+{
+   ALLEGRO_FONT_COLOR_DATA *first = f->data;
+   ALLEGRO_FONT_COLOR_DATA *cf;
+   int ch;
+
+   if (!first)
+      return true;
+
+   first->lookup = _al_font_lookup_create();
+   if (!first->lookup)
+      return false;
+
+   for (cf = first; cf; cf = cf->next) {
+      for (ch = cf->begin; ch < cf->end; ch++) {
+         if (_al_font_lookup_get(first->lookup, ch))
+            continue;
+         if (!_al_font_lookup_set(first->lookup, ch,
+               cf->bitmaps[ch - cf->begin])) {
+            ALLEGRO_ERROR("Unable to index character %d\n", ch);
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+
+
 /* Function: al_grab_font_from_bitmap
  */
 ALLEGRO_FONT *al_grab_font_from_bitmap(ALLEGRO_BITMAP *bmp,
@@ -279,6 +314,9 @@ ALLEGRO_FONT *al_grab_font_from_bitmap(ALLEGRO_BITMAP *bmp,
       }
    }
    al_restore_state(&backup);
+
+   if (!build_lookup(f))
+      goto cleanup_and_fail_on_error;
    
    cf = f->data;
    if (cf && cf->bitmaps[0])
@@ -0,0 +1,110 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Codepoint to glyph lookup tables.
+ *
+ *      Codepoints are split into blocks of 256. The table has a slot for
+ *      every block up to the highest codepoint of the font, and only the
+ *      blocks which contain glyphs are allocated. A lookup is two array
+ *      accesses for the BMP and the astral planes alike, while a font
+ *      with a few scattered ranges stays small.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_font.h"
+#include "allegro5/internal/aintern_font.h"
+
+#include "font.h"
+
+#define BLOCK_BITS   8
+#define BLOCK_SIZE   (1 << BLOCK_BITS)
+#define MAX_BLOCKS   ((0x10FFFF >> BLOCK_BITS) + 1)
+
+
+struct _AL_FONT_LOOKUP
+{
+   void ***blocks;
+   unsigned int num_blocks;
+};
+
+
+_AL_FONT_LOOKUP *_al_font_lookup_create(void)
+{
+   return al_calloc(1, sizeof(_AL_FONT_LOOKUP));
+}
+
+
+
+void _al_font_lookup_destroy(_AL_FONT_LOOKUP *lookup)
+{
+   unsigned int i;
+
+   if (!lookup)
+      return;
+
+   for (i = 0; i < lookup->num_blocks; i++) {
+      al_free(lookup->blocks[i]);
+   }
+   al_free(lookup->blocks);
+   al_free(lookup);
+}
+
+
+
+/* Returns false if the codepoint is out of range or memory runs out. */
+bool _al_font_lookup_set(_AL_FONT_LOOKUP *lookup, int codepoint, void *glyph)
+{
+   unsigned int block = (unsigned int)codepoint >> BLOCK_BITS;
+
+   ASSERT(lookup);
+
+   if (codepoint < 0 || block >= MAX_BLOCKS)
+      return false;
+
+   if (block >= lookup->num_blocks) {
+      void ***blocks = al_realloc(lookup->blocks,
+         (block + 1) * sizeof(*blocks));
+      if (!blocks)
+         return false;
+      memset(blocks + lookup->num_blocks, 0,
+         (block + 1 - lookup->num_blocks) * sizeof(*blocks));
+      lookup->blocks = blocks;
+      lookup->num_blocks = block + 1;
+   }
+
+   if (!lookup->blocks[block]) {
+      lookup->blocks[block] = al_calloc(BLOCK_SIZE, sizeof(void *));
+      if (!lookup->blocks[block])
+         return false;
+   }
+
+   lookup->blocks[block][codepoint & (BLOCK_SIZE - 1)] = glyph;
+   return true;
+}
+
+
+
+void *_al_font_lookup_get(const _AL_FONT_LOOKUP *lookup, int codepoint)
+{
+   unsigned int block = (unsigned int)codepoint >> BLOCK_BITS;
+
+   if (block >= lookup->num_blocks || !lookup->blocks[block])
+      return NULL;
+
+   return lookup->blocks[block][codepoint & (BLOCK_SIZE - 1)];
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -0,0 +1,505 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Prepared text.
+ *
+ *      The layout of a text is worked out once: the glyph pages, source
+ *      rectangles and positions are stored, so drawing it only has to
+ *      submit the glyphs.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <float.h>
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_font.h"
+#include "allegro5/internal/aintern_font.h"
+
+#include "font.h"
+
+ALLEGRO_DEBUG_CHANNEL("font")
+
+
+typedef struct PREPARED_GLYPH
+{
+   ALLEGRO_BITMAP *bitmap;
+   float sx, sy, sw, sh;
+   float dx, dy;              /* relative to the run */
+} PREPARED_GLYPH;
+
+
+/* Glyphs which are positioned together, like al_draw_ustr would. */
+typedef struct PREPARED_RUN
+{
+   float x, y;                /* relative to the drawing position */
+   int advance;
+   int first_glyph;
+   int num_glyphs;
+   ALLEGRO_USTR *ustr;        /* if the font has to draw the glyphs */
+} PREPARED_RUN;
+
+
+struct ALLEGRO_PREPARED_TEXT
+{
+   const ALLEGRO_FONT *font;
+   int flags;
+   bool failed;
+
+   PREPARED_RUN *runs;
+   int num_runs;
+   int runs_size;
+
+   PREPARED_GLYPH *glyphs;
+   int num_glyphs;
+   int glyphs_size;
+};
+
+
+static ALLEGRO_PREPARED_TEXT *create_prepared_text(const ALLEGRO_FONT *font,
+   int flags)
+{
+   ALLEGRO_PREPARED_TEXT *text = al_calloc(1, sizeof(*text));
+   if (!text)
+      return NULL;
+
+   text->font = font;
+   text->flags = flags;
+   return text;
+}
+
+
+static void *grow(void *items, int *size, int needed, size_t item_size)
+{
+   int new_size = *size * 2;
+   void *new_items;
+
+   if (new_size < needed)
+      new_size = needed;
+   if (new_size < 8)
+      new_size = 8;
+
+   new_items = al_realloc(items, new_size * item_size);
+   if (new_items)
+      *size = new_size;
+   return new_items;
+}
+
+
+/* Lays out a line of text as a new run and returns its advance, like the
+ * render method of the font would.
+ */
+static int add_run(ALLEGRO_PREPARED_TEXT *text, const ALLEGRO_USTR *ustr,
+   float x, float y)
+{
+   const ALLEGRO_FONT *font = text->font;
+   PREPARED_RUN *run;
+   ALLEGRO_GLYPH glyph;
+   int32_t prev_ch = -1;
+   int32_t ch;
+   int pos = 0;
+   int advance = 0;
+
+   if (text->failed)
+      return 0;
+
+   if (text->num_runs == text->runs_size) {
+      PREPARED_RUN *runs = grow(text->runs, &text->runs_size,
+         text->num_runs + 1, sizeof(*runs));
+      if (!runs) {
+         text->failed = true;
+         return 0;
+      }
+      text->runs = runs;
+   }
+
+   run = &text->runs[text->num_runs++];
+   run->x = x;
+   run->y = y;
+   run->first_glyph = text->num_glyphs;
+   run->ustr = NULL;
+
+   while ((ch = al_ustr_get_next(ustr, &pos)) >= 0) {
+      memset(&glyph, 0, sizeof(glyph));
+      if (font->vtable->get_glyph(font, prev_ch, ch, &glyph)) {
+         /* Visible glyphs without a bitmap, like those of distance field
+          * fonts, can't be drawn as bitmap regions. The glyph is kept for
+          * the dimensions.
+          */
+         if (!glyph.bitmap && glyph.w > 0 && glyph.h > 0 && !run->ustr) {
+            run->ustr = al_ustr_dup(ustr);
+            if (!run->ustr) {
+               text->failed = true;
+               return 0;
+            }
+         }
+         if (glyph.bitmap || (glyph.w > 0 && glyph.h > 0)) {
+            PREPARED_GLYPH *g;
+
+            if (text->num_glyphs == text->glyphs_size) {
+               PREPARED_GLYPH *glyphs = grow(text->glyphs, &text->glyphs_size,
+                  text->num_glyphs + 1, sizeof(*glyphs));
+               if (!glyphs) {
+                  text->failed = true;
+                  return 0;
+               }
+               text->glyphs = glyphs;
+            }
+
+            g = &text->glyphs[text->num_glyphs++];
+            g->bitmap = glyph.bitmap;
+            g->sx = glyph.x;
+            g->sy = glyph.y;
+            g->sw = glyph.w;
+            g->sh = glyph.h;
+            g->dx = advance + glyph.offset_x + glyph.kerning;
+            g->dy = glyph.offset_y;
+         }
+         advance += glyph.advance;
+      }
+      prev_ch = ch;
+   }
+
+   run->num_glyphs = text->num_glyphs - run->first_glyph;
+   run->advance = advance;
+
+   return advance;
+}
+
+
+/* Adds a line aligned like al_draw_ustr does it. */
+static void add_aligned_run(ALLEGRO_PREPARED_TEXT *text,
+   const ALLEGRO_USTR *ustr, float y)
+{
+   const ALLEGRO_FONT *font = text->font;
+   float x = 0;
+
+   if (text->flags & ALLEGRO_ALIGN_CENTRE) {
+      /* Integer division like al_draw_ustr. */
+      x -= font->vtable->text_length(font, ustr) / 2;
+   }
+   else if (text->flags & ALLEGRO_ALIGN_RIGHT) {
+      x -= font->vtable->text_length(font, ustr);
+   }
+
+   add_run(text, ustr, x, y);
+}
+
+
+static ALLEGRO_PREPARED_TEXT *finish_prepared_text(ALLEGRO_PREPARED_TEXT *text)
+{
+   if (text && text->failed) {
+      ALLEGRO_ERROR("Out of memory while preparing text.\n");
+      al_destroy_prepared_text(text);
+      return NULL;
+   }
+
+   return text;
+}
+
+
+/* Function: al_prepare_ustr
+ */
+ALLEGRO_PREPARED_TEXT *al_prepare_ustr(const ALLEGRO_FONT *font, int flags,
+   const ALLEGRO_USTR *ustr)
+{
+   ALLEGRO_PREPARED_TEXT *text;
+
+   ASSERT(font);
+   ASSERT(ustr);
+
+   text = create_prepared_text(font, flags);
+   if (!text)
+      return NULL;
+
+   add_aligned_run(text, ustr, 0);
+
+   return finish_prepared_text(text);
+}
+
+
+/* Function: al_prepare_text
+ */
+ALLEGRO_PREPARED_TEXT *al_prepare_text(const ALLEGRO_FONT *font, int flags,
+   const char *str)
+{
+   ALLEGRO_USTR_INFO info;
+   ASSERT(str);
+   return al_prepare_ustr(font, flags, al_ref_cstr(&info, str));
+}
+
+
+/* Function: al_prepare_justified_ustr
+ */
+ALLEGRO_PREPARED_TEXT *al_prepare_justified_ustr(const ALLEGRO_FONT *font,
+   float width, float diff, int flags, const ALLEGRO_USTR *ustr)
+{
+   const char *whitespace = " \t\n\r";
+   ALLEGRO_PREPARED_TEXT *text;
+   ALLEGRO_USTR_INFO word_info;
+   const ALLEGRO_USTR *word;
+   int pos1, pos2;
+   int minlen;
+   int num_words;
+   int space;
+   float fleft, finc;
+   int advance;
+
+   ASSERT(font);
+   ASSERT(ustr);
+
+   text = create_prepared_text(font, flags);
+   if (!text)
+      return NULL;
+
+   /* Same as al_draw_justified_ustr, with x1 at 0. */
+   num_words = 0;
+   minlen = 0;
+   pos1 = 0;
+   for (;;) {
+      pos1 = al_ustr_find_cset_cstr(ustr, pos1, whitespace);
+      if (pos1 == -1)
+         break;
+      pos2 = al_ustr_find_set_cstr(ustr, pos1, whitespace);
+      if (pos2 == -1)
+         pos2 = al_ustr_size(ustr);
+
+      word = al_ref_ustr(&word_info, ustr, pos1, pos2);
+      minlen += font->vtable->text_length(font, word);
+      num_words++;
+
+      pos1 = pos2;
+   }
+
+   space = width - minlen;
+
+   if ((space <= 0) || (space > diff) || (num_words < 2)) {
+      /* can't justify */
+      add_run(text, ustr, 0, 0);
+      return finish_prepared_text(text);
+   }
+
+   fleft = 0;
+   finc = (float)space / (float)(num_words-1);
+   pos1 = 0;
+
+   for (;;) {
+      pos1 = al_ustr_find_cset_cstr(ustr, pos1, whitespace);
+      if (pos1 == -1)
+         break;
+      pos2 = al_ustr_find_set_cstr(ustr, pos1, whitespace);
+      if (pos2 == -1)
+         pos2 = al_ustr_size(ustr);
+
+      word = al_ref_ustr(&word_info, ustr, pos1, pos2);
+      advance = add_run(text, word, fleft, 0);
+      fleft += advance + finc;
+      pos1 = pos2;
+   }
+
+   return finish_prepared_text(text);
+}
+
+
+/* Function: al_prepare_justified_text
+ */
+ALLEGRO_PREPARED_TEXT *al_prepare_justified_text(const ALLEGRO_FONT *font,
+   float width, float diff, int flags, const char *str)
+{
+   ALLEGRO_USTR_INFO info;
+   ASSERT(str);
+   return al_prepare_justified_ustr(font, width, diff, flags,
+      al_ref_cstr(&info, str));
+}
+
+
+typedef struct PREPARE_MULTILINE_EXTRA {
+   ALLEGRO_PREPARED_TEXT *text;
+   float line_height;
+} PREPARE_MULTILINE_EXTRA;
+
+
+static bool prepare_multiline_cb(int line_num, const ALLEGRO_USTR *line,
+   void *extra)
+{
+   PREPARE_MULTILINE_EXTRA *s = extra;
+
+   add_aligned_run(s->text, line, s->line_height * line_num);
+   return !s->text->failed;
+}
+
+
+/* Function: al_prepare_multiline_ustr
+ */
+ALLEGRO_PREPARED_TEXT *al_prepare_multiline_ustr(const ALLEGRO_FONT *font,
+   float max_width, float line_height, int flags, const ALLEGRO_USTR *ustr)
+{
+   PREPARE_MULTILINE_EXTRA extra;
+
+   ASSERT(font);
+   ASSERT(ustr);
+
+   extra.text = create_prepared_text(font, flags);
+   if (!extra.text)
+      return NULL;
+
+   if (line_height < 1) {
+      extra.line_height = al_get_font_line_height(font);
+   }
+   else {
+      extra.line_height = line_height;
+   }
+
+   al_do_multiline_ustr(font, max_width, ustr, prepare_multiline_cb, &extra);
+
+   return finish_prepared_text(extra.text);
+}
+
+
+/* Function: al_prepare_multiline_text
+ */
+ALLEGRO_PREPARED_TEXT *al_prepare_multiline_text(const ALLEGRO_FONT *font,
+   float max_width, float line_height, int flags, const char *str)
+{
+   ALLEGRO_USTR_INFO info;
+   ASSERT(str);
+   return al_prepare_multiline_ustr(font, max_width, line_height, flags,
+      al_ref_cstr(&info, str));
+}
+
+
+/* Function: al_destroy_prepared_text
+ */
+void al_destroy_prepared_text(ALLEGRO_PREPARED_TEXT *text)
+{
+   int i;
+
+   if (!text)
+      return;
+
+   for (i = 0; i < text->num_runs; i++) {
+      al_ustr_free(text->runs[i].ustr);
+   }
+   al_free(text->runs);
+   al_free(text->glyphs);
+   al_free(text);
+}
+
+
+/* Function: al_draw_prepared_text
+ */
+void al_draw_prepared_text(const ALLEGRO_PREPARED_TEXT *text,
+   ALLEGRO_COLOR color, float x, float y)
+{
+   ALLEGRO_TRANSFORM const *fwd = NULL;
+   ALLEGRO_TRANSFORM inv;
+   bool hold;
+   int i, j;
+
+   ASSERT(text);
+
+   if (text->num_glyphs == 0)
+      return;
+
+   if (text->flags & ALLEGRO_ALIGN_INTEGER) {
+      fwd = al_get_current_transform();
+      al_copy_transform(&inv, fwd);
+      al_invert_transform(&inv);
+   }
+
+   /* Glyphs on the same page end up in one draw call. */
+   hold = al_is_bitmap_drawing_held();
+   al_hold_bitmap_drawing(true);
+
+   for (i = 0; i < text->num_runs; i++) {
+      const PREPARED_RUN *run = &text->runs[i];
+      const PREPARED_GLYPH *g = &text->glyphs[run->first_glyph];
+      float rx = x + run->x;
+      float ry = y + run->y;
+
+      if (fwd)
+         _al_font_align_to_integer_pixel(fwd, &inv, &rx, &ry);
+
+      if (run->ustr) {
+         text->font->vtable->render(text->font, color, run->ustr, rx, ry);
+         continue;
+      }
+
+      for (j = 0; j < run->num_glyphs; j++, g++) {
+         al_draw_tinted_bitmap_region(g->bitmap, color,
+            g->sx, g->sy, g->sw, g->sh, rx + g->dx, ry + g->dy, 0);
+      }
+   }
+
+   al_hold_bitmap_drawing(hold);
+}
+
+
+/* Function: al_get_prepared_text_width
+ */
+int al_get_prepared_text_width(const ALLEGRO_PREPARED_TEXT *text)
+{
+   float left = FLT_MAX;
+   float right = -FLT_MAX;
+   int i;
+
+   ASSERT(text);
+
+   for (i = 0; i < text->num_runs; i++) {
+      const PREPARED_RUN *run = &text->runs[i];
+      if (run->x < left)
+         left = run->x;
+      if (run->x + run->advance > right)
+         right = run->x + run->advance;
+   }
+
+   return text->num_runs > 0 ? (int)(right - left) : 0;
+}
+
+
+/* Function: al_get_prepared_text_dimensions
+ */
+void al_get_prepared_text_dimensions(const ALLEGRO_PREPARED_TEXT *text,
+   int *bbx, int *bby, int *bbw, int *bbh)
+{
+   float x1 = FLT_MAX, y1 = FLT_MAX;
+   float x2 = -FLT_MAX, y2 = -FLT_MAX;
+   int i, j;
+
+   ASSERT(text);
+
+   for (i = 0; i < text->num_runs; i++) {
+      const PREPARED_RUN *run = &text->runs[i];
+      const PREPARED_GLYPH *g = &text->glyphs[run->first_glyph];
+
+      for (j = 0; j < run->num_glyphs; j++, g++) {
+         float gx = run->x + g->dx;
+         float gy = run->y + g->dy;
+         if (gx < x1) x1 = gx;
+         if (gy < y1) y1 = gy;
+         if (gx + g->sw > x2) x2 = gx + g->sw;
+         if (gy + g->sh > y2) y2 = gy + g->sh;
+      }
+   }
+
+   if (text->num_glyphs == 0) {
+      x1 = y1 = x2 = y2 = 0;
+   }
+
+   if (bbx) *bbx = x1;
+   if (bby) *bby = y1;
+   if (bbw) *bbw = x2 - x1;
+   if (bbh) *bbh = y2 - y1;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -29,6 +29,8 @@
 #include "allegro5/internal/aintern_font.h"
 #include "allegro5/internal/aintern_system.h"
 
+#include "font.h"
+
 /* If you call this, you're probably making a mistake. */
 /*
 #define strlen(s)   __are_you_sure__
@@ -46,7 +48,7 @@
  * translated x by 0.5. So we simply apply the transformation,
  * round to nearest integer, and backtransform that.
  */
-static void align_to_integer_pixel_inner(
+void _al_font_align_to_integer_pixel(
    ALLEGRO_TRANSFORM const *fwd,
    ALLEGRO_TRANSFORM const *inv,
    float *x, float *y)
@@ -65,7 +67,7 @@ static void align_to_integer_pixel(float *x, float *y)
    fwd = al_get_current_transform();
    al_copy_transform(&inv, fwd);
    al_invert_transform(&inv);
-   align_to_integer_pixel_inner(fwd, &inv, x, y);
+   _al_font_align_to_integer_pixel(fwd, &inv, x, y);
 }
 
 
@@ -183,7 +185,7 @@ void al_draw_justified_ustr(const ALLEGRO_FONT *font,
       if (flags & ALLEGRO_ALIGN_INTEGER) {
          float drawx = fleft;
          float drawy = y;
-         align_to_integer_pixel_inner(fwd, &inv, &drawx, &drawy);
+         _al_font_align_to_integer_pixel(fwd, &inv, &drawx, &drawy);
          advance = font->vtable->render(font, color, word, drawx, drawy);
       }
       else {
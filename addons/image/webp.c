@@ -3,6 +3,8 @@
  */
 
 
+#define ALLEGRO_INTERNAL_UNSTABLE
+
 #include <webp/decode.h>
 #include <webp/encode.h>
 
@@ -66,6 +68,17 @@ ALLEGRO_BITMAP *_al_load_webp_f(ALLEGRO_FILE *fp, int flags)
 {
    ALLEGRO_ASSERT(fp);
    ALLEGRO_BITMAP *bmp;
+   const uint8_t *memory;
+   int64_t memory_size;
+   int64_t pos = al_ftell(fp);
+
+   /* Decode in place if the file is in memory anyway. */
+   memory = al_get_file_memory(fp, &memory_size);
+   if (memory && pos >= 0 && pos < memory_size) {
+      bmp = load_from_buffer(memory + pos, memory_size - pos, flags);
+      al_fseek(fp, 0, ALLEGRO_SEEK_END);
+      return bmp;
+   }
 
    size_t data_size = al_fsize(fp);
    uint8_t *data = al_malloc(data_size * sizeof(uint8_t));
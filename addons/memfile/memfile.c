@@ -1,5 +1,6 @@
 #include <allegro5/allegro.h>
 #include "allegro5/allegro_memfile.h"
+#include "allegro5/internal/aintern_file.h"
 
 typedef struct ALLEGRO_FILE_MEMFILE ALLEGRO_FILE_MEMFILE;
 
@@ -192,6 +193,10 @@ ALLEGRO_FILE *al_open_memfile(void *mem, int64_t size, const char *mode)
    if (!memfile) {
       al_free(userdata);
    }
+   else if (userdata->readable) {
+      /* Let loaders parse the memory in place. */
+      _al_set_file_memory(memfile, mem, size);
+   }
 
    return memfile;
 }
@@ -159,6 +159,12 @@ typedef struct ALLEGRO_VERTEX_BUFFER ALLEGRO_VERTEX_BUFFER;
  */
 typedef struct ALLEGRO_INDEX_BUFFER ALLEGRO_INDEX_BUFFER;
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_PRIMITIVES_SRC)
+/* Type: ALLEGRO_GEOMETRY
+ */
+typedef struct ALLEGRO_GEOMETRY ALLEGRO_GEOMETRY;
+#endif
+
 ALLEGRO_PRIM_FUNC(uint32_t, al_get_allegro_primitives_version, (void));
 
 /*
@@ -192,10 +198,27 @@ ALLEGRO_PRIM_FUNC(void*, al_lock_index_buffer, (ALLEGRO_INDEX_BUFFER* buffer, in
 ALLEGRO_PRIM_FUNC(void, al_unlock_index_buffer, (ALLEGRO_INDEX_BUFFER* buffer));
 ALLEGRO_PRIM_FUNC(int, al_get_index_buffer_size, (ALLEGRO_INDEX_BUFFER* buffer));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_PRIMITIVES_SRC)
+/*
+ * Retained geometry
+ */
+ALLEGRO_PRIM_FUNC(ALLEGRO_GEOMETRY*, al_create_geometry, (int flags));
+ALLEGRO_PRIM_FUNC(void, al_destroy_geometry, (ALLEGRO_GEOMETRY* geometry));
+ALLEGRO_PRIM_FUNC(int, al_begin_geometry_shape, (ALLEGRO_GEOMETRY* geometry, int shape));
+ALLEGRO_PRIM_FUNC(void, al_end_geometry_shape, (ALLEGRO_GEOMETRY* geometry));
+ALLEGRO_PRIM_FUNC(void, al_remove_geometry_shape, (ALLEGRO_GEOMETRY* geometry, int shape));
+ALLEGRO_PRIM_FUNC(void, al_clear_geometry, (ALLEGRO_GEOMETRY* geometry));
+ALLEGRO_PRIM_FUNC(int, al_get_geometry_num_shapes, (ALLEGRO_GEOMETRY* geometry));
+ALLEGRO_PRIM_FUNC(void, al_draw_geometry, (ALLEGRO_GEOMETRY* geometry));
+#endif
+
 /*
 * Utilities for high level primitives.
 */
 ALLEGRO_PRIM_FUNC(bool, al_triangulate_polygon, (const float* vertices, size_t vertex_stride, const int* vertex_counts, void (*emit_triangle)(int, int, int, void*), void* userdata));
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_PRIMITIVES_SRC)
+ALLEGRO_PRIM_FUNC(int*, al_triangulate_polygon_indices, (const float* vertices, size_t vertex_stride, const int* vertex_counts, int* num_indices));
+#endif
 
 
 /*
@@ -60,6 +60,21 @@ void _al_prim_cache_flush(ALLEGRO_PRIM_VERTEX_CACHE* cache);
 void _al_prim_cache_push_point(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* v);
 void _al_prim_cache_push_triangle(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* v0, const float* v1, const float* v2);
 
+/* Growable scratch memory, reused between triangulations. */
+typedef struct _AL_PRIM_SCRATCH {
+   void*  data;
+   size_t size;
+} _AL_PRIM_SCRATCH;
+
+void* _al_prim_scratch_reserve(_AL_PRIM_SCRATCH* scratch, size_t size);
+void  _al_prim_scratch_free(_AL_PRIM_SCRATCH* scratch);
+void  _al_prim_init_triangulator(void);
+void  _al_prim_shutdown_triangulator(void);
+void  _al_prim_init_geometry(void);
+void  _al_prim_shutdown_geometry(void);
+int   _al_prim_record_geometry(ALLEGRO_BITMAP* target, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture, const int* indices, int start, int end, int type);
+int   _al_prim_triangulate_monotone(const float* vertices, size_t vertex_stride, const int* vertex_counts, _AL_PRIM_SCRATCH* scratch, int** indices);
+
 
 /* Internal functions. */
 float     _al_prim_get_scale(void);
@@ -0,0 +1,710 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Retained geometry.
+ *
+ *      While a shape is being recorded, everything al_draw_prim and
+ *      al_draw_indexed_prim are asked to draw to the recording target is
+ *      appended to the shape instead, converted to indexed triangle, line
+ *      and point lists. All shapes are drawn together from one vertex
+ *      array, with one draw call per list.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_primitives.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_prim.h"
+#include "allegro5/internal/aintern_vector.h"
+
+ALLEGRO_DEBUG_CHANNEL("primitives")
+
+
+enum {
+   LIST_TRIANGLES,
+   LIST_LINES,
+   LIST_POINTS,
+   NUM_LISTS
+};
+
+static const int list_prim_type[NUM_LISTS] = {
+   ALLEGRO_PRIM_TRIANGLE_LIST,
+   ALLEGRO_PRIM_LINE_LIST,
+   ALLEGRO_PRIM_POINT_LIST
+};
+
+
+/* Growable vertex and index lists. */
+typedef struct GEOMETRY_DATA {
+   ALLEGRO_VERTEX* vertices;
+   int num_vertices;
+   int vertex_capacity;
+   int* indices[NUM_LISTS];
+   int num_indices[NUM_LISTS];
+   int index_capacity[NUM_LISTS];
+} GEOMETRY_DATA;
+
+
+typedef struct GEOMETRY_SHAPE {
+   GEOMETRY_DATA data;              /* indices relative to the shape */
+   /* Position of the shape in the combined lists. */
+   int vertex_offset;
+   int index_offset[NUM_LISTS];
+   bool dirty;
+} GEOMETRY_SHAPE;
+
+
+struct ALLEGRO_GEOMETRY {
+   int flags;
+   _AL_VECTOR shapes;               /* GEOMETRY_SHAPE */
+
+   /* Recording state. */
+   int recording;
+   ALLEGRO_BITMAP* target;
+   int old_sizes[NUM_LISTS + 1];
+
+   /* Set when shapes changed size, were added or removed. */
+   bool rebuild;
+   /* Set when some shapes changed without changing size. */
+   bool dirty;
+
+   GEOMETRY_DATA combined;
+
+   ALLEGRO_VERTEX_BUFFER* vertex_buffer;
+   ALLEGRO_INDEX_BUFFER* index_buffers[NUM_LISTS];
+   bool buffers_failed;
+};
+
+
+/* Geometries which are recording right now. */
+static ALLEGRO_MUTEX* recording_mutex = NULL;
+static _AL_VECTOR recording = _AL_VECTOR_INITIALIZER(ALLEGRO_GEOMETRY*);
+static int num_recording = 0;
+
+
+void _al_prim_init_geometry(void)
+{
+   if (!recording_mutex)
+      recording_mutex = al_create_mutex();
+}
+
+
+void _al_prim_shutdown_geometry(void)
+{
+   _al_vector_free(&recording);
+   num_recording = 0;
+   al_destroy_mutex(recording_mutex);
+   recording_mutex = NULL;
+}
+
+
+static void data_free(GEOMETRY_DATA* data)
+{
+   int i;
+
+   al_free(data->vertices);
+   for (i = 0; i < NUM_LISTS; i++)
+      al_free(data->indices[i]);
+   memset(data, 0, sizeof(*data));
+}
+
+
+/* Empties the lists but keeps their memory for the next recording. */
+static void data_reset(GEOMETRY_DATA* data)
+{
+   int i;
+
+   data->num_vertices = 0;
+   for (i = 0; i < NUM_LISTS; i++)
+      data->num_indices[i] = 0;
+}
+
+
+static bool grow(void** items, int* capacity, int needed, size_t item_size)
+{
+   int new_capacity;
+   void* new_items;
+
+   if (needed <= *capacity)
+      return true;
+
+   new_capacity = *capacity * 2;
+   if (new_capacity < needed)
+      new_capacity = needed;
+   if (new_capacity < 16)
+      new_capacity = 16;
+
+   new_items = al_realloc(*items, new_capacity * item_size);
+   if (!new_items)
+      return false;
+
+   *items = new_items;
+   *capacity = new_capacity;
+   return true;
+}
+
+
+static bool reserve_vertices(GEOMETRY_DATA* data, int n)
+{
+   return grow((void**)&data->vertices, &data->vertex_capacity,
+      data->num_vertices + n, sizeof(ALLEGRO_VERTEX));
+}
+
+
+static bool reserve_indices(GEOMETRY_DATA* data, int list, int n)
+{
+   return grow((void**)&data->indices[list], &data->index_capacity[list],
+      data->num_indices[list] + n, sizeof(int));
+}
+
+
+static GEOMETRY_SHAPE* get_shape(ALLEGRO_GEOMETRY* geometry, int shape)
+{
+   return _al_vector_ref(&geometry->shapes, shape);
+}
+
+
+static void destroy_buffers(ALLEGRO_GEOMETRY* geometry)
+{
+   int i;
+
+   /* These need a display even when passed NULL. */
+   if (geometry->vertex_buffer) {
+      al_destroy_vertex_buffer(geometry->vertex_buffer);
+      geometry->vertex_buffer = NULL;
+   }
+   for (i = 0; i < NUM_LISTS; i++) {
+      if (geometry->index_buffers[i]) {
+         al_destroy_index_buffer(geometry->index_buffers[i]);
+         geometry->index_buffers[i] = NULL;
+      }
+   }
+}
+
+
+/*
+ * Appends n vertices of the given primitive type to the shape. Returns the
+ * number of primitives, or -1 on failure.
+ */
+static int shape_append(GEOMETRY_DATA* data, const ALLEGRO_VERTEX* vtx,
+   const int* indices, int n, int type)
+{
+   int base = data->num_vertices;
+   int list;
+   int* idx;
+   int i, k = 0;
+
+   switch (type) {
+      case ALLEGRO_PRIM_LINE_LIST:
+      case ALLEGRO_PRIM_LINE_STRIP:
+      case ALLEGRO_PRIM_LINE_LOOP:
+         list = LIST_LINES;
+         break;
+      case ALLEGRO_PRIM_POINT_LIST:
+         list = LIST_POINTS;
+         break;
+      default:
+         list = LIST_TRIANGLES;
+         break;
+   }
+
+   /* Enough for the worst case, a triangle fan or strip. */
+   if (!reserve_vertices(data, n) || !reserve_indices(data, list, 3 * n))
+      return -1;
+
+   if (indices) {
+      for (i = 0; i < n; i++)
+         data->vertices[base + i] = vtx[indices[i]];
+   }
+   else if (n > 0) {
+      memcpy(data->vertices + base, vtx, n * sizeof(ALLEGRO_VERTEX));
+   }
+   data->num_vertices += n;
+
+   idx = data->indices[list] + data->num_indices[list];
+   switch (type) {
+      case ALLEGRO_PRIM_TRIANGLE_LIST:
+         for (i = 0; i + 2 < n; i += 3) {
+            idx[k++] = base + i;
+            idx[k++] = base + i + 1;
+            idx[k++] = base + i + 2;
+         }
+         break;
+      case ALLEGRO_PRIM_TRIANGLE_STRIP:
+         /* Keep the winding of every other triangle. */
+         for (i = 0; i + 2 < n; i++) {
+            idx[k++] = base + i + (i % 2);
+            idx[k++] = base + i + 1 - (i % 2);
+            idx[k++] = base + i + 2;
+         }
+         break;
+      case ALLEGRO_PRIM_TRIANGLE_FAN:
+         for (i = 1; i + 1 < n; i++) {
+            idx[k++] = base;
+            idx[k++] = base + i;
+            idx[k++] = base + i + 1;
+         }
+         break;
+      case ALLEGRO_PRIM_LINE_LIST:
+         for (i = 0; i + 1 < n; i += 2) {
+            idx[k++] = base + i;
+            idx[k++] = base + i + 1;
+         }
+         break;
+      case ALLEGRO_PRIM_LINE_STRIP:
+      case ALLEGRO_PRIM_LINE_LOOP:
+         for (i = 0; i + 1 < n; i++) {
+            idx[k++] = base + i;
+            idx[k++] = base + i + 1;
+         }
+         if (type == ALLEGRO_PRIM_LINE_LOOP && n > 2) {
+            idx[k++] = base + n - 1;
+            idx[k++] = base;
+         }
+         break;
+      case ALLEGRO_PRIM_POINT_LIST:
+         for (i = 0; i < n; i++)
+            idx[k++] = base + i;
+         break;
+   }
+   data->num_indices[list] += k;
+
+   return list == LIST_TRIANGLES ? k / 3 : list == LIST_LINES ? k / 2 : k;
+}
+
+
+/*
+ * Called by al_draw_prim and al_draw_indexed_prim. Returns the number of
+ * recorded primitives, or -1 if nothing is recording to the target and the
+ * primitives should be drawn.
+ */
+int _al_prim_record_geometry(ALLEGRO_BITMAP* target, const void* vtxs,
+   const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_BITMAP* texture,
+   const int* indices, int start, int end, int type)
+{
+   ALLEGRO_GEOMETRY* geometry = NULL;
+   GEOMETRY_SHAPE* shape;
+   unsigned int i;
+   int ret;
+
+   /* Only a hint, checked again under the lock. This keeps drawing fast
+    * while nothing is being recorded.
+    */
+   if (num_recording == 0 || !recording_mutex)
+      return -1;
+
+   al_lock_mutex(recording_mutex);
+   for (i = 0; i < _al_vector_size(&recording); i++) {
+      ALLEGRO_GEOMETRY** slot = _al_vector_ref(&recording, i);
+      if ((*slot)->target == target) {
+         geometry = *slot;
+         break;
+      }
+   }
+   al_unlock_mutex(recording_mutex);
+
+   if (!geometry)
+      return -1;
+
+   if (decl || texture) {
+      ALLEGRO_WARN("Only untextured ALLEGRO_VERTEX primitives can be recorded.\n");
+      return -1;
+   }
+
+   shape = get_shape(geometry, geometry->recording);
+   if (indices)
+      ret = shape_append(&shape->data, vtxs, indices, end - start, type);
+   else
+      ret = shape_append(&shape->data, (const ALLEGRO_VERTEX*)vtxs + start, NULL, end - start, type);
+   if (ret < 0) {
+      ALLEGRO_ERROR("Out of memory while recording a shape.\n");
+      return 0;
+   }
+
+   return ret;
+}
+
+
+/* Function: al_create_geometry
+ */
+ALLEGRO_GEOMETRY* al_create_geometry(int flags)
+{
+   ALLEGRO_GEOMETRY* geometry;
+
+   geometry = al_calloc(1, sizeof(*geometry));
+   if (!geometry)
+      return NULL;
+
+   geometry->flags = flags;
+   geometry->recording = -1;
+   _al_vector_init(&geometry->shapes, sizeof(GEOMETRY_SHAPE));
+
+   return geometry;
+}
+
+
+/* Function: al_destroy_geometry
+ */
+void al_destroy_geometry(ALLEGRO_GEOMETRY* geometry)
+{
+   if (!geometry)
+      return;
+
+   if (geometry->recording >= 0)
+      al_end_geometry_shape(geometry);
+
+   al_clear_geometry(geometry);
+   data_free(&geometry->combined);
+   destroy_buffers(geometry);
+   al_free(geometry);
+}
+
+
+/* Function: al_begin_geometry_shape
+ */
+int al_begin_geometry_shape(ALLEGRO_GEOMETRY* geometry, int shape)
+{
+   ALLEGRO_BITMAP* target = al_get_target_bitmap();
+   GEOMETRY_SHAPE* s;
+   ALLEGRO_GEOMETRY** slot;
+   unsigned int i;
+   int j;
+
+   ASSERT(geometry);
+   ASSERT(geometry->recording < 0);
+   ASSERT(shape < (int)_al_vector_size(&geometry->shapes));
+   ASSERT(recording_mutex);
+
+   al_lock_mutex(recording_mutex);
+   for (i = 0; i < _al_vector_size(&recording); i++) {
+      slot = _al_vector_ref(&recording, i);
+      if ((*slot)->target == target) {
+         al_unlock_mutex(recording_mutex);
+         ALLEGRO_ERROR("Another geometry is recording to this target bitmap.\n");
+         return -1;
+      }
+   }
+   slot = _al_vector_alloc_back(&recording);
+   if (!slot) {
+      al_unlock_mutex(recording_mutex);
+      return -1;
+   }
+   *slot = geometry;
+   num_recording++;
+   al_unlock_mutex(recording_mutex);
+
+   if (shape < 0) {
+      s = _al_vector_alloc_back(&geometry->shapes);
+      if (!s) {
+         al_lock_mutex(recording_mutex);
+         _al_vector_find_and_delete(&recording, &geometry);
+         num_recording--;
+         al_unlock_mutex(recording_mutex);
+         return -1;
+      }
+      memset(s, 0, sizeof(*s));
+      shape = _al_vector_size(&geometry->shapes) - 1;
+      geometry->rebuild = true;
+   }
+   else {
+      s = get_shape(geometry, shape);
+      geometry->old_sizes[0] = s->data.num_vertices;
+      for (j = 0; j < NUM_LISTS; j++)
+         geometry->old_sizes[j + 1] = s->data.num_indices[j];
+      data_reset(&s->data);
+   }
+
+   geometry->target = target;
+   geometry->recording = shape;
+
+   return shape;
+}
+
+
+/* Function: al_end_geometry_shape
+ */
+void al_end_geometry_shape(ALLEGRO_GEOMETRY* geometry)
+{
+   GEOMETRY_SHAPE* s;
+   bool same_size;
+   int j;
+
+   ASSERT(geometry);
+   ASSERT(geometry->recording >= 0);
+
+   al_lock_mutex(recording_mutex);
+   _al_vector_find_and_delete(&recording, &geometry);
+   num_recording--;
+   al_unlock_mutex(recording_mutex);
+
+   s = get_shape(geometry, geometry->recording);
+   geometry->recording = -1;
+   geometry->target = NULL;
+
+   if (geometry->rebuild)
+      return;
+
+   /* A shape which kept its size is updated in place. */
+   same_size = (s->data.num_vertices == geometry->old_sizes[0]);
+   for (j = 0; j < NUM_LISTS; j++) {
+      if (s->data.num_indices[j] != geometry->old_sizes[j + 1])
+         same_size = false;
+   }
+
+   if (same_size) {
+      s->dirty = true;
+      geometry->dirty = true;
+   }
+   else {
+      geometry->rebuild = true;
+   }
+}
+
+
+/* Function: al_remove_geometry_shape
+ */
+void al_remove_geometry_shape(ALLEGRO_GEOMETRY* geometry, int shape)
+{
+   ASSERT(geometry);
+   ASSERT(shape >= 0 && shape < (int)_al_vector_size(&geometry->shapes));
+   ASSERT(shape != geometry->recording);
+
+   /* Keep the slot so the other shapes keep their numbers. */
+   data_free(&get_shape(geometry, shape)->data);
+   geometry->rebuild = true;
+}
+
+
+/* Function: al_clear_geometry
+ */
+void al_clear_geometry(ALLEGRO_GEOMETRY* geometry)
+{
+   unsigned int i;
+
+   ASSERT(geometry);
+   ASSERT(geometry->recording < 0);
+
+   for (i = 0; i < _al_vector_size(&geometry->shapes); i++)
+      data_free(&get_shape(geometry, i)->data);
+   _al_vector_free(&geometry->shapes);
+   geometry->rebuild = true;
+}
+
+
+/* Function: al_get_geometry_num_shapes
+ */
+int al_get_geometry_num_shapes(ALLEGRO_GEOMETRY* geometry)
+{
+   ASSERT(geometry);
+
+   return _al_vector_size(&geometry->shapes);
+}
+
+
+/*
+ * Copies the lists of a shape to its place in the combined lists.
+ */
+static void copy_shape(ALLEGRO_GEOMETRY* geometry, GEOMETRY_SHAPE* s)
+{
+   GEOMETRY_DATA* dst = &geometry->combined;
+   int j, k;
+
+   memcpy(dst->vertices + s->vertex_offset, s->data.vertices,
+      s->data.num_vertices * sizeof(ALLEGRO_VERTEX));
+
+   for (j = 0; j < NUM_LISTS; j++) {
+      int* idx = dst->indices[j] + s->index_offset[j];
+      for (k = 0; k < s->data.num_indices[j]; k++)
+         idx[k] = s->data.indices[j][k] + s->vertex_offset;
+   }
+}
+
+
+/*
+ * Concatenates all shapes into the combined lists.
+ */
+static bool rebuild(ALLEGRO_GEOMETRY* geometry)
+{
+   GEOMETRY_DATA* dst = &geometry->combined;
+   GEOMETRY_SHAPE* s;
+   int num_vertices = 0;
+   int num_indices[NUM_LISTS] = {0};
+   unsigned int i;
+   int j;
+
+   for (i = 0; i < _al_vector_size(&geometry->shapes); i++) {
+      s = get_shape(geometry, i);
+      s->vertex_offset = num_vertices;
+      num_vertices += s->data.num_vertices;
+      for (j = 0; j < NUM_LISTS; j++) {
+         s->index_offset[j] = num_indices[j];
+         num_indices[j] += s->data.num_indices[j];
+      }
+   }
+
+   data_reset(dst);
+   if (!reserve_vertices(dst, num_vertices))
+      return false;
+   for (j = 0; j < NUM_LISTS; j++) {
+      if (!reserve_indices(dst, j, num_indices[j]))
+         return false;
+   }
+
+   for (i = 0; i < _al_vector_size(&geometry->shapes); i++) {
+      s = get_shape(geometry, i);
+      copy_shape(geometry, s);
+      s->dirty = false;
+   }
+
+   dst->num_vertices = num_vertices;
+   for (j = 0; j < NUM_LISTS; j++)
+      dst->num_indices[j] = num_indices[j];
+
+   return true;
+}
+
+
+/*
+ * Updates a shape which changed in place in the combined lists and the
+ * buffers.
+ */
+static void update_shape(ALLEGRO_GEOMETRY* geometry, GEOMETRY_SHAPE* s)
+{
+   GEOMETRY_DATA* src = &geometry->combined;
+   int n = s->data.num_vertices;
+   void* p;
+   int j, m;
+
+   copy_shape(geometry, s);
+   s->dirty = false;
+
+   if (!geometry->vertex_buffer)
+      return;
+
+   if (n > 0) {
+      p = al_lock_vertex_buffer(geometry->vertex_buffer, s->vertex_offset, n, ALLEGRO_LOCK_WRITEONLY);
+      if (!p)
+         goto fail;
+      memcpy(p, src->vertices + s->vertex_offset, n * sizeof(ALLEGRO_VERTEX));
+      al_unlock_vertex_buffer(geometry->vertex_buffer);
+   }
+   for (j = 0; j < NUM_LISTS; j++) {
+      m = s->data.num_indices[j];
+      if (m == 0)
+         continue;
+      p = al_lock_index_buffer(geometry->index_buffers[j], s->index_offset[j], m, ALLEGRO_LOCK_WRITEONLY);
+      if (!p)
+         goto fail;
+      memcpy(p, src->indices[j] + s->index_offset[j], m * sizeof(int));
+      al_unlock_index_buffer(geometry->index_buffers[j]);
+   }
+   return;
+
+fail:
+   /* Upload everything again on the next draw. */
+   destroy_buffers(geometry);
+}
+
+
+static bool create_buffers(ALLEGRO_GEOMETRY* geometry)
+{
+   GEOMETRY_DATA* src = &geometry->combined;
+   int j;
+
+   geometry->vertex_buffer = al_create_vertex_buffer(NULL, src->vertices,
+      src->num_vertices, geometry->flags);
+   if (!geometry->vertex_buffer)
+      return false;
+
+   for (j = 0; j < NUM_LISTS; j++) {
+      if (src->num_indices[j] == 0)
+         continue;
+      geometry->index_buffers[j] = al_create_index_buffer(sizeof(int),
+         src->indices[j], src->num_indices[j], geometry->flags);
+      if (!geometry->index_buffers[j]) {
+         destroy_buffers(geometry);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+
+/* Function: al_draw_geometry
+ */
+void al_draw_geometry(ALLEGRO_GEOMETRY* geometry)
+{
+   ALLEGRO_BITMAP* target = al_get_target_bitmap();
+   GEOMETRY_DATA* src = &geometry->combined;
+   bool use_buffers;
+   unsigned int i;
+   int j;
+
+   ASSERT(geometry);
+   ASSERT(geometry->recording < 0);
+
+   if (geometry->rebuild) {
+      destroy_buffers(geometry);
+      geometry->buffers_failed = false;
+      geometry->rebuild = false;
+      geometry->dirty = false;
+      if (!rebuild(geometry)) {
+         ALLEGRO_ERROR("Out of memory while building geometry.\n");
+         /* Try again next time. */
+         data_reset(src);
+         geometry->rebuild = true;
+         return;
+      }
+   }
+   else if (geometry->dirty) {
+      for (i = 0; i < _al_vector_size(&geometry->shapes); i++) {
+         GEOMETRY_SHAPE* s = get_shape(geometry, i);
+         if (s->dirty)
+            update_shape(geometry, s);
+      }
+      geometry->dirty = false;
+   }
+
+   if (src->num_vertices == 0)
+      return;
+
+   /* Memory bitmaps are drawn by the software renderer, which would have to
+    * read the buffers back.
+    */
+   use_buffers = !(al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP);
+   if (use_buffers && !geometry->vertex_buffer && !geometry->buffers_failed) {
+      if (!create_buffers(geometry)) {
+         ALLEGRO_WARN("Could not create buffers, drawing from memory.\n");
+         geometry->buffers_failed = true;
+      }
+   }
+   use_buffers = use_buffers && geometry->vertex_buffer;
+
+   for (j = 0; j < NUM_LISTS; j++) {
+      int m = src->num_indices[j];
+      if (m == 0)
+         continue;
+      if (use_buffers) {
+         al_draw_indexed_buffer(geometry->vertex_buffer, NULL,
+            geometry->index_buffers[j], 0, m, list_prim_type[j]);
+      }
+      else {
+         al_draw_indexed_prim(src->vertices, NULL, NULL, src->indices[j], m,
+            list_prim_type[j]);
+      }
+   }
+}
+
+/* vim: set sts=3 sw=3 et: */
@@ -31,6 +31,46 @@ The vertex cache allows for bulk transformation of vertices, for faster run spee
 */
 #define LOCAL_VERTEX_CACHE  ALLEGRO_VERTEX vertex_cache[ALLEGRO_VERTEX_CACHE_SIZE]
 
+/*
+Triangles are collected and drawn in batches, so that the rasterizer can
+look up the blender and lock the target once per batch, and split big
+batches over several threads. The batch lives on the stack and is drawn
+whenever it fills up
+*/
+#define TRIANGLE_BATCH_SIZE  ALLEGRO_VERTEX_CACHE_SIZE
+
+typedef struct TRIANGLE_BATCH {
+   ALLEGRO_BITMAP* texture;
+   ALLEGRO_VERTEX vtxs[3 * TRIANGLE_BATCH_SIZE];
+   int count;
+} TRIANGLE_BATCH;
+
+static void begin_triangles(TRIANGLE_BATCH* batch, ALLEGRO_BITMAP* texture)
+{
+   batch->texture = texture;
+   batch->count = 0;
+}
+
+static void draw_triangles(TRIANGLE_BATCH* batch)
+{
+   if (batch->count == 0)
+      return;
+   _al_triangles_2d(batch->texture, batch->vtxs, batch->count);
+   batch->count = 0;
+}
+
+static void add_triangle(TRIANGLE_BATCH* batch, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3)
+{
+   ALLEGRO_VERTEX* v;
+   if (batch->count == TRIANGLE_BATCH_SIZE)
+      draw_triangles(batch);
+   v = &batch->vtxs[batch->count * 3];
+   v[0] = *v1;
+   v[1] = *v2;
+   v[2] = *v3;
+   batch->count++;
+}
+
 static void convert_vtx(ALLEGRO_BITMAP* texture, const char* src, ALLEGRO_VERTEX* dest, const ALLEGRO_VERTEX_DECL* decl)
 {
    ALLEGRO_VERTEX_ELEMENT* e;
@@ -103,6 +143,7 @@ static void convert_vtx(ALLEGRO_BITMAP* texture, const char* src, ALLEGRO_VERTEX
 int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, int start, int end, int type)
 {
    LOCAL_VERTEX_CACHE;
+   TRIANGLE_BATCH triangles;
    int num_primitives;
    int num_vtx;
    int use_cache;
@@ -110,6 +151,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
    const ALLEGRO_TRANSFORM* global_trans = al_get_current_transform();
    
    num_primitives = 0;
+   begin_triangles(&triangles, texture);
    num_vtx = end - start;
    use_cache = num_vtx < ALLEGRO_VERTEX_CACHE_SIZE;
 
@@ -199,7 +241,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
          if (use_cache) {
             int ii;
             for (ii = 0; ii < num_vtx - 2; ii += 3) {
-               _al_triangle_2d(texture, &vertex_cache[ii], &vertex_cache[ii + 1], &vertex_cache[ii + 2]);
+               add_triangle(&triangles, &vertex_cache[ii], &vertex_cache[ii + 1], &vertex_cache[ii + 2]);
             }
          } else {
             int ii;
@@ -209,7 +251,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
                SET_VERTEX(v2, ii + 1);
                SET_VERTEX(v3, ii + 2);
                
-               _al_triangle_2d(texture, &v1, &v2, &v3);
+               add_triangle(&triangles, &v1, &v2, &v3);
             }
          }
          num_primitives = num_vtx / 3;
@@ -219,7 +261,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
          if (use_cache) {
             int ii;
             for (ii = 2; ii < num_vtx; ii++) {
-               _al_triangle_2d(texture, &vertex_cache[ii - 2], &vertex_cache[ii - 1], &vertex_cache[ii]);
+               add_triangle(&triangles, &vertex_cache[ii - 2], &vertex_cache[ii - 1], &vertex_cache[ii]);
             }
          } else {
             int ii;
@@ -230,7 +272,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
             for (ii = start + 2; ii < end; ii++) {
                SET_VERTEX(vtx[idx], ii);
                
-               _al_triangle_2d(texture, &vtx[0], &vtx[1], &vtx[2]);
+               add_triangle(&triangles, &vtx[0], &vtx[1], &vtx[2]);
                idx = (idx + 1) % 3;
             }
          }
@@ -241,7 +283,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
          if (use_cache) {
             int ii;
             for (ii = 1; ii < num_vtx; ii++) {
-               _al_triangle_2d(texture, &vertex_cache[0], &vertex_cache[ii], &vertex_cache[ii - 1]);
+               add_triangle(&triangles, &vertex_cache[0], &vertex_cache[ii], &vertex_cache[ii - 1]);
             }
          } else {
             int ii;
@@ -252,7 +294,7 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
             SET_VERTEX(vtx[0], start + 1);
             for (ii = start + 1; ii < end; ii++) {
                SET_VERTEX(vtx[idx], ii)
-               _al_triangle_2d(texture, &v0, &vtx[0], &vtx[1]);
+               add_triangle(&triangles, &v0, &vtx[0], &vtx[1]);
                idx = 1 - idx;
             }
          }
@@ -278,6 +320,8 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
          break;
       };
    }
+
+   draw_triangles(&triangles);
    
    if(texture)
        al_unlock_bitmap(texture);
@@ -290,6 +334,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
    const int* indices, int num_vtx, int type)
 {
    LOCAL_VERTEX_CACHE;
+   TRIANGLE_BATCH triangles;
    int num_primitives;
    int use_cache;
    int min_idx, max_idx;
@@ -298,6 +343,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
    const ALLEGRO_TRANSFORM* global_trans = al_get_current_transform();
 
    num_primitives = 0;   
+   begin_triangles(&triangles, texture);
    use_cache = 1;
    min_idx = indices[0];
    max_idx = indices[0];
@@ -419,7 +465,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                int idx1 = indices[ii] - min_idx;
                int idx2 = indices[ii + 1] - min_idx;
                int idx3 = indices[ii + 2] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
+               add_triangle(&triangles, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
             }
          } else {
             int ii;
@@ -433,7 +479,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                SET_VERTEX(v2, idx2);
                SET_VERTEX(v3, idx3);
                
-               _al_triangle_2d(texture, &v1, &v2, &v3);
+               add_triangle(&triangles, &v1, &v2, &v3);
             }
          }
          num_primitives = num_vtx / 3;
@@ -446,7 +492,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                int idx1 = indices[ii - 2] - min_idx;
                int idx2 = indices[ii - 1] - min_idx;
                int idx3 = indices[ii] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
+               add_triangle(&triangles, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
             }
          } else {
             int ii;
@@ -457,7 +503,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
             for (ii = 2; ii < num_vtx; ii ++) {
                SET_VERTEX(vtx[idx], indices[ii]);
                
-               _al_triangle_2d(texture, &vtx[0], &vtx[1], &vtx[2]);
+               add_triangle(&triangles, &vtx[0], &vtx[1], &vtx[2]);
                idx = (idx + 1) % 3;
             }
          }
@@ -471,7 +517,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
             for (ii = 1; ii < num_vtx; ii++) {
                int idx1 = indices[ii] - min_idx;
                int idx2 = indices[ii - 1] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx0], &vertex_cache[idx1], &vertex_cache[idx2]);
+               add_triangle(&triangles, &vertex_cache[idx0], &vertex_cache[idx1], &vertex_cache[idx2]);
             }
          } else {
             int ii;
@@ -482,7 +528,7 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
             SET_VERTEX(vtx[0], indices[1]);
             for (ii = 2; ii < num_vtx; ii ++) {
                SET_VERTEX(vtx[idx], indices[ii])
-               _al_triangle_2d(texture, &v0, &vtx[0], &vtx[1]);
+               add_triangle(&triangles, &v0, &vtx[0], &vtx[1]);
                idx = 1 - idx;
             }
          }
@@ -510,6 +556,8 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
       };
    }
 
+   draw_triangles(&triangles);
+
    if(texture)
        al_unlock_bitmap(texture);
    
@@ -249,3 +249,26 @@ void _al_prim_cache_push_point(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* v)
    ++cache->current;
    ++cache->size;
 }
+
+/*
+ * Returns at least size bytes of scratch memory. The previous contents are
+ * not preserved when the memory has to grow.
+ */
+void* _al_prim_scratch_reserve(_AL_PRIM_SCRATCH* scratch, size_t size)
+{
+   if (scratch->size < size) {
+      al_free(scratch->data);
+      /* Leave some headroom so slowly growing inputs don't reallocate every time. */
+      size += size / 2;
+      scratch->data = al_malloc(size);
+      scratch->size = scratch->data ? size : 0;
+   }
+   return scratch->data;
+}
+
+void _al_prim_scratch_free(_AL_PRIM_SCRATCH* scratch)
+{
+   al_free(scratch->data);
+   scratch->data = NULL;
+   scratch->size = 0;
+}
@@ -47,6 +47,8 @@ bool al_init_primitives_addon(void)
 {
    bool ret = true;
    ret &= _al_init_d3d_driver();
+   _al_prim_init_triangulator();
+   _al_prim_init_geometry();
    
    addon_initialized = ret;
    
@@ -60,6 +62,8 @@ bool al_init_primitives_addon(void)
 void al_shutdown_primitives_addon(void)
 {
    _al_shutdown_d3d_driver();
+   _al_prim_shutdown_triangulator();
+   _al_prim_shutdown_geometry();
    addon_initialized = false;
 }
 
@@ -79,6 +83,11 @@ int al_draw_prim(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
 
    target = al_get_target_bitmap();
 
+   ret = _al_prim_record_geometry(target, vtxs, decl, texture, NULL, start, end, type);
+   if (ret >= 0)
+      return ret;
+   ret = 0;
+
    /* In theory, if we ever get a camera concept for this addon, the transformation into
     * view space should occur here
     */
@@ -114,6 +123,11 @@ int al_draw_indexed_prim(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
    ASSERT(type >= 0 && type < ALLEGRO_PRIM_NUM_TYPES);
 
    target = al_get_target_bitmap();
+
+   ret = _al_prim_record_geometry(target, vtxs, decl, texture, indices, 0, num_vtx, type);
+   if (ret >= 0)
+      return ret;
+   ret = 0;
    
    /* In theory, if we ever get a camera concept for this addon, the transformation into
     * view space should occur here
@@ -808,10 +808,11 @@ static void poly_do_triangulate(POLY* polygon)
 }
 
 
-/* Function: al_triangulate_polygon
- *  General triangulation function.
+/*
+ *  Ear clipping triangulation, O(n^2). Used for polygons the monotone
+ *  decomposition rejects.
  */
-bool al_triangulate_polygon(
+static bool poly_triangulate_ear_clip(
    const float* vertices, size_t vertex_stride, const int* vertex_counts,
    void (*emit_triangle)(int, int, int, void*), void* userdata)
 {
@@ -867,4 +868,211 @@ bool al_triangulate_polygon(
    return ret;
 }
 
+
+/* Scratch memory shared by all triangulations. A thread takes it out of the
+ * slot while triangulating, so concurrent callers get their own temporary
+ * scratch memory instead.
+ */
+#define MAX_SHARED_SCRATCH    (16 * 1024 * 1024)
+
+static ALLEGRO_MUTEX*     scratch_mutex  = NULL;
+static _AL_PRIM_SCRATCH*  shared_scratch = NULL;
+
+
+void _al_prim_init_triangulator(void)
+{
+   if (!scratch_mutex)
+      scratch_mutex = al_create_mutex();
+}
+
+
+void _al_prim_shutdown_triangulator(void)
+{
+   if (shared_scratch) {
+      _al_prim_scratch_free(shared_scratch);
+      al_free(shared_scratch);
+      shared_scratch = NULL;
+   }
+   al_destroy_mutex(scratch_mutex);
+   scratch_mutex = NULL;
+}
+
+
+static _AL_PRIM_SCRATCH* poly_acquire_scratch(void)
+{
+   _AL_PRIM_SCRATCH* scratch = NULL;
+
+   if (scratch_mutex) {
+      al_lock_mutex(scratch_mutex);
+      scratch = shared_scratch;
+      shared_scratch = NULL;
+      al_unlock_mutex(scratch_mutex);
+   }
+
+   if (!scratch)
+      scratch = al_calloc(1, sizeof(*scratch));
+
+   return scratch;
+}
+
+
+static void poly_release_scratch(_AL_PRIM_SCRATCH* scratch)
+{
+   /* Don't hold on to the memory of an unusually large polygon. */
+   if (scratch_mutex && scratch->size <= MAX_SHARED_SCRATCH) {
+      al_lock_mutex(scratch_mutex);
+      if (!shared_scratch) {
+         shared_scratch = scratch;
+         scratch = NULL;
+      }
+      al_unlock_mutex(scratch_mutex);
+   }
+
+   if (scratch) {
+      _al_prim_scratch_free(scratch);
+      al_free(scratch);
+   }
+}
+
+
+/* Polygons with fewer vertices are ear clipped. The sweep of the monotone
+ * triangulator leaves long thin diagonals, along which the software
+ * rasterizer blends some pixels twice, so translucent fills of the small
+ * polygons drawn most often look as they always did.
+ */
+#define MIN_MONOTONE_VERTICES    256
+
+
+/* Function: al_triangulate_polygon
+ *  General triangulation function.
+ */
+bool al_triangulate_polygon(
+   const float* vertices, size_t vertex_stride, const int* vertex_counts,
+   void (*emit_triangle)(int, int, int, void*), void* userdata)
+{
+   _AL_PRIM_SCRATCH* scratch;
+   int* indices;
+   int num_triangles;
+   int vertex_count;
+   int i;
+
+   ASSERT(vertices);
+   ASSERT(vertex_counts);
+   ASSERT(emit_triangle);
+
+   vertex_count = 0;
+   for (i = 0; vertex_counts[i] > 0; i++)
+      vertex_count += vertex_counts[i];
+   if (vertex_count < MIN_MONOTONE_VERTICES) {
+      return poly_triangulate_ear_clip(vertices, vertex_stride,
+         vertex_counts, emit_triangle, userdata);
+   }
+
+   scratch = poly_acquire_scratch();
+   if (!scratch)
+      return false;
+
+   num_triangles = _al_prim_triangulate_monotone(vertices, vertex_stride,
+      vertex_counts, scratch, &indices);
+   if (num_triangles >= 0) {
+      for (i = 0; i < num_triangles; i++)
+         emit_triangle(indices[i * 3 + 0], indices[i * 3 + 1], indices[i * 3 + 2], userdata);
+      poly_release_scratch(scratch);
+      return true;
+   }
+   poly_release_scratch(scratch);
+
+   return poly_triangulate_ear_clip(vertices, vertex_stride, vertex_counts,
+      emit_triangle, userdata);
+}
+
+
+typedef struct POLY_INDEX_BUFFER {
+   int* indices;
+   int  count;
+   int  max_count;
+} POLY_INDEX_BUFFER;
+
+
+static void poly_emit_index_triangle(int a, int b, int c, void* userdata)
+{
+   POLY_INDEX_BUFFER* buffer = (POLY_INDEX_BUFFER*)userdata;
+
+   if (buffer->count + 3 > buffer->max_count)
+      return;
+
+   buffer->indices[buffer->count++] = a;
+   buffer->indices[buffer->count++] = b;
+   buffer->indices[buffer->count++] = c;
+}
+
+
+/* Function: al_triangulate_polygon_indices
+ */
+int* al_triangulate_polygon_indices(
+   const float* vertices, size_t vertex_stride, const int* vertex_counts,
+   int* num_indices)
+{
+   _AL_PRIM_SCRATCH* scratch;
+   POLY_INDEX_BUFFER buffer;
+   int* indices;
+   int num_triangles;
+   int vertex_count;
+   int split_count;
+
+   ASSERT(vertices);
+   ASSERT(vertex_counts);
+   ASSERT(num_indices);
+
+   *num_indices = 0;
+
+   vertex_count = 0;
+   for (split_count = 0; vertex_counts[split_count] > 0; split_count++)
+      vertex_count += vertex_counts[split_count];
+   ASSERT(split_count > 0);
+   if (vertex_count < 3)
+      return NULL;
+
+   scratch = poly_acquire_scratch();
+   if (!scratch)
+      return NULL;
+
+   /* The monotone triangulator reports how many triangles it made, so the
+    * result is allocated after it has run.
+    */
+   num_triangles = _al_prim_triangulate_monotone(vertices, vertex_stride,
+      vertex_counts, scratch, &indices);
+   if (num_triangles >= 0) {
+      buffer.count = num_triangles * 3;
+      /* Never ask for zero bytes, NULL means failure. */
+      buffer.indices = al_malloc((buffer.count + 1) * sizeof(int));
+      if (buffer.indices)
+         memcpy(buffer.indices, indices, buffer.count * sizeof(int));
+      poly_release_scratch(scratch);
+      if (!buffer.indices)
+         return NULL;
+      *num_indices = buffer.count;
+      return buffer.indices;
+   }
+   poly_release_scratch(scratch);
+
+   /* A polygon with h holes has n + 2h - 2 triangles. The ear clipper
+    * drops any triangle past that.
+    */
+   buffer.max_count = 3 * (vertex_count + 2 * (split_count - 1) - 2);
+   buffer.count = 0;
+   buffer.indices = al_malloc(buffer.max_count * sizeof(int));
+   if (!buffer.indices)
+      return NULL;
+
+   if (!poly_triangulate_ear_clip(vertices, vertex_stride, vertex_counts,
+         poly_emit_index_triangle, &buffer)) {
+      al_free(buffer.indices);
+      return NULL;
+   }
+
+   *num_indices = buffer.count;
+   return buffer.indices;
+}
+
 /* vim: set sts=3 sw=3 et: */
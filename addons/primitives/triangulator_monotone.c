@@ -0,0 +1,701 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Polygon triangulation by monotone decomposition.
+ *
+ *      A sweep line from top to bottom splits the polygon, holes included,
+ *      into y-monotone pieces which are then triangulated in linear time.
+ *      This is O(n log n) overall. See "Computational Geometry: Algorithms
+ *      and Applications" by de Berg et al., chapter 3.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_primitives.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_prim.h"
+
+
+enum {
+   VERTEX_START,
+   VERTEX_END,
+   VERTEX_SPLIT,
+   VERTEX_MERGE,
+   VERTEX_REGULAR
+};
+
+
+typedef struct SWEEP_KEY {
+   float y, x;
+   int index;
+} SWEEP_KEY;
+
+
+/* All arrays live in the scratch arena. Vertex and boundary edge indices
+ * are the same: edge v goes from v to next[v]. Boundary half-edges use the
+ * same numbering, diagonals are appended after them.
+ */
+typedef struct MONOTONE {
+   int n;
+   bool flipped;        /* outline was given clockwise */
+   float *pt;           /* packed x, y pairs */
+   int *next, *prev;
+   int *rank;           /* position in sweep order, 0 is the topmost */
+   int *helper;
+
+   /* Status structure: a treap of the edges crossing the sweep line, from
+    * left to right. Node i holds edge i.
+    */
+   int root;
+   int *left, *right, *parent;
+   unsigned *prio;
+   char *in_tree;
+
+   /* Half-edge structure for splitting the polygon. */
+   int num_he, max_he;
+   int *he_origin, *he_next, *he_prev;
+   int *out_head, *out_next;
+
+   int *indices;
+   int num_triangles;
+   int max_triangles;
+} MONOTONE;
+
+
+#define X(m, v)   ((double)(m)->pt[(v) * 2])
+#define Y(m, v)   ((double)(m)->pt[(v) * 2 + 1])
+#define ABOVE(m, a, b)  ((m)->rank[a] < (m)->rank[b])
+
+
+/* Twice the signed area of the triangle, positive if counter-clockwise
+ * with the y-axis pointing up.
+ */
+static double orient(const MONOTONE *m, int a, int b, int c)
+{
+   return (X(m, b) - X(m, a)) * (Y(m, c) - Y(m, a)) -
+      (Y(m, b) - Y(m, a)) * (X(m, c) - X(m, a));
+}
+
+
+static int sweep_key_compare(const void *pa, const void *pb)
+{
+   const SWEEP_KEY *a = pa;
+   const SWEEP_KEY *b = pb;
+
+   if (a->y != b->y)
+      return a->y > b->y ? -1 : 1;
+   if (a->x != b->x)
+      return a->x < b->x ? -1 : 1;
+   return a->index - b->index;
+}
+
+
+/* Carves aligned arrays out of the scratch arena. */
+static void *take(char **p, size_t size)
+{
+   void *ptr = *p;
+   *p += (size + 15) & ~(size_t)15;
+   return ptr;
+}
+
+
+/*
+ *  Status structure.
+ */
+
+
+/* Whether edge e, which goes downwards, passes to the left of vertex v. */
+static bool edge_left_of(const MONOTONE *m, int e, int v)
+{
+   int l = m->next[e];
+   double o = orient(m, e, l, v);
+
+   if (o != 0)
+      return o > 0;
+   return X(m, v) > X(m, e) && X(m, v) > X(m, l);
+}
+
+
+static void rotate_up(MONOTONE *m, int k)
+{
+   int p = m->parent[k];
+   int g = m->parent[p];
+
+   if (m->left[p] == k) {
+      m->left[p] = m->right[k];
+      if (m->right[k] >= 0)
+         m->parent[m->right[k]] = p;
+      m->right[k] = p;
+   }
+   else {
+      m->right[p] = m->left[k];
+      if (m->left[k] >= 0)
+         m->parent[m->left[k]] = p;
+      m->left[k] = p;
+   }
+   m->parent[p] = k;
+   m->parent[k] = g;
+
+   if (g < 0)
+      m->root = k;
+   else if (m->left[g] == p)
+      m->left[g] = k;
+   else
+      m->right[g] = k;
+}
+
+
+static void tree_insert(MONOTONE *m, int e)
+{
+   int cur = m->root;
+   int par = -1;
+   bool go_right = false;
+
+   while (cur >= 0) {
+      par = cur;
+      go_right = edge_left_of(m, cur, e);
+      cur = go_right ? m->right[cur] : m->left[cur];
+   }
+
+   m->left[e] = m->right[e] = -1;
+   m->parent[e] = par;
+   m->in_tree[e] = true;
+   if (par < 0)
+      m->root = e;
+   else if (go_right)
+      m->right[par] = e;
+   else
+      m->left[par] = e;
+
+   while (m->parent[e] >= 0 && m->prio[e] > m->prio[m->parent[e]])
+      rotate_up(m, e);
+}
+
+
+static void tree_remove(MONOTONE *m, int e)
+{
+   int p;
+
+   while (m->left[e] >= 0 || m->right[e] >= 0) {
+      int l = m->left[e];
+      int r = m->right[e];
+      if (l < 0 || (r >= 0 && m->prio[r] > m->prio[l]))
+         rotate_up(m, r);
+      else
+         rotate_up(m, l);
+   }
+
+   p = m->parent[e];
+   if (p < 0)
+      m->root = -1;
+   else if (m->left[p] == e)
+      m->left[p] = -1;
+   else
+      m->right[p] = -1;
+   m->in_tree[e] = false;
+}
+
+
+/* Returns the edge directly to the left of vertex v, or -1. */
+static int tree_find_left(const MONOTONE *m, int v)
+{
+   int cur = m->root;
+   int best = -1;
+
+   while (cur >= 0) {
+      if (edge_left_of(m, cur, v)) {
+         best = cur;
+         cur = m->right[cur];
+      }
+      else {
+         cur = m->left[cur];
+      }
+   }
+
+   return best;
+}
+
+
+/*
+ *  Half-edge structure.
+ */
+
+
+/* Whether the direction from a to b lies inside the corner of the face to
+ * the left of half-edge h, which starts at a.
+ */
+static bool in_corner(const MONOTONE *m, int h, int b)
+{
+   int a = m->he_origin[h];
+   int u = m->he_origin[m->he_next[h]];
+   int w = m->he_origin[m->he_prev[h]];
+
+   if (orient(m, a, u, w) > 0)
+      return orient(m, a, u, b) > 0 && orient(m, a, b, w) > 0;
+   return orient(m, a, u, b) > 0 || orient(m, a, b, w) > 0;
+}
+
+
+static int find_corner(const MONOTONE *m, int a, int b)
+{
+   int h = m->out_head[a];
+
+   if (m->out_next[h] < 0)
+      return h;
+
+   for (; h >= 0; h = m->out_next[h]) {
+      if (in_corner(m, h, b))
+         return h;
+   }
+
+   return -1;
+}
+
+
+static bool add_diagonal(MONOTONE *m, int a, int b)
+{
+   int ha, hb, pa, pb, d1, d2;
+
+   if (m->num_he + 2 > m->max_he)
+      return false;
+
+   ha = find_corner(m, a, b);
+   hb = find_corner(m, b, a);
+   if (ha < 0 || hb < 0)
+      return false;
+
+   d1 = m->num_he++;
+   d2 = m->num_he++;
+   pa = m->he_prev[ha];
+   pb = m->he_prev[hb];
+
+   m->he_origin[d1] = a;
+   m->he_origin[d2] = b;
+
+   m->he_next[pa] = d1;
+   m->he_prev[d1] = pa;
+   m->he_next[d1] = hb;
+   m->he_prev[hb] = d1;
+
+   m->he_next[pb] = d2;
+   m->he_prev[d2] = pb;
+   m->he_next[d2] = ha;
+   m->he_prev[ha] = d2;
+
+   m->out_next[d1] = m->out_head[a];
+   m->out_head[a] = d1;
+   m->out_next[d2] = m->out_head[b];
+   m->out_head[b] = d2;
+
+   return true;
+}
+
+
+/*
+ *  Monotone decomposition.
+ */
+
+
+static int classify(const MONOTONE *m, int v)
+{
+   int p = m->prev[v];
+   int n = m->next[v];
+   bool convex = orient(m, p, v, n) > 0;
+
+   if (ABOVE(m, v, p) && ABOVE(m, v, n))
+      return convex ? VERTEX_START : VERTEX_SPLIT;
+   if (ABOVE(m, p, v) && ABOVE(m, n, v))
+      return convex ? VERTEX_END : VERTEX_MERGE;
+   return VERTEX_REGULAR;
+}
+
+
+/* Connects v to the helper of edge e if that is a merge vertex. */
+static bool fix_up(MONOTONE *m, int v, int e, const char *types)
+{
+   int h = m->helper[e];
+
+   if (types[h] == VERTEX_MERGE)
+      return add_diagonal(m, v, h);
+   return true;
+}
+
+
+static bool sweep(MONOTONE *m, const int *order, const char *types)
+{
+   int i;
+
+   for (i = 0; i < m->n; i++) {
+      int v = order[i];
+      int p = m->prev[v];
+      int e;
+
+      switch (types[v]) {
+         case VERTEX_START:
+            tree_insert(m, v);
+            m->helper[v] = v;
+            break;
+
+         case VERTEX_END:
+            if (!m->in_tree[p] || !fix_up(m, v, p, types))
+               return false;
+            tree_remove(m, p);
+            break;
+
+         case VERTEX_SPLIT:
+            e = tree_find_left(m, v);
+            if (e < 0 || !add_diagonal(m, v, m->helper[e]))
+               return false;
+            m->helper[e] = v;
+            tree_insert(m, v);
+            m->helper[v] = v;
+            break;
+
+         case VERTEX_MERGE:
+            if (!m->in_tree[p] || !fix_up(m, v, p, types))
+               return false;
+            tree_remove(m, p);
+            e = tree_find_left(m, v);
+            if (e < 0 || !fix_up(m, v, e, types))
+               return false;
+            m->helper[e] = v;
+            break;
+
+         default:
+            if (ABOVE(m, p, v)) {
+               /* The interior lies to the right of v. */
+               if (!m->in_tree[p] || !fix_up(m, v, p, types))
+                  return false;
+               tree_remove(m, p);
+               tree_insert(m, v);
+               m->helper[v] = v;
+            }
+            else {
+               e = tree_find_left(m, v);
+               if (e < 0 || !fix_up(m, v, e, types))
+                  return false;
+               m->helper[e] = v;
+            }
+            break;
+      }
+   }
+
+   return true;
+}
+
+
+/*
+ *  Triangulation of the monotone pieces.
+ */
+
+
+static void emit(MONOTONE *m, int a, int b, int c)
+{
+   int *out;
+   double o = orient(m, a, b, c);
+
+   if (m->num_triangles == m->max_triangles)
+      return;
+   out = m->indices + m->num_triangles * 3;
+
+   /* Keep the winding of the input. */
+   if ((o < 0) != m->flipped) {
+      int t = b;
+      b = c;
+      c = t;
+   }
+
+   out[0] = a;
+   out[1] = b;
+   out[2] = c;
+   m->num_triangles++;
+}
+
+
+/* Triangulates a y-monotone face given counter-clockwise. Uses sorted and
+ * stack as temporary storage, both as large as the face.
+ */
+static bool triangulate_face(MONOTONE *m, const int *face, int k,
+   int *sorted, char *on_left, int *stack)
+{
+   int top = 0, bottom = 0;
+   int i, j, l, r, sp;
+
+   /* A monotone piece always gives k - 2 triangles. */
+   if (m->num_triangles + k - 2 > m->max_triangles)
+      return false;
+
+   if (k == 3) {
+      emit(m, face[0], face[1], face[2]);
+      return true;
+   }
+
+   for (i = 1; i < k; i++) {
+      if (ABOVE(m, face[i], face[top]))
+         top = i;
+      if (ABOVE(m, face[bottom], face[i]))
+         bottom = i;
+   }
+
+   /* Merge the two chains into sweep order. Going forward from the top
+    * follows the left chain down, going backward the right one.
+    */
+   sorted[0] = face[top];
+   on_left[0] = true;
+   l = (top + 1) % k;
+   r = (top + k - 1) % k;
+   for (i = 1; i < k - 1; i++) {
+      if (l != bottom && (r == bottom || ABOVE(m, face[l], face[r]))) {
+         sorted[i] = face[l];
+         on_left[i] = true;
+         l = (l + 1) % k;
+      }
+      else {
+         sorted[i] = face[r];
+         on_left[i] = false;
+         r = (r + k - 1) % k;
+      }
+   }
+   sorted[k - 1] = face[bottom];
+   on_left[k - 1] = true;
+
+   for (i = 1; i < k; i++) {
+      if (!ABOVE(m, sorted[i - 1], sorted[i]))
+         return false;
+   }
+
+   stack[0] = 0;
+   stack[1] = 1;
+   sp = 2;
+   for (j = 2; j < k - 1; j++) {
+      int u = sorted[j];
+
+      if (on_left[j] != on_left[stack[sp - 1]]) {
+         while (sp > 1) {
+            emit(m, u, sorted[stack[sp - 1]], sorted[stack[sp - 2]]);
+            sp--;
+         }
+         stack[0] = j - 1;
+         stack[1] = j;
+         sp = 2;
+      }
+      else {
+         int last = stack[--sp];
+         while (sp > 0) {
+            int s = sorted[stack[sp - 1]];
+            double o = on_left[j] ?
+               orient(m, s, sorted[last], u) : orient(m, u, sorted[last], s);
+            if (o <= 0)
+               break;
+            emit(m, u, sorted[last], s);
+            last = stack[--sp];
+         }
+         stack[sp++] = last;
+         stack[sp++] = j;
+      }
+   }
+
+   while (sp > 1) {
+      emit(m, sorted[k - 1], sorted[stack[sp - 1]], sorted[stack[sp - 2]]);
+      sp--;
+   }
+
+   return true;
+}
+
+
+static bool triangulate_faces(MONOTONE *m, char *visited, int *face,
+   int *sorted, char *on_left, int *stack)
+{
+   int h;
+
+   memset(visited, 0, m->num_he);
+
+   for (h = 0; h < m->num_he; h++) {
+      int k = 0;
+      int g;
+
+      if (visited[h])
+         continue;
+
+      for (g = h; !visited[g]; g = m->he_next[g]) {
+         visited[g] = true;
+         if (k == m->n)
+            return false;
+         face[k++] = m->he_origin[g];
+      }
+      if (g != h || k < 3)
+         return false;
+
+      if (!triangulate_face(m, face, k, sorted, on_left, stack))
+         return false;
+   }
+
+   return true;
+}
+
+
+/* Internal function: _al_prim_triangulate_monotone
+ *
+ *  Triangulates a polygon with holes. The outline and the holes may use
+ *  either winding, the triangles get the winding of the outline. *indices
+ *  is pointed at the triangle indices, stored in the scratch memory.
+ *  Returns the number of triangles, or -1 if the input is degenerate in a
+ *  way this method cannot handle.
+ */
+int _al_prim_triangulate_monotone(const float *vertices, size_t vertex_stride,
+   const int *vertex_counts, _AL_PRIM_SCRATCH *scratch, int **indices)
+{
+   MONOTONE m;
+   SWEEP_KEY *keys;
+   int *order, *face, *sorted, *stack;
+   char *types, *visited, *on_left;
+   char *p;
+   int num_loops, n, begin, i, j;
+   size_t size;
+   unsigned seed = 0x9E3779B9;
+
+   n = 0;
+   for (num_loops = 0; vertex_counts[num_loops] > 0; num_loops++) {
+      if (vertex_counts[num_loops] < 3)
+         return -1;
+      n += vertex_counts[num_loops];
+   }
+   if (num_loops == 0)
+      return -1;
+
+   memset(&m, 0, sizeof(m));
+   m.n = n;
+   m.max_he = 5 * n;
+   m.max_triangles = n + 2 * (num_loops - 1) - 2;
+   m.root = -1;
+
+   size = m.max_triangles * 3 * sizeof(int);
+   size += n * (sizeof(float) * 2 + sizeof(SWEEP_KEY) + 16 * sizeof(int)) +
+      m.max_he * (4 * sizeof(int) + 1) + n * 4 + 16 * 32;
+   p = _al_prim_scratch_reserve(scratch, size);
+   if (!p)
+      return -1;
+
+   m.indices = take(&p, m.max_triangles * 3 * sizeof(int));
+   m.pt = take(&p, n * sizeof(float) * 2);
+   keys = take(&p, n * sizeof(SWEEP_KEY));
+   m.next = take(&p, n * sizeof(int));
+   m.prev = take(&p, n * sizeof(int));
+   m.rank = take(&p, n * sizeof(int));
+   m.helper = take(&p, n * sizeof(int));
+   m.left = take(&p, n * sizeof(int));
+   m.right = take(&p, n * sizeof(int));
+   m.parent = take(&p, n * sizeof(int));
+   m.prio = take(&p, n * sizeof(unsigned));
+   m.in_tree = take(&p, n);
+   m.out_head = take(&p, n * sizeof(int));
+   order = take(&p, n * sizeof(int));
+   types = take(&p, n);
+   m.he_origin = take(&p, m.max_he * sizeof(int));
+   m.he_next = take(&p, m.max_he * sizeof(int));
+   m.he_prev = take(&p, m.max_he * sizeof(int));
+   m.out_next = take(&p, m.max_he * sizeof(int));
+   visited = take(&p, m.max_he);
+   face = take(&p, n * sizeof(int));
+   sorted = take(&p, n * sizeof(int));
+   stack = take(&p, n * sizeof(int));
+   on_left = take(&p, n);
+
+   /* Pack the coordinates and link up the loops, all of them with the
+    * interior on their left when the y-axis points up. Holes are the
+    * other way around.
+    */
+   begin = 0;
+   for (i = 0; i < num_loops; i++) {
+      int count = vertex_counts[i];
+      double area = 0;
+      bool reverse;
+
+      for (j = 0; j < count; j++) {
+         const float *v = (const float *)((const char *)vertices +
+            (begin + j) * vertex_stride);
+         m.pt[(begin + j) * 2] = v[0];
+         m.pt[(begin + j) * 2 + 1] = v[1];
+      }
+      for (j = 0; j < count; j++) {
+         int a = begin + j;
+         int b = begin + (j + 1) % count;
+         area += X(&m, a) * Y(&m, b) - X(&m, b) * Y(&m, a);
+      }
+      if (area == 0)
+         return -1;
+
+      reverse = (i == 0) ? (area < 0) : (area > 0);
+      if (i == 0)
+         m.flipped = reverse;
+      for (j = 0; j < count; j++) {
+         int a = begin + j;
+         int b = begin + (j + 1) % count;
+         if (reverse) {
+            m.next[b] = a;
+            m.prev[a] = b;
+         }
+         else {
+            m.next[a] = b;
+            m.prev[b] = a;
+         }
+      }
+      begin += count;
+   }
+
+   for (i = 0; i < n; i++) {
+      keys[i].x = m.pt[i * 2];
+      keys[i].y = m.pt[i * 2 + 1];
+      keys[i].index = i;
+   }
+   qsort(keys, n, sizeof(SWEEP_KEY), sweep_key_compare);
+   for (i = 0; i < n; i++) {
+      order[i] = keys[i].index;
+      m.rank[keys[i].index] = i;
+   }
+
+   for (i = 0; i < n; i++) {
+      types[i] = classify(&m, i);
+      m.in_tree[i] = false;
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      m.prio[i] = seed;
+
+      m.he_origin[i] = i;
+      m.he_next[i] = m.next[i];
+      m.he_prev[i] = m.prev[i];
+      m.out_head[i] = i;
+      m.out_next[i] = -1;
+   }
+   m.num_he = n;
+
+   if (!sweep(&m, order, types))
+      return -1;
+
+   if (!triangulate_faces(&m, visited, face, sorted, on_left, stack))
+      return -1;
+
+   /* Anything else means the pieces overlapped or were not monotone. */
+   if (m.num_triangles != m.max_triangles)
+      return -1;
+
+   *indices = m.indices;
+   return m.num_triangles;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -42,6 +42,14 @@ ALLEGRO_TTF_FUNC(bool, al_init_ttf_addon, (void));
 ALLEGRO_TTF_FUNC(void, al_shutdown_ttf_addon, (void));
 ALLEGRO_TTF_FUNC(uint32_t, al_get_allegro_ttf_version, (void));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE)
+#define ALLEGRO_TTF_DISTANCE_FIELD 8
+
+ALLEGRO_TTF_FUNC(ALLEGRO_LOAD_REQUEST *, al_load_ttf_font_async, (ALLEGRO_LOADER *loader, char const *filename, int size, int flags, int priority));
+ALLEGRO_TTF_FUNC(bool, al_cache_ttf_glyphs, (ALLEGRO_FONT * const *fonts, int num_fonts, int ranges_n, const int ranges[]));
+ALLEGRO_TTF_FUNC(ALLEGRO_FONT *, al_derive_ttf_font, (ALLEGRO_FONT *font, int size));
+#endif
+
 #ifdef __cplusplus
    }
 #endif
@@ -5,6 +5,8 @@
 #include "allegro5/allegro_opengl.h"
 #endif
 #include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_display.h"
 #include "allegro5/internal/aintern_vector.h"
 
 #include "allegro5/allegro_ttf.h"
@@ -16,6 +18,9 @@
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
+#include <float.h>
+#include <limits.h>
+#include <math.h>
 #include <stdlib.h>
 
 ALLEGRO_DEBUG_CHANNEL("font")
@@ -36,6 +41,12 @@ ALLEGRO_DEBUG_CHANNEL("font")
 
 #define RANGE_SIZE   128
 
+/* Distance field glyphs are rendered at this many pixels per em by
+ * default. The field reaches an eighth of that beyond the outlines.
+ */
+#define DISTANCE_FIELD_SIZE      32
+#define DISTANCE_FIELD_MAX_SIZE  128
+
 
 typedef struct REGION
 {
@@ -46,6 +57,15 @@ typedef struct REGION
 } REGION;
 
 
+/* A segment of the top edge of the used area of a page. */
+typedef struct SKYLINE_NODE
+{
+   int x;
+   int y;
+   int w;
+} SKYLINE_NODE;
+
+
 typedef struct ALLEGRO_TTF_GLYPH_DATA
 {
    ALLEGRO_BITMAP *page_bitmap;
@@ -66,13 +86,13 @@ typedef struct ALLEGRO_TTF_GLYPH_RANGE
 typedef struct ALLEGRO_TTF_FONT_DATA
 {
    FT_Face face;
+   int face_w;
+   int face_h;
    int flags;
    _AL_VECTOR glyph_ranges;  /* sorted array of of ALLEGRO_TTF_GLYPH_RANGE */
 
    _AL_VECTOR page_bitmaps;  /* of ALLEGRO_BITMAP pointers */
-   int page_pos_x;
-   int page_pos_y;
-   int page_line_height;
+   _AL_VECTOR skyline;       /* of SKYLINE_NODE, free space of the last page */
    ALLEGRO_LOCKED_REGION *page_lr;
 
    FT_StreamRec stream;
@@ -87,14 +107,48 @@ typedef struct ALLEGRO_TTF_FONT_DATA
    int max_page_size;
 
    bool skip_cache_misses;
+
+   int refcount;             /* fonts sharing this data */
+   int df_size;              /* pixels per em of distance field glyphs */
+   int df_spread;
+   ALLEGRO_BITMAP *df_scratch;
 } ALLEGRO_TTF_FONT_DATA;
 
 
+/* A font loaded with ALLEGRO_TTF_DISTANCE_FIELD. Its glyphs are cached
+ * once at df_size pixels per em and scaled when they are drawn, so any
+ * number of sizes can share the data.
+ */
+typedef struct ALLEGRO_TTF_DF_FONT
+{
+   ALLEGRO_FONT font;        /* must be first */
+   float scale_x;
+   float scale_y;
+   int ascent;
+   int descent;
+} ALLEGRO_TTF_DF_FONT;
+
+
 /* globals */
 static bool ttf_inited;
 static FT_Library ft;
+/* Faces of one library must not be created or destroyed concurrently. The
+ * mutex also guards df_shaders.
+ */
+static ALLEGRO_MUTEX *ft_mutex;
 static ALLEGRO_FONT_VTABLE vt;
 
+/* The distance field shader of each display which has drawn distance field
+ * glyphs. The shader is NULL if it could not be built for the display.
+ */
+typedef struct DF_SHADER
+{
+   ALLEGRO_DISPLAY *display;
+   ALLEGRO_SHADER *shader;
+} DF_SHADER;
+
+static _AL_VECTOR df_shaders = _AL_VECTOR_INITIALIZER(DF_SHADER);
+
 
 static INLINE int align4(int x)
 {
@@ -106,6 +160,164 @@ static INLINE int align4(int x)
 }
 
 
+static INLINE int scaled(float x, float scale)
+{
+   return (int)floorf(x * scale + 0.5f);
+}
+
+
+static INLINE ALLEGRO_TTF_DF_FONT const *df_font(ALLEGRO_FONT const *f)
+{
+   return (ALLEGRO_TTF_DF_FONT const *)f;
+}
+
+
+static void set_face_size(FT_Face face, int w, int h)
+{
+   if (h > 0) {
+      FT_Set_Pixel_Sizes(face, w, h);
+   }
+   else {
+      /* Set the "real dimension" of the font to be the passed size,
+       * in pixels.
+       */
+      FT_Size_RequestRec req;
+      ASSERT(w <= 0);
+      ASSERT(h <= 0);
+      req.type = FT_SIZE_REQUEST_TYPE_REAL_DIM;
+      req.width = (-w) << 6;
+      req.height = (-h) << 6;
+      req.horiResolution = 0;
+      req.vertResolution = 0;
+      FT_Request_Size(face, &req);
+   }
+}
+
+
+static FT_Int32 get_load_flags(int flags)
+{
+   FT_Int32 ft_load_flags;
+
+   // FIXME: make this a config setting? FT_LOAD_FORCE_AUTOHINT
+
+   // FIXME: Investigate why some fonts don't work without the
+   // NO_BITMAP flags. Supposedly using that flag makes small sizes
+   // look bad so ideally we would not used it.
+   ft_load_flags = FT_LOAD_RENDER | FT_LOAD_NO_BITMAP;
+   if (flags & ALLEGRO_TTF_DISTANCE_FIELD)
+      /* Hinting is for one size only. */
+      return ft_load_flags | FT_LOAD_NO_HINTING;
+   if (flags & ALLEGRO_TTF_MONOCHROME)
+      ft_load_flags |= FT_LOAD_TARGET_MONO;
+   if (flags & ALLEGRO_TTF_NO_AUTOHINT)
+      ft_load_flags |= FT_LOAD_NO_AUTOHINT;
+
+   return ft_load_flags;
+}
+
+
+/* Returns the y position a w x h rectangle gets with its left edge at
+ * the start of skyline node i, or -1 if it does not fit there.
+ */
+static int skyline_fit(_AL_VECTOR *skyline, unsigned int i, int w, int h,
+   int page_w, int page_h)
+{
+   SKYLINE_NODE *node = _al_vector_ref(skyline, i);
+   int y = 0;
+   int left = w;
+
+   if (node->x + w > page_w)
+      return -1;
+
+   while (left > 0) {
+      if (i >= _al_vector_size(skyline))
+         return -1;
+      node = _al_vector_ref(skyline, i);
+      if (node->y > y)
+         y = node->y;
+      if (y + h > page_h)
+         return -1;
+      left -= node->w;
+      i++;
+   }
+
+   return y;
+}
+
+
+/* Bottom-left skyline packing: the rectangle goes where its bottom edge
+ * ends up highest, preferring narrow gaps on ties. Unlike filling rows,
+ * short glyphs can use the space left above the shorter glyphs of a
+ * previous row.
+ */
+static bool skyline_insert(_AL_VECTOR *skyline, int w, int h,
+   int page_w, int page_h, int *x, int *y)
+{
+   SKYLINE_NODE *node;
+   int best = -1;
+   int best_y = 0;
+   int best_w = 0;
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(skyline); i++) {
+      int fit_y = skyline_fit(skyline, i, w, h, page_w, page_h);
+      node = _al_vector_ref(skyline, i);
+      if (fit_y >= 0 && (best < 0 || fit_y < best_y ||
+            (fit_y == best_y && node->w < best_w))) {
+         best = i;
+         best_y = fit_y;
+         best_w = node->w;
+      }
+   }
+
+   if (best < 0)
+      return false;
+
+   node = _al_vector_ref(skyline, best);
+   *x = node->x;
+   *y = best_y;
+
+   node = _al_vector_alloc_mid(skyline, best);
+   if (!node)
+      return false;
+   node->x = *x;
+   node->y = best_y + h;
+   node->w = w;
+
+   /* Cut away what the new node covers. */
+   i = best + 1;
+   while (i < _al_vector_size(skyline)) {
+      SKYLINE_NODE *prev = _al_vector_ref(skyline, i - 1);
+      int shrink;
+      node = _al_vector_ref(skyline, i);
+      shrink = prev->x + prev->w - node->x;
+      if (shrink <= 0)
+         break;
+      node->x += shrink;
+      node->w -= shrink;
+      if (node->w > 0)
+         break;
+      _al_vector_delete_at(skyline, i);
+   }
+
+   /* Merge neighbours of the same height. */
+   i = 0;
+   while (i + 1 < _al_vector_size(skyline)) {
+      SKYLINE_NODE *a = _al_vector_ref(skyline, i);
+      SKYLINE_NODE *b = _al_vector_ref(skyline, i + 1);
+      if (a->y == b->y) {
+         a->w += b->w;
+         _al_vector_delete_at(skyline, i + 1);
+      }
+      else {
+         i++;
+      }
+   }
+
+   return true;
+}
+
+
 /* Returns false if the glyph is invalid.
  */
 static bool get_glyph(ALLEGRO_TTF_FONT_DATA *data,
@@ -205,65 +417,78 @@ static ALLEGRO_BITMAP *push_new_page(ALLEGRO_TTF_FONT_DATA *data, int glyph_size
     _al_pop_destructor_owner();
 
     if (page) {
+       SKYLINE_NODE *node;
+
        back = _al_vector_alloc_back(&data->page_bitmaps);
        *back = page;
 
-       data->page_pos_x = 0;
-       data->page_pos_y = 0;
-       data->page_line_height = 0;
+       _al_vector_free(&data->skyline);
+       node = _al_vector_alloc_back(&data->skyline);
+       node->x = 0;
+       node->y = 0;
+       node->w = page_size;
     }
 
     return page;
 }
 
 
-static unsigned char *alloc_glyph_region(ALLEGRO_TTF_FONT_DATA *data,
-   int ft_index, int w, int h, bool new, ALLEGRO_TTF_GLYPH_DATA *glyph,
-   bool lock_whole_page)
+/* Finds room for a w4 x h4 block on the last page, or else on a new page.
+ */
+static ALLEGRO_BITMAP *place_glyph(ALLEGRO_TTF_FONT_DATA *data,
+   int ft_index, int w4, int h4, int *x, int *y)
 {
    ALLEGRO_BITMAP *page;
-   int w4 = align4(w);
-   int h4 = align4(h);
    int glyph_size = w4 > h4 ? w4 : h4;
-   bool lock = false;
 
-   if (_al_vector_is_empty(&data->page_bitmaps) || new) {
-      page = push_new_page(data, glyph_size);
-      if (!page) {
-         ALLEGRO_ERROR("Failed to create a new page for glyph %d.\n", ft_index);
-         return NULL;
-      }
-   }
-   else {
+   if (!_al_vector_is_empty(&data->page_bitmaps)) {
       ALLEGRO_BITMAP **back = _al_vector_ref_back(&data->page_bitmaps);
       page = *back;
+      if (skyline_insert(&data->skyline, w4, h4, al_get_bitmap_width(page),
+            al_get_bitmap_height(page), x, y)) {
+         return page;
+      }
    }
 
-   ALLEGRO_DEBUG("Glyph %d: %dx%d (%dx%d)%s\n",
-      ft_index, w, h, w4, h4, new ? " new" : "");
-
-   if (data->page_pos_x + w4 > al_get_bitmap_width(page)) {
-      data->page_pos_y += data->page_line_height;
-      data->page_pos_y = align4(data->page_pos_y);
-      data->page_pos_x = 0;
-      data->page_line_height = 0;
+   page = push_new_page(data, glyph_size);
+   if (!page) {
+      ALLEGRO_ERROR("Failed to create a new page for glyph %d.\n", ft_index);
+      return NULL;
    }
 
-   if (data->page_pos_y + h4 > al_get_bitmap_height(page)) {
-      return alloc_glyph_region(data, ft_index, w, h, true, glyph, lock_whole_page);
+   if (!skyline_insert(&data->skyline, w4, h4, al_get_bitmap_width(page),
+         al_get_bitmap_height(page), x, y)) {
+      ALLEGRO_ERROR("Glyph %d does not fit on a new page.\n", ft_index);
+      return NULL;
    }
 
+   return page;
+}
+
+
+static unsigned char *alloc_glyph_region(ALLEGRO_TTF_FONT_DATA *data,
+   int ft_index, int w, int h, ALLEGRO_TTF_GLYPH_DATA *glyph,
+   bool lock_whole_page)
+{
+   ALLEGRO_BITMAP *page;
+   int w4 = align4(w);
+   int h4 = align4(h);
+   int x, y;
+   bool lock = false;
+
+   page = place_glyph(data, ft_index, w4, h4, &x, &y);
+   if (!page)
+      return NULL;
+
+   ALLEGRO_DEBUG("Glyph %d: %dx%d (%dx%d) at %d %d\n",
+      ft_index, w, h, w4, h4, x, y);
+
    glyph->page_bitmap = page;
-   glyph->region.x = data->page_pos_x;
-   glyph->region.y = data->page_pos_y;
+   glyph->region.x = x;
+   glyph->region.y = y;
    glyph->region.w = w;
    glyph->region.h = h;
 
-   data->page_pos_x = align4(data->page_pos_x + w4);
-   if (h > data->page_line_height) {
-      data->page_line_height = h4;
-   }
-
    REGION lock_rect;
    if (lock_whole_page) {
       lock_rect.x = 0;
@@ -319,19 +544,18 @@ static unsigned char *alloc_glyph_region(ALLEGRO_TTF_FONT_DATA *data,
 }
 
 
-static void copy_glyph_mono(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
-   unsigned char *glyph_data)
+static void copy_glyph_mono(FT_Bitmap const *bitmap, int flags,
+   unsigned char *glyph_data, int pitch)
 {
-   int pitch = font_data->page_lr->pitch;
    int x, y;
 
-   for (y = 0; y < (int)face->glyph->bitmap.rows; y++) {
-      unsigned char const *ptr = face->glyph->bitmap.buffer + face->glyph->bitmap.pitch * y;
+   for (y = 0; y < (int)bitmap->rows; y++) {
+      unsigned char const *ptr = bitmap->buffer + bitmap->pitch * y;
       unsigned char *dptr = glyph_data + pitch * y;
       int bit = 0;
 
-      if (font_data->flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA) {
-         for (x = 0; x < (int)face->glyph->bitmap.width; x++) {
+      if (flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA) {
+         for (x = 0; x < (int)bitmap->width; x++) {
             unsigned char set = ((*ptr >> (7-bit)) & 1) ? 255 : 0;
             *dptr++ = 255;
             *dptr++ = 255;
@@ -344,7 +568,7 @@ static void copy_glyph_mono(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
          }
       }
       else {
-         for (x = 0; x < (int)face->glyph->bitmap.width; x++) {
+         for (x = 0; x < (int)bitmap->width; x++) {
             unsigned char set = ((*ptr >> (7-bit)) & 1) ? 255 : 0;
             *dptr++ = set;
             *dptr++ = set;
@@ -360,18 +584,17 @@ static void copy_glyph_mono(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
 }
 
 
-static void copy_glyph_color(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
-   unsigned char *glyph_data)
+static void copy_glyph_color(FT_Bitmap const *bitmap, int flags,
+   unsigned char *glyph_data, int pitch)
 {
-   int pitch = font_data->page_lr->pitch;
    int x, y;
 
-   for (y = 0; y < (int)face->glyph->bitmap.rows; y++) {
-      unsigned char const *ptr = face->glyph->bitmap.buffer + face->glyph->bitmap.pitch * y;
+   for (y = 0; y < (int)bitmap->rows; y++) {
+      unsigned char const *ptr = bitmap->buffer + bitmap->pitch * y;
       unsigned char *dptr = glyph_data + pitch * y;
 
-      if (font_data->flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA) {
-         for (x = 0; x < (int)face->glyph->bitmap.width; x++) {
+      if (flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA) {
+         for (x = 0; x < (int)bitmap->width; x++) {
             unsigned char c = *ptr;
             *dptr++ = 255;
             *dptr++ = 255;
@@ -381,7 +604,7 @@ static void copy_glyph_color(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
          }
       }
       else {
-         for (x = 0; x < (int)face->glyph->bitmap.width; x++) {
+         for (x = 0; x < (int)bitmap->width; x++) {
             unsigned char c = *ptr;
             *dptr++ = c;
             *dptr++ = c;
@@ -394,6 +617,180 @@ static void copy_glyph_color(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
 }
 
 
+#define DF_INF 1e20f
+
+
+/* Squared Euclidean distance transform of n samples, f[0], f[stride], ...
+ * in place. See Felzenszwalb and Huttenlocher, "Distance Transforms of
+ * Sampled Functions". d, v and z need room for n, n and n + 1 items.
+ */
+static void distance_transform(float *f, int n, int stride,
+   float *d, int *v, float *z)
+{
+   int q, k = 0;
+
+   v[0] = 0;
+   z[0] = -DF_INF;
+   z[1] = DF_INF;
+
+   for (q = 1; q < n; q++) {
+      float fq = f[q * stride] + q * q;
+      float s;
+      k++;
+      do {
+         int r = v[--k];
+         s = (fq - (f[r * stride] + r * r)) / (2 * q - 2 * r);
+      } while (s <= z[k]);
+      k++;
+      v[k] = q;
+      z[k] = s;
+      z[k + 1] = DF_INF;
+   }
+
+   for (q = 0, k = 0; q < n; q++) {
+      while (z[k + 1] < q)
+         k++;
+      d[q] = (q - v[k]) * (q - v[k]) + f[v[k] * stride];
+   }
+   for (q = 0; q < n; q++)
+      f[q * stride] = d[q];
+}
+
+
+static void distance_transform_2d(float *grid, int w, int h,
+   float *d, int *v, float *z)
+{
+   int x, y;
+
+   for (x = 0; x < w; x++)
+      distance_transform(grid + x, h, w, d, v, z);
+   for (y = 0; y < h; y++)
+      distance_transform(grid + y * w, w, 1, d, v, z);
+}
+
+
+/* Turns the anti-aliased glyph into a signed distance field with a margin
+ * of spread pixels. The distance is in the alpha channel: 128 on the
+ * outline and 0 or 255 at spread pixels outside or inside.
+ *
+ * The coverage of edge pixels places the outline between pixel centers,
+ * like in Mapbox's TinySDF.
+ */
+static void copy_glyph_distance_field(FT_Bitmap const *bitmap, int spread,
+   unsigned char *glyph_data, int pitch)
+{
+   int w = bitmap->width + 2 * spread;
+   int h = bitmap->rows + 2 * spread;
+   int n = w > h ? w : h;
+   float *outer, *inner, *d, *z;
+   int *v;
+   int x, y;
+
+   outer = al_malloc(w * h * sizeof(float));
+   inner = al_malloc(w * h * sizeof(float));
+   d = al_malloc(n * sizeof(float));
+   z = al_malloc((n + 1) * sizeof(float));
+   v = al_malloc(n * sizeof(int));
+   if (!outer || !inner || !d || !z || !v)
+      goto done;
+
+   for (y = 0; y < h; y++) {
+      for (x = 0; x < w; x++) {
+         int bx = x - spread;
+         int by = y - spread;
+         float a = 0;
+         if (bx >= 0 && by >= 0 && bx < (int)bitmap->width &&
+               by < (int)bitmap->rows) {
+            a = bitmap->buffer[by * bitmap->pitch + bx] / 255.0f;
+         }
+         if (a >= 1) {
+            outer[y * w + x] = 0;
+            inner[y * w + x] = DF_INF;
+         }
+         else if (a <= 0) {
+            outer[y * w + x] = DF_INF;
+            inner[y * w + x] = 0;
+         }
+         else {
+            float e = 0.5f - a;
+            outer[y * w + x] = e > 0 ? e * e : 0;
+            inner[y * w + x] = e < 0 ? e * e : 0;
+         }
+      }
+   }
+
+   distance_transform_2d(outer, w, h, d, v, z);
+   distance_transform_2d(inner, w, h, d, v, z);
+
+   for (y = 0; y < h; y++) {
+      unsigned char *dptr = glyph_data + pitch * y;
+      for (x = 0; x < w; x++) {
+         float dist = sqrtf(outer[y * w + x]) - sqrtf(inner[y * w + x]);
+         float c = 0.5f - dist / (2 * spread);
+         c = _ALLEGRO_CLAMP(0.0f, c, 1.0f);
+         *dptr++ = 255;
+         *dptr++ = 255;
+         *dptr++ = 255;
+         *dptr++ = (unsigned char)(c * 255 + 0.5f);
+      }
+   }
+
+done:
+   al_free(outer);
+   al_free(inner);
+   al_free(d);
+   al_free(z);
+   al_free(v);
+}
+
+
+static void copy_glyph(ALLEGRO_TTF_FONT_DATA const *data,
+   FT_Bitmap const *bitmap, unsigned char *glyph_data, int pitch)
+{
+   if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD)
+      copy_glyph_distance_field(bitmap, data->df_spread, glyph_data, pitch);
+   else if (data->flags & ALLEGRO_TTF_MONOCHROME)
+      copy_glyph_mono(bitmap, data->flags, glyph_data, pitch);
+   else
+      copy_glyph_color(bitmap, data->flags, glyph_data, pitch);
+}
+
+
+/* Gets the placement of the glyph in the glyph slot of the face, and its
+ * size on a page with the border. The size is 0 if it has no pixels.
+ */
+static void get_slot_metrics(ALLEGRO_TTF_FONT_DATA const *data, FT_Face face,
+   short *offset_x, short *offset_y, short *advance, int *w, int *h)
+{
+   FT_GlyphSlot slot = face->glyph;
+   int margin = 0;
+
+   if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD) {
+      /* These get scaled, so the offsets are relative to the baseline
+       * and the advance is in 26.6 fixed point.
+       */
+      margin = data->df_spread;
+      *offset_x = slot->bitmap_left - margin;
+      *offset_y = -slot->bitmap_top - margin;
+      *advance = slot->linearHoriAdvance >> 10;
+   }
+   else {
+      *offset_x = slot->bitmap_left;
+      *offset_y = (face->size->metrics.ascender >> 6) - slot->bitmap_top;
+      *advance = slot->advance.x >> 6;
+   }
+
+   if (slot->bitmap.width == 0 || slot->bitmap.rows == 0) {
+      *w = 0;
+      *h = 0;
+   }
+   else {
+      *w = slot->bitmap.width + 2 * margin + 2;
+      *h = slot->bitmap.rows + 2 * margin + 2;
+   }
+}
+
+
 /* NOTE: this function may disable the bitmap hold drawing state
  * and leave the current page bitmap locked.
  * 
@@ -403,7 +800,6 @@ static void copy_glyph_color(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
 static void cache_glyph(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
    int ft_index, ALLEGRO_TTF_GLYPH_DATA *glyph, bool lock_whole_page)
 {
-    FT_Int32 ft_load_flags;
     FT_Error e;
     int w, h;
     unsigned char *glyph_data;
@@ -415,28 +811,13 @@ static void cache_glyph(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
      * should have been set to ft_index = 0. */
     ASSERT(!(font_data->skip_cache_misses && !lock_whole_page));
 
-    // FIXME: make this a config setting? FT_LOAD_FORCE_AUTOHINT
-
-    // FIXME: Investigate why some fonts don't work without the
-    // NO_BITMAP flags. Supposedly using that flag makes small sizes
-    // look bad so ideally we would not used it.
-    ft_load_flags = FT_LOAD_RENDER | FT_LOAD_NO_BITMAP;
-    if (font_data->flags & ALLEGRO_TTF_MONOCHROME)
-       ft_load_flags |= FT_LOAD_TARGET_MONO;
-    if (font_data->flags & ALLEGRO_TTF_NO_AUTOHINT)
-       ft_load_flags |= FT_LOAD_NO_AUTOHINT;
-
-    e = FT_Load_Glyph(face, ft_index, ft_load_flags);
+    e = FT_Load_Glyph(face, ft_index, get_load_flags(font_data->flags));
     if (e) {
        ALLEGRO_WARN("Failed loading glyph %d from.\n", ft_index);
     }
 
-    glyph->offset_x = face->glyph->bitmap_left;
-    glyph->offset_y = (face->size->metrics.ascender >> 6) - face->glyph->bitmap_top;
-    glyph->advance = face->glyph->advance.x >> 6;
-
-    w = face->glyph->bitmap.width;
-    h = face->glyph->bitmap.rows;
+    get_slot_metrics(font_data, face, &glyph->offset_x, &glyph->offset_y,
+       &glyph->advance, &w, &h);
 
     if (w == 0 || h == 0) {
        /* Mark this glyph so we won't try to cache it next time. */
@@ -450,16 +831,14 @@ static void cache_glyph(ALLEGRO_TTF_FONT_DATA *font_data, FT_Face face,
      * even against the outer bitmap edge, to ensure consistent rendering.
      */
     glyph_data = alloc_glyph_region(font_data, ft_index,
-       w + 2, h + 2, false, glyph, lock_whole_page);
+       w, h, glyph, lock_whole_page);
 
     if (glyph_data == NULL) {
        return;
     }
 
-    if (font_data->flags & ALLEGRO_TTF_MONOCHROME)
-       copy_glyph_mono(font_data, face, glyph_data);
-    else
-       copy_glyph_color(font_data, face, glyph_data);
+    copy_glyph(font_data, &face->glyph->bitmap, glyph_data,
+       font_data->page_lr->pitch);
 
     if (!lock_whole_page) {
        unlock_current_page(font_data);
@@ -488,12 +867,476 @@ static void cache_glyphs(ALLEGRO_TTF_FONT_DATA *data, const char *text, size_t t
 }
 
 
-static int get_kerning(ALLEGRO_TTF_FONT_DATA const *data, FT_Face face,
+/* Glyphs cached ahead of time by al_cache_ttf_glyphs. */
+typedef struct CACHE_JOB
+{
+   ALLEGRO_TTF_FONT_DATA *data;
+   int source;                /* index into CACHE_WORK.sources */
+   int ft_index;
+   ALLEGRO_TTF_GLYPH_DATA *glyph;
+
+   /* Set by the worker threads. */
+   bool loaded;
+   int w, h;                  /* with the border */
+   short offset_x;
+   short offset_y;
+   short advance;
+   unsigned char *pixels;     /* align4(w) x align4(h) pixels, ABGR_8888_LE */
+
+   /* Set by the packer. */
+   ALLEGRO_BITMAP *page;
+   int x, y;
+} CACHE_JOB;
+
+
+typedef struct CACHE_SOURCE
+{
+   ALLEGRO_TTF_FONT_DATA *data;
+   const unsigned char *memory;
+   unsigned long size;
+   unsigned char *buffer;     /* if the file had to be read */
+} CACHE_SOURCE;
+
+
+typedef struct CACHE_WORK
+{
+   CACHE_SOURCE *sources;
+   int num_sources;
+   CACHE_JOB *jobs;
+   int num_jobs;
+   ALLEGRO_MUTEX *mutex;
+   int next_job;
+} CACHE_WORK;
+
+
+#define CACHE_JOBS_PER_FETCH  16
+#define CACHE_MAX_THREADS     64
+
+
+static int cmp_job_index(const void *a, const void *b)
+{
+   const CACHE_JOB *ja = a;
+   const CACHE_JOB *jb = b;
+   if (ja->source != jb->source)
+      return ja->source - jb->source;
+   return ja->ft_index - jb->ft_index;
+}
+
+
+/* Tall glyphs first, that packs tighter. */
+static int cmp_job_size(const void *a, const void *b)
+{
+   const CACHE_JOB *ja = a;
+   const CACHE_JOB *jb = b;
+   if (ja->source != jb->source)
+      return ja->source - jb->source;
+   if (ja->h != jb->h)
+      return jb->h - ja->h;
+   if (ja->w != jb->w)
+      return jb->w - ja->w;
+   return ja->ft_index - jb->ft_index;
+}
+
+
+/* The workers open their own faces on a copy of the font file in memory,
+ * as the file handle of the font can't be shared between threads.
+ */
+static bool init_cache_source(CACHE_SOURCE *src, ALLEGRO_TTF_FONT_DATA *data)
+{
+   src->data = data;
+
+   /* FreeType uses the base field of streams with a read callback, too. */
+   if (!data->stream.read) {
+      src->memory = data->stream.base;
+      src->size = data->stream.size;
+      return true;
+   }
+
+   if (!data->file)
+      return false;
+
+   src->buffer = al_malloc(data->stream.size);
+   if (!src->buffer)
+      return false;
+
+   al_fseek(data->file, data->base_offset, ALLEGRO_SEEK_SET);
+   src->size = al_fread(data->file, src->buffer, data->stream.size);
+   src->memory = src->buffer;
+   /* Keep ftread in sync with the file position. */
+   data->offset = src->size;
+
+   return src->size > 0;
+}
+
+
+static FT_Face open_worker_face(CACHE_SOURCE *src)
+{
+   FT_Face face;
+   int result;
+
+   al_lock_mutex(ft_mutex);
+   result = FT_New_Memory_Face(ft, src->memory, src->size, 0, &face);
+   al_unlock_mutex(ft_mutex);
+   if (result != 0) {
+      ALLEGRO_WARN("Could not open a face for caching. Freetype error code %d\n",
+         result);
+      return NULL;
+   }
+
+   set_face_size(face, src->data->face_w, src->data->face_h);
+   return face;
+}
+
+
+static void render_job(FT_Face face, CACHE_JOB *job)
+{
+   FT_Bitmap const *bitmap;
+   int w4, h4;
+
+   if (FT_Load_Glyph(face, job->ft_index, get_load_flags(job->data->flags)))
+      return;
+
+   bitmap = &face->glyph->bitmap;
+   get_slot_metrics(job->data, face, &job->offset_x, &job->offset_y,
+      &job->advance, &job->w, &job->h);
+
+   if (job->w > 0) {
+      /* Same layout as a glyph on a page, including the border. */
+      w4 = align4(job->w);
+      h4 = align4(job->h);
+      job->pixels = al_calloc(w4 * h4, 4);
+      if (!job->pixels)
+         return;
+      copy_glyph(job->data, bitmap, job->pixels + (w4 + 1) * 4, w4 * 4);
+   }
+
+   job->loaded = true;
+}
+
+
+static void *cache_worker(ALLEGRO_THREAD *thread, void *arg)
+{
+   CACHE_WORK *work = arg;
+   FT_Face *faces;
+   int first, i;
+
+   (void)thread;
+
+   faces = al_calloc(work->num_sources, sizeof(*faces));
+   if (!faces)
+      return NULL;
+
+   for (;;) {
+      al_lock_mutex(work->mutex);
+      first = work->next_job;
+      work->next_job += CACHE_JOBS_PER_FETCH;
+      al_unlock_mutex(work->mutex);
+
+      if (first >= work->num_jobs)
+         break;
+
+      for (i = first; i < first + CACHE_JOBS_PER_FETCH && i < work->num_jobs;
+            i++) {
+         CACHE_JOB *job = &work->jobs[i];
+         if (!work->sources[job->source].memory)
+            continue;
+         if (!faces[job->source]) {
+            faces[job->source] = open_worker_face(&work->sources[job->source]);
+            if (!faces[job->source])
+               continue;
+         }
+         render_job(faces[job->source], job);
+      }
+   }
+
+   al_lock_mutex(ft_mutex);
+   for (i = 0; i < work->num_sources; i++) {
+      if (faces[i])
+         FT_Done_Face(faces[i]);
+   }
+   al_unlock_mutex(ft_mutex);
+   al_free(faces);
+
+   return NULL;
+}
+
+
+/* Copies the glyphs of jobs [first, last), which are all on the same page,
+ * with one lock.
+ */
+static void upload_jobs(CACHE_JOB *jobs, int first, int last, bool new_page)
+{
+   ALLEGRO_BITMAP *page = jobs[first].page;
+   ALLEGRO_LOCKED_REGION *lr;
+   int x1 = INT_MAX, y1 = INT_MAX, x2 = 0, y2 = 0;
+   int i, y;
+
+   for (i = first; i < last; i++) {
+      CACHE_JOB *job = &jobs[i];
+      if (!job->page)
+         continue;
+      if (job->x < x1) x1 = job->x;
+      if (job->y < y1) y1 = job->y;
+      if (job->x + align4(job->w) > x2) x2 = job->x + align4(job->w);
+      if (job->y + align4(job->h) > y2) y2 = job->y + align4(job->h);
+   }
+
+   /* Other glyphs of an older page may be inside the rectangle. */
+   lr = al_lock_bitmap_region(page, x1, y1, x2 - x1, y2 - y1,
+      ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      new_page ? ALLEGRO_LOCK_WRITEONLY : ALLEGRO_LOCK_READWRITE);
+   if (!lr) {
+      ALLEGRO_ERROR("Failed to lock page.\n");
+      return;
+   }
+
+   if (new_page) {
+      for (y = 0; y < y2 - y1; y++) {
+         memset((char *)lr->data + y * lr->pitch, 0, (x2 - x1) * 4);
+      }
+   }
+
+   for (i = first; i < last; i++) {
+      CACHE_JOB *job = &jobs[i];
+      int w4 = align4(job->w);
+      if (!job->page)
+         continue;
+      for (y = 0; y < align4(job->h); y++) {
+         memcpy((char *)lr->data + (job->y - y1 + y) * lr->pitch
+            + (job->x - x1) * 4, job->pixels + y * w4 * 4, w4 * 4);
+      }
+   }
+
+   al_unlock_bitmap(page);
+}
+
+
+/* Places the rendered glyphs on the pages of their fonts and uploads
+ * them. Jobs are sorted by source, so those of one font data are together.
+ */
+static void pack_jobs(CACHE_JOB *jobs, int num_jobs)
+{
+   int first = 0;
+   int i;
+
+   while (first < num_jobs) {
+      ALLEGRO_TTF_FONT_DATA *data = jobs[first].data;
+      ALLEGRO_BITMAP *old_page = NULL;
+      int last = first;
+
+      while (last < num_jobs && jobs[last].data == data)
+         last++;
+
+      unlock_current_page(data);
+      if (!_al_vector_is_empty(&data->page_bitmaps)) {
+         ALLEGRO_BITMAP **back = _al_vector_ref_back(&data->page_bitmaps);
+         old_page = *back;
+      }
+
+      for (i = first; i < last; i++) {
+         CACHE_JOB *job = &jobs[i];
+         ALLEGRO_TTF_GLYPH_DATA *glyph = job->glyph;
+
+         if (!job->loaded)
+            continue;
+
+         glyph->offset_x = job->offset_x;
+         glyph->offset_y = job->offset_y;
+         glyph->advance = job->advance;
+
+         if (!job->pixels) {
+            glyph->region.x = -1;
+            glyph->region.y = -1;
+            continue;
+         }
+
+         job->page = place_glyph(data, job->ft_index, align4(job->w),
+            align4(job->h), &job->x, &job->y);
+         if (!job->page)
+            continue;
+
+         glyph->page_bitmap = job->page;
+         glyph->region.x = job->x;
+         glyph->region.y = job->y;
+         glyph->region.w = job->w;
+         glyph->region.h = job->h;
+      }
+
+      /* Glyphs only ever go to the last page, so the jobs of one page
+       * follow each other.
+       */
+      i = first;
+      while (i < last) {
+         int end = i + 1;
+         if (!jobs[i].page) {
+            i++;
+            continue;
+         }
+         while (end < last && (!jobs[end].page || jobs[end].page == jobs[i].page))
+            end++;
+         upload_jobs(jobs, i, end, jobs[i].page != old_page);
+         i = end;
+      }
+
+      /* Let the usual code path deal with glyphs the workers could not
+       * render. This has to come after the uploads, which may clear the
+       * pages.
+       */
+      for (i = first; i < last; i++) {
+         if (!jobs[i].loaded)
+            cache_glyph(data, data->face, jobs[i].ft_index, jobs[i].glyph, false);
+      }
+
+      first = last;
+   }
+}
+
+
+/* Function: al_cache_ttf_glyphs
+ */
+bool al_cache_ttf_glyphs(ALLEGRO_FONT * const *fonts, int num_fonts,
+   int ranges_n, const int ranges[])
+{
+   CACHE_WORK work;
+   _AL_VECTOR jobs = _AL_VECTOR_INITIALIZER(CACHE_JOB);
+   ALLEGRO_THREAD *threads[CACHE_MAX_THREADS];
+   int num_threads;
+   int i, j, n;
+   int32_t ch;
+   bool ret = true;
+
+   ASSERT(fonts);
+   ASSERT(ranges || ranges_n == 0);
+
+   memset(&work, 0, sizeof(work));
+   work.sources = al_calloc(num_fonts, sizeof(*work.sources));
+   if (!work.sources)
+      return false;
+
+   for (i = 0; i < num_fonts; i++) {
+      ALLEGRO_TTF_FONT_DATA *data;
+      CACHE_SOURCE *src;
+      int num_font_jobs = 0;
+
+      if (fonts[i]->vtable != &vt) {
+         ALLEGRO_WARN("Font %d is not a TTF font.\n", i);
+         ret = false;
+         continue;
+      }
+      data = fonts[i]->data;
+
+      /* Fonts made by al_derive_ttf_font share their glyphs and pages,
+       * so each glyph is rendered and packed once for all of them.
+       */
+      for (j = 0; j < work.num_sources; j++) {
+         if (work.sources[j].data == data)
+            break;
+      }
+      if (j < work.num_sources)
+         continue;
+      src = &work.sources[work.num_sources++];
+      src->data = data;
+
+      for (j = 0; j < ranges_n; j++) {
+         for (ch = ranges[j * 2]; ch <= ranges[j * 2 + 1]; ch++) {
+            int ft_index = FT_Get_Char_Index(data->face, ch);
+            ALLEGRO_TTF_GLYPH_DATA *glyph;
+            CACHE_JOB *job;
+
+            if (ft_index == 0)
+               continue;
+            get_glyph(data, ft_index, &glyph);
+            if (glyph->page_bitmap || glyph->region.x < 0)
+               continue;
+
+            job = _al_vector_alloc_back(&jobs);
+            memset(job, 0, sizeof(*job));
+            job->data = data;
+            job->source = src - work.sources;
+            job->ft_index = ft_index;
+            job->glyph = glyph;
+            num_font_jobs++;
+         }
+      }
+
+      if (num_font_jobs > 0 && !init_cache_source(src, data)) {
+         ALLEGRO_WARN("Could not read font %d for caching.\n", i);
+      }
+   }
+
+   n = _al_vector_size(&jobs);
+   if (n == 0)
+      goto done;
+
+   /* Several codepoints may share a glyph. */
+   work.jobs = _al_vector_ref(&jobs, 0);
+   qsort(work.jobs, n, sizeof(CACHE_JOB), cmp_job_index);
+   work.num_jobs = 0;
+   for (i = 0; i < n; i++) {
+      if (work.num_jobs > 0 &&
+            cmp_job_index(&work.jobs[work.num_jobs - 1], &work.jobs[i]) == 0)
+         continue;
+      work.jobs[work.num_jobs++] = work.jobs[i];
+   }
+
+   num_threads = al_get_cpu_count();
+   n = (work.num_jobs + CACHE_JOBS_PER_FETCH - 1) / CACHE_JOBS_PER_FETCH;
+   if (num_threads > n)
+      num_threads = n;
+   num_threads = _ALLEGRO_CLAMP(1, num_threads, CACHE_MAX_THREADS);
+
+   ALLEGRO_DEBUG("Caching %d glyphs of %d fonts with %d threads.\n",
+      work.num_jobs, work.num_sources, num_threads);
+
+   work.mutex = al_create_mutex();
+   if (!work.mutex) {
+      ret = false;
+      goto done;
+   }
+   for (i = 0; i < num_threads; i++) {
+      threads[i] = al_create_thread(cache_worker, &work);
+      if (threads[i])
+         al_start_thread(threads[i]);
+   }
+   for (i = 0; i < num_threads; i++) {
+      if (threads[i]) {
+         al_join_thread(threads[i], NULL);
+         al_destroy_thread(threads[i]);
+      }
+   }
+   al_destroy_mutex(work.mutex);
+
+   qsort(work.jobs, work.num_jobs, sizeof(CACHE_JOB), cmp_job_size);
+   pack_jobs(work.jobs, work.num_jobs);
+
+   for (i = 0; i < work.num_jobs; i++) {
+      al_free(work.jobs[i].pixels);
+   }
+
+done:
+   for (i = 0; i < work.num_sources; i++) {
+      al_free(work.sources[i].buffer);
+   }
+   al_free(work.sources);
+   _al_vector_free(&jobs);
+
+   return ret;
+}
+
+
+static int get_kerning(ALLEGRO_FONT const *f, FT_Face face,
    int prev_ft_index, int ft_index)
 {
+   ALLEGRO_TTF_FONT_DATA const *data = f->data;
+
    /* Do kerning? */
    if (!(data->flags & ALLEGRO_TTF_NO_KERNING) && prev_ft_index != -1) {
       FT_Vector delta;
+      if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD) {
+         FT_Get_Kerning(face, prev_ft_index, ft_index,
+            FT_KERNING_UNFITTED, &delta);
+         return scaled(delta.x / 64.0f, df_font(f)->scale_x);
+      }
       FT_Get_Kerning(face, prev_ft_index, ft_index,
          FT_KERNING_DEFAULT, &delta);
       return delta.x >> 6;
@@ -503,6 +1346,49 @@ static int get_kerning(ALLEGRO_TTF_FONT_DATA const *data, FT_Face face,
 }
 
 
+static int get_advance(ALLEGRO_FONT const *f,
+   ALLEGRO_TTF_GLYPH_DATA const *glyph)
+{
+   ALLEGRO_TTF_FONT_DATA const *data = f->data;
+
+   if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD)
+      return scaled(glyph->advance / 64.0f, df_font(f)->scale_x);
+   return glyph->advance;
+}
+
+
+/* The bounding box of the visible pixels of a glyph at the size of the
+ * font, relative to the top of the line.
+ */
+static void get_glyph_box(ALLEGRO_FONT const *f,
+   ALLEGRO_TTF_GLYPH_DATA const *glyph, int *x, int *y, int *w, int *h)
+{
+   ALLEGRO_TTF_FONT_DATA const *data = f->data;
+
+   if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD) {
+      ALLEGRO_TTF_DF_FONT const *df = df_font(f);
+      int spread = data->df_spread;
+
+      *x = scaled(glyph->offset_x + spread, df->scale_x);
+      *y = df->ascent + scaled(glyph->offset_y + spread, df->scale_y);
+      if (glyph->region.w == 0) {
+         *w = 0;
+         *h = 0;
+      }
+      else {
+         *w = scaled(glyph->region.w - 2 - 2 * spread, df->scale_x);
+         *h = scaled(glyph->region.h - 2 - 2 * spread, df->scale_y);
+      }
+      return;
+   }
+
+   *x = glyph->offset_x;
+   *y = glyph->offset_y;
+   *w = glyph->region.w - 2;
+   *h = glyph->region.h - 2;
+}
+
+
 static bool ttf_get_glyph_worker(ALLEGRO_FONT const *f, int prev_ft_index, int ft_index, int prev_codepoint, int codepoint, ALLEGRO_GLYPH *info)
 {
    ALLEGRO_TTF_FONT_DATA *data = f->data;
@@ -521,9 +1407,18 @@ static bool ttf_get_glyph_worker(ALLEGRO_FONT const *f, int prev_ft_index, int f
 
    cache_glyph(data, face, ft_index, glyph, false);
 
-   advance += get_kerning(data, face, prev_ft_index, ft_index);
+   advance += get_kerning(f, face, prev_ft_index, ft_index);
 
-   if (glyph->page_bitmap) {
+   if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD) {
+      /* The page holds a distance field, which can't be drawn as is. */
+      info->bitmap = NULL;
+      info->x = 0;
+      info->y = 0;
+      get_glyph_box(f, glyph, &info->offset_x, &info->offset_y,
+         &info->w, &info->h);
+      info->kerning = advance;
+   }
+   else if (glyph->page_bitmap) {
       info->bitmap = glyph->page_bitmap;
       info->x = glyph->region.x + 1;
       info->y = glyph->region.y + 1;
@@ -541,7 +1436,7 @@ static bool ttf_get_glyph_worker(ALLEGRO_FONT const *f, int prev_ft_index, int f
       info->bitmap = 0;
    }
 
-   advance += glyph->advance;
+   advance += get_advance(f, glyph);
 
    info->advance = advance;
 
@@ -581,6 +1476,451 @@ static int render_glyph(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
 }
 
 
+/* Distance field glyphs are thresholded at the outline when drawn. The
+ * edge is one pixel wide at any size: df_scale is the number of pixels
+ * between the distance values 0 and 1.
+ */
+static const char *df_glsl_pixel_source =
+   "#ifdef GL_ES\n"
+   "precision mediump float;\n"
+   "#endif\n"
+   "uniform sampler2D " ALLEGRO_SHADER_VAR_TEX ";\n"
+   "uniform float df_scale;\n"
+   "uniform float df_premul;\n"
+   "varying vec4 varying_color;\n"
+   "varying vec2 varying_texcoord;\n"
+   "void main()\n"
+   "{\n"
+   "  float d = texture2D(" ALLEGRO_SHADER_VAR_TEX ", varying_texcoord).a;\n"
+   "  float c = clamp((d - 0.5) * df_scale + 0.5, 0.0, 1.0);\n"
+   "  gl_FragColor = varying_color * vec4(mix(vec3(1.0), vec3(c), df_premul), c);\n"
+   "}\n";
+
+static const char *df_hlsl_pixel_source =
+   "float df_scale;\n"
+   "float df_premul;\n"
+   "texture " ALLEGRO_SHADER_VAR_TEX ";\n"
+   "sampler2D s = sampler_state {\n"
+   "   texture = <" ALLEGRO_SHADER_VAR_TEX ">;\n"
+   "};\n"
+   "\n"
+   "float4 ps_main(VS_OUTPUT Input) : COLOR0\n"
+   "{\n"
+   "   float d = tex2D(s, Input.TexCoord).a;\n"
+   "   float c = saturate((d - 0.5) * df_scale + 0.5);\n"
+   "   return Input.Color * float4(lerp(float3(1, 1, 1), float3(c, c, c), df_premul), c);\n"
+   "}\n";
+
+
+/* Returns the index of the display in df_shaders, or -1. Called with
+ * ft_mutex held.
+ */
+static int find_df_shader(ALLEGRO_DISPLAY *display)
+{
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&df_shaders); i++) {
+      DF_SHADER *entry = _al_vector_ref(&df_shaders, i);
+      if (entry->display == display)
+         return i;
+   }
+
+   return -1;
+}
+
+
+static void df_display_destroyed(ALLEGRO_DISPLAY *display)
+{
+   int i;
+
+   al_lock_mutex(ft_mutex);
+   i = find_df_shader(display);
+   if (i >= 0) {
+      DF_SHADER *entry = _al_vector_ref(&df_shaders, i);
+      al_destroy_shader(entry->shader);
+      _al_vector_delete_at(&df_shaders, i);
+   }
+   al_unlock_mutex(ft_mutex);
+}
+
+
+static ALLEGRO_SHADER *create_df_shader(void)
+{
+   ALLEGRO_SHADER *shader;
+   ALLEGRO_SHADER_PLATFORM platform;
+
+   /* Destroyed along with the display. */
+   _al_push_destructor_owner();
+   shader = al_create_shader(ALLEGRO_SHADER_AUTO);
+   _al_pop_destructor_owner();
+   if (!shader)
+      return NULL;
+
+   platform = al_get_shader_platform(shader);
+   if (!al_attach_shader_source(shader, ALLEGRO_VERTEX_SHADER,
+         al_get_default_shader_source(platform, ALLEGRO_VERTEX_SHADER)) ||
+       !al_attach_shader_source(shader, ALLEGRO_PIXEL_SHADER,
+         platform == ALLEGRO_SHADER_HLSL ?
+            df_hlsl_pixel_source : df_glsl_pixel_source) ||
+       !al_build_shader(shader)) {
+      ALLEGRO_ERROR("Could not build the distance field shader: %s\n",
+         al_get_shader_log(shader));
+      al_destroy_shader(shader);
+      shader = NULL;
+   }
+
+   return shader;
+}
+
+
+/* The shader is built once for each display with a programmable pipeline
+ * which draws distance field glyphs. Where it can't be used, the glyphs
+ * are drawn in software.
+ */
+static ALLEGRO_SHADER *get_df_shader(void)
+{
+   ALLEGRO_DISPLAY *display = al_get_current_display();
+   DF_SHADER *entry;
+   ALLEGRO_SHADER *shader;
+   int i;
+
+   if (!display ||
+         !(al_get_display_flags(display) & ALLEGRO_PROGRAMMABLE_PIPELINE))
+      return NULL;
+
+   al_lock_mutex(ft_mutex);
+   i = find_df_shader(display);
+   if (i >= 0) {
+      entry = _al_vector_ref(&df_shaders, i);
+   }
+   else {
+      entry = _al_vector_alloc_back(&df_shaders);
+      entry->display = display;
+      entry->shader = create_df_shader();
+      _al_add_display_destroyed_callback(display, df_display_destroyed);
+   }
+   shader = entry->shader;
+   al_unlock_mutex(ft_mutex);
+
+   return shader;
+}
+
+
+typedef struct DF_DRAW
+{
+   ALLEGRO_FONT const *font;
+   ALLEGRO_SHADER *shader;
+   bool use_shader;
+   bool shader_active;
+   ALLEGRO_SHADER *old_shader;
+   bool hold;
+   /* The page the software fallback reads from, locked until the end of
+    * the draw call or until another page is needed.
+    */
+   ALLEGRO_BITMAP *read_page;
+   ALLEGRO_LOCKED_REGION *read_lr;
+} DF_DRAW;
+
+
+static void begin_df_draw(DF_DRAW *st, ALLEGRO_FONT const *f)
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+
+   st->font = f;
+   st->shader = NULL;
+   if (target && !(al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP))
+      st->shader = get_df_shader();
+   st->use_shader = (st->shader != NULL);
+   st->shader_active = false;
+   st->old_shader = NULL;
+   st->hold = al_is_bitmap_drawing_held();
+   st->read_page = NULL;
+   st->read_lr = NULL;
+   al_hold_bitmap_drawing(true);
+}
+
+
+static void release_df_page(DF_DRAW *st)
+{
+   if (st->read_lr) {
+      al_unlock_bitmap(st->read_page);
+      st->read_lr = NULL;
+   }
+   st->read_page = NULL;
+}
+
+
+/* Switching shaders flushes the held glyphs, so that they are drawn with
+ * the shader they were meant for.
+ */
+static void set_df_shader(DF_DRAW *st, bool active)
+{
+   ALLEGRO_TTF_FONT_DATA const *data = st->font->data;
+
+   if (active == st->shader_active || (active && !st->use_shader))
+      return;
+
+   al_hold_bitmap_drawing(false);
+
+   if (active) {
+      ALLEGRO_TTF_DF_FONT const *df = df_font(st->font);
+      float scale = df->scale_x < df->scale_y ? df->scale_x : df->scale_y;
+
+      st->old_shader = al_get_target_bitmap()->shader;
+      if (al_use_shader(st->shader)) {
+         al_set_shader_float("df_scale", 2 * data->df_spread * scale);
+         al_set_shader_float("df_premul",
+            (data->flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA) ? 0 : 1);
+         st->shader_active = true;
+      }
+      else {
+         st->use_shader = false;
+      }
+   }
+   else {
+      al_use_shader(st->old_shader);
+      st->shader_active = false;
+   }
+
+   al_hold_bitmap_drawing(true);
+}
+
+
+static void end_df_draw(DF_DRAW *st)
+{
+   release_df_page(st);
+   set_df_shader(st, false);
+   al_hold_bitmap_drawing(st->hold);
+}
+
+
+/* Nothing is outside the glyph. */
+static INLINE float df_texel(unsigned char const *row, int x, int w)
+{
+   if (!row || x < 0 || x >= w)
+      return 0;
+   return row[x * 4 + 3];
+}
+
+
+/* Returns false if the rectangle is clipped away completely, which spares
+ * resampling the glyph.
+ */
+static bool is_df_glyph_visible(int x, int y, int w, int h)
+{
+   ALLEGRO_TRANSFORM const *t = al_get_current_transform();
+   float x1 = FLT_MAX, y1 = FLT_MAX, x2 = -FLT_MAX, y2 = -FLT_MAX;
+   int cx, cy, cw, ch;
+   int i;
+
+   if (!t)
+      return true;
+
+   for (i = 0; i < 4; i++) {
+      float px = x + ((i & 1) ? w : 0);
+      float py = y + ((i & 2) ? h : 0);
+      al_transform_coordinates(t, &px, &py);
+      if (px < x1) x1 = px;
+      if (py < y1) y1 = py;
+      if (px > x2) x2 = px;
+      if (py > y2) y2 = py;
+   }
+
+   al_get_clipping_rectangle(&cx, &cy, &cw, &ch);
+   return x2 > cx && y2 > cy && x1 < cx + cw && y1 < cy + ch;
+}
+
+
+/* Without a shader the glyph is resampled into a scratch bitmap at the
+ * size it is drawn with, which is then drawn like any other glyph. The
+ * page is locked once for all the glyphs of a draw call on it, since
+ * reading back a video bitmap is slow.
+ */
+static void draw_df_glyph_software(DF_DRAW *st,
+   ALLEGRO_TTF_GLYPH_DATA const *glyph, ALLEGRO_COLOR color,
+   float x, float y, float scale_x, float scale_y)
+{
+   ALLEGRO_TTF_FONT_DATA *data = st->font->data;
+   int gw = glyph->region.w - 2;
+   int gh = glyph->region.h - 2;
+   int ix = (int)floorf(x);
+   int iy = (int)floorf(y);
+   int dw = (int)ceilf(x + gw * scale_x) - ix;
+   int dh = (int)ceilf(y + gh * scale_y) - iy;
+   float edge = 2 * data->df_spread *
+      (scale_x < scale_y ? scale_x : scale_y);
+   float inv_scale_x = 1 / scale_x;
+   bool premul = !(data->flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+   unsigned char const *src_data;
+   ALLEGRO_LOCKED_REGION *dst;
+   int i, j;
+
+   if (dw <= 0 || dh <= 0 || !is_df_glyph_visible(ix, iy, dw, dh))
+      return;
+
+   if (!data->df_scratch || al_get_bitmap_width(data->df_scratch) < dw ||
+         al_get_bitmap_height(data->df_scratch) < dh) {
+      ALLEGRO_STATE state;
+      int w = dw, h = dh;
+
+      if (data->df_scratch) {
+         w = _ALLEGRO_MAX(w, al_get_bitmap_width(data->df_scratch));
+         h = _ALLEGRO_MAX(h, al_get_bitmap_height(data->df_scratch));
+         al_destroy_bitmap(data->df_scratch);
+      }
+      _al_push_destructor_owner();
+      al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+      al_set_new_bitmap_format(data->bitmap_format);
+      al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+      data->df_scratch = al_create_bitmap(w, h);
+      al_restore_state(&state);
+      _al_pop_destructor_owner();
+      if (!data->df_scratch)
+         return;
+   }
+
+   if (st->read_page != glyph->page_bitmap) {
+      release_df_page(st);
+      unlock_current_page(data);
+      st->read_page = glyph->page_bitmap;
+      st->read_lr = al_lock_bitmap(st->read_page,
+         ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+   }
+   if (!st->read_lr)
+      return;
+   src_data = (unsigned char const *)st->read_lr->data +
+      (glyph->region.y + 1) * st->read_lr->pitch + (glyph->region.x + 1) * 4;
+
+   dst = al_lock_bitmap_region(data->df_scratch, 0, 0, dw, dh,
+      ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+   if (!dst)
+      return;
+
+   /* Bilinear filtering of the pixel centers. */
+   for (j = 0; j < dh; j++) {
+      unsigned char *dptr = (unsigned char *)dst->data + j * dst->pitch;
+      unsigned char const *rows[2];
+      float v = (iy + j + 0.5f - y) / scale_y - 0.5f;
+      int y0 = (int)floorf(v);
+      float fy = v - y0;
+      for (i = 0; i < 2; i++) {
+         rows[i] = (y0 + i >= 0 && y0 + i < gh) ?
+            src_data + (y0 + i) * st->read_lr->pitch : NULL;
+      }
+      for (i = 0; i < dw; i++) {
+         float u = (ix + i + 0.5f - x) * inv_scale_x - 0.5f;
+         /* u is never far below 0, this is floorf without a call. */
+         int x0 = (int)(u + 16) - 16;
+         float fx = u - x0;
+         float d = (df_texel(rows[0], x0, gw) * (1 - fx) +
+               df_texel(rows[0], x0 + 1, gw) * fx) * (1 - fy) +
+            (df_texel(rows[1], x0, gw) * (1 - fx) +
+               df_texel(rows[1], x0 + 1, gw) * fx) * fy;
+         float c = (d / 255.0f - 0.5f) * edge + 0.5f;
+         unsigned char a;
+         c = _ALLEGRO_CLAMP(0.0f, c, 1.0f);
+         a = (unsigned char)(c * 255 + 0.5f);
+         *dptr++ = premul ? a : 255;
+         *dptr++ = premul ? a : 255;
+         *dptr++ = premul ? a : 255;
+         *dptr++ = a;
+      }
+   }
+
+   al_unlock_bitmap(data->df_scratch);
+
+   al_draw_tinted_bitmap_region(data->df_scratch, color, 0, 0, dw, dh,
+      ix, iy, 0);
+}
+
+
+static void draw_df_glyph(DF_DRAW *st, ALLEGRO_TTF_GLYPH_DATA const *glyph,
+   ALLEGRO_COLOR color, float x, float y)
+{
+   ALLEGRO_TTF_DF_FONT const *df = df_font(st->font);
+   int sw = glyph->region.w - 2;
+   int sh = glyph->region.h - 2;
+
+   if (st->use_shader &&
+         !(al_get_bitmap_flags(glyph->page_bitmap) & ALLEGRO_MEMORY_BITMAP)) {
+      set_df_shader(st, true);
+      if (st->shader_active) {
+         al_draw_tinted_scaled_bitmap(glyph->page_bitmap, color,
+            glyph->region.x + 1, glyph->region.y + 1, sw, sh,
+            x, y, sw * df->scale_x, sh * df->scale_y, 0);
+         return;
+      }
+   }
+
+   set_df_shader(st, false);
+   draw_df_glyph_software(st, glyph, color, x, y,
+      df->scale_x, df->scale_y);
+}
+
+
+/* Draws a glyph of a fallback font, which may need to be drawn by its
+ * own font if it's a distance field font, too.
+ */
+static int render_fallback_glyph(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
+   int32_t prev_ch, int32_t ch, float xpos, float ypos)
+{
+   ALLEGRO_GLYPH glyph;
+
+   memset(&glyph, 0, sizeof(glyph));
+   if (!f->vtable->get_glyph(f, prev_ch, ch, &glyph))
+      return 0;
+
+   if (glyph.bitmap) {
+      al_draw_tinted_bitmap_region(glyph.bitmap, color,
+         glyph.x, glyph.y, glyph.w, glyph.h,
+         xpos + glyph.offset_x + glyph.kerning, ypos + glyph.offset_y, 0);
+   }
+   else if (glyph.w > 0 && glyph.h > 0) {
+      f->vtable->render_char(f, color, ch, xpos + glyph.kerning, ypos);
+   }
+
+   return glyph.advance;
+}
+
+
+static int render_df_glyph(DF_DRAW *st, ALLEGRO_COLOR color,
+   int prev_ft_index, int ft_index, int32_t prev_ch, int32_t ch,
+   float xpos, float ypos)
+{
+   ALLEGRO_FONT const *f = st->font;
+   ALLEGRO_TTF_DF_FONT const *df = df_font(f);
+   ALLEGRO_TTF_FONT_DATA *data = f->data;
+   ALLEGRO_TTF_GLYPH_DATA *glyph;
+   int kerning;
+
+   if (!get_glyph(data, ft_index, &glyph)) {
+      if (f->fallback) {
+         /* The fallback may share the pages of this font. */
+         release_df_page(st);
+         set_df_shader(st, false);
+         return render_fallback_glyph(f->fallback, color, prev_ch, ch,
+            xpos, ypos);
+      }
+      get_glyph(data, 0, &glyph);
+      ft_index = 0;
+   }
+
+   /* Caching locks the page for writing. */
+   if (!glyph->page_bitmap)
+      release_df_page(st);
+   cache_glyph(data, data->face, ft_index, glyph, false);
+   kerning = get_kerning(f, data->face, prev_ft_index, ft_index);
+
+   if (glyph->page_bitmap) {
+      draw_df_glyph(st, glyph, color,
+         xpos + kerning + glyph->offset_x * df->scale_x,
+         ypos + df->ascent + glyph->offset_y * df->scale_y);
+   }
+
+   return kerning + get_advance(f, glyph);
+}
+
+
 static int ttf_font_height(ALLEGRO_FONT const *f)
 {
    ASSERT(f);
@@ -598,6 +1938,9 @@ static int ttf_font_ascent(ALLEGRO_FONT const *f)
     data = f->data;
     face = data->face;
 
+    if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD)
+       return df_font(f)->ascent;
+
     return face->size->metrics.ascender >> 6;
 }
 
@@ -612,6 +1955,9 @@ static int ttf_font_descent(ALLEGRO_FONT const *f)
     data = f->data;
     face = data->face;
 
+    if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD)
+       return df_font(f)->descent;
+
     return (-face->size->metrics.descender) >> 6;
 }
 
@@ -625,6 +1971,15 @@ static int ttf_render_char(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
    int32_t ch32 = (int32_t) ch;
 
    int ft_index = FT_Get_Char_Index(face, ch32);
+
+   if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD) {
+      DF_DRAW st;
+      begin_df_draw(&st, f);
+      advance = render_df_glyph(&st, color, -1, ft_index, -1, ch, xpos, ypos);
+      end_df_draw(&st);
+      return advance;
+   }
+
    advance = render_glyph(f, color, -1, ft_index, -1, ch, xpos, ypos);
 
    return advance;
@@ -648,7 +2003,13 @@ static int ttf_char_length(ALLEGRO_FONT const *f, int ch)
       }
    }
    cache_glyph(data, face, ft_index, glyph, false);
-   result = glyph->region.w - 2;
+   if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD) {
+      int x, y, h;
+      get_glyph_box(f, glyph, &x, &y, &result, &h);
+   }
+   else {
+      result = glyph->region.w - 2;
+   }
 
    return result;
 }
@@ -666,6 +2027,20 @@ static int ttf_render(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
    int32_t ch;
    bool hold;
 
+   if (data->flags & ALLEGRO_TTF_DISTANCE_FIELD) {
+      DF_DRAW st;
+      begin_df_draw(&st, f);
+      while ((ch = al_ustr_get_next(text, &pos)) >= 0) {
+         int ft_index = FT_Get_Char_Index(face, ch);
+         advance += render_df_glyph(&st, color, prev_ft_index, ft_index,
+            prev_ch, ch, x + advance, y);
+         prev_ft_index = ft_index;
+         prev_ch = ch;
+      }
+      end_df_draw(&st);
+      return advance;
+   }
+
    hold = al_is_bitmap_drawing_held();
    al_hold_bitmap_drawing(true);
 
@@ -772,18 +2147,15 @@ static void debug_cache(ALLEGRO_FONT *f)
 #endif
 
 
-static void ttf_destroy(ALLEGRO_FONT *f)
+static void ttf_destroy_data(ALLEGRO_TTF_FONT_DATA *data)
 {
-   ALLEGRO_TTF_FONT_DATA *data = f->data;
    int i;
 
    unlock_current_page(data);
 
-#ifdef DEBUG_CACHE
-   debug_cache(f);
-#endif
-
+   al_lock_mutex(ft_mutex);
    FT_Done_Face(data->face);
+   al_unlock_mutex(ft_mutex);
    for (i = _al_vector_size(&data->glyph_ranges) - 1; i >= 0; i--) {
       ALLEGRO_TTF_GLYPH_RANGE *range = _al_vector_ref(&data->glyph_ranges, i);
       al_free(range->glyphs);
@@ -794,7 +2166,24 @@ static void ttf_destroy(ALLEGRO_FONT *f)
       al_destroy_bitmap(*bmp);
    }
    _al_vector_free(&data->page_bitmaps);
+   _al_vector_free(&data->skyline);
+   al_destroy_bitmap(data->df_scratch);
    al_free(data);
+}
+
+
+static void ttf_destroy(ALLEGRO_FONT *f)
+{
+   ALLEGRO_TTF_FONT_DATA *data = f->data;
+
+   /* Sizes of a distance field font share its data. */
+   if (--data->refcount == 0) {
+#ifdef DEBUG_CACHE
+      debug_cache(f);
+#endif
+      ttf_destroy_data(data);
+   }
+
    al_free(f);
 }
 
@@ -823,6 +2212,49 @@ static void ftclose(FT_Stream  stream)
     data->file = NULL;
 }
 
+/* Creates a font which draws the distance field glyphs of data at the
+ * size given like for al_load_ttf_font_stretch.
+ */
+static ALLEGRO_FONT *create_df_font(ALLEGRO_TTF_FONT_DATA *data, int w, int h)
+{
+   FT_Face face = data->face;
+   ALLEGRO_TTF_DF_FONT *df;
+   float em_w, em_h, units;
+
+   if (h < 0) {
+      /* See FT_SIZE_REQUEST_TYPE_REAL_DIM. */
+      float real_dim = face->ascender - face->descender;
+      em_h = -h * face->units_per_EM / real_dim;
+      em_w = w < 0 ? -w * face->units_per_EM / real_dim : em_h;
+   }
+   else {
+      em_h = h;
+      em_w = w > 0 ? w : h;
+   }
+
+   df = al_calloc(1, sizeof *df);
+   if (!df)
+      return NULL;
+
+   df->scale_x = em_w / data->df_size;
+   df->scale_y = em_h / data->df_size;
+
+   /* Rounded like the metrics of hinted sizes. */
+   units = em_h / face->units_per_EM;
+   df->ascent = (int)ceilf(face->ascender * units);
+   df->descent = (int)ceilf(-face->descender * units);
+
+   df->font.height = scaled(face->height, units);
+   df->font.vtable = &vt;
+   df->font.data = data;
+
+   df->font.dtor_item = _al_register_destructor(_al_dtor_list, "ttf_font",
+      &df->font, (void (*)(void *))al_destroy_font);
+
+   return &df->font;
+}
+
+
 /* Function: al_load_ttf_font_f
  */
 ALLEGRO_FONT *al_load_ttf_font_f(ALLEGRO_FILE *file,
@@ -843,6 +2275,10 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
     ALLEGRO_PATH *path;
     FT_Open_Args args;
     int result;
+    const unsigned char *memory;
+    int64_t memory_size;
+    int face_w = w;
+    int face_h = h;
     ALLEGRO_CONFIG* system_cfg = al_get_system_config();
     const char* min_page_size_str =
       al_get_config_value(system_cfg, "ttf", "min_page_size");
@@ -852,6 +2288,8 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
       al_get_config_value(system_cfg, "ttf", "cache_text");
     const char* skip_cache_misses_str =
       al_get_config_value(system_cfg, "ttf", "skip_cache_misses");
+    const char* df_size_str =
+      al_get_config_value(system_cfg, "ttf", "distance_field_size");
 
     if ((h > 0 && w < 0) || (h < 0 && w > 0)) {
        ALLEGRO_ERROR("Height/width have opposite signs (w = %d, h = %d).\n", w, h);
@@ -865,6 +2303,15 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
     data->base_offset = al_ftell(file);
     data->stream.size = al_fsize(file);
     data->file = file;
+
+    /* If the file is in memory anyway, let FreeType read it in place. */
+    memory = al_get_file_memory(file, &memory_size);
+    if (memory && (uint64_t)data->base_offset < (uint64_t)memory_size) {
+       data->stream.read = NULL;
+       data->stream.base = (unsigned char *)memory + data->base_offset;
+       data->stream.size = memory_size - data->base_offset;
+    }
+
     data->bitmap_format = al_get_new_bitmap_format();
     data->bitmap_flags = al_get_new_bitmap_flags();
     data->min_page_size = 256;
@@ -888,11 +2335,23 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
        data->skip_cache_misses = true;
     }
 
+    data->df_size = DISTANCE_FIELD_SIZE;
+    if (df_size_str) {
+      int df_size = atoi(df_size_str);
+      if (df_size > 0 && df_size <= DISTANCE_FIELD_MAX_SIZE) {
+         data->df_size = df_size;
+      }
+    }
+    data->df_spread = _ALLEGRO_MAX(2, data->df_size / 8);
+
     memset(&args, 0, sizeof args);
     args.flags = FT_OPEN_STREAM;
     args.stream = &data->stream;
 
-    if ((result = FT_Open_Face(ft, &args, 0, &face)) != 0) {
+    al_lock_mutex(ft_mutex);
+    result = FT_Open_Face(ft, &args, 0, &face);
+    al_unlock_mutex(ft_mutex);
+    if (result != 0) {
         ALLEGRO_ERROR("Reading %s failed. Freetype error code %d\n", filename,
           result);
         // Note: Freetype already closed the file for us.
@@ -921,36 +2380,39 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
     }
     al_destroy_path(path);
 
-    if (h > 0) {
-       FT_Set_Pixel_Sizes(face, w, h);
-    }
-    else {
-       /* Set the "real dimension" of the font to be the passed size,
-        * in pixels.
-        */
-       FT_Size_RequestRec req;
-       ASSERT(w <= 0);
-       ASSERT(h <= 0);
-       req.type = FT_SIZE_REQUEST_TYPE_REAL_DIM;
-       req.width = (-w) << 6;
-       req.height = (-h) << 6;
-       req.horiResolution = 0;
-       req.vertResolution = 0;
-       FT_Request_Size(face, &req);
+    if (flags & ALLEGRO_TTF_DISTANCE_FIELD) {
+       if (!FT_IS_SCALABLE(face)) {
+          ALLEGRO_ERROR("%s has no outlines for distance fields.\n", filename);
+          al_lock_mutex(ft_mutex);
+          FT_Done_Face(face);
+          al_unlock_mutex(ft_mutex);
+          al_free(data);
+          return NULL;
+       }
+       /* All sizes are drawn from glyphs of this size. */
+       face_w = 0;
+       face_h = data->df_size;
+       data->bitmap_flags |= ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR;
     }
 
+    set_face_size(face, face_w, face_h);
+
     ALLEGRO_DEBUG("Font %s loaded with pixel size %d x %d.\n", filename,
-        w, h);
+        face_w, face_h);
     ALLEGRO_DEBUG("    ascent=%.1f, descent=%.1f, height=%.1f\n",
         face->size->metrics.ascender / 64.0,
         face->size->metrics.descender / 64.0,
         face->size->metrics.height / 64.0);
 
     data->face = face;
+    data->face_w = face_w;
+    data->face_h = face_h;
     data->flags = flags;
+    data->refcount = 1;
 
     _al_vector_init(&data->glyph_ranges, sizeof(ALLEGRO_TTF_GLYPH_RANGE));
     _al_vector_init(&data->page_bitmaps, sizeof(ALLEGRO_BITMAP*));
+    _al_vector_init(&data->skyline, sizeof(SKYLINE_NODE));
 
     if (data->skip_cache_misses) {
        cache_glyphs(data, "\0", 1);
@@ -960,6 +2422,13 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
     }
     unlock_current_page(data);
 
+    if (flags & ALLEGRO_TTF_DISTANCE_FIELD) {
+       f = create_df_font(data, w, h);
+       if (!f)
+          ttf_destroy_data(data);
+       return f;
+    }
+
     f = al_calloc(sizeof *f, 1);
     f->height = face->size->metrics.height >> 6;
     f->vtable = &vt;
@@ -980,6 +2449,77 @@ ALLEGRO_FONT *al_load_ttf_font(char const *filename, int size, int flags)
 }
 
 
+typedef struct ASYNC_TTF_FONT
+{
+   int size;
+   int flags;
+   int bitmap_flags;
+   int bitmap_format;
+} ASYNC_TTF_FONT;
+
+
+/* The glyph pages are created with the new bitmap parameters of the thread
+ * which queued the font, not those of the loader thread.
+ */
+static void *async_ttf_load(const char *filename, void *arg)
+{
+   ASYNC_TTF_FONT *af = arg;
+   ALLEGRO_STATE state;
+   ALLEGRO_FONT *font;
+
+   al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+   al_set_new_bitmap_flags(af->bitmap_flags);
+   al_set_new_bitmap_format(af->bitmap_format);
+   font = al_load_ttf_font(filename, af->size, af->flags);
+   al_restore_state(&state);
+
+   return font;
+}
+
+
+static void async_ttf_finish(void *result, void *arg)
+{
+   (void)result;
+   al_free(arg);
+}
+
+
+static void async_ttf_destroy(void *result, void *arg)
+{
+   al_destroy_font(result);
+   al_free(arg);
+}
+
+
+/* Function: al_load_ttf_font_async
+ */
+ALLEGRO_LOAD_REQUEST *al_load_ttf_font_async(ALLEGRO_LOADER *loader,
+   char const *filename, int size, int flags, int priority)
+{
+   ASYNC_TTF_FONT *af;
+   ALLEGRO_LOAD_REQUEST *req;
+
+   ASSERT(loader);
+   ASSERT(filename);
+
+   af = al_malloc(sizeof(*af));
+   if (!af)
+      return NULL;
+
+   af->size = size;
+   af->flags = flags;
+   af->bitmap_flags = al_get_new_bitmap_flags();
+   af->bitmap_format = al_get_new_bitmap_format();
+
+   req = al_queue_load(loader, filename, priority, async_ttf_load,
+      async_ttf_finish, async_ttf_destroy, af);
+   if (!req)
+      al_free(af);
+
+   return req;
+}
+
+
 /* Function: al_load_ttf_font_stretch
  */
 ALLEGRO_FONT *al_load_ttf_font_stretch(char const *filename, int w, int h,
@@ -1005,6 +2545,38 @@ ALLEGRO_FONT *al_load_ttf_font_stretch(char const *filename, int w, int h,
 }
 
 
+/* Function: al_derive_ttf_font
+ */
+ALLEGRO_FONT *al_derive_ttf_font(ALLEGRO_FONT *font, int size)
+{
+   ALLEGRO_TTF_FONT_DATA *data;
+   ALLEGRO_FONT *f;
+   ASSERT(font);
+
+   if (font->vtable != &vt) {
+      ALLEGRO_ERROR("Not a TTF font.\n");
+      return NULL;
+   }
+
+   data = font->data;
+   if (!(data->flags & ALLEGRO_TTF_DISTANCE_FIELD)) {
+      ALLEGRO_ERROR("Font was not loaded with ALLEGRO_TTF_DISTANCE_FIELD.\n");
+      return NULL;
+   }
+
+   if (size == 0) {
+      ALLEGRO_ERROR("Invalid font size 0.\n");
+      return NULL;
+   }
+
+   f = create_df_font(data, 0, size);
+   if (f)
+      data->refcount++;
+
+   return f;
+}
+
+
 static int ttf_get_font_ranges(ALLEGRO_FONT *font, int ranges_count,
    int *ranges)
 {
@@ -1054,10 +2626,7 @@ static bool ttf_get_glyph_dimensions(ALLEGRO_FONT const *f,
       }
    }
    cache_glyph(data, face, ft_index, glyph, false);
-   *bbx = glyph->offset_x;
-   *bbw = glyph->region.w - 2;
-   *bbh = glyph->region.h - 2;
-   *bby = glyph->offset_y;
+   get_glyph_box(f, glyph, bbx, bby, bbw, bbh);
 
    return true;
 }
@@ -1090,10 +2659,10 @@ static int ttf_get_glyph_advance(ALLEGRO_FONT const *f, int codepoint1,
    if (codepoint2 != ALLEGRO_NO_KERNING) {
       int ft_index1 = FT_Get_Char_Index(face, codepoint1);
       int ft_index2 = FT_Get_Char_Index(face, codepoint2);
-      kerning = get_kerning(data, face, ft_index1, ft_index2);
+      kerning = get_kerning(f, face, ft_index1, ft_index2);
    }
 
-   advance = glyph->advance;
+   advance = get_advance(f, glyph);
    return advance + kerning;
 }
 
@@ -1109,6 +2678,7 @@ bool al_init_ttf_addon(void)
    }
 
    FT_Init_FreeType(&ft);
+   ft_mutex = al_create_mutex();
    vt.font_height = ttf_font_height;
    vt.font_ascent = ttf_font_ascent;
    vt.font_descent = ttf_font_descent;
@@ -1145,7 +2715,18 @@ void al_shutdown_ttf_addon(void)
 
    al_register_font_loader(".ttf", NULL);
 
+   while (_al_vector_is_nonempty(&df_shaders)) {
+      DF_SHADER *entry = _al_vector_ref_back(&df_shaders);
+      _al_remove_display_destroyed_callback(entry->display,
+         df_display_destroyed);
+      al_destroy_shader(entry->shader);
+      _al_vector_delete_at(&df_shaders, _al_vector_size(&df_shaders) - 1);
+   }
+   _al_vector_free(&df_shaders);
+
    FT_Done_FreeType(ft);
+   al_destroy_mutex(ft_mutex);
+   ft_mutex = NULL;
 
    ttf_inited = false;
 }
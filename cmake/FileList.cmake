@@ -10,6 +10,7 @@ set(ALLEGRO_SRC_FILES
     src/clipboard.c
     src/config.c
     src/convert.c
+    src/convert_simd.c
     src/cpu.c
     src/debug.c
     src/display.c
@@ -20,6 +21,7 @@ set(ALLEGRO_SRC_FILES
     src/evtsrc.c
     src/exitfunc.c
     src/file.c
+    src/file_mmap.c
     src/file_slice.c
     src/file_stdio.c
     src/fshook.c
@@ -30,6 +32,7 @@ set(ALLEGRO_SRC_FILES
     src/joynu.c
     src/keybdnu.c
     src/libc.c
+    src/loader.c
     src/math.c
     src/memblit.c
     src/memdraw.c
@@ -37,6 +40,7 @@ set(ALLEGRO_SRC_FILES
     src/monitor.c
     src/mousenu.c
     src/mouse_cursor.c
+    src/parallel.c
     src/path.c
     src/pixels.c
     src/shader.c
@@ -238,6 +242,7 @@ set(ALLEGRO_INCLUDE_ALLEGRO_FILES
     include/allegro5/joystick.h
     include/allegro5/keyboard.h
     include/allegro5/keycodes.h
+    include/allegro5/loader.h
     include/allegro5/memory.h
     include/allegro5/monitor.h
     include/allegro5/mouse.h
@@ -16,6 +16,7 @@ set(PAGES
     haptic
     joystick
     keyboard
+    loader
     memory
     misc
     monitor
@@ -0,0 +1,144 @@
+/*
+ *    Example program for the Allegro library.
+ *
+ *    Benchmark pixel format conversions by locking memory bitmaps in a
+ *    different format than they were created with.
+ *
+ *    Set simd_converters=false in the [graphics] section of allegro5.cfg
+ *    to compare against the plain C converters.
+ *
+ *    Usage: ex_convert_bench [size] [iterations]
+ */
+
+#define ALLEGRO_UNSTABLE
+#include <stdio.h>
+#include <stdlib.h>
+#include "allegro5/allegro.h"
+
+#include "common.c"
+
+typedef struct CONVERSION
+{
+   ALLEGRO_PIXEL_FORMAT src;
+   ALLEGRO_PIXEL_FORMAT dst;
+   const char *name;
+} CONVERSION;
+
+static const CONVERSION conversions[] = {
+   {ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      "ARGB_8888    -> ABGR_8888_LE"},
+   {ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_PIXEL_FORMAT_ARGB_8888,
+      "ABGR_8888_LE -> ARGB_8888"},
+   {ALLEGRO_PIXEL_FORMAT_XRGB_8888, ALLEGRO_PIXEL_FORMAT_RGBA_8888,
+      "XRGB_8888    -> RGBA_8888"},
+   {ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_PIXEL_FORMAT_RGB_565,
+      "ARGB_8888    -> RGB_565"},
+   {ALLEGRO_PIXEL_FORMAT_RGB_565, ALLEGRO_PIXEL_FORMAT_ARGB_8888,
+      "RGB_565      -> ARGB_8888"},
+   {ALLEGRO_PIXEL_FORMAT_RGBA_8888, ALLEGRO_PIXEL_FORMAT_RGBA_4444,
+      "RGBA_8888    -> RGBA_4444"},
+   {ALLEGRO_PIXEL_FORMAT_RGBA_4444, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      "RGBA_4444    -> ABGR_8888_LE"},
+   {ALLEGRO_PIXEL_FORMAT_ABGR_F32, ALLEGRO_PIXEL_FORMAT_ARGB_8888,
+      "ABGR_F32     -> ARGB_8888"},
+   {ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_PIXEL_FORMAT_ABGR_F32,
+      "ARGB_8888    -> ABGR_F32"},
+};
+
+
+static ALLEGRO_BITMAP *create_source(ALLEGRO_PIXEL_FORMAT format, int size)
+{
+   ALLEGRO_BITMAP *bitmap;
+   ALLEGRO_LOCKED_REGION *lr;
+   int x, y;
+
+   al_set_new_bitmap_format(format);
+   bitmap = al_create_bitmap(size, size);
+   if (!bitmap)
+      return NULL;
+
+   /* Fill with random colors, written as ABGR_8888_LE so that every
+    * channel of the source format gets valid values.
+    */
+   lr = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      ALLEGRO_LOCK_WRITEONLY);
+   for (y = 0; y < size; y++) {
+      unsigned char *row = (unsigned char *)lr->data + y * lr->pitch;
+      for (x = 0; x < size * 4; x++) {
+         row[x] = rand() & 255;
+      }
+   }
+   al_unlock_bitmap(bitmap);
+
+   return bitmap;
+}
+
+
+static double run(const CONVERSION *c, int size, int iterations)
+{
+   ALLEGRO_BITMAP *bitmap = create_source(c->src, size);
+   double t0, t1;
+   int i;
+
+   if (!bitmap)
+      abort_example("Could not create bitmap.\n");
+
+   t0 = al_get_time();
+   for (i = 0; i < iterations; i++) {
+      al_lock_bitmap(bitmap, c->dst, ALLEGRO_LOCK_READONLY);
+      al_unlock_bitmap(bitmap);
+   }
+   t1 = al_get_time();
+
+   al_destroy_bitmap(bitmap);
+
+   return t1 - t0;
+}
+
+
+int main(int argc, char **argv)
+{
+   int size = 1024;
+   int iterations = 50;
+   int features;
+   unsigned i;
+
+   if (argc > 1) {
+      size = atoi(argv[1]);
+      if (size < 1)
+         size = 1;
+   }
+   if (argc > 2) {
+      iterations = atoi(argv[2]);
+      if (iterations < 1)
+         iterations = 1;
+   }
+
+   if (!al_init()) {
+      abort_example("Could not init Allegro.\n");
+   }
+
+   open_log();
+
+   al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+   features = al_get_cpu_features();
+   log_printf("CPU features:%s%s%s%s\n",
+      (features & ALLEGRO_CPU_SSE2) ? " SSE2" : "",
+      (features & ALLEGRO_CPU_SSSE3) ? " SSSE3" : "",
+      (features & ALLEGRO_CPU_AVX2) ? " AVX2" : "",
+      (features & ALLEGRO_CPU_NEON) ? " NEON" : "");
+   log_printf("%dx%d pixels, %d iterations\n", size, size, iterations);
+
+   for (i = 0; i < sizeof(conversions) / sizeof(conversions[0]); i++) {
+      double t = run(&conversions[i], size, iterations);
+      log_printf("%s: %8.1f Mpixels/s\n", conversions[i].name,
+         (double)size * size * iterations / t / 1e6);
+   }
+
+   close_log(true);
+
+   return 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
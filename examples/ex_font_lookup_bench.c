@@ -0,0 +1,217 @@
+/*
+ *    Example program for the Allegro library.
+ *
+ *    Benchmark glyph and kerning lookups by measuring a long string of
+ *    mixed Latin and CJK text with a bitmap font and a BMFont which both
+ *    have thousands of codepoint ranges.
+ *
+ *    Usage: ex_font_lookup_bench [ranges] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_font.h"
+
+#include "common.c"
+
+#define GLYPH_W      4
+#define GLYPH_H      6
+#define PER_ROW      200
+#define RANGE_SIZE   3
+#define CJK_FIRST    0x4E00
+#define ASTRAL_FIRST 0x20000
+#define TEXT_LENGTH  20000
+
+/* Codepoints are grouped into short ranges with gaps between them, the
+ * way a CJK subset with a hand picked character list looks.
+ */
+static int range_start(int i, int ranges)
+{
+   if (i == 0)
+      return 32;
+   if (i < ranges / 2)
+      return CJK_FIRST + (i - 1) * (RANGE_SIZE + 2);
+   return ASTRAL_FIRST + (i - ranges / 2) * (RANGE_SIZE + 2);
+}
+
+
+static int range_size(int i)
+{
+   return i == 0 ? 95 : RANGE_SIZE;
+}
+
+
+/* Draws one small box per glyph, separated by the mask color, in the
+ * layout al_grab_font_from_bitmap expects.
+ */
+static ALLEGRO_FONT *create_bitmap_font(int ranges)
+{
+   ALLEGRO_BITMAP *bmp;
+   ALLEGRO_FONT *font;
+   ALLEGRO_COLOR mask = al_map_rgb(255, 255, 0);
+   ALLEGRO_COLOR white = al_map_rgb(255, 255, 255);
+   int *range_array;
+   int num_glyphs = 0;
+   int i, x, y;
+
+   range_array = malloc(ranges * 2 * sizeof(int));
+   for (i = 0; i < ranges; i++) {
+      range_array[i * 2] = range_start(i, ranges);
+      range_array[i * 2 + 1] = range_start(i, ranges) + range_size(i) - 1;
+      num_glyphs += range_size(i);
+   }
+
+   bmp = al_create_bitmap(PER_ROW * (GLYPH_W + 2),
+      (num_glyphs / PER_ROW + 1) * (GLYPH_H + 2) + 1);
+   al_set_target_bitmap(bmp);
+   al_clear_to_color(mask);
+   al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READWRITE);
+   for (i = 0; i < num_glyphs; i++) {
+      int gx = (i % PER_ROW) * (GLYPH_W + 2) + 1;
+      int gy = (i / PER_ROW) * (GLYPH_H + 2) + 1;
+      for (y = 0; y < GLYPH_H; y++) {
+         for (x = 0; x < GLYPH_W; x++) {
+            al_put_pixel(gx + x, gy + y, white);
+         }
+      }
+   }
+   al_unlock_bitmap(bmp);
+
+   font = al_grab_font_from_bitmap(bmp, ranges, range_array);
+
+   al_destroy_bitmap(bmp);
+   free(range_array);
+   return font;
+}
+
+
+/* Writes a BMFont description with the same ranges and a few kerning
+ * pairs for every character. It has no pages, so it can only be measured.
+ */
+static ALLEGRO_FONT *create_bmfont(int ranges)
+{
+   ALLEGRO_PATH *path;
+   ALLEGRO_FILE *f;
+   ALLEGRO_FONT *font;
+   int i, j, k;
+
+   f = al_make_temp_file("ex_font_lookup_XXXXXX.fnt", &path);
+   if (!f)
+      return NULL;
+
+   al_fputs(f, "<font>\n<common lineHeight=\"8\" base=\"6\"/>\n<chars>\n");
+   for (i = 0; i < ranges; i++) {
+      for (j = 0; j < range_size(i); j++) {
+         al_fprintf(f, "<char id=\"%d\" x=\"0\" y=\"0\" width=\"%d\" "
+            "height=\"%d\" xoffset=\"0\" yoffset=\"0\" xadvance=\"%d\"/>\n",
+            range_start(i, ranges) + j, GLYPH_W, GLYPH_H, GLYPH_W + 1);
+      }
+   }
+   al_fputs(f, "</chars>\n<kernings>\n");
+   for (i = 0; i < ranges; i++) {
+      for (j = 0; j < range_size(i); j++) {
+         for (k = 0; k < 16; k++) {
+            al_fprintf(f, "<kerning first=\"%d\" second=\"%d\" "
+               "amount=\"-1\"/>\n", range_start(i, ranges) + j,
+               range_start((i + k * 7) % ranges, ranges));
+         }
+      }
+   }
+   al_fputs(f, "</kernings>\n</font>\n");
+   al_fclose(f);
+
+   font = al_load_font(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP), 0, 0);
+
+   al_remove_filename(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+   al_destroy_path(path);
+   return font;
+}
+
+
+/* Mostly CJK with some Latin words in between. */
+static ALLEGRO_USTR *create_text(int ranges)
+{
+   ALLEGRO_USTR *text = al_ustr_new("");
+   int i;
+
+   for (i = 0; i < TEXT_LENGTH; i++) {
+      int r = rand() % 4 == 0 ? 0 : 1 + rand() % (ranges - 1);
+      al_ustr_append_chr(text,
+         range_start(r, ranges) + rand() % range_size(r));
+   }
+
+   return text;
+}
+
+
+static void run(const char *name, ALLEGRO_FONT *font,
+   const ALLEGRO_USTR *text, int iterations)
+{
+   double t0, t1;
+   int width = 0;
+   int i;
+
+   t0 = al_get_time();
+   for (i = 0; i < iterations; i++) {
+      width += al_get_ustr_width(font, text);
+   }
+   t1 = al_get_time();
+
+   log_printf("%-12s %8.2f Mglyphs/s (width %d)\n", name,
+      (double)al_ustr_length(text) * iterations / (t1 - t0) / 1e6,
+      width / iterations);
+}
+
+
+int main(int argc, char **argv)
+{
+   ALLEGRO_FONT *bitmap_font;
+   ALLEGRO_FONT *bmfont;
+   ALLEGRO_USTR *text;
+   int ranges = 4000;
+   int iterations = 20;
+
+   if (argc > 1) {
+      ranges = atoi(argv[1]);
+      if (ranges < 2)
+         ranges = 2;
+   }
+   if (argc > 2) {
+      iterations = atoi(argv[2]);
+      if (iterations < 1)
+         iterations = 1;
+   }
+
+   if (!al_init()) {
+      abort_example("Could not init Allegro.\n");
+   }
+   al_init_font_addon();
+
+   open_log();
+
+   al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+   bitmap_font = create_bitmap_font(ranges);
+   if (!bitmap_font)
+      abort_example("Could not create bitmap font.\n");
+   bmfont = create_bmfont(ranges);
+   if (!bmfont)
+      abort_example("Could not create BMFont.\n");
+   text = create_text(ranges);
+
+   log_printf("%d ranges, %d characters, %d iterations\n", ranges,
+      TEXT_LENGTH, iterations);
+   run("bitmap font", bitmap_font, text, iterations);
+   run("BMFont", bmfont, text, iterations);
+
+   al_ustr_free(text);
+   al_destroy_font(bmfont);
+   al_destroy_font(bitmap_font);
+
+   close_log(true);
+
+   return 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
@@ -0,0 +1,134 @@
+/*
+ *    Example program for the Allegro library.
+ *
+ *    Benchmark logging from several threads at once, with the log file
+ *    written by the logging threads and by a writer thread, and with text
+ *    and binary output. Reports how long the threads spend in each log
+ *    call. The messages go to allegro.log, or the file named by the
+ *    ALLEGRO_TRACE environment variable.
+ *
+ *    Usage: ex_log_bench [threads] [messages per thread]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "allegro5/allegro.h"
+
+#include "common.c"
+
+ALLEGRO_DEBUG_CHANNEL("bench")
+
+#define MAX_THREADS  64
+
+typedef struct LOGGER
+{
+   ALLEGRO_THREAD *thread;
+   int num_messages;
+   double total;
+   double worst;
+} LOGGER;
+
+static LOGGER loggers[MAX_THREADS];
+
+
+static void *logger_proc(ALLEGRO_THREAD *thread, void *arg)
+{
+   LOGGER *logger = arg;
+   double t0, t1;
+   int i;
+
+   (void)thread;
+
+   for (i = 0; i < logger->num_messages; i++) {
+      t0 = al_get_time();
+      ALLEGRO_INFO("message %d of %d, some text to make it longer\n", i,
+         logger->num_messages);
+      t1 = al_get_time();
+
+      logger->total += t1 - t0;
+      if (t1 - t0 > logger->worst)
+         logger->worst = t1 - t0;
+
+      /* Log a few hundred messages a second, like a busy audio thread. */
+      al_rest(0.002);
+   }
+
+   return NULL;
+}
+
+
+static void run(const char *name, const char *async, const char *format,
+   int num_threads, int num_messages)
+{
+   ALLEGRO_CONFIG *config;
+   double total = 0;
+   double worst = 0;
+   int i;
+
+   /* The logging configuration is read by al_init. */
+   config = al_get_system_config();
+   al_set_config_value(config, "trace", "level", "info");
+   al_set_config_value(config, "trace", "async", async);
+   al_set_config_value(config, "trace", "format", format);
+
+   if (!al_init()) {
+      abort_example("Could not init Allegro.\n");
+   }
+
+   for (i = 0; i < num_threads; i++) {
+      loggers[i].num_messages = num_messages;
+      loggers[i].total = 0;
+      loggers[i].worst = 0;
+      loggers[i].thread = al_create_thread(logger_proc, &loggers[i]);
+   }
+   for (i = 0; i < num_threads; i++) {
+      al_start_thread(loggers[i].thread);
+   }
+   for (i = 0; i < num_threads; i++) {
+      al_join_thread(loggers[i].thread, NULL);
+      al_destroy_thread(loggers[i].thread);
+      total += loggers[i].total;
+      if (loggers[i].worst > worst)
+         worst = loggers[i].worst;
+   }
+
+   al_uninstall_system();
+
+   printf("%-14s %8.2f us per message, worst %8.2f us\n", name,
+      total / (num_threads * num_messages) * 1e6, worst * 1e6);
+}
+
+
+int main(int argc, char **argv)
+{
+   int num_threads = 4;
+   int num_messages = 1000;
+
+   if (argc > 1) {
+      num_threads = atoi(argv[1]);
+      if (num_threads < 1)
+         num_threads = 1;
+      if (num_threads > MAX_THREADS)
+         num_threads = MAX_THREADS;
+   }
+   if (argc > 2) {
+      num_messages = atoi(argv[2]);
+      if (num_messages < 1)
+         num_messages = 1;
+   }
+
+#if !defined(DEBUGMODE) && !defined(ALLEGRO_CFG_RELEASE_LOGGING)
+   abort_example("Logging is not compiled into this build.\n");
+#endif
+
+   printf("%d threads, %d messages per thread\n", num_threads,
+      num_messages);
+   run("text", "0", "text", num_threads, num_messages);
+   run("text, async", "1", "text", num_threads, num_messages);
+   run("binary", "0", "binary", num_threads, num_messages);
+   run("binary, async", "1", "binary", num_threads, num_messages);
+
+   return 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
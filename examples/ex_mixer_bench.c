@@ -0,0 +1,115 @@
+/*
+ *    Example program for the Allegro library.
+ *
+ *    Benchmark the mixer by playing many sample instances through the
+ *    offline audio driver, which renders as fast as possible without a
+ *    sound device.
+ *
+ *    Usage: ex_mixer_bench [instances] [seconds] [output.wav]
+ */
+
+#define ALLEGRO_UNSTABLE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_audio.h"
+
+#include "common.c"
+
+#define FREQUENCY 44100
+
+static volatile unsigned long rendered = 0;
+
+
+static void count_samples(ALLEGRO_VOICE *voice, const void *buf,
+   unsigned int samples, void *data)
+{
+   (void)voice;
+   (void)buf;
+   (void)data;
+   rendered += samples;
+}
+
+
+static ALLEGRO_SAMPLE *create_tone(float pitch)
+{
+   const int len = FREQUENCY;
+   float *buf = al_malloc(len * 2 * sizeof(float));
+   int i;
+
+   for (i = 0; i < len; i++) {
+      float s = sin(2 * ALLEGRO_PI * pitch * i / FREQUENCY) * 0.01f;
+      buf[i * 2] = s;
+      buf[i * 2 + 1] = s;
+   }
+
+   return al_create_sample(buf, len, FREQUENCY, ALLEGRO_AUDIO_DEPTH_FLOAT32,
+      ALLEGRO_CHANNEL_CONF_2, true);
+}
+
+
+int main(int argc, char **argv)
+{
+   ALLEGRO_SAMPLE *sample;
+   int instances = 200;
+   double seconds = 3;
+   double t;
+   int i;
+
+   if (argc > 1) {
+      instances = atoi(argv[1]);
+      if (instances < 1)
+         instances = 1;
+   }
+   if (argc > 2) {
+      seconds = atof(argv[2]);
+   }
+
+   if (!al_init()) {
+      abort_example("Could not init Allegro.\n");
+   }
+
+   open_log();
+
+   al_set_config_value(al_get_system_config(), "audio", "driver", "offline");
+   if (argc > 3) {
+      al_set_config_value(al_get_system_config(), "offline", "file", argv[3]);
+   }
+   al_set_offline_audio_callback(count_samples, NULL);
+
+   if (!al_install_audio()) {
+      abort_example("Could not init sound.\n");
+   }
+   if (!al_reserve_samples(instances)) {
+      abort_example("Could not set up voice and mixer.\n");
+   }
+
+   sample = create_tone(440);
+   if (!sample) {
+      abort_example("Could not create sample.\n");
+   }
+
+   for (i = 0; i < instances; i++) {
+      /* Spread the speeds so that most instances need resampling. */
+      float speed = 0.5f + (float)i / instances;
+      al_play_sample(sample, 1.0f, 0.0f, speed, ALLEGRO_PLAYMODE_LOOP, NULL);
+   }
+
+   log_printf("Mixing %d sample instances for %.1f seconds...\n",
+      instances, seconds);
+   rendered = 0;
+   al_rest(seconds);
+   t = (double)rendered / FREQUENCY;
+   log_printf("Rendered %.1f seconds of audio, %.1f times real time.\n",
+      t, t / seconds);
+
+   al_destroy_sample(sample);
+   al_uninstall_audio();
+
+   close_log(true);
+
+   return 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
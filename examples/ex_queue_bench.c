@@ -0,0 +1,132 @@
+/*
+ *    Example program for the Allegro library.
+ *
+ *    Benchmark event queues by pushing user events from several threads
+ *    while the main thread drains them, once with a normal queue and once
+ *    with a lock-free queue.
+ *
+ *    Usage: ex_queue_bench [threads] [events per thread]
+ */
+
+#define ALLEGRO_UNSTABLE
+#include <stdio.h>
+#include <stdlib.h>
+#include "allegro5/allegro.h"
+
+#include "common.c"
+
+#define MAX_THREADS  64
+
+typedef struct PRODUCER
+{
+   ALLEGRO_THREAD *thread;
+   ALLEGRO_EVENT_SOURCE source;
+   int num_events;
+} PRODUCER;
+
+static PRODUCER producers[MAX_THREADS];
+
+
+static void *producer_proc(ALLEGRO_THREAD *thread, void *arg)
+{
+   PRODUCER *producer = arg;
+   ALLEGRO_EVENT event;
+   int i;
+
+   (void)thread;
+
+   for (i = 0; i < producer->num_events; i++) {
+      event.user.type = ALLEGRO_GET_EVENT_TYPE('b', 'e', 'n', 'c');
+      event.user.data1 = i;
+      al_emit_user_event(&producer->source, &event, NULL);
+   }
+
+   return NULL;
+}
+
+
+static double run(int flags, int num_threads, int num_events)
+{
+   ALLEGRO_EVENT_QUEUE *queue;
+   ALLEGRO_EVENT event;
+   int total = num_threads * num_events;
+   int received = 0;
+   double t0, t1;
+   int i;
+
+   queue = al_create_event_queue_flags(flags);
+   if (!queue) {
+      abort_example("Could not create event queue.\n");
+   }
+
+   for (i = 0; i < num_threads; i++) {
+      al_init_user_event_source(&producers[i].source);
+      al_register_event_source(queue, &producers[i].source);
+      producers[i].num_events = num_events;
+      producers[i].thread = al_create_thread(producer_proc, &producers[i]);
+   }
+
+   t0 = al_get_time();
+
+   for (i = 0; i < num_threads; i++) {
+      al_start_thread(producers[i].thread);
+   }
+
+   while (received < total) {
+      al_wait_for_event(queue, &event);
+      received++;
+   }
+
+   t1 = al_get_time();
+
+   for (i = 0; i < num_threads; i++) {
+      al_destroy_thread(producers[i].thread);
+      al_destroy_user_event_source(&producers[i].source);
+   }
+   al_destroy_event_queue(queue);
+
+   return t1 - t0;
+}
+
+
+int main(int argc, char **argv)
+{
+   int num_threads = 4;
+   int num_events = 250000;
+   double t;
+
+   if (argc > 1) {
+      num_threads = atoi(argv[1]);
+      if (num_threads < 1)
+         num_threads = 1;
+      if (num_threads > MAX_THREADS)
+         num_threads = MAX_THREADS;
+   }
+   if (argc > 2) {
+      num_events = atoi(argv[2]);
+      if (num_events < 1)
+         num_events = 1;
+   }
+
+   if (!al_init()) {
+      abort_example("Could not init Allegro.\n");
+   }
+
+   open_log();
+
+   log_printf("%d threads, %d events each\n", num_threads, num_events);
+
+   t = run(0, num_threads, num_events);
+   log_printf("Default queue:   %.3f s (%.0f events/s)\n", t,
+      num_threads * num_events / t);
+
+   t = run(ALLEGRO_EVENT_QUEUE_LOCK_FREE, num_threads, num_events);
+   log_printf("Lock-free queue: %.3f s (%.0f events/s)\n", t,
+      num_threads * num_events / t);
+
+   close_log(true);
+
+   return 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
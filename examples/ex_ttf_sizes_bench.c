@@ -0,0 +1,117 @@
+/*
+ *    Example program for the Allegro library.
+ *
+ *    Benchmark using a TTF face at many sizes, once as a separate font
+ *    for every size and once as sizes of a single distance field font,
+ *    which share their glyphs. Glyphs are measured, which caches them,
+ *    and drawn to a memory bitmap, where distance field fonts have to be
+ *    drawn in software.
+ *
+ *    Usage: ex_ttf_sizes_bench [font]
+ */
+
+#define ALLEGRO_UNSTABLE
+#include <stdio.h>
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_font.h"
+#include "allegro5/allegro_ttf.h"
+
+#include "common.c"
+
+#define NUM_SIZES    10
+#define TARGET_W     1024
+#define TARGET_H     4096
+
+static const int sizes[NUM_SIZES] = {10, 12, 14, 16, 20, 24, 28, 32, 40, 48};
+
+
+static ALLEGRO_USTR *create_text(void)
+{
+   ALLEGRO_USTR *text = al_ustr_new("");
+   int c;
+
+   /* Basic Latin and Latin-1 through Latin Extended-B. */
+   for (c = 0x20; c < 0x250; c++) {
+      if (c < 0x7F || c >= 0xA0)
+         al_ustr_append_chr(text, c);
+      if (c % 16 == 0)
+         al_ustr_append_chr(text, ' ');
+   }
+
+   return text;
+}
+
+
+static void run(const char *name, const char *filename, bool distance_field,
+   const ALLEGRO_USTR *text)
+{
+   ALLEGRO_FONT *fonts[NUM_SIZES];
+   double t0, t1, t2;
+   int i;
+
+   t0 = al_get_time();
+   for (i = 0; i < NUM_SIZES; i++) {
+      if (!distance_field)
+         fonts[i] = al_load_ttf_font(filename, sizes[i], 0);
+      else if (i == 0)
+         fonts[i] = al_load_ttf_font(filename, sizes[i],
+            ALLEGRO_TTF_DISTANCE_FIELD);
+      else
+         fonts[i] = al_derive_ttf_font(fonts[0], sizes[i]);
+      if (!fonts[i])
+         abort_example("Could not load %s.\n", filename);
+      al_get_ustr_width(fonts[i], text);
+   }
+   t1 = al_get_time();
+   for (i = 0; i < NUM_SIZES; i++) {
+      al_draw_multiline_ustr(fonts[i], al_map_rgb(255, 255, 255), 0, 0,
+         TARGET_W, 0, 0, text);
+   }
+   t2 = al_get_time();
+
+   log_printf("%-16s load and cache %7.1f ms, draw %7.1f ms\n", name,
+      (t1 - t0) * 1000, (t2 - t1) * 1000);
+
+   for (i = NUM_SIZES - 1; i >= 0; i--) {
+      al_destroy_font(fonts[i]);
+   }
+}
+
+
+int main(int argc, char **argv)
+{
+   const char *filename = "data/DejaVuSans.ttf";
+   ALLEGRO_BITMAP *target;
+   ALLEGRO_USTR *text;
+
+   if (argc > 1) {
+      filename = argv[1];
+   }
+
+   if (!al_init()) {
+      abort_example("Could not init Allegro.\n");
+   }
+   al_init_font_addon();
+   al_init_ttf_addon();
+
+   open_log();
+
+   al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+   target = al_create_bitmap(TARGET_W, TARGET_H);
+   al_set_target_bitmap(target);
+   text = create_text();
+
+   log_printf("%d sizes, %d characters\n", NUM_SIZES,
+      (int)al_ustr_length(text));
+   run("separate fonts", filename, false, text);
+   run("distance field", filename, true, text);
+
+   al_ustr_free(text);
+   al_destroy_bitmap(target);
+
+   close_log(true);
+
+   return 0;
+}
+
+/* vim: set sts=3 sw=3 et: */
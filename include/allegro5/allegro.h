@@ -48,6 +48,7 @@
 #include "allegro5/haptic.h"
 #include "allegro5/joystick.h"
 #include "allegro5/keyboard.h"
+#include "allegro5/loader.h"
 #include "allegro5/memory.h"
 #include "allegro5/monitor.h"
 #include "allegro5/mouse.h"
@@ -27,7 +27,8 @@ enum {
    ALLEGRO_MIPMAP                   = 0x0100,
    _ALLEGRO_NO_PREMULTIPLIED_ALPHA  = 0x0200,	/* now a bitmap loader flag */
    ALLEGRO_VIDEO_BITMAP             = 0x0400,
-   ALLEGRO_CONVERT_BITMAP           = 0x1000
+   ALLEGRO_CONVERT_BITMAP           = 0x1000,
+   ALLEGRO_KEEP_LOCK_BUFFER         = 0x2000
 };
 
 
@@ -25,6 +25,19 @@
 AL_FUNC(int, al_get_cpu_count, (void));
 AL_FUNC(int, al_get_ram_size, (void));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+/* Enum: ALLEGRO_CPU_FEATURES
+ */
+enum ALLEGRO_CPU_FEATURES {
+   ALLEGRO_CPU_SSE2  = 0x0001,
+   ALLEGRO_CPU_SSSE3 = 0x0002,
+   ALLEGRO_CPU_AVX2  = 0x0004,
+   ALLEGRO_CPU_NEON  = 0x0008
+};
+
+AL_FUNC(int, al_get_cpu_features, (void));
+#endif
+
 #ifdef __cplusplus
    }
 #endif
@@ -29,26 +29,35 @@
 AL_FUNC(bool, _al_trace_prefix, (char const *channel, int level,
    char const *file, int line, char const *function));
 
+AL_FUNC(bool, _al_trace_prefix_channel, (char const *channel, int *id,
+   int level, char const *file, int line, char const *function));
+
 AL_PRINTFUNC(void, _al_trace_suffix, (const char *msg, ...), 1, 2);
 
 #if defined(DEBUGMODE) || defined(ALLEGRO_CFG_RELEASE_LOGGING)
    /* Must not be used with a trailing semicolon. */
    #ifdef ALLEGRO_GCC
       #define ALLEGRO_DEBUG_CHANNEL(x) \
-         static char const *__al_debug_channel __attribute__((unused)) = x;
+         static char const *__al_debug_channel __attribute__((unused)) = x; \
+         static int __al_debug_channel_id __attribute__((unused)) = 0;
    #else
       #define ALLEGRO_DEBUG_CHANNEL(x) \
-         static char const *__al_debug_channel = x;
+         static char const *__al_debug_channel = x; \
+         static int __al_debug_channel_id = 0;
    #endif
    #define ALLEGRO_TRACE_CHANNEL_LEVEL(channel, level)                        \
       !_al_trace_prefix(channel, level, __FILE__, __LINE__, __func__)         \
       ? (void)0 : _al_trace_suffix
+   #define ALLEGRO_TRACE_LEVEL(level)                                         \
+      !_al_trace_prefix_channel(__al_debug_channel, &__al_debug_channel_id,   \
+         level, __FILE__, __LINE__, __func__)                                 \
+      ? (void)0 : _al_trace_suffix
 #else
    #define ALLEGRO_TRACE_CHANNEL_LEVEL(channel, x)  1 ? (void) 0 : _al_trace_suffix
+   #define ALLEGRO_TRACE_LEVEL(x)   1 ? (void) 0 : _al_trace_suffix
    #define ALLEGRO_DEBUG_CHANNEL(x)
 #endif
 
-#define ALLEGRO_TRACE_LEVEL(x)   ALLEGRO_TRACE_CHANNEL_LEVEL(__al_debug_channel, x)
 #define ALLEGRO_DEBUG            ALLEGRO_TRACE_LEVEL(0)
 #define ALLEGRO_INFO             ALLEGRO_TRACE_LEVEL(1)
 #define ALLEGRO_WARN             ALLEGRO_TRACE_LEVEL(2)
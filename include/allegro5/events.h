@@ -52,6 +52,13 @@ enum
    ALLEGRO_EVENT_DISPLAY_DISCONNECTED        = 61
 };
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+enum
+{
+   ALLEGRO_EVENT_LOAD_FINISHED               = 70
+};
+#endif
+
 
 /* Function: ALLEGRO_EVENT_TYPE_IS_USER
  *
@@ -160,6 +167,9 @@ typedef struct ALLEGRO_TIMER_EVENT
    _AL_EVENT_HEADER(struct ALLEGRO_TIMER)
    int64_t count;
    double error;
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+   int64_t ticks;
+#endif
 } ALLEGRO_TIMER_EVENT;
 
 
@@ -181,6 +191,18 @@ typedef struct ALLEGRO_TOUCH_EVENT
 
 
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+typedef struct ALLEGRO_LOADER_EVENT
+{
+   _AL_EVENT_HEADER(struct ALLEGRO_EVENT_SOURCE)
+   struct ALLEGRO_LOADER *loader;
+   struct ALLEGRO_LOAD_REQUEST *request;
+   bool success;
+} ALLEGRO_LOADER_EVENT;
+#endif
+
+
+
 /* Type: ALLEGRO_USER_EVENT
  */
 typedef struct ALLEGRO_USER_EVENT ALLEGRO_USER_EVENT;
@@ -217,6 +239,9 @@ union ALLEGRO_EVENT
    ALLEGRO_TIMER_EVENT    timer;
    ALLEGRO_TOUCH_EVENT    touch;
    ALLEGRO_USER_EVENT     user;
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+   ALLEGRO_LOADER_EVENT   loader;
+#endif
 };
 
 
@@ -242,7 +267,17 @@ AL_FUNC(intptr_t, al_get_event_source_data, (const ALLEGRO_EVENT_SOURCE*));
  */
 typedef struct ALLEGRO_EVENT_QUEUE ALLEGRO_EVENT_QUEUE;
 
+/* Enum: ALLEGRO_EVENT_QUEUE_FLAGS
+ */
+enum ALLEGRO_EVENT_QUEUE_FLAGS
+{
+   ALLEGRO_EVENT_QUEUE_LOCK_FREE = 0x0001
+};
+
 AL_FUNC(ALLEGRO_EVENT_QUEUE*, al_create_event_queue, (void));
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+AL_FUNC(ALLEGRO_EVENT_QUEUE*, al_create_event_queue_flags, (int flags));
+#endif
 AL_FUNC(void, al_destroy_event_queue, (ALLEGRO_EVENT_QUEUE*));
 AL_FUNC(bool, al_is_event_source_registered, (ALLEGRO_EVENT_QUEUE *, 
          ALLEGRO_EVENT_SOURCE *));
@@ -252,6 +287,14 @@ AL_FUNC(void, al_pause_event_queue, (ALLEGRO_EVENT_QUEUE*, bool));
 AL_FUNC(bool, al_is_event_queue_paused, (const ALLEGRO_EVENT_QUEUE*));
 AL_FUNC(bool, al_is_event_queue_empty, (ALLEGRO_EVENT_QUEUE*));
 AL_FUNC(bool, al_get_next_event, (ALLEGRO_EVENT_QUEUE*, ALLEGRO_EVENT *ret_event));
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+AL_FUNC(int, al_get_next_events, (ALLEGRO_EVENT_QUEUE*, ALLEGRO_EVENT *ret_events,
+                                  int max));
+AL_FUNC(int, al_get_next_events_filtered, (ALLEGRO_EVENT_QUEUE*,
+                                           ALLEGRO_EVENT *ret_events, int max,
+                                           ALLEGRO_EVENT_SOURCE *source,
+                                           ALLEGRO_EVENT_TYPE type));
+#endif
 AL_FUNC(bool, al_peek_next_event, (ALLEGRO_EVENT_QUEUE*, ALLEGRO_EVENT *ret_event));
 AL_FUNC(bool, al_drop_next_event, (ALLEGRO_EVENT_QUEUE*));
 AL_FUNC(void, al_flush_event_queue, (ALLEGRO_EVENT_QUEUE*));
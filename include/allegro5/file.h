@@ -97,6 +97,18 @@ AL_FUNC(void, al_set_standard_file_interface, (void));
 /* ALLEGRO_FILE field accessors */
 AL_FUNC(void *, al_get_file_userdata, (ALLEGRO_FILE *f));
 
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+/* Read-ahead buffering. */
+AL_FUNC(bool, al_set_file_buffer_size, (ALLEGRO_FILE *f, size_t size));
+AL_FUNC(size_t, al_get_file_buffer_size, (ALLEGRO_FILE *f));
+AL_FUNC(const void *, al_fpeek, (ALLEGRO_FILE *f, size_t *size));
+AL_FUNC(void, al_fconsume, (ALLEGRO_FILE *f, size_t size));
+AL_FUNC(const void *, al_get_file_memory, (ALLEGRO_FILE *f, int64_t *size));
+
+/* Specific to memory mapping. */
+AL_FUNC(ALLEGRO_FILE*, al_fopen_mmap, (const char *path));
+#endif
+
 
 #ifdef __cplusplus
    }
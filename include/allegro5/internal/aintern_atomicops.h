@@ -19,6 +19,21 @@
       return __sync_sub_and_fetch(ptr, 1);
    })
 
+   AL_INLINE(bool,
+      _al_atomic_compare_and_swap, (volatile _AL_ATOMIC *ptr,
+         _AL_ATOMIC oldval, _AL_ATOMIC newval),
+   {
+      return __sync_bool_compare_and_swap(ptr, oldval, newval);
+   })
+
+   AL_INLINE(void,
+      _al_memory_barrier, (void),
+   {
+      __sync_synchronize();
+   })
+
+   #define _AL_HAVE_ATOMIC_CAS 1
+
 #elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
 
    /* gcc, x86 or x86-64 */
@@ -49,6 +64,30 @@
       return old - 1;
    })
 
+   AL_INLINE(bool,
+      _al_atomic_compare_and_swap, (volatile _AL_ATOMIC *ptr,
+         _AL_ATOMIC oldval, _AL_ATOMIC newval),
+   {
+      _AL_ATOMIC prev;
+      __asm__ __volatile__ (
+         "lock; cmpxchgl %2, %1"
+         : "=a" (prev), "+m" (*ptr)
+         : "r" (newval), "0" (oldval)
+         : "memory"
+      );
+      return prev == oldval;
+   })
+
+   AL_INLINE(void,
+      _al_memory_barrier, (void),
+   {
+      _AL_ATOMIC dummy = 0, result;
+      __al_fetch_and_add(&dummy, 0, result);
+      (void)result;
+   })
+
+   #define _AL_HAVE_ATOMIC_CAS 1
+
 #elif defined(_MSC_VER) && _M_IX86 >= 400
 
    /* MSVC, x86 */
@@ -68,6 +107,21 @@
       return InterlockedDecrement(ptr);
    })
 
+   AL_INLINE(bool,
+      _al_atomic_compare_and_swap, (volatile _AL_ATOMIC *ptr,
+         _AL_ATOMIC oldval, _AL_ATOMIC newval),
+   {
+      return InterlockedCompareExchange(ptr, newval, oldval) == oldval;
+   })
+
+   AL_INLINE(void,
+      _al_memory_barrier, (void),
+   {
+      MemoryBarrier();
+   })
+
+   #define _AL_HAVE_ATOMIC_CAS 1
+
 #elif defined(ALLEGRO_HAVE_OSATOMIC_H)
 
    /* OS X, GCC < 4.1
@@ -93,6 +147,21 @@
       return OSAtomicDecrement32Barrier((_AL_ATOMIC *)ptr);
    })
 
+   AL_INLINE(bool,
+      _al_atomic_compare_and_swap, (volatile _AL_ATOMIC *ptr,
+         _AL_ATOMIC oldval, _AL_ATOMIC newval),
+   {
+      return OSAtomicCompareAndSwap32Barrier(oldval, newval, (_AL_ATOMIC *)ptr);
+   })
+
+   AL_INLINE(void,
+      _al_memory_barrier, (void),
+   {
+      OSMemoryBarrier();
+   })
+
+   #define _AL_HAVE_ATOMIC_CAS 1
+
 
 #else
 
@@ -113,6 +182,24 @@
       return --(*ptr);
    })
 
+   /* _AL_HAVE_ATOMIC_CAS is left undefined so callers can avoid relying on
+    * these.
+    */
+   AL_INLINE(bool,
+      _al_atomic_compare_and_swap, (volatile _AL_ATOMIC *ptr,
+         _AL_ATOMIC oldval, _AL_ATOMIC newval),
+   {
+      if (*ptr != oldval)
+         return false;
+      *ptr = newval;
+      return true;
+   })
+
+   AL_INLINE(void,
+      _al_memory_barrier, (void),
+   {
+   })
+
 #endif
 
 #endif
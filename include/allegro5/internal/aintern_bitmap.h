@@ -14,6 +14,23 @@ extern "C" {
 
 typedef struct ALLEGRO_BITMAP_INTERFACE ALLEGRO_BITMAP_INTERFACE;
 
+/* Copy of a memory bitmap in a foreign pixel format, kept between locks for
+ * bitmaps with ALLEGRO_KEEP_LOCK_BUFFER.
+ */
+typedef struct _AL_LOCK_BUFFER
+{
+   int format;
+   int pitch;
+   unsigned char *data;
+   /* What data looked like when it last matched the bitmap memory, used to
+    * find the rows changed by writable locks. Allocated on the first
+    * writable lock.
+    */
+   unsigned char *clean;
+   /* Area of data which is out of date, x1 == x2 if none. */
+   int stale_x1, stale_y1, stale_x2, stale_y2;
+} _AL_LOCK_BUFFER;
+
 struct ALLEGRO_BITMAP
 {
    ALLEGRO_BITMAP_INTERFACE *vt;
@@ -75,6 +92,8 @@ struct ALLEGRO_BITMAP
    void* lock_data;
    int lock_flags;
    ALLEGRO_LOCKED_REGION locked_region;
+   /* Only used by memory bitmaps with ALLEGRO_KEEP_LOCK_BUFFER. */
+   _AL_LOCK_BUFFER *lock_buffer;
 
    /* Transformation for this bitmap */
    ALLEGRO_TRANSFORM transform;
@@ -147,6 +166,7 @@ AL_FUNC(ALLEGRO_DISPLAY*, _al_get_bitmap_display, (ALLEGRO_BITMAP *bitmap));
 extern void (*_al_convert_funcs[ALLEGRO_NUM_PIXEL_FORMATS]
    [ALLEGRO_NUM_PIXEL_FORMATS])(const void *, int, void *, int,
    int, int, int, int, int, int);
+void _al_init_convert_simd(void);
 
 /* Bitmap conversion */
 void _al_convert_bitmap_data(
@@ -160,6 +180,9 @@ void _al_copy_bitmap_data(
    int sx, int sy, int dx, int dy, int width, int height,
    int format);
 
+/* Bitmap locking */
+void _al_destroy_lock_buffer(ALLEGRO_BITMAP *bitmap);
+
 /* Bitmap type conversion */ 
 void _al_init_convert_bitmap_list(void);
 void _al_register_convert_bitmap(ALLEGRO_BITMAP *bitmap);
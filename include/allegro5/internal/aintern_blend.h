@@ -245,6 +245,11 @@ void _al_blend_inline(
 void _al_blend_memory(ALLEGRO_COLOR *src_color, ALLEGRO_BITMAP *dest,
    int dx, int dy, ALLEGRO_COLOR *result);
 
+/* Blends n pixels from src onto dst. */
+typedef void (*_AL_BLEND_SPAN)(const void *src, void *dst, int n);
+
+_AL_BLEND_SPAN _al_get_blend_span(int format);
+
 
 #ifdef __cplusplus
    }
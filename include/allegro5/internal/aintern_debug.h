@@ -8,6 +8,8 @@
 
 void _al_configure_logging(void);
 void _al_shutdown_logging(void);
+void _al_trace_thread_ended(void);
+void _al_trace_release_thread_data(void **data);
 
 
 #ifdef __cplusplus
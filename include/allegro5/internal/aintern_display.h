@@ -155,6 +155,7 @@ struct ALLEGRO_DISPLAY
 
    _AL_VECTOR display_invalidated_callbacks;
    _AL_VECTOR display_validated_callbacks;
+   _AL_VECTOR display_destroyed_callbacks;
 
    /* Issue #725 */
    bool use_constraints;
@@ -184,6 +185,14 @@ AL_FUNC(void, _al_remove_display_invalidated_callback, (ALLEGRO_DISPLAY *display
 AL_FUNC(void, _al_remove_display_validated_callback, (ALLEGRO_DISPLAY *display,
    void (*display_validated)(ALLEGRO_DISPLAY*)));
 
+/* Called by al_destroy_display while the display is still valid, so addons
+ * can destroy what they created for it.
+ */
+AL_FUNC(void, _al_add_display_destroyed_callback, (ALLEGRO_DISPLAY *display,
+   void (*display_destroyed)(ALLEGRO_DISPLAY*)));
+AL_FUNC(void, _al_remove_display_destroyed_callback, (ALLEGRO_DISPLAY *display,
+   void (*display_destroyed)(ALLEGRO_DISPLAY*)));
+
 /* Defined in tls.c */
 bool _al_set_current_display_only(ALLEGRO_DISPLAY *display);
 void _al_set_new_display_settings(ALLEGRO_EXTRA_DISPLAY_SETTINGS *settings);
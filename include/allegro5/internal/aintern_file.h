@@ -16,8 +16,28 @@ struct ALLEGRO_FILE
    void *userdata;
    unsigned char ungetc[ALLEGRO_UNGETC_SIZE];
    int ungetc_len;
+
+   /* Optional read-ahead buffer. The unread bytes are [buffer_pos,
+    * buffer_len). Data is read in after ALLEGRO_UNGETC_SIZE bytes of
+    * headroom so pushbacks can go straight into the buffer.
+    */
+   unsigned char *buffer;
+   size_t buffer_size;
+   size_t buffer_pos;
+   size_t buffer_len;
+   bool buffer_eof;     /* the end-of-file flag below does not apply yet */
+   size_t buffer_ungetc_end;  /* pushbacks are [buffer_pos, this) */
+
+   /* The whole contents of the file, for backends which have them in
+    * memory. See al_get_file_memory.
+    */
+   const void *memory;
+   int64_t memory_size;
 };
 
+AL_FUNC(void, _al_set_file_memory, (ALLEGRO_FILE *f, const void *memory,
+   int64_t size));
+
 #ifdef __cplusplus
    }
 #endif
@@ -0,0 +1,22 @@
+#ifndef __al_included_allegro5_aintern_parallel_h
+#define __al_included_allegro5_aintern_parallel_h
+
+#ifdef __cplusplus
+   extern "C" {
+#endif
+
+/* Processes the items [begin, end) of a job split up by _al_parallel_for. */
+typedef void (*_AL_PARALLEL_FUNC)(void *arg, int begin, int end);
+
+void _al_init_parallel(void);
+AL_FUNC(int, _al_get_parallel_thread_count, (void));
+AL_FUNC(void, _al_parallel_for, (int count, int grain,
+   _AL_PARALLEL_FUNC func, void *arg));
+
+#ifdef __cplusplus
+   }
+#endif
+
+#endif
+
+/* vim: set sts=3 sw=3 et: */
@@ -0,0 +1,35 @@
+#ifndef __al_included_allegro5_aintern_simd_h
+#define __al_included_allegro5_aintern_simd_h
+
+/* Which SIMD kernels can be compiled in. The x86 ones are built with
+ * _AL_SIMD_TARGET so they need no global compiler flags, and must only be
+ * called after checking al_get_cpu_features(). NEON is part of AArch64.
+ */
+#ifndef ALLEGRO_BIG_ENDIAN
+   #if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) && \
+      (defined(__clang__) || __GNUC__ > 4 || \
+      (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+      #define _AL_SIMD_TARGET(x) __attribute__((target(x)))
+      #define _AL_SIMD_SSE2
+      #define _AL_SIMD_SSSE3
+      #define _AL_SIMD_AVX2
+   #elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+      #define _AL_SIMD_TARGET(x)
+      #define _AL_SIMD_SSE2
+      #define _AL_SIMD_SSSE3
+      #define _AL_SIMD_AVX2
+   #elif defined(__aarch64__) || defined(_M_ARM64)
+      #define _AL_SIMD_TARGET(x)
+      #define _AL_SIMD_NEON
+   #endif
+#endif
+
+#if defined(_AL_SIMD_SSE2)
+   #include <immintrin.h>
+#elif defined(_AL_SIMD_NEON)
+   #include <arm_neon.h>
+#endif
+
+#endif
+
+/* vim: set sts=3 sw=3 et: */
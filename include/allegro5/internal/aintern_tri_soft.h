@@ -17,6 +17,7 @@ struct ALLEGRO_VERTEX {
 #endif
 
 AL_FUNC(void, _al_triangle_2d, (ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3));
+AL_FUNC(void, _al_triangles_2d, (ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* vtxs, int num_triangles));
 AL_FUNC(void, _al_draw_soft_triangle, (
    ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3, uintptr_t state,
    void (*init)(uintptr_t, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*),
@@ -0,0 +1,65 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Asynchronous asset loading.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#ifndef __al_included_allegro5_loader_h
+#define __al_included_allegro5_loader_h
+
+#include "allegro5/base.h"
+#include "allegro5/events.h"
+
+#ifdef __cplusplus
+   extern "C" {
+#endif
+
+#if defined(ALLEGRO_UNSTABLE) || defined(ALLEGRO_INTERNAL_UNSTABLE) || defined(ALLEGRO_SRC)
+
+/* Type: ALLEGRO_LOADER
+ */
+typedef struct ALLEGRO_LOADER ALLEGRO_LOADER;
+
+/* Type: ALLEGRO_LOAD_REQUEST
+ */
+typedef struct ALLEGRO_LOAD_REQUEST ALLEGRO_LOAD_REQUEST;
+
+AL_FUNC(ALLEGRO_LOADER *, al_create_loader, (int num_threads,
+   ALLEGRO_EVENT_SOURCE *source));
+AL_FUNC(void, al_destroy_loader, (ALLEGRO_LOADER *loader));
+
+AL_FUNC(ALLEGRO_LOAD_REQUEST *, al_queue_load, (ALLEGRO_LOADER *loader,
+   const char *filename, int priority,
+   void *(*load)(const char *filename, void *arg),
+   void (*finish)(void *result, void *arg),
+   void (*destroy)(void *result, void *arg),
+   void *arg));
+AL_FUNC(bool, al_cancel_load, (ALLEGRO_LOAD_REQUEST *request));
+AL_FUNC(void, al_set_load_priority, (ALLEGRO_LOAD_REQUEST *request,
+   int priority));
+AL_FUNC(bool, al_is_load_finished, (ALLEGRO_LOAD_REQUEST *request));
+AL_FUNC(void *, al_finish_load, (ALLEGRO_LOAD_REQUEST *request));
+AL_FUNC(const char *, al_get_load_request_filename,
+   (ALLEGRO_LOAD_REQUEST *request));
+
+AL_FUNC(ALLEGRO_LOAD_REQUEST *, al_load_bitmap_async, (ALLEGRO_LOADER *loader,
+   const char *filename, int flags, int priority));
+
+#endif
+
+#ifdef __cplusplus
+   }
+#endif
+
+#endif
+
+/* vim: set sts=3 sw=3 et: */
@@ -430,13 +430,188 @@ void (*_al_convert_funcs[ALLEGRO_NUM_PIXEL_FORMATS]
 // Warning: This file was created by make_converters.py - do not edit.
 """)
 
+# Exact integer forms of the _al_rgb_scale_N tables (i * 255 / (2^N - 1)),
+# as (mul, add, shift) so that the SIMD kernels can compute them.
+scale_factors = {
+    1: (255, 0, 0),
+    4: (17, 0, 0),
+    5: (1053, 0, 7),
+    6: (259, 3, 6)}
+
+def is_packed(info):
+    """
+    Whether a format is a plain 16 or 32 bit integer format.
+    """
+    return info and not info.float and not info.single_channel and \
+        info.size in [15, 16, 32]
+
+def is_8888(info):
+    """
+    Whether a format is a 32 bit format with four 8 bit components.
+    """
+    if not is_packed(info) or info.size != 32: return False
+    for c in info.components.values():
+        if c.size != 8: return False
+    return True
+
+def simd_ops(info_a, info_b):
+    """
+    Express the conversion of one packed pixel as bits to set and a list of
+    (shift_right, mask, mul, add, shift_scale, shift_left) operations, the
+    same computation the conversion macro does.
+    """
+    names = info_b.components.keys()
+    names.sort()
+    fill = 0
+    shifted = {}
+    ops = []
+    for name in names:
+        if name == "X": continue
+        c_b = info_b.components[name]
+        if name not in info_a.components:
+            if name == "A":
+                fill |= ((1 << c_b.size) - 1) << c_b.position
+            continue
+        c_a = info_a.components[name]
+        if c_a.size < c_b.size and c_b.size == 8:
+            mul, add, shift_scale = scale_factors[c_a.size]
+            mask = (1 << c_a.size) - 1
+            for i in range(mask + 1):
+                assert (i * mul + add) >> shift_scale == i * 255 / mask
+                assert i * mul + add < 0x10000
+            ops.append((c_a.position, mask, mul, add, shift_scale,
+                c_b.position))
+            continue
+        if c_a.size >= c_b.size:
+            shift_right = c_a.position + c_a.size - c_b.size
+            mask = ((1 << c_b.size) - 1) << shift_right
+            shift_left = c_b.position
+        else:
+            shift_right = c_a.position
+            mask = ((1 << c_a.size) - 1) << shift_right
+            shift_left = c_b.position + c_b.size - c_a.size
+        # Collapse components which move by the same amount.
+        shift = shift_left - shift_right
+        shifted[shift] = shifted.get(shift, 0) | mask
+    shifts = shifted.keys()
+    shifts.sort()
+    for shift in shifts:
+        mask = shifted[shift]
+        if shift < 0:
+            ops.append((-shift, mask >> -shift, 1, 0, 0, 0))
+        else:
+            ops.append((0, mask, 1, 0, 0, shift))
+    assert len(ops) <= 4
+    return fill, ops
+
+def simd_shuffle(info_a, info_b):
+    """
+    Byte shuffle which converts four little endian 8888 pixels, with 128
+    selecting a zero byte.
+    """
+    shuffle = []
+    for pixel in range(4):
+        for byte in range(4):
+            value = 128
+            for name, c_b in info_b.components.items():
+                if c_b.position != byte * 8 or name not in info_a.components:
+                    continue
+                if name == "X": continue
+                value = pixel * 4 + info_a.components[name].position / 8
+            shuffle.append(value)
+    return shuffle
+
+def simd_ops_lines(name, fill, ops):
+    r = "static const CONVERT_OPS " + name + " = {\n"
+    r += "   0x%08x, %d, {" % (fill, len(ops))
+    lines = []
+    for op in ops:
+        lines.append("\n      {%2d, 0x%08x, %4d, %d, %d, %2d}" % op)
+    r += ",".join(lines)
+    r += "}};\n"
+    return r
+
+def write_convert_simd_inc(filename):
+    """
+    Write out the SIMD conversion functions and the list of them which
+    convert_simd.c installs into _al_convert_funcs.
+    """
+    f = open(filename, "w")
+    f.write("""\
+// Warning: This file was created by make_converters.py - do not edit.
+""")
+
+    packed = []
+    shuffled = []
+    from_f32 = []
+    to_f32 = []
+    abgr_8888 = formats_by_name["ABGR_8888"]
+    for a in formats_list:
+        for b in formats_list:
+            if b == a: continue
+            if not a or not b: continue
+            name = a.name.lower() + "_to_" + b.name.lower()
+            if is_packed(a) and is_packed(b):
+                fill, ops = simd_ops(a, b)
+                f.write(simd_ops_lines(name + "_ops", fill, ops))
+                types = "uint%d_t, uint%d_t" % (
+                    32 if a.size == 32 else 16, 32 if b.size == 32 else 16)
+                f.write("PACKED_FUNCS(%s, %s, %s)\n" % (
+                    a.name.lower(), b.name.lower(), types))
+                packed.append((a, b))
+                if is_8888(a) and is_8888(b):
+                    f.write("static const uint8_t " + name +
+                        "_shuffle[16] = {\n   ")
+                    f.write(", ".join(["%d" % x
+                        for x in simd_shuffle(a, b)]))
+                    f.write("};\n")
+                    f.write("SHUFFLE_FUNCS(%s, %s)\n" % (
+                        a.name.lower(), b.name.lower()))
+                    shuffled.append((a, b))
+            elif a.float and is_8888(b):
+                fill, ops = simd_ops(abgr_8888, b)
+                f.write(simd_ops_lines(name + "_ops", fill, ops))
+                f.write("FROM_F32_FUNCS(%s, %s)\n" % (
+                    a.name.lower(), b.name.lower()))
+                from_f32.append((a, b))
+            elif is_8888(a) and b.float:
+                fill, ops = simd_ops(a, abgr_8888)
+                f.write(simd_ops_lines(name + "_ops", fill, ops))
+                f.write("TO_F32_FUNCS(%s, %s)\n" % (
+                    a.name.lower(), b.name.lower()))
+                to_f32.append((a, b))
+
+    f.write("""\
+
+static const CONVERT_SIMD_FUNC convert_simd_funcs[] = {
+""")
+    def entries(define, feature, suffix, pairs):
+        f.write("#ifdef " + define + "\n")
+        for a, b in pairs:
+            f.write("   {ALLEGRO_PIXEL_FORMAT_%s, ALLEGRO_PIXEL_FORMAT_%s,\n" % (
+                a.name, b.name))
+            f.write("      %s, %s_to_%s_%s},\n" % (feature, a.name.lower(),
+                b.name.lower(), suffix))
+        f.write("#endif\n")
+    entries("_AL_SIMD_SSE2", "ALLEGRO_CPU_SSE2", "sse2",
+        packed + from_f32 + to_f32)
+    entries("_AL_SIMD_SSSE3", "ALLEGRO_CPU_SSSE3", "ssse3", shuffled)
+    entries("_AL_SIMD_AVX2", "ALLEGRO_CPU_AVX2", "avx2", shuffled)
+    entries("_AL_SIMD_NEON", "ALLEGRO_CPU_NEON", "neon", shuffled)
+    f.write("""\
+   {0, 0, 0, NULL}
+};
+
+// Warning: This file was created by make_converters.py - do not edit.
+""")
+
 def main(argv):
     global options
     p = optparse.OptionParser()
     p.description = """\
-When run from the toplevel A5 folder, this will re-create the convert.h and
-convert.c files containing all the low-level color conversion macros and
-functions."""
+When run from the toplevel A5 folder, this will re-create the convert.h,
+convert.c and convert_simd.inc files containing all the low-level color
+conversion macros and functions."""
     options, args = p.parse_args()
 
     # Read in color.h to get the available formats.
@@ -456,6 +631,9 @@ functions."""
     # Output a function for each possible conversion.
     write_convert_c("src/convert.c")
 
+    # Output the SIMD variants of the common conversions.
+    write_convert_simd_inc("src/convert_simd.inc")
+
 if __name__ == "__main__":
     main(sys.argv)
 
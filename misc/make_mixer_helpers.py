@@ -293,6 +293,103 @@ def make_cubic_interpolator(name, fmt):
       return samp_buf-> #{fmt} ;
    }""")
 
+# Block resamplers produce n frames at once for the block mixers, and advance
+# the position themselves.  The caller makes sure that none of the frames
+# need to wrap around, so the per-frame loop handling above is not needed.
+# The values are computed exactly as in the single frame versions.
+block_step = """\
+               pos += delta;
+               err += delta_error;
+               if (err >= spl->step_denom) {
+                  pos++;
+                  err -= spl->step_denom;
+               }"""
+
+def make_point_block(name):
+   print interp("""\
+   static void
+      #{name}
+      (float *out,
+       ALLEGRO_SAMPLE_INSTANCE *spl,
+       unsigned int maxc,
+       unsigned int n,
+       int delta,
+       int delta_error)
+   {
+      int pos = spl->pos;
+      int err = spl->pos_bresenham_error;
+      unsigned int i, k;
+
+      switch (spl->spl_data.depth) {
+      """)
+
+   for depth in depths:
+      buf_index = depth.index("f32")("spl->spl_data.buffer", "i0 + i")
+      print interp("""\
+         case #{depth.constant()}:
+            for (k = 0; k < n; k++) {
+               const unsigned int i0 = pos*maxc;
+               for (i = 0; i < maxc; i++) {
+                  *out++ = #{buf_index};
+               }
+#{block_step}
+            }
+            break;
+         """)
+
+   print interp("""\
+      }
+      spl->pos = pos;
+      spl->pos_bresenham_error = err;
+   }""")
+
+def make_linear_block(name):
+   print interp("""\
+   static void
+      #{name}
+      (float *out,
+       ALLEGRO_SAMPLE_INSTANCE *spl,
+       unsigned int maxc,
+       unsigned int n,
+       int delta,
+       int delta_error)
+   {
+      /* Streams lag by one sample, see linear_spl32. */
+      const int lag = (spl->loop == _ALLEGRO_PLAYMODE_STREAM_ONCE ||
+         spl->loop == _ALLEGRO_PLAYMODE_STREAM_ONEDIR) ? 1 : 0;
+      int pos = spl->pos;
+      int err = spl->pos_bresenham_error;
+      unsigned int k;
+
+      switch (spl->spl_data.depth) {
+      """)
+
+   for depth in depths:
+      x0 = depth.index("f32")("spl->spl_data.buffer", "p0 + i")
+      x1 = depth.index("f32")("spl->spl_data.buffer", "p1 + i")
+      print interp("""\
+         case #{depth.constant()}:
+            for (k = 0; k < n; k++) {
+               const int p0 = (pos - lag) * maxc;
+               const int p1 = p0 + maxc;
+               const float t = (float)err / spl->step_denom;
+               int i;
+               for (i = 0; i < (int)maxc; i++) {
+                  const float x0 = #{x0};
+                  const float x1 = #{x1};
+                  *out++ = (x0 * (1.0f - t)) + (x1 * t);
+               }
+#{block_step}
+            }
+            break;
+         """)
+
+   print interp("""\
+      }
+      spl->pos = pos;
+      spl->pos_bresenham_error = err;
+   }""")
+
 if __name__ == "__main__":
    print "// Warning: This file was created by make_resamplers.py - do not edit."
    print "// vim: set ft=c:"
@@ -302,5 +399,7 @@ if __name__ == "__main__":
    make_linear_interpolator("linear_spl32", "f32")
    make_linear_interpolator("linear_spl16", "s16")
    make_cubic_interpolator("cubic_spl32", "f32")
+   make_point_block("point_block32")
+   make_linear_block("linear_block32")
 
 # vim: set sts=3 sw=3 et:
@@ -108,12 +108,13 @@ def make_drawer(name):
    print "{"
    if shade:
       print """\
-      int op, src_mode, dst_mode;
-      int op_alpha, src_alpha, dst_alpha;
-      ALLEGRO_COLOR const_color;
-      al_get_separate_blender(&op, &src_mode, &dst_mode,
-         &op_alpha, &src_alpha, &dst_alpha);
-      const_color = al_get_blend_color();
+      const int op = s->blend->op;
+      const int src_mode = s->blend->src_mode;
+      const int dst_mode = s->blend->dst_mode;
+      const int op_alpha = s->blend->op_alpha;
+      const int src_alpha = s->blend->src_alpha;
+      const int dst_alpha = s->blend->dst_alpha;
+      ALLEGRO_COLOR const_color = s->blend->const_color;
       """
 
    print "{"
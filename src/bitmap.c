@@ -24,6 +24,7 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_display.h"
+#include "allegro5/internal/aintern_parallel.h"
 #include "allegro5/internal/aintern_pixels.h"
 #include "allegro5/internal/aintern_shader.h"
 #include "allegro5/internal/aintern_system.h"
@@ -84,6 +85,7 @@ static ALLEGRO_BITMAP *create_memory_bitmap(ALLEGRO_DISPLAY *current_display,
 static void destroy_memory_bitmap(ALLEGRO_BITMAP *bmp)
 {
    _al_unregister_convert_bitmap(bmp);
+   _al_destroy_lock_buffer(bmp);
 
    if (bmp->memory)
       al_free(bmp->memory);
@@ -636,17 +638,54 @@ void _al_copy_bitmap_data(
    }
 }
 
+/* Conversions of fewer pixels than this per thread are not worth the
+ * overhead of handing them to the worker threads.
+ */
+#define CONVERT_PIXELS_PER_THREAD  (128 * 1024)
+
+typedef struct CONVERT_JOB {
+   const void *src;
+   int src_format, src_pitch;
+   void *dst;
+   int dst_format, dst_pitch;
+   int sx, sy, dx, dy, width;
+} CONVERT_JOB;
+
+
+/* Converts the rows [begin, end) of a CONVERT_JOB. */
+static void convert_rows(void *arg, int begin, int end)
+{
+   const CONVERT_JOB *job = arg;
+
+   if (job->src_format == job->dst_format) {
+      _al_copy_bitmap_data(job->src, job->src_pitch, job->dst, job->dst_pitch,
+         job->sx, job->sy + begin, job->dx, job->dy + begin,
+         job->width, end - begin, job->src_format);
+   }
+   else {
+      (_al_convert_funcs[job->src_format][job->dst_format])(
+         job->src, job->src_pitch, job->dst, job->dst_pitch,
+         job->sx, job->sy + begin, job->dx, job->dy + begin,
+         job->width, end - begin);
+   }
+}
+
+
 void _al_convert_bitmap_data(
    const void *src, int src_format, int src_pitch,
    void *dst, int dst_format, int dst_pitch,
    int sx, int sy, int dx, int dy, int width, int height)
 {
+   CONVERT_JOB job;
+
    ASSERT(src);
    ASSERT(dst);
    ASSERT(_al_pixel_format_is_real(dst_format));
 
-   /* Use memcpy if no conversion is needed. */
-   if (src_format == dst_format) {
+   /* Use memcpy if no conversion is needed. Block formats are only copied,
+    * and whole blocks at that, so they are not split up.
+    */
+   if (src_format == dst_format && al_get_pixel_block_height(src_format) > 1) {
       _al_copy_bitmap_data(src, src_pitch, dst, dst_pitch, sx, sy,
          dx, dy, width, height, src_format);
       return;
@@ -654,11 +693,28 @@ void _al_convert_bitmap_data(
 
    /* Video-only formats don't have conversion functions, so they should have
     * been taken care of before reaching this location. */
-   ASSERT(!_al_pixel_format_is_video_only(src_format));
-   ASSERT(!_al_pixel_format_is_video_only(dst_format));
-
-   (_al_convert_funcs[src_format][dst_format])(src, src_pitch,
-      dst, dst_pitch, sx, sy, dx, dy, width, height);
+   ASSERT(src_format == dst_format ||
+      !_al_pixel_format_is_video_only(src_format));
+   ASSERT(src_format == dst_format ||
+      !_al_pixel_format_is_video_only(dst_format));
+
+   job.src = src;
+   job.src_format = src_format;
+   job.src_pitch = src_pitch;
+   job.dst = dst;
+   job.dst_format = dst_format;
+   job.dst_pitch = dst_pitch;
+   job.sx = sx;
+   job.sy = sy;
+   job.dx = dx;
+   job.dy = dy;
+   job.width = width;
+
+   /* Rows are independent, so large images are split up across the
+    * worker threads.
+    */
+   _al_parallel_for(height, CONVERT_PIXELS_PER_THREAD / _ALLEGRO_MAX(width, 1),
+      convert_rows, &job);
 }
 
 
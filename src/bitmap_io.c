@@ -304,6 +304,89 @@ char const *al_identify_bitmap_f(ALLEGRO_FILE *fp)
 }
 
 
+typedef struct ASYNC_BITMAP
+{
+   int load_flags;
+   int bitmap_flags;
+   int bitmap_format;
+} ASYNC_BITMAP;
+
+
+/* Decodes the bitmap into a memory bitmap on a loader thread, converting
+ * it to the requested format there as well.
+ */
+static void *async_bitmap_load(const char *filename, void *arg)
+{
+   ASYNC_BITMAP *ab = arg;
+   int flags = ab->bitmap_flags;
+
+   flags &= ~(ALLEGRO_VIDEO_BITMAP | ALLEGRO_CONVERT_BITMAP);
+   al_set_new_bitmap_flags(flags | ALLEGRO_MEMORY_BITMAP);
+   al_set_new_bitmap_format(ab->bitmap_format);
+
+   return al_load_bitmap_flags(filename, ab->load_flags);
+}
+
+
+/* Uploads the bitmap on the thread finishing the request, with the new
+ * bitmap flags which were in effect when it was queued.
+ */
+static void async_bitmap_finish(void *result, void *arg)
+{
+   ASYNC_BITMAP *ab = arg;
+   ALLEGRO_BITMAP *bmp = result;
+   ALLEGRO_STATE state;
+
+   if (bmp && !(ab->bitmap_flags & ALLEGRO_MEMORY_BITMAP)) {
+      al_store_state(&state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+      al_set_new_bitmap_flags(ab->bitmap_flags);
+      if (ab->load_flags & ALLEGRO_KEEP_BITMAP_FORMAT)
+         al_set_new_bitmap_format(al_get_bitmap_format(bmp));
+      else
+         al_set_new_bitmap_format(ab->bitmap_format);
+      al_convert_bitmap(bmp);
+      al_restore_state(&state);
+   }
+
+   al_free(ab);
+}
+
+
+static void async_bitmap_destroy(void *result, void *arg)
+{
+   al_destroy_bitmap(result);
+   al_free(arg);
+}
+
+
+/* Function: al_load_bitmap_async
+ */
+ALLEGRO_LOAD_REQUEST *al_load_bitmap_async(ALLEGRO_LOADER *loader,
+   const char *filename, int flags, int priority)
+{
+   ASYNC_BITMAP *ab;
+   ALLEGRO_LOAD_REQUEST *req;
+
+   ASSERT(loader);
+   ASSERT(filename);
+
+   ab = al_malloc(sizeof(*ab));
+   if (!ab)
+      return NULL;
+
+   ab->load_flags = flags;
+   ab->bitmap_flags = al_get_new_bitmap_flags();
+   ab->bitmap_format = al_get_new_bitmap_format();
+
+   req = al_queue_load(loader, filename, priority, async_bitmap_load,
+      async_bitmap_finish, async_bitmap_destroy, ab);
+   if (!req)
+      al_free(ab);
+
+   return req;
+}
+
+
 /* Function: al_identify_bitmap
  */
 char const *al_identify_bitmap(char const *filename)
@@ -14,12 +14,144 @@
  */
 
 
+#include <string.h>
+
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_pixels.h"
 
 
+/* Marks the given area of the lock buffer as no longer matching the bitmap
+ * memory.
+ */
+static void invalidate_lock_buffer(_AL_LOCK_BUFFER *buf,
+   int x, int y, int w, int h)
+{
+   if (w <= 0 || h <= 0)
+      return;
+
+   if (buf->stale_x1 == buf->stale_x2) {
+      buf->stale_x1 = x;
+      buf->stale_y1 = y;
+      buf->stale_x2 = x + w;
+      buf->stale_y2 = y + h;
+   }
+   else {
+      buf->stale_x1 = _ALLEGRO_MIN(buf->stale_x1, x);
+      buf->stale_y1 = _ALLEGRO_MIN(buf->stale_y1, y);
+      buf->stale_x2 = _ALLEGRO_MAX(buf->stale_x2, x + w);
+      buf->stale_y2 = _ALLEGRO_MAX(buf->stale_y2, y + h);
+   }
+}
+
+
+void _al_destroy_lock_buffer(ALLEGRO_BITMAP *bitmap)
+{
+   _AL_LOCK_BUFFER *buf = bitmap->lock_buffer;
+
+   if (!buf)
+      return;
+
+   al_free(buf->clean);
+   al_free(buf->data);
+   al_free(buf);
+   bitmap->lock_buffer = NULL;
+}
+
+
+/* Returns the lock buffer of a memory bitmap in the given format, with
+ * everything converted, or NULL if there is not enough memory.
+ */
+static _AL_LOCK_BUFFER *get_lock_buffer(ALLEGRO_BITMAP *bitmap, int format,
+   bool writable)
+{
+   _AL_LOCK_BUFFER *buf = bitmap->lock_buffer;
+   int bitmap_format = al_get_bitmap_format(bitmap);
+   int x, y, w, h;
+
+   if (buf && buf->format != format)
+      _al_destroy_lock_buffer(bitmap);
+
+   if (!bitmap->lock_buffer) {
+      buf = al_calloc(1, sizeof *buf);
+      if (!buf)
+         return NULL;
+      buf->format = format;
+      buf->pitch = al_get_pixel_size(format) * bitmap->w;
+      buf->data = al_malloc(buf->pitch * bitmap->h);
+      if (!buf->data) {
+         al_free(buf);
+         return NULL;
+      }
+      invalidate_lock_buffer(buf, 0, 0, bitmap->w, bitmap->h);
+      bitmap->lock_buffer = buf;
+   }
+
+   if (buf->stale_x1 != buf->stale_x2) {
+      x = buf->stale_x1;
+      y = buf->stale_y1;
+      w = buf->stale_x2 - x;
+      h = buf->stale_y2 - y;
+      _al_convert_bitmap_data(
+         bitmap->memory, bitmap_format, bitmap->pitch,
+         buf->data, format, buf->pitch,
+         x, y, x, y, w, h);
+      if (buf->clean) {
+         _al_copy_bitmap_data(buf->data, buf->pitch, buf->clean, buf->pitch,
+            x, y, x, y, w, h, format);
+      }
+      buf->stale_x1 = buf->stale_x2 = 0;
+   }
+
+   if (writable && !buf->clean) {
+      buf->clean = al_malloc(buf->pitch * bitmap->h);
+      if (!buf->clean) {
+         _al_destroy_lock_buffer(bitmap);
+         return NULL;
+      }
+      memcpy(buf->clean, buf->data, buf->pitch * bitmap->h);
+   }
+
+   return buf;
+}
+
+
+/* Converts the rows of the locked region which were changed in the lock
+ * buffer back into the bitmap memory, and converts them back so that
+ * the buffer matches the bitmap.
+ */
+static void write_back_lock_buffer(ALLEGRO_BITMAP *bitmap)
+{
+   _AL_LOCK_BUFFER *buf = bitmap->lock_buffer;
+   int pixel_size = al_get_pixel_size(buf->format);
+   int offset = bitmap->lock_x * pixel_size;
+   int size = bitmap->lock_w * pixel_size;
+   int y;
+
+   for (y = bitmap->lock_y; y < bitmap->lock_y + bitmap->lock_h; y++) {
+      unsigned char *data = buf->data + y * buf->pitch + offset;
+      unsigned char *clean = buf->clean + y * buf->pitch + offset;
+
+      if (memcmp(data, clean, size) == 0)
+         continue;
+
+      _al_convert_bitmap_data(
+         buf->data, buf->format, buf->pitch,
+         bitmap->memory, al_get_bitmap_format(bitmap), bitmap->pitch,
+         bitmap->lock_x, y, bitmap->lock_x, y, bitmap->lock_w, 1);
+      /* The bitmap format may not hold the written values exactly, so the
+       * buffer is refreshed with what the bitmap now contains.
+       */
+      _al_convert_bitmap_data(
+         bitmap->memory, al_get_bitmap_format(bitmap), bitmap->pitch,
+         buf->data, buf->format, buf->pitch,
+         bitmap->lock_x, y, bitmap->lock_x, y, bitmap->lock_w, 1);
+      memcpy(clean, data, size);
+   }
+}
+
+
 /* Function: al_lock_bitmap_region
  */
 ALLEGRO_LOCKED_REGION *al_lock_bitmap_region(ALLEGRO_BITMAP *bitmap,
@@ -90,6 +222,16 @@ ALLEGRO_LOCKED_REGION *al_lock_bitmap_region(ALLEGRO_BITMAP *bitmap,
          bitmap->locked_region.pitch = bitmap->pitch;
          bitmap->locked_region.pixel_size = al_get_pixel_size(bitmap_format);
       }
+      else if ((bitmap_flags & ALLEGRO_KEEP_LOCK_BUFFER) &&
+            get_lock_buffer(bitmap, f,
+               !(bitmap->lock_flags & ALLEGRO_LOCK_READONLY))) {
+         _AL_LOCK_BUFFER *buf = bitmap->lock_buffer;
+         bitmap->locked_region.data = buf->data
+            + buf->pitch * yc + xc * al_get_pixel_size(f);
+         bitmap->locked_region.format = f;
+         bitmap->locked_region.pitch = buf->pitch;
+         bitmap->locked_region.pixel_size = al_get_pixel_size(f);
+      }
       else {
          bitmap->locked_region.pitch = al_get_pixel_size(f) * wc;
          bitmap->locked_region.data = al_malloc(bitmap->locked_region.pitch*hc);
@@ -146,7 +288,16 @@ void al_unlock_bitmap(ALLEGRO_BITMAP *bitmap)
       else
          bitmap->vt->unlock_region(bitmap);
    }
+   else if (bitmap->lock_buffer &&
+         bitmap->locked_region.format != bitmap_format) {
+      if (!(bitmap->lock_flags & ALLEGRO_LOCK_READONLY))
+         write_back_lock_buffer(bitmap);
+   }
    else {
+      if (bitmap->lock_buffer && !(bitmap->lock_flags & ALLEGRO_LOCK_READONLY)) {
+         invalidate_lock_buffer(bitmap->lock_buffer, bitmap->lock_x,
+            bitmap->lock_y, bitmap->lock_w, bitmap->lock_h);
+      }
       if (bitmap->locked_region.format != 0 && bitmap->locked_region.format != bitmap_format) {
          if (!(bitmap->lock_flags & ALLEGRO_LOCK_READONLY)) {
             _al_convert_bitmap_data(
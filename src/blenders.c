@@ -16,10 +16,13 @@
 
 
 #include "allegro5/allegro.h"
+#include "allegro5/cpu.h"
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_blend.h"
 #include "allegro5/internal/aintern_display.h"
+#include "allegro5/internal/aintern_pixels.h"
+#include "allegro5/internal/aintern_simd.h"
 #include <string.h>
 
 void _al_blend_memory(ALLEGRO_COLOR *scol,
@@ -39,3 +42,195 @@ void _al_blend_memory(ALLEGRO_COLOR *scol,
                     &constcol, result);
    (void) _al_blend_alpha_inline; // silence compiler
 }
+
+
+
+/* Span kernels for the common blender states, blending whole rows of one
+ * 8888 format onto the same format. They do the same float math as
+ * _al_blend_inline followed by _AL_INLINE_PUT_PIXEL, so the results are
+ * identical to the per pixel path. The alpha channel uses the same factors
+ * as the color channels in all of these states, so only the position of
+ * the source alpha byte matters.
+ */
+
+/* result = min(1, s * FS + d * FD), per channel. */
+#define ALPHA_FS(s, d, sa)     (sa)
+#define ALPHA_FD(s, d, sa)     (1 - (sa))
+#define PREMUL_FS(s, d, sa)    1
+#define PREMUL_FD(s, d, sa)    (1 - (sa))
+#define ADD_FS(s, d, sa)       1
+#define ADD_FD(s, d, sa)       1
+#define MULTIPLY_FS(s, d, sa)  (d)
+#define MULTIPLY_FD(s, d, sa)  0
+
+#define DEFINE_BLEND_SPAN(name, a, FS, FD)                                    \
+   static void name(const void *src, void *dst, int n)                        \
+   {                                                                          \
+      const uint8_t *s = src;                                                 \
+      uint8_t *d = dst;                                                       \
+      int i, c;                                                               \
+      for (i = 0; i < n; i++, s += 4, d += 4) {                               \
+         const float sa = _al_u8_to_float[s[a]];                              \
+         for (c = 0; c < 4; c++) {                                            \
+            const float sc = _al_u8_to_float[s[c]];                           \
+            const float dc = _al_u8_to_float[d[c]];                           \
+            const float r = _ALLEGRO_MIN(1,                                   \
+               sc * FS(sc, dc, sa) + dc * FD(sc, dc, sa));                    \
+            d[c] = _al_fast_float_to_int(r * 255);                            \
+         }                                                                    \
+         (void)sa;                                                            \
+      }                                                                       \
+   }
+
+DEFINE_BLEND_SPAN(blend_span_alpha_a0, 0, ALPHA_FS, ALPHA_FD)
+DEFINE_BLEND_SPAN(blend_span_alpha_a3, 3, ALPHA_FS, ALPHA_FD)
+DEFINE_BLEND_SPAN(blend_span_premul_a0, 0, PREMUL_FS, PREMUL_FD)
+DEFINE_BLEND_SPAN(blend_span_premul_a3, 3, PREMUL_FS, PREMUL_FD)
+DEFINE_BLEND_SPAN(blend_span_add_a0, 0, ADD_FS, ADD_FD)
+DEFINE_BLEND_SPAN(blend_span_add_a3, 3, ADD_FS, ADD_FD)
+DEFINE_BLEND_SPAN(blend_span_multiply_a0, 0, MULTIPLY_FS, MULTIPLY_FD)
+DEFINE_BLEND_SPAN(blend_span_multiply_a3, 3, MULTIPLY_FS, MULTIPLY_FD)
+
+
+#ifdef _AL_SIMD_SSE2
+
+/* One pixel per vector. The u8 to float conversion divides by 255 in
+ * single precision, which matches _al_u8_to_float exactly.
+ */
+#define DEFINE_BLEND_SPAN_SSE2(name, a, FS, FD)                               \
+   _AL_SIMD_TARGET("sse2")                                                    \
+   static void name(const void *src, void *dst, int n)                        \
+   {                                                                          \
+      const uint8_t *sp = src;                                                \
+      uint8_t *dp = dst;                                                      \
+      const __m128i zero = _mm_setzero_si128();                               \
+      const __m128 one = _mm_set1_ps(1);                                      \
+      const __m128 scale = _mm_set1_ps(255);                                  \
+      int i;                                                                  \
+      for (i = 0; i < n; i++, sp += 4, dp += 4) {                             \
+         int32_t sv, dv;                                                      \
+         __m128 s, d, sa, r;                                                  \
+         __m128i ri;                                                          \
+         memcpy(&sv, sp, 4);                                                  \
+         memcpy(&dv, dp, 4);                                                  \
+         s = _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8( \
+            _mm_cvtsi32_si128(sv), zero), zero)), scale);                     \
+         d = _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8( \
+            _mm_cvtsi32_si128(dv), zero), zero)), scale);                     \
+         sa = _mm_shuffle_ps(s, s, _MM_SHUFFLE(a, a, a, a));                  \
+         r = _mm_add_ps(_mm_mul_ps(s, FS(s, d, sa)),                          \
+            _mm_mul_ps(d, FD(s, d, sa)));                                     \
+         r = _mm_min_ps(r, one);                                              \
+         ri = _mm_cvttps_epi32(_mm_mul_ps(r, scale));                         \
+         ri = _mm_packus_epi16(_mm_packs_epi32(ri, zero), zero);              \
+         dv = _mm_cvtsi128_si32(ri);                                          \
+         memcpy(dp, &dv, 4);                                                  \
+         (void)sa;                                                            \
+      }                                                                       \
+   }
+
+#define ALPHA_FS_SSE2(s, d, sa)     (sa)
+#define ALPHA_FD_SSE2(s, d, sa)     _mm_sub_ps(one, (sa))
+#define PREMUL_FS_SSE2(s, d, sa)    one
+#define PREMUL_FD_SSE2(s, d, sa)    _mm_sub_ps(one, (sa))
+#define ADD_FS_SSE2(s, d, sa)       one
+#define ADD_FD_SSE2(s, d, sa)       one
+#define MULTIPLY_FS_SSE2(s, d, sa)  (d)
+#define MULTIPLY_FD_SSE2(s, d, sa)  _mm_setzero_ps()
+
+DEFINE_BLEND_SPAN_SSE2(blend_span_alpha_a0_sse2, 0, ALPHA_FS_SSE2, ALPHA_FD_SSE2)
+DEFINE_BLEND_SPAN_SSE2(blend_span_alpha_a3_sse2, 3, ALPHA_FS_SSE2, ALPHA_FD_SSE2)
+DEFINE_BLEND_SPAN_SSE2(blend_span_premul_a0_sse2, 0, PREMUL_FS_SSE2, PREMUL_FD_SSE2)
+DEFINE_BLEND_SPAN_SSE2(blend_span_premul_a3_sse2, 3, PREMUL_FS_SSE2, PREMUL_FD_SSE2)
+DEFINE_BLEND_SPAN_SSE2(blend_span_add_a0_sse2, 0, ADD_FS_SSE2, ADD_FD_SSE2)
+DEFINE_BLEND_SPAN_SSE2(blend_span_add_a3_sse2, 3, ADD_FS_SSE2, ADD_FD_SSE2)
+DEFINE_BLEND_SPAN_SSE2(blend_span_multiply_a0_sse2, 0, MULTIPLY_FS_SSE2, MULTIPLY_FD_SSE2)
+DEFINE_BLEND_SPAN_SSE2(blend_span_multiply_a3_sse2, 3, MULTIPLY_FS_SSE2, MULTIPLY_FD_SSE2)
+
+#endif
+
+
+typedef struct BLEND_SPAN_STATE {
+   int src_mode;
+   int dst_mode;
+   _AL_BLEND_SPAN span[2];       /* alpha in byte 0, byte 3 */
+   _AL_BLEND_SPAN span_sse2[2];
+} BLEND_SPAN_STATE;
+
+#ifdef _AL_SIMD_SSE2
+   #define SSE2_SPANS(name) {name##_a0_sse2, name##_a3_sse2}
+#else
+   #define SSE2_SPANS(name) {NULL, NULL}
+#endif
+
+static const BLEND_SPAN_STATE blend_span_states[] = {
+   {ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA,
+      {blend_span_alpha_a0, blend_span_alpha_a3},
+      SSE2_SPANS(blend_span_alpha)},
+   {ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA,
+      {blend_span_premul_a0, blend_span_premul_a3},
+      SSE2_SPANS(blend_span_premul)},
+   {ALLEGRO_ONE, ALLEGRO_ONE,
+      {blend_span_add_a0, blend_span_add_a3},
+      SSE2_SPANS(blend_span_add)},
+   {ALLEGRO_DEST_COLOR, ALLEGRO_ZERO,
+      {blend_span_multiply_a0, blend_span_multiply_a3},
+      SSE2_SPANS(blend_span_multiply)}
+};
+
+
+/* Byte offset of the alpha component in memory, or -1. */
+static int alpha_byte(int format)
+{
+   switch (format) {
+      case ALLEGRO_PIXEL_FORMAT_ARGB_8888:
+      case ALLEGRO_PIXEL_FORMAT_ABGR_8888:
+#ifdef ALLEGRO_BIG_ENDIAN
+         return 0;
+#else
+         return 3;
+#endif
+      case ALLEGRO_PIXEL_FORMAT_RGBA_8888:
+#ifdef ALLEGRO_BIG_ENDIAN
+         return 3;
+#else
+         return 0;
+#endif
+      case ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE:
+         return 3;
+      default:
+         return -1;
+   }
+}
+
+
+/* Returns a span kernel for blending pixels of the given format onto the
+ * same format with the current blender, or NULL if there is none. Tinting
+ * is not handled.
+ */
+_AL_BLEND_SPAN _al_get_blend_span(int format)
+{
+   int op, src_mode, dst_mode, op_alpha, src_alpha, dst_alpha;
+   int a = alpha_byte(format);
+   unsigned i;
+
+   if (a < 0)
+      return NULL;
+
+   al_get_separate_blender(&op, &src_mode, &dst_mode,
+      &op_alpha, &src_alpha, &dst_alpha);
+   if (op != ALLEGRO_ADD || op_alpha != ALLEGRO_ADD ||
+         src_mode != src_alpha || dst_mode != dst_alpha)
+      return NULL;
+
+   for (i = 0; i < sizeof(blend_span_states) / sizeof(*blend_span_states); i++) {
+      const BLEND_SPAN_STATE *state = &blend_span_states[i];
+      if (state->src_mode != src_mode || state->dst_mode != dst_mode)
+         continue;
+      if (state->span_sse2[a / 3] && (al_get_cpu_features() & ALLEGRO_CPU_SSE2))
+         return state->span_sse2[a / 3];
+      return state->span[a / 3];
+   }
+
+   return NULL;
+}
@@ -315,6 +315,10 @@ ALLEGRO_CONFIG *al_load_config_file(const char *filename)
 
    file = al_fopen(filename, "r");
    if (file) {
+      /* Lines are read with al_fgets, which copies whole runs of the
+       * buffer at a time.
+       */
+      al_set_file_buffer_size(file, 16 * 1024);
       cfg = al_load_config_file_f(file);
       al_fclose(file);
    }
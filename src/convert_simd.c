@@ -0,0 +1,507 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      SIMD versions of the pixel format converters.
+ *
+ *      The per-format descriptions in convert_simd.inc are generated by
+ *      misc/make_converters.py. Every kernel produces exactly the same
+ *      pixels as the plain C converter in convert.c it replaces, except for
+ *      ALLEGRO_COLOR components outside of [0, 1], see
+ *      convert_from_f32_sse2.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#include "allegro5/allegro.h"
+#include "allegro5/cpu.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_simd.h"
+#include "allegro5/internal/aintern_system.h"
+
+ALLEGRO_DEBUG_CHANNEL("convert")
+
+#if defined(_AL_SIMD_SSE2) || defined(_AL_SIMD_NEON)
+
+typedef void (*CONVERT_FUNC)(const void *, int, void *, int,
+   int, int, int, int, int, int);
+
+/* One component (or several which move by the same amount) of a packed
+ * pixel: ((x >> shift_right) & mask), scaled up to 8 bits if mul != 1,
+ * then shifted into place.
+ */
+typedef struct CONVERT_OP {
+   int shift_right;
+   uint32_t mask;
+   int mul, add, shift_scale;
+   int shift_left;
+} CONVERT_OP;
+
+typedef struct CONVERT_OPS {
+   uint32_t fill;
+   int num_ops;
+   CONVERT_OP op[4];
+} CONVERT_OPS;
+
+typedef struct CONVERT_SIMD_FUNC {
+   int src_format;
+   int dst_format;
+   int cpu_feature;
+   CONVERT_FUNC func;
+} CONVERT_SIMD_FUNC;
+
+#define CONVERT_PARAMS \
+   const void *src, int src_pitch, void *dst, int dst_pitch, \
+   int sx, int sy, int dx, int dy, int width, int height
+
+#define CONVERT_ARGS \
+   src, src_pitch, dst, dst_pitch, sx, sy, dx, dy, width, height
+
+
+/* Used for the pixels left over at the end of a row. */
+static uint32_t convert_pixel(const CONVERT_OPS *ops, uint32_t x)
+{
+   uint32_t r = ops->fill;
+   int i;
+
+   for (i = 0; i < ops->num_ops; i++) {
+      const CONVERT_OP *op = &ops->op[i];
+      uint32_t c = (x >> op->shift_right) & op->mask;
+      c = (c * op->mul + op->add) >> op->shift_scale;
+      r |= c << op->shift_left;
+   }
+   return r;
+}
+
+
+#define ROW(type, base, pitch, x, y) \
+   ((type *)((char *)(base) + (y) * (pitch)) + (x))
+
+/* Generic row walker for packed to packed conversions. `convert4` converts
+ * four pixels, the remainder goes through convert_pixel.
+ */
+#define CONVERT_ROWS(src_type, dst_type, convert4)                            \
+   int y;                                                                     \
+   for (y = 0; y < height; y++) {                                             \
+      const src_type *s = ROW(const src_type, src, src_pitch, sx, sy + y);    \
+      dst_type *d = ROW(dst_type, dst, dst_pitch, dx, dy + y);                \
+      int x = 0;                                                              \
+      for (; x + 4 <= width; x += 4) {                                        \
+         convert4;                                                            \
+      }                                                                       \
+      for (; x < width; x++) {                                                \
+         d[x] = convert_pixel(ops, s[x]);                                     \
+      }                                                                       \
+   }
+
+
+#ifdef _AL_SIMD_SSE2
+
+typedef struct SSE2_OPS {
+   __m128i fill;
+   int num_ops;
+   bool scale[4];
+   __m128i shift_right[4], mask[4], mul[4], add[4], shift_scale[4];
+   __m128i shift_left[4];
+} SSE2_OPS;
+
+
+_AL_SIMD_TARGET("sse2")
+static void sse2_prepare(SSE2_OPS *v, const CONVERT_OPS *ops)
+{
+   int i;
+
+   v->fill = _mm_set1_epi32(ops->fill);
+   v->num_ops = ops->num_ops;
+   for (i = 0; i < ops->num_ops; i++) {
+      const CONVERT_OP *op = &ops->op[i];
+      v->scale[i] = op->mul != 1;
+      v->shift_right[i] = _mm_cvtsi32_si128(op->shift_right);
+      v->mask[i] = _mm_set1_epi32(op->mask);
+      /* The products fit in 16 bits, so a 16 bit multiply is exact. */
+      v->mul[i] = _mm_set1_epi32(op->mul);
+      v->add[i] = _mm_set1_epi32(op->add);
+      v->shift_scale[i] = _mm_cvtsi32_si128(op->shift_scale);
+      v->shift_left[i] = _mm_cvtsi32_si128(op->shift_left);
+   }
+}
+
+
+_AL_SIMD_TARGET("sse2")
+static __m128i sse2_convert(const SSE2_OPS *v, __m128i x)
+{
+   __m128i r = v->fill;
+   int i;
+
+   for (i = 0; i < v->num_ops; i++) {
+      __m128i c = _mm_srl_epi32(x, v->shift_right[i]);
+      c = _mm_and_si128(c, v->mask[i]);
+      if (v->scale[i]) {
+         c = _mm_add_epi32(_mm_mullo_epi16(c, v->mul[i]), v->add[i]);
+         c = _mm_srl_epi32(c, v->shift_scale[i]);
+      }
+      r = _mm_or_si128(r, _mm_sll_epi32(c, v->shift_left[i]));
+   }
+   return r;
+}
+
+
+/* Same as sse2_convert, for eight pixels at a time. */
+_AL_SIMD_TARGET("sse2")
+static void sse2_convert8(const SSE2_OPS *v, __m128i *x0, __m128i *x1)
+{
+   __m128i r0 = v->fill;
+   __m128i r1 = v->fill;
+   int i;
+
+   for (i = 0; i < v->num_ops; i++) {
+      __m128i c0 = _mm_and_si128(_mm_srl_epi32(*x0, v->shift_right[i]),
+         v->mask[i]);
+      __m128i c1 = _mm_and_si128(_mm_srl_epi32(*x1, v->shift_right[i]),
+         v->mask[i]);
+      if (v->scale[i]) {
+         c0 = _mm_add_epi32(_mm_mullo_epi16(c0, v->mul[i]), v->add[i]);
+         c1 = _mm_add_epi32(_mm_mullo_epi16(c1, v->mul[i]), v->add[i]);
+         c0 = _mm_srl_epi32(c0, v->shift_scale[i]);
+         c1 = _mm_srl_epi32(c1, v->shift_scale[i]);
+      }
+      r0 = _mm_or_si128(r0, _mm_sll_epi32(c0, v->shift_left[i]));
+      r1 = _mm_or_si128(r1, _mm_sll_epi32(c1, v->shift_left[i]));
+   }
+   *x0 = r0;
+   *x1 = r1;
+}
+
+
+_AL_SIMD_TARGET("sse2")
+static void sse2_load8(const void *p, int size, __m128i *x0, __m128i *x1)
+{
+   if (size == 4) {
+      *x0 = _mm_loadu_si128((const __m128i *)p);
+      *x1 = _mm_loadu_si128((const __m128i *)p + 1);
+   }
+   else {
+      __m128i x = _mm_loadu_si128((const __m128i *)p);
+      *x0 = _mm_unpacklo_epi16(x, _mm_setzero_si128());
+      *x1 = _mm_unpackhi_epi16(x, _mm_setzero_si128());
+   }
+}
+
+
+_AL_SIMD_TARGET("sse2")
+static void sse2_store8(void *p, int size, __m128i x0, __m128i x1)
+{
+   if (size == 4) {
+      _mm_storeu_si128((__m128i *)p, x0);
+      _mm_storeu_si128((__m128i *)p + 1, x1);
+   }
+   else {
+      /* Sign extend the low halves so packs does not saturate them. */
+      x0 = _mm_srai_epi32(_mm_slli_epi32(x0, 16), 16);
+      x1 = _mm_srai_epi32(_mm_slli_epi32(x1, 16), 16);
+      _mm_storeu_si128((__m128i *)p, _mm_packs_epi32(x0, x1));
+   }
+}
+
+
+#define PACKED_ROWS(src_type, dst_type)                                       \
+   int y;                                                                     \
+   for (y = 0; y < height; y++) {                                             \
+      const src_type *s = ROW(const src_type, src, src_pitch, sx, sy + y);    \
+      dst_type *d = ROW(dst_type, dst, dst_pitch, dx, dy + y);                \
+      int x = 0;                                                              \
+      for (; x + 8 <= width; x += 8) {                                        \
+         __m128i x0, x1;                                                      \
+         sse2_load8(s + x, sizeof(src_type), &x0, &x1);                       \
+         sse2_convert8(&v, &x0, &x1);                                         \
+         sse2_store8(d + x, sizeof(dst_type), x0, x1);                        \
+      }                                                                       \
+      for (; x < width; x++) {                                                \
+         d[x] = convert_pixel(ops, s[x]);                                     \
+      }                                                                       \
+   }
+
+
+_AL_SIMD_TARGET("sse2")
+static void convert_packed_sse2(const CONVERT_OPS *ops, int src_size,
+   int dst_size, CONVERT_PARAMS)
+{
+   SSE2_OPS v;
+   sse2_prepare(&v, ops);
+
+   if (src_size == 4 && dst_size == 4) {
+      PACKED_ROWS(uint32_t, uint32_t)
+   }
+   else if (src_size == 4) {
+      PACKED_ROWS(uint32_t, uint16_t)
+   }
+   else if (dst_size == 4) {
+      PACKED_ROWS(uint16_t, uint32_t)
+   }
+   else {
+      PACKED_ROWS(uint16_t, uint16_t)
+   }
+}
+
+
+/* Converts ALLEGRO_COLOR to ABGR_8888 the way the plain C converters do,
+ * (uint32_t)(c * 255) per component, then on to the destination format.
+ * The packs saturate, so components outside of [0, 1] become 0 or 255.
+ * The plain C converters let those spill into the other components
+ * instead, so the results differ for such colors.
+ */
+_AL_SIMD_TARGET("sse2")
+static void convert_from_f32_sse2(const CONVERT_OPS *ops, CONVERT_PARAMS)
+{
+   const __m128 scale = _mm_set1_ps(255);
+   SSE2_OPS v;
+   int y;
+   sse2_prepare(&v, ops);
+
+   for (y = 0; y < height; y++) {
+      const ALLEGRO_COLOR *s = ROW(const ALLEGRO_COLOR, src, src_pitch,
+         sx, sy + y);
+      uint32_t *d = ROW(uint32_t, dst, dst_pitch, dx, dy + y);
+      int x = 0;
+      for (; x + 4 <= width; x += 4) {
+         const float *f = &s[x].r;
+         __m128i c0 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(f), scale));
+         __m128i c1 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(f + 4), scale));
+         __m128i c2 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(f + 8), scale));
+         __m128i c3 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(f + 12), scale));
+         __m128i abgr = _mm_packus_epi16(_mm_packs_epi32(c0, c1),
+            _mm_packs_epi32(c2, c3));
+         _mm_storeu_si128((__m128i *)(d + x), sse2_convert(&v, abgr));
+      }
+      for (; x < width; x++) {
+         uint32_t abgr = (uint32_t)(s[x].r * 255) |
+            ((uint32_t)(s[x].g * 255) << 8) |
+            ((uint32_t)(s[x].b * 255) << 16) |
+            ((uint32_t)(s[x].a * 255) << 24);
+         d[x] = convert_pixel(ops, abgr);
+      }
+   }
+}
+
+
+/* Converts to ABGR_8888 first, then divides by 255 like _al_u8_to_float
+ * (single precision division gives the same results as that table).
+ */
+_AL_SIMD_TARGET("sse2")
+static void convert_to_f32_sse2(const CONVERT_OPS *ops, CONVERT_PARAMS)
+{
+   const __m128 scale = _mm_set1_ps(255);
+   const __m128i zero = _mm_setzero_si128();
+   SSE2_OPS v;
+   int y;
+   sse2_prepare(&v, ops);
+
+   for (y = 0; y < height; y++) {
+      const uint32_t *s = ROW(const uint32_t, src, src_pitch, sx, sy + y);
+      ALLEGRO_COLOR *d = ROW(ALLEGRO_COLOR, dst, dst_pitch, dx, dy + y);
+      int x = 0;
+      for (; x + 4 <= width; x += 4) {
+         __m128i abgr = sse2_convert(&v,
+            _mm_loadu_si128((const __m128i *)(s + x)));
+         __m128i lo = _mm_unpacklo_epi8(abgr, zero);
+         __m128i hi = _mm_unpackhi_epi8(abgr, zero);
+         float *f = &d[x].r;
+         _mm_storeu_ps(f, _mm_div_ps(
+            _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+         _mm_storeu_ps(f + 4, _mm_div_ps(
+            _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+         _mm_storeu_ps(f + 8, _mm_div_ps(
+            _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+         _mm_storeu_ps(f + 12, _mm_div_ps(
+            _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+      }
+      for (; x < width; x++) {
+         uint32_t abgr = convert_pixel(ops, s[x]);
+         d[x] = al_map_rgba(abgr & 255, (abgr >> 8) & 255,
+            (abgr >> 16) & 255, abgr >> 24);
+      }
+   }
+}
+
+
+#define PACKED_FUNCS(a, b, src_type, dst_type)                                \
+   static void a##_to_##b##_sse2(CONVERT_PARAMS)                              \
+   {                                                                          \
+      convert_packed_sse2(&a##_to_##b##_ops, sizeof(src_type),                \
+         sizeof(dst_type), CONVERT_ARGS);                                     \
+   }
+
+#define FROM_F32_FUNCS(a, b)                                                  \
+   static void a##_to_##b##_sse2(CONVERT_PARAMS)                              \
+   {                                                                          \
+      convert_from_f32_sse2(&a##_to_##b##_ops, CONVERT_ARGS);                 \
+   }
+
+#define TO_F32_FUNCS(a, b)                                                    \
+   static void a##_to_##b##_sse2(CONVERT_PARAMS)                              \
+   {                                                                          \
+      convert_to_f32_sse2(&a##_to_##b##_ops, CONVERT_ARGS);                   \
+   }
+
+#else
+
+#define PACKED_FUNCS(a, b, src_type, dst_type)
+#define FROM_F32_FUNCS(a, b)
+#define TO_F32_FUNCS(a, b)
+
+#endif /* _AL_SIMD_SSE2 */
+
+
+#ifdef _AL_SIMD_SSSE3
+
+_AL_SIMD_TARGET("ssse3")
+static void convert_shuffle_ssse3(const CONVERT_OPS *ops,
+   const uint8_t *shuffle, CONVERT_PARAMS)
+{
+   const __m128i mask = _mm_loadu_si128((const __m128i *)shuffle);
+   const __m128i fill = _mm_set1_epi32(ops->fill);
+
+   CONVERT_ROWS(uint32_t, uint32_t,
+      _mm_storeu_si128((__m128i *)(d + x), _mm_or_si128(fill,
+         _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + x)), mask))))
+}
+
+#define SHUFFLE_SSSE3(a, b)                                                   \
+   static void a##_to_##b##_ssse3(CONVERT_PARAMS)                             \
+   {                                                                          \
+      convert_shuffle_ssse3(&a##_to_##b##_ops, a##_to_##b##_shuffle,          \
+         CONVERT_ARGS);                                                       \
+   }
+
+#else
+#define SHUFFLE_SSSE3(a, b)
+#endif
+
+
+#ifdef _AL_SIMD_AVX2
+
+_AL_SIMD_TARGET("avx2")
+static void convert_shuffle_avx2(const CONVERT_OPS *ops,
+   const uint8_t *shuffle, CONVERT_PARAMS)
+{
+   const __m128i mask128 = _mm_loadu_si128((const __m128i *)shuffle);
+   const __m256i mask = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(mask128), mask128, 1);
+   const __m256i fill = _mm256_set1_epi32(ops->fill);
+   int y;
+
+   for (y = 0; y < height; y++) {
+      const uint32_t *s = ROW(const uint32_t, src, src_pitch, sx, sy + y);
+      uint32_t *d = ROW(uint32_t, dst, dst_pitch, dx, dy + y);
+      int x = 0;
+      for (; x + 8 <= width; x += 8) {
+         __m256i p = _mm256_loadu_si256((const __m256i *)(s + x));
+         _mm256_storeu_si256((__m256i *)(d + x),
+            _mm256_or_si256(fill, _mm256_shuffle_epi8(p, mask)));
+      }
+      for (; x < width; x++) {
+         d[x] = convert_pixel(ops, s[x]);
+      }
+   }
+}
+
+#define SHUFFLE_AVX2(a, b)                                                    \
+   static void a##_to_##b##_avx2(CONVERT_PARAMS)                              \
+   {                                                                          \
+      convert_shuffle_avx2(&a##_to_##b##_ops, a##_to_##b##_shuffle,           \
+         CONVERT_ARGS);                                                       \
+   }
+
+#else
+#define SHUFFLE_AVX2(a, b)
+#endif
+
+
+#ifdef _AL_SIMD_NEON
+
+static void convert_shuffle_neon(const CONVERT_OPS *ops,
+   const uint8_t *shuffle, CONVERT_PARAMS)
+{
+   /* Out of range indices (128) select zero bytes, as with pshufb. */
+   const uint8x16_t mask = vld1q_u8(shuffle);
+   const uint8x16_t fill = vreinterpretq_u8_u32(vdupq_n_u32(ops->fill));
+
+   CONVERT_ROWS(uint32_t, uint32_t,
+      vst1q_u8((uint8_t *)(d + x), vorrq_u8(fill,
+         vqtbl1q_u8(vld1q_u8((const uint8_t *)(s + x)), mask))))
+}
+
+#define SHUFFLE_NEON(a, b)                                                    \
+   static void a##_to_##b##_neon(CONVERT_PARAMS)                              \
+   {                                                                          \
+      convert_shuffle_neon(&a##_to_##b##_ops, a##_to_##b##_shuffle,           \
+         CONVERT_ARGS);                                                       \
+   }
+
+#else
+#define SHUFFLE_NEON(a, b)
+#endif
+
+
+#define SHUFFLE_FUNCS(a, b) \
+   SHUFFLE_SSSE3(a, b) \
+   SHUFFLE_AVX2(a, b) \
+   SHUFFLE_NEON(a, b)
+
+#include "convert_simd.inc"
+
+
+static CONVERT_FUNC scalar_funcs[ALLEGRO_NUM_PIXEL_FORMATS]
+   [ALLEGRO_NUM_PIXEL_FORMATS];
+static bool scalar_funcs_saved = false;
+
+#endif /* _AL_SIMD_SSE2 || _AL_SIMD_NEON */
+
+
+/* Replaces the plain C converters in _al_convert_funcs by the best SIMD
+ * variant the CPU supports. The entries are listed by increasing feature
+ * level, so later ones win. The results are the same except for float
+ * colors out of range, which the SIMD converters clamp.
+ */
+void _al_init_convert_simd(void)
+{
+#if defined(_AL_SIMD_SSE2) || defined(_AL_SIMD_NEON)
+   const char *value;
+   int features;
+   int i;
+
+   if (!scalar_funcs_saved) {
+      memcpy(scalar_funcs, _al_convert_funcs, sizeof(scalar_funcs));
+      scalar_funcs_saved = true;
+   }
+   else {
+      memcpy(_al_convert_funcs, scalar_funcs, sizeof(scalar_funcs));
+   }
+
+   value = al_get_config_value(al_get_system_config(), "graphics",
+      "simd_converters");
+   if (value && !_al_stricmp(value, "false")) {
+      ALLEGRO_INFO("SIMD pixel converters disabled.\n");
+      return;
+   }
+
+   features = al_get_cpu_features();
+   for (i = 0; convert_simd_funcs[i].func; i++) {
+      const CONVERT_SIMD_FUNC *f = &convert_simd_funcs[i];
+      if (features & f->cpu_feature)
+         _al_convert_funcs[f->src_format][f->dst_format] = f->func;
+   }
+
+   ALLEGRO_INFO("SIMD pixel converters for CPU features 0x%x.\n", features);
+#endif
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -37,6 +37,14 @@
 #include <sys/sysctl.h>
 #endif
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define CPU_X86_MSVC
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#define CPU_X86_GCC
+#endif
+
 #ifdef ALLEGRO_WINDOWS
 #ifndef WINVER
 #define WINVER 0x0500
@@ -108,5 +116,98 @@ int al_get_ram_size(void)
 }
 
 
+#if defined(CPU_X86_MSVC) || defined(CPU_X86_GCC)
+
+static void cpuid(int leaf, unsigned int regs[4])
+{
+#ifdef CPU_X86_MSVC
+   int r[4];
+   __cpuidex(r, leaf, 0);
+   regs[0] = r[0];
+   regs[1] = r[1];
+   regs[2] = r[2];
+   regs[3] = r[3];
+#else
+   if ((unsigned int)leaf > __get_cpuid_max(0, NULL)) {
+      regs[0] = regs[1] = regs[2] = regs[3] = 0;
+      return;
+   }
+   __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+
+/* Whether the OS saves the YMM registers on context switches, which is
+ * required before any AVX instruction may be used.
+ */
+static bool os_saves_ymm(void)
+{
+   uint32_t xcr0;
+#ifdef CPU_X86_MSVC
+   xcr0 = (uint32_t)_xgetbv(0);
+#else
+   uint32_t edx;
+   __asm__ (".byte 0x0f, 0x01, 0xd0" : "=a" (xcr0), "=d" (edx) : "c" (0));
+   (void)edx;
+#endif
+   return (xcr0 & 6) == 6;
+}
+
+
+static int detect_cpu_features(void)
+{
+   unsigned int regs[4];
+   unsigned int max_leaf;
+   int features = 0;
+
+   cpuid(0, regs);
+   max_leaf = regs[0];
+   if (max_leaf < 1)
+      return 0;
+
+   cpuid(1, regs);
+   if (regs[3] & (1 << 26))
+      features |= ALLEGRO_CPU_SSE2;
+   if (regs[2] & (1 << 9))
+      features |= ALLEGRO_CPU_SSSE3;
+
+   /* AVX2 needs the OSXSAVE bit as well as AVX support from the OS. */
+   if ((regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) && max_leaf >= 7
+         && os_saves_ymm()) {
+      cpuid(7, regs);
+      if (regs[1] & (1 << 5))
+         features |= ALLEGRO_CPU_AVX2;
+   }
+
+   return features;
+}
+
+#else
+
+static int detect_cpu_features(void)
+{
+#if defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+   return ALLEGRO_CPU_NEON;
+#else
+   return 0;
+#endif
+}
+
+#endif
+
+
+/* Function: al_get_cpu_features
+ */
+int al_get_cpu_features(void)
+{
+   static int features = -1;
+
+   /* Detection is idempotent, so racing threads at worst repeat it. */
+   if (features < 0)
+      features = detect_cpu_features();
+   return features;
+}
+
+
 /* vi: set ts=4 sw=4 expandtab: */
       
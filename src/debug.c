@@ -10,6 +10,34 @@
  *
  *      Logging and assertion handlers.
  *
+ *      Channels are interned to small integer ids the first time they are
+ *      used, so filtering a message is a bit test.
+ *
+ *      With [trace] async=1 every thread formats its messages into a ring
+ *      buffer of its own, and a writer thread drains the rings into the
+ *      log file. Logging threads take no lock and do no I/O, but messages
+ *      are dropped (and counted) when a ring is full, and the last few
+ *      milliseconds of messages are lost if the process crashes.
+ *
+ *      With [trace] format=binary the log file holds records instead of
+ *      lines, for post-processing. All numbers are in the byte order of
+ *      the machine. The file starts with the 8 bytes "ALTRACE\0", the
+ *      uint32 0x01020304 and the uint32 version 1. Each record starts
+ *      with a uint8 type, a uint8 level, a uint16 channel id and the
+ *      uint32 size of the data which follows:
+ *
+ *         'C' channel: the name of the channel.
+ *         'M' message: uint32 thread, uint32 line, double time,
+ *             uint16 file name size, uint16 function name size, then the
+ *             file name, the function name and the text.
+ *         'D' dropped: uint32 thread, uint32 number of messages.
+ *
+ *      Strings are not terminated. A channel record precedes the first
+ *      message of its channel. Channel 0 holds the channels which did
+ *      not get an id, and is redefined before each of its messages.
+ *      Threads are numbered by their buffer, which is reused after the
+ *      thread exits.
+ *
  *      See LICENSE.txt for copyright information.
  */
 
@@ -17,8 +45,10 @@
 #include <stdio.h>
 
 #include "allegro5/allegro.h"
+#include "allegro5/internal/aintern_atomicops.h"
 #include "allegro5/internal/aintern_debug.h"
 #include "allegro5/internal/aintern_thread.h"
+#include "allegro5/internal/aintern_tls.h"
 #include "allegro5/internal/aintern_vector.h"
 
 #ifdef ALLEGRO_ANDROID
@@ -27,6 +57,19 @@
 #endif
 
 
+#define MAX_CHANNELS          1024
+#define CHANNEL_HASH_SIZE     (2 * MAX_CHANNELS)
+#define CHANNEL_NAMES_SIZE    16384
+#define MAX_MESSAGE           2048
+#define MAX_NESTING           4
+#define DEFAULT_RING_SIZE     262144
+#define MIN_RING_SIZE         16384
+#define MAX_RING_SIZE         (64 << 20)
+#define WRITER_INTERVAL       0.01
+
+#define ALIGN8(x)             (((x) + 7) & ~7)
+
+
 /* tracing */
 typedef struct TRACE_INFO
 {
@@ -43,9 +86,61 @@ typedef struct TRACE_INFO
    _AL_VECTOR excluded;
    /* Whether settings have been read from allegro5.cfg or not. */
    bool configured;
+   /* Whether messages are written by the writer thread. */
+   bool async;
+   /* Whether the log file holds binary records. */
+   bool binary;
+   /* Whether the binary header has been written to the log file. */
+   bool binary_started;
+   /* Of the ring buffers of new threads. */
+   int ring_size;
 } TRACE_INFO;
 
 
+/* A message in a ring buffer, followed by its text. */
+typedef struct TRACE_RECORD
+{
+   /* Of the record with its text. 0 means the record is at the start. */
+   int size;
+   int level;
+   int channel;
+   int line;
+   char const *channel_name;
+   char const *file;
+   char const *function;
+   double time;
+   int length;
+} TRACE_RECORD;
+
+
+/* The log state of a thread. The thread only moves the head of the ring
+ * and the writer thread only moves the tail, so neither has to lock.
+ * These are never freed, as threads hold pointers to them. Instead the
+ * buffer of an exited thread is given to the next thread which logs, see
+ * _al_trace_release_thread_data.
+ */
+typedef struct TRACE_THREAD
+{
+   struct TRACE_THREAD *next;
+   int index;
+   volatile _AL_ATOMIC in_use;
+   volatile _AL_ATOMIC head;
+   volatile _AL_ATOMIC tail;
+   volatile _AL_ATOMIC dropped;
+   /* Used by the writer thread only. */
+   int snapshot_head;
+   /* The messages between _al_trace_prefix and _al_trace_suffix. They
+    * nest if the arguments of a message log something.
+    */
+   int depth;
+   TRACE_RECORD pending[MAX_NESTING];
+   bool pending_async[MAX_NESTING];
+   int ring_size;
+   /* Points just past the structure. */
+   char *ring;
+} TRACE_THREAD;
+
+
 static TRACE_INFO trace_info =
 {
    true,
@@ -55,10 +150,35 @@ static TRACE_INFO trace_info =
    7,
    _AL_VECTOR_INITIALIZER(ALLEGRO_USTR *),
    _AL_VECTOR_INITIALIZER(ALLEGRO_USTR *),
-   false
+   false,
+   false,
+   false,
+   false,
+   DEFAULT_RING_SIZE
 };
 
-static char static_trace_buffer[2048];
+static char static_trace_buffer[MAX_MESSAGE];
+
+/* Interned channels. Ids start at 1 and are never reused, since channels
+ * keep them in static variables.
+ */
+static char const *channel_names[MAX_CHANNELS];
+static int num_channels = 1;
+static char channel_name_pool[CHANNEL_NAMES_SIZE];
+static int channel_name_pool_size;
+static volatile int channel_hash[CHANNEL_HASH_SIZE];
+static unsigned int channel_bits[MAX_CHANNELS / 32];
+static unsigned int channel_written[MAX_CHANNELS / 32];
+
+/* Per-thread buffers and the writer thread. */
+static TRACE_THREAD * volatile trace_threads;
+static int num_trace_threads;
+static _AL_THREAD writer_thread;
+static _AL_MUTEX writer_mutex = _AL_MUTEX_UNINITED;
+static _AL_COND writer_cond;
+static volatile _AL_ATOMIC writer_wake;
+static bool writer_inited;
+static bool writer_running;
 
 /* run-time assertions */
 void (*_al_user_assert_handler)(char const *expr, char const *file,
@@ -79,11 +199,160 @@ static void delete_string_list(_AL_VECTOR *v)
 }
 
 
+static bool channel_is_listed(_AL_VECTOR const *v, char const *channel)
+{
+   size_t i;
+
+   for (i = 0; i < _al_vector_size(v); i++) {
+      ALLEGRO_USTR **iter = _al_vector_ref(v, i);
+      if (!strcmp(al_cstr(*iter), channel))
+         return true;
+   }
+   return false;
+}
+
+
+static bool channel_is_enabled(char const *channel)
+{
+   if (_al_vector_is_nonempty(&trace_info.channels) &&
+         !channel_is_listed(&trace_info.channels, channel)) {
+      return false;
+   }
+   return !channel_is_listed(&trace_info.excluded, channel);
+}
+
+
+static void update_channel_bit(int id)
+{
+   unsigned int bit = 1u << (id & 31);
+
+   if (channel_is_enabled(channel_names[id]))
+      channel_bits[id >> 5] |= bit;
+   else
+      channel_bits[id >> 5] &= ~bit;
+}
+
+
+static unsigned int hash_channel(char const *channel)
+{
+   unsigned int h = 2166136261u;
+
+   while (*channel) {
+      h = (h ^ (unsigned char)*channel++) * 16777619u;
+   }
+   return h;
+}
+
+
+/* Can be called without the lock, as names are stored before their ids
+ * are added to the hash table.
+ */
+static int find_channel(char const *channel, unsigned int *slot)
+{
+   unsigned int i = hash_channel(channel) & (CHANNEL_HASH_SIZE - 1);
+   int id;
+
+   while ((id = channel_hash[i]) != 0) {
+      if (!strcmp(channel_names[id], channel))
+         break;
+      i = (i + 1) & (CHANNEL_HASH_SIZE - 1);
+   }
+   if (slot)
+      *slot = i;
+   return id;
+}
+
+
+/* Returns the id of the channel, or -1 if there is no room left for it,
+ * in which case it is filtered by name.
+ */
+static int intern_channel(char const *channel)
+{
+   unsigned int slot;
+   size_t size;
+   int id;
+
+   id = find_channel(channel, NULL);
+   if (id)
+      return id;
+
+   _al_mutex_lock(&trace_info.trace_mutex);
+
+   id = find_channel(channel, &slot);
+   if (!id) {
+      size = strlen(channel) + 1;
+      if (num_channels == MAX_CHANNELS ||
+            channel_name_pool_size + size > sizeof(channel_name_pool)) {
+         id = -1;
+      }
+      else {
+         id = num_channels++;
+         channel_names[id] = channel_name_pool + channel_name_pool_size;
+         memcpy(channel_name_pool + channel_name_pool_size, channel, size);
+         channel_name_pool_size += size;
+         update_channel_bit(id);
+         _al_memory_barrier();
+         channel_hash[slot] = id;
+      }
+   }
+
+   _al_mutex_unlock(&trace_info.trace_mutex);
+
+   return id;
+}
+
+
+static bool channel_enabled(int id, char const *channel)
+{
+   if (id > 0)
+      return (channel_bits[id >> 5] & (1u << (id & 31))) != 0;
+   return channel_is_enabled(channel);
+}
+
+
+static void writer_proc(_AL_THREAD *self, void *unused);
+
+
+static void start_writer(void)
+{
+   if (writer_running)
+      return;
+
+   /* Threads may still signal the condition after the writer stopped,
+    * so it is never destroyed.
+    */
+   if (!writer_inited) {
+      _al_mutex_init(&writer_mutex);
+      _al_cond_init(&writer_cond);
+      writer_inited = true;
+   }
+
+   _al_thread_create(&writer_thread, writer_proc, NULL);
+   writer_running = true;
+}
+
+
+static void stop_writer(void)
+{
+   if (!writer_running)
+      return;
+
+   _al_mutex_lock(&writer_mutex);
+   _al_thread_set_should_stop(&writer_thread);
+   _al_cond_signal(&writer_cond);
+   _al_mutex_unlock(&writer_mutex);
+   _al_thread_join(&writer_thread);
+   writer_running = false;
+}
+
+
 void _al_configure_logging(void)
 {
    ALLEGRO_CONFIG *config;
    char const *v;
    bool got_all = false;
+   bool async;
+   int i;
 
    config = al_get_system_config();
    v = al_get_config_value(config, "trace", "channels");
@@ -157,8 +426,44 @@ void _al_configure_logging(void)
    else
       trace_info.flags &= ~1;
 
+   /* Both need thread local storage, which is set up by al_install_system
+    * before the configuration is read.
+    */
+   v = al_get_config_value(config, "trace", "async");
+   async = v && !strcmp(v, "1") && al_get_system_driver();
+
+   v = al_get_config_value(config, "trace", "format");
+   trace_info.binary = v && !strcmp(v, "binary") && al_get_system_driver();
+
+   trace_info.ring_size = DEFAULT_RING_SIZE;
+   v = al_get_config_value(config, "trace", "buffer_size");
+   if (v && v[0] != '\0') {
+      trace_info.ring_size = ALIGN8(atoi(v));
+      if (trace_info.ring_size < MIN_RING_SIZE)
+         trace_info.ring_size = MIN_RING_SIZE;
+      if (trace_info.ring_size > MAX_RING_SIZE)
+         trace_info.ring_size = MAX_RING_SIZE;
+   }
+
+   /* Recursive, since the arguments of a message may log something
+    * while _al_trace_prefix holds the lock.
+    */
    if (!trace_info.configured)
-      _al_mutex_init(&trace_info.trace_mutex);
+      _al_mutex_init_recursive(&trace_info.trace_mutex);
+
+   _al_mutex_lock(&trace_info.trace_mutex);
+   for (i = 1; i < num_channels; i++)
+      update_channel_bit(i);
+   _al_mutex_unlock(&trace_info.trace_mutex);
+
+   if (async) {
+      start_writer();
+      trace_info.async = true;
+   }
+   else {
+      trace_info.async = false;
+      stop_writer();
+   }
 
    trace_info.configured = true;
 }
@@ -167,12 +472,13 @@ void _al_configure_logging(void)
 static void open_trace_file(void)
 {
    const char *s;
+   const char *mode = trace_info.binary ? "wb" : "w";
 
    if (trace_info.trace_virgin) {
       s = getenv("ALLEGRO_TRACE");
 
       if (s)
-         trace_info.trace_file = fopen(s, "w");
+         trace_info.trace_file = fopen(s, mode);
       else
 #ifdef ALLEGRO_IPHONE
          // Remember, we have no (accessible) filesystem on (not jailbroken)
@@ -181,7 +487,7 @@ static void open_trace_file(void)
          // it's as good to use as the NSLog stuff.
          trace_info.trace_file = stderr;
 #else
-         trace_info.trace_file = fopen("allegro.log", "w");
+         trace_info.trace_file = fopen("allegro.log", mode);
 #endif
 
       trace_info.trace_virgin = false;
@@ -213,45 +519,423 @@ static void do_trace(const char *msg, ...)
 }
 
 
-/* _al_trace_prefix:
- *  Conditionally write the initial part of a trace message.  If we do, return true
- *  and continue to hold the trace_mutex lock.
- */
-bool _al_trace_prefix(char const *channel, int level,
-   char const *file, int line, char const *function)
+static void append_trace(char *buf, size_t size, const char *msg, ...)
+{
+   int s = strlen(buf);
+   va_list ap;
+
+   va_start(ap, msg);
+   vsnprintf(buf + s, size - s, msg, ap);
+   va_end(ap);
+}
+
+
+/* Formats the part of a text message before the text. */
+static void format_prefix(char *buf, size_t size, char const *channel,
+   int level, char const *file, int line, char const *function, double t)
 {
-   size_t i;
    char *name;
-   _AL_VECTOR const *v;
 
-   if (!trace_info.configured) {
-      _al_configure_logging();
+   buf[0] = '\0';
+   append_trace(buf, size, "%-8s ", channel);
+   if (level == 0) append_trace(buf, size, "D ");
+   if (level == 1) append_trace(buf, size, "I ");
+   if (level == 2) append_trace(buf, size, "W ");
+   if (level == 3) append_trace(buf, size, "E ");
+
+#ifdef ALLEGRO_ANDROID
+   append_trace(buf, size, "%i: ", gettid());
+#endif
+
+#ifdef ALLEGRO_MSVC
+   name = strrchr(file, '\\');
+#else
+   name = strrchr(file, '/');
+#endif
+   if (trace_info.flags & 1) {
+      append_trace(buf, size, "%20s:%-4d ", name ? name + 1 : file, line);
    }
+   if (trace_info.flags & 2) {
+      append_trace(buf, size, "%-32s ", function);
+   }
+   if (trace_info.flags & 4) {
+      append_trace(buf, size, "[%10.5f] ", t);
+   }
+}
 
-   if (level < trace_info.level)
+
+static double get_trace_time(void)
+{
+   if (al_is_system_installed())
+      return al_get_time();
+   return 0;
+}
+
+
+/* Whether messages are passed on as TRACE_RECORDs instead of being
+ * written by _al_trace_prefix and _al_trace_suffix directly.
+ */
+static bool use_records(void)
+{
+#ifdef ALLEGRO_ANDROID
+   return false;
+#else
+   return (trace_info.async || trace_info.binary) && !_al_user_trace_handler;
+#endif
+}
+
+
+static TRACE_THREAD *get_trace_thread(void)
+{
+   void **data = _al_tls_get_trace_data();
+   TRACE_THREAD *thread = *data;
+
+   if (thread)
+      return thread;
+
+   _al_mutex_lock(&trace_info.trace_mutex);
+
+   for (thread = trace_threads; thread; thread = thread->next) {
+      if (!thread->in_use)
+         break;
+   }
+   if (!thread) {
+      thread = al_calloc(1, sizeof(*thread) + trace_info.ring_size);
+      if (thread) {
+         thread->index = ++num_trace_threads;
+         thread->ring_size = trace_info.ring_size;
+         thread->ring = (char *)(thread + 1);
+         thread->next = trace_threads;
+         _al_memory_barrier();
+         trace_threads = thread;
+      }
+   }
+   if (thread) {
+      thread->in_use = 1;
+      *data = thread;
+   }
+
+   _al_mutex_unlock(&trace_info.trace_mutex);
+
+   return thread;
+}
+
+
+/* Called with the log buffer of a thread when the thread exits, so that
+ * the buffer can be reused. Records still in the ring are written out by
+ * the writer thread as usual.
+ */
+void _al_trace_release_thread_data(void **data)
+{
+   TRACE_THREAD *thread = *data;
+
+   if (thread) {
+      *data = NULL;
+      _al_memory_barrier();
+      thread->in_use = 0;
+   }
+}
+
+
+/* Called by threads created by Allegro when they exit. Other threads
+ * release their buffer when their thread local storage is destroyed.
+ */
+void _al_trace_thread_ended(void)
+{
+   if (!trace_threads)
+      return;
+
+   _al_trace_release_thread_data(_al_tls_get_trace_data());
+}
+
+
+static void wake_writer(void)
+{
+   if (_al_atomic_compare_and_swap(&writer_wake, 0, 1))
+      _al_cond_signal(&writer_cond);
+}
+
+
+static void push_record(TRACE_THREAD *thread, TRACE_RECORD *r,
+   char const *text, int length)
+{
+   int size = ALIGN8(sizeof(*r) + length + 1);
+   int head = thread->head;
+   int used = (head - thread->tail + thread->ring_size) % thread->ring_size;
+   int contiguous = thread->ring_size - head;
+   int needed = size + (contiguous < size ? contiguous : 0);
+   int zero = 0;
+
+   /* Positions are multiples of 8, and the head must not catch up with
+    * the tail.
+    */
+   if (used + needed > thread->ring_size - 8) {
+      _al_fetch_and_add1(&thread->dropped);
+      wake_writer();
+      return;
+   }
+
+   if (contiguous < size) {
+      memcpy(thread->ring + head, &zero, sizeof(zero));
+      head = 0;
+   }
+
+   r->size = size;
+   memcpy(thread->ring + head, r, sizeof(*r));
+   memcpy(thread->ring + head + sizeof(*r), text, length + 1);
+
+   _al_memory_barrier();
+   thread->head = (head + size) % thread->ring_size;
+
+   if (r->level >= 3 || used + needed > thread->ring_size / 2)
+      wake_writer();
+}
+
+
+static void write_binary(void const *data, size_t size)
+{
+   fwrite(data, 1, size, trace_info.trace_file);
+}
+
+
+static void write_binary_header(int type, int level, int channel,
+   uint32_t size)
+{
+   unsigned char header[8];
+   uint16_t channel16 = channel;
+
+   header[0] = type;
+   header[1] = level;
+   memcpy(header + 2, &channel16, 2);
+   memcpy(header + 4, &size, 4);
+   write_binary(header, sizeof(header));
+}
+
+
+static void write_binary_start(void)
+{
+   uint32_t magic[2] = {0x01020304, 1};
+
+   if (trace_info.binary_started)
+      return;
+
+   write_binary("ALTRACE", 8);
+   write_binary(magic, sizeof(magic));
+   memset(channel_written, 0, sizeof(channel_written));
+   trace_info.binary_started = true;
+}
+
+
+static void write_binary_channel(int id, char const *channel)
+{
+   unsigned int bit = 1u << (id & 31);
+
+   if (id > 0 && (channel_written[id >> 5] & bit))
+      return;
+
+   write_binary_header('C', 0, id, strlen(channel));
+   write_binary(channel, strlen(channel));
+   channel_written[id >> 5] |= bit;
+}
+
+
+/* Writes a message to the log file. Must be called with the trace mutex
+ * held.
+ */
+static void write_record(int thread_index, TRACE_RECORD const *r,
+   char const *text)
+{
+   if (!trace_info.trace_file)
+      return;
+
+   if (trace_info.binary) {
+      uint32_t ints[2];
+      uint16_t shorts[2];
+      size_t file_size = strlen(r->file);
+      size_t function_size = strlen(r->function);
+
+      write_binary_start();
+      write_binary_channel(r->channel, r->channel_name);
+
+      write_binary_header('M', r->level, r->channel,
+         sizeof(ints) + sizeof(r->time) + sizeof(shorts) + file_size +
+         function_size + r->length);
+      ints[0] = thread_index;
+      ints[1] = r->line;
+      shorts[0] = file_size;
+      shorts[1] = function_size;
+      write_binary(ints, sizeof(ints));
+      write_binary(&r->time, sizeof(r->time));
+      write_binary(shorts, sizeof(shorts));
+      write_binary(r->file, file_size);
+      write_binary(r->function, function_size);
+      write_binary(text, r->length);
+   }
+   else {
+      char prefix[512];
+      format_prefix(prefix, sizeof(prefix), r->channel_name, r->level,
+         r->file, r->line, r->function, r->time);
+      fputs(prefix, trace_info.trace_file);
+      fputs(text, trace_info.trace_file);
+   }
+}
+
+
+static void write_dropped(int thread_index, int count)
+{
+   if (!trace_info.trace_file)
+      return;
+
+   if (trace_info.binary) {
+      uint32_t ints[2];
+      ints[0] = thread_index;
+      ints[1] = count;
+      write_binary_start();
+      write_binary_header('D', 0, 0, sizeof(ints));
+      write_binary(ints, sizeof(ints));
+   }
+   else {
+      fprintf(trace_info.trace_file, "%-8s W %d messages dropped\n",
+         "trace", count);
+   }
+}
+
+
+/* Skips a record which says the next one is at the start of the ring.
+ * Returns false if there are no more records.
+ */
+static bool peek_record(TRACE_THREAD *thread, TRACE_RECORD *r)
+{
+   int pos = thread->tail;
+
+   if (pos == thread->snapshot_head)
       return false;
+   memcpy(&r->size, thread->ring + pos, sizeof(r->size));
+   if (r->size == 0) {
+      pos = 0;
+      thread->tail = pos;
+      if (pos == thread->snapshot_head)
+         return false;
+   }
+   memcpy(r, thread->ring + pos, sizeof(*r));
+   return true;
+}
 
-   v = &trace_info.channels;
-   if (_al_vector_is_empty(v))
-      goto channel_included;
 
-   for (i = 0; i < _al_vector_size(v); i++) {
-      ALLEGRO_USTR **iter = _al_vector_ref(v, i);
-      if (!strcmp(al_cstr(*iter), channel))
-         goto channel_included;
+/* Writes the messages which are in the rings now, merged in the order in
+ * which they were logged. Returns true if anything was written.
+ */
+static bool write_rings(void)
+{
+   TRACE_THREAD *thread;
+   bool written = false;
+
+   _al_mutex_lock(&trace_info.trace_mutex);
+
+   for (thread = trace_threads; thread; thread = thread->next) {
+      int dropped = thread->dropped;
+      while (dropped && !_al_atomic_compare_and_swap(&thread->dropped,
+            dropped, 0)) {
+         dropped = thread->dropped;
+      }
+      if (dropped) {
+         open_trace_file();
+         write_dropped(thread->index, dropped);
+         written = true;
+      }
+      thread->snapshot_head = thread->head;
    }
+   _al_memory_barrier();
+
+   for (;;) {
+      TRACE_THREAD *first = NULL;
+      TRACE_RECORD first_record;
+      TRACE_RECORD r;
+
+      for (thread = trace_threads; thread; thread = thread->next) {
+         if (peek_record(thread, &r) &&
+               (!first || r.time < first_record.time)) {
+            first = thread;
+            first_record = r;
+         }
+      }
+      if (!first)
+         break;
 
-   return false;
+      open_trace_file();
+      write_record(first->index, &first_record,
+         first->ring + first->tail + sizeof(first_record));
+      written = true;
 
-channel_included:
+      _al_memory_barrier();
+      first->tail = (first->tail + first_record.size) % first->ring_size;
+   }
 
-   v = &trace_info.excluded;
-   if (_al_vector_is_nonempty(v)) {
-      for (i = 0; i < _al_vector_size(v); i++) {
-         ALLEGRO_USTR **iter = _al_vector_ref(v, i);
-         if (!strcmp(al_cstr(*iter), channel))
-            return false;
+   if (written && trace_info.trace_file)
+      fflush(trace_info.trace_file);
+
+   _al_mutex_unlock(&trace_info.trace_mutex);
+
+   return written;
+}
+
+
+static void writer_proc(_AL_THREAD *self, void *unused)
+{
+   (void)unused;
+
+   _al_mutex_lock(&writer_mutex);
+
+   while (!_al_get_thread_should_stop(self)) {
+      ALLEGRO_TIMEOUT timeout;
+
+      _al_mutex_unlock(&writer_mutex);
+      write_rings();
+      _al_mutex_lock(&writer_mutex);
+
+      if (writer_wake) {
+         writer_wake = 0;
+         continue;
       }
+      if (_al_get_thread_should_stop(self))
+         break;
+      al_init_timeout(&timeout, WRITER_INTERVAL);
+      _al_cond_timedwait(&writer_cond, &writer_mutex, &timeout);
+      writer_wake = 0;
+   }
+
+   _al_mutex_unlock(&writer_mutex);
+
+   write_rings();
+}
+
+
+static bool trace_prefix(int id, char const *channel, int level,
+   char const *file, int line, char const *function)
+{
+   TRACE_THREAD *thread;
+   char prefix[512];
+
+   if (!channel_enabled(id, channel))
+      return false;
+
+   if (use_records() && (thread = get_trace_thread())) {
+      TRACE_RECORD *r;
+      if (thread->depth == MAX_NESTING)
+         return false;
+      r = &thread->pending[thread->depth];
+      r->level = level;
+      r->channel = id > 0 ? id : 0;
+      r->line = line;
+      r->channel_name = channel;
+      r->file = file;
+      r->function = function;
+      r->time = get_trace_time();
+      thread->pending_async[thread->depth] = trace_info.async;
+      thread->depth++;
+
+      /* No lock is held until _al_trace_suffix. */
+      return true;
    }
 
    /* Avoid interleaved output from different threads. */
@@ -260,40 +944,54 @@ channel_included:
    if (!_al_user_trace_handler)
       open_trace_file();
 
-   do_trace("%-8s ", channel);
-   if (level == 0) do_trace("D ");
-   if (level == 1) do_trace("I ");
-   if (level == 2) do_trace("W ");
-   if (level == 3) do_trace("E ");
+   format_prefix(prefix, sizeof(prefix), channel, level, file, line,
+      function, (trace_info.flags & 4) ? get_trace_time() : 0);
+   do_trace("%s", prefix);
 
-#ifdef ALLEGRO_ANDROID
-   {
-      char pid_buf[16];
-      snprintf(pid_buf, sizeof(pid_buf), "%i: ", gettid());
-      do_trace(pid_buf);
-   }
-#endif
+   /* Do not unlocked trace_mutex here; that is done by _al_trace_suffix. */
+   return true;
+}
 
-#ifdef ALLEGRO_MSVC
-   name = strrchr(file, '\\');
-#else
-   name = strrchr(file, '/');
-#endif
-   if (trace_info.flags & 1) {
-      do_trace("%20s:%-4d ", name ? name + 1 : file, line);
-   }
-   if (trace_info.flags & 2) {
-      do_trace("%-32s ", function);
+
+/* _al_trace_prefix:
+ *  Conditionally write the initial part of a trace message.  If we do, return true
+ *  and continue to hold the trace_mutex lock, unless the message is
+ *  passed on as a record.
+ */
+bool _al_trace_prefix(char const *channel, int level,
+   char const *file, int line, char const *function)
+{
+   if (!trace_info.configured) {
+      _al_configure_logging();
    }
-   if (trace_info.flags & 4) {
-      double t = 0;
-      if (al_is_system_installed())
-         t = al_get_time();
-      do_trace("[%10.5f] ", t);
+
+   if (level < trace_info.level)
+      return false;
+
+   return trace_prefix(intern_channel(channel), channel, level, file, line,
+      function);
+}
+
+
+/* _al_trace_prefix_channel:
+ *  Like _al_trace_prefix, for channels defined with ALLEGRO_DEBUG_CHANNEL.
+ *  The channel is interned the first time it is used, and its id kept in
+ *  *id, which starts out as 0.
+ */
+bool _al_trace_prefix_channel(char const *channel, int *id, int level,
+   char const *file, int line, char const *function)
+{
+   if (!trace_info.configured) {
+      _al_configure_logging();
    }
 
-   /* Do not unlocked trace_mutex here; that is done by _al_trace_suffix. */
-   return true;
+   if (level < trace_info.level)
+      return false;
+
+   if (*id == 0)
+      *id = intern_channel(channel);
+
+   return trace_prefix(*id, channel, level, file, line, function);
 }
 
 
@@ -303,8 +1001,46 @@ channel_included:
 void _al_trace_suffix(const char *msg, ...)
 {
    int olderr = errno;
+   TRACE_THREAD *thread = NULL;
    va_list ap;
 
+   if (trace_threads)
+      thread = *_al_tls_get_trace_data();
+
+   if (thread && thread->depth > 0) {
+      char text[MAX_MESSAGE];
+      TRACE_RECORD *r;
+      int length;
+
+      thread->depth--;
+      r = &thread->pending[thread->depth];
+
+      va_start(ap, msg);
+      length = vsnprintf(text, sizeof(text), msg, ap);
+      va_end(ap);
+      if (length < 0)
+         length = 0;
+      if (length >= (int)sizeof(text))
+         length = sizeof(text) - 1;
+      text[length] = '\0';
+      r->length = length;
+
+      if (thread->pending_async[thread->depth]) {
+         push_record(thread, r, text, length);
+      }
+      else {
+         _al_mutex_lock(&trace_info.trace_mutex);
+         open_trace_file();
+         write_record(thread->index, r, text);
+         if (trace_info.trace_file)
+            fflush(trace_info.trace_file);
+         _al_mutex_unlock(&trace_info.trace_mutex);
+      }
+
+      errno = olderr;
+      return;
+   }
+
 #ifdef ALLEGRO_ANDROID
    if (true)
 #else
@@ -344,6 +1080,10 @@ void _al_trace_suffix(const char *msg, ...)
 void _al_shutdown_logging(void)
 {
    if (trace_info.configured) {
+      /* Writes out the rings. */
+      trace_info.async = false;
+      stop_writer();
+
       _al_mutex_destroy(&trace_info.trace_mutex);
 
       delete_string_list(&trace_info.channels);
@@ -358,6 +1098,7 @@ void _al_shutdown_logging(void)
 
    trace_info.trace_file = NULL;
    trace_info.trace_virgin = true;
+   trace_info.binary_started = false;
 }
 
 
@@ -82,6 +82,7 @@ ALLEGRO_DISPLAY *al_create_display(int w, int h)
 
    _al_vector_init(&display->display_invalidated_callbacks, sizeof(void *));
    _al_vector_init(&display->display_validated_callbacks, sizeof(void *));
+   _al_vector_init(&display->display_destroyed_callbacks, sizeof(void *));
 
    display->render_state.write_mask = ALLEGRO_MASK_RGBA | ALLEGRO_MASK_DEPTH;
    display->render_state.depth_test = false;
@@ -141,6 +142,8 @@ ALLEGRO_DISPLAY *al_create_display(int w, int h)
 void al_destroy_display(ALLEGRO_DISPLAY *display)
 {
    if (display) {
+      unsigned int i;
+
       /* This causes warnings and potential errors on Android because
        * it clears the context and Android needs this thread to have
        * the context bound in its destroy function and to destroy the
@@ -160,6 +163,13 @@ void al_destroy_display(ALLEGRO_DISPLAY *display)
          _al_set_current_display_only(NULL);
 #endif
 
+      for (i = 0; i < _al_vector_size(&display->display_destroyed_callbacks); i++) {
+         void (**callback)(ALLEGRO_DISPLAY *) =
+            _al_vector_ref(&display->display_destroyed_callbacks, i);
+         (*callback)(display);
+      }
+      _al_vector_free(&display->display_destroyed_callbacks);
+
       al_destroy_shader(display->default_shader);
       display->default_shader = NULL;
 
@@ -570,6 +580,22 @@ void _al_remove_display_validated_callback(ALLEGRO_DISPLAY *display, void (*call
    _al_vector_find_and_delete(&display->display_validated_callbacks, &callback);
 }
 
+void _al_add_display_destroyed_callback(ALLEGRO_DISPLAY* display, void (*display_destroyed)(ALLEGRO_DISPLAY*))
+{
+   if (_al_vector_find(&display->display_destroyed_callbacks, &display_destroyed) >= 0) {
+      return;
+   }
+   else {
+      void (**callback)(ALLEGRO_DISPLAY *) = _al_vector_alloc_back(&display->display_destroyed_callbacks);
+      *callback = display_destroyed;
+   }
+}
+
+void _al_remove_display_destroyed_callback(ALLEGRO_DISPLAY *display, void (*callback)(ALLEGRO_DISPLAY *))
+{
+   _al_vector_find_and_delete(&display->display_destroyed_callbacks, &callback);
+}
+
 /* Function: al_acknowledge_drawing_halt
  */
 void al_acknowledge_drawing_halt(ALLEGRO_DISPLAY *display)
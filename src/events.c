@@ -26,6 +26,7 @@
 
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_atomicops.h"
 #include "allegro5/internal/aintern_dtor.h"
 #include "allegro5/internal/aintern_exitfunc.h"
 #include "allegro5/internal/aintern_events.h"
@@ -33,6 +34,17 @@
 
 
 
+/* Number of events a lock-free queue can hold before producers fall back
+ * to the locked circular array.  Must be a power of two.
+ */
+#define RING_SIZE    1024
+
+typedef struct RING_CELL
+{
+   volatile _AL_ATOMIC seq;
+   ALLEGRO_EVENT event;
+} RING_CELL;
+
 struct ALLEGRO_EVENT_QUEUE
 {
    _AL_VECTOR sources;  /* vector of (ALLEGRO_EVENT_SOURCE *) */
@@ -43,6 +55,19 @@ struct ALLEGRO_EVENT_QUEUE
    _AL_MUTEX mutex;
    _AL_COND cond;
    _AL_LIST_ITEM *dtor_item;
+
+   /* Only used by queues created with ALLEGRO_EVENT_QUEUE_LOCK_FREE.
+    * Producers claim ring slots with a compare-and-swap on ring_head and
+    * only fall back to the circular array above (under the mutex) while
+    * the ring is full.  Readers are serialised by reader_mutex, which
+    * producers never touch.
+    */
+   RING_CELL *ring;
+   volatile _AL_ATOMIC ring_head;   /* next slot claimed by a producer */
+   unsigned int ring_tail;          /* next slot to read */
+   volatile _AL_ATOMIC overflowed;  /* circular array may hold events */
+   volatile _AL_ATOMIC waiters;     /* readers blocked on cond */
+   _AL_MUTEX reader_mutex;
 };
 
 
@@ -61,6 +86,11 @@ static void ref_if_user_event(ALLEGRO_EVENT *event);
 static void unref_if_user_event(ALLEGRO_EVENT *event);
 static void discard_events_of_source(ALLEGRO_EVENT_QUEUE *queue,
    const ALLEGRO_EVENT_SOURCE *source);
+static int take_ring_events(ALLEGRO_EVENT_QUEUE *queue,
+   ALLEGRO_EVENT *ret_events, int max, const ALLEGRO_EVENT_SOURCE *source,
+   ALLEGRO_EVENT_TYPE type);
+static bool next_event_lock_free(ALLEGRO_EVENT_QUEUE *queue,
+   ALLEGRO_EVENT *ret_event, bool delete);
 
 
 
@@ -88,8 +118,18 @@ static void shutdown_events(void)
 /* Function: al_create_event_queue
  */
 ALLEGRO_EVENT_QUEUE *al_create_event_queue(void)
+{
+   return al_create_event_queue_flags(0);
+}
+
+
+
+/* Function: al_create_event_queue_flags
+ */
+ALLEGRO_EVENT_QUEUE *al_create_event_queue_flags(int flags)
 {
    ALLEGRO_EVENT_QUEUE *queue = al_malloc(sizeof *queue);
+   unsigned int i;
 
    ASSERT(queue);
 
@@ -106,6 +146,28 @@ ALLEGRO_EVENT_QUEUE *al_create_event_queue(void)
       _al_mutex_init(&queue->mutex);
       _al_cond_init(&queue->cond);
 
+      queue->ring = NULL;
+      queue->ring_head = 0;
+      queue->ring_tail = 0;
+      queue->overflowed = 0;
+      queue->waiters = 0;
+
+#ifdef _AL_HAVE_ATOMIC_CAS
+      if (flags & ALLEGRO_EVENT_QUEUE_LOCK_FREE) {
+         queue->ring = al_malloc(RING_SIZE * sizeof(RING_CELL));
+      }
+#else
+      (void)flags;
+#endif
+
+      if (queue->ring) {
+         for (i = 0; i < RING_SIZE; i++) {
+            queue->ring[i].seq = i;
+         }
+         _AL_MARK_MUTEX_UNINITED(queue->reader_mutex);
+         _al_mutex_init(&queue->reader_mutex);
+      }
+
       queue->dtor_item = _al_register_destructor(_al_dtor_list, "queue", queue,
          (void (*)(void *)) al_destroy_event_queue);
    }
@@ -135,6 +197,11 @@ void al_destroy_event_queue(ALLEGRO_EVENT_QUEUE *queue)
    ASSERT(queue->events_head == queue->events_tail);
    _al_vector_free(&queue->events);
 
+   if (queue->ring) {
+      _al_mutex_destroy(&queue->reader_mutex);
+      al_free(queue->ring);
+   }
+
    _al_cond_destroy(&queue->cond);
    _al_mutex_destroy(&queue->mutex);
 
@@ -195,9 +262,16 @@ void al_unregister_event_source(ALLEGRO_EVENT_QUEUE *queue,
       _al_event_source_on_unregistration_from_queue(source, queue);
 
       /* Drop all the events in the queue that belonged to the source. */
+      if (queue->ring) {
+         _al_mutex_lock(&queue->reader_mutex);
+         take_ring_events(queue, NULL, INT_MAX, source, 0);
+      }
       _al_mutex_lock(&queue->mutex);
       discard_events_of_source(queue, source);
       _al_mutex_unlock(&queue->mutex);
+      if (queue->ring) {
+         _al_mutex_unlock(&queue->reader_mutex);
+      }
    }
 }
 
@@ -236,13 +310,41 @@ static void heartbeat(void)
 
 
 
-static bool is_event_queue_empty(ALLEGRO_EVENT_QUEUE *queue)
+static bool is_events_array_empty(const ALLEGRO_EVENT_QUEUE *queue)
 {
    return (queue->events_head == queue->events_tail);
 }
 
 
 
+/* ring_front:
+ *  Return the oldest published cell of the lock-free ring, or NULL.
+ *  The reader mutex should be held if the cell is going to be used.
+ */
+static RING_CELL *ring_front(const ALLEGRO_EVENT_QUEUE *queue)
+{
+   RING_CELL *cell = &queue->ring[queue->ring_tail & (RING_SIZE - 1)];
+
+   if ((unsigned int)cell->seq != queue->ring_tail + 1)
+      return NULL;
+
+   /* Don't let the event be read before its sequence number. */
+   _al_memory_barrier();
+   return cell;
+}
+
+
+
+static bool is_event_queue_empty(ALLEGRO_EVENT_QUEUE *queue)
+{
+   if (queue->ring && ring_front(queue))
+      return false;
+
+   return is_events_array_empty(queue);
+}
+
+
+
 /* Function: al_is_event_queue_empty
  */
 bool al_is_event_queue_empty(ALLEGRO_EVENT_QUEUE *queue)
@@ -278,7 +380,7 @@ static ALLEGRO_EVENT *get_next_event_if_any(ALLEGRO_EVENT_QUEUE *queue,
 {
    ALLEGRO_EVENT *event;
 
-   if (is_event_queue_empty(queue)) {
+   if (is_events_array_empty(queue)) {
       return NULL;
    }
 
@@ -301,6 +403,14 @@ bool al_get_next_event(ALLEGRO_EVENT_QUEUE *queue, ALLEGRO_EVENT *ret_event)
 
    heartbeat();
 
+   if (queue->ring) {
+      bool found;
+      _al_mutex_lock(&queue->reader_mutex);
+      found = next_event_lock_free(queue, ret_event, true);
+      _al_mutex_unlock(&queue->reader_mutex);
+      return found;
+   }
+
    _al_mutex_lock(&queue->mutex);
 
    next_event = get_next_event_if_any(queue, true);
@@ -316,6 +426,110 @@ bool al_get_next_event(ALLEGRO_EVENT_QUEUE *queue, ALLEGRO_EVENT *ret_event)
 
 
 
+/* event_matches:
+ *  Return true if the event passes the filter of al_get_next_events_filtered.
+ */
+static bool event_matches(const ALLEGRO_EVENT *event,
+   const ALLEGRO_EVENT_SOURCE *source, ALLEGRO_EVENT_TYPE type)
+{
+   if (source && event->any.source != source)
+      return false;
+   if (type && event->type != type)
+      return false;
+   return true;
+}
+
+
+
+/* take_array_events:
+ *  Move up to MAX of the oldest events matching SOURCE and TYPE out of the
+ *  circular array, keeping the order of the remaining events.  The queue
+ *  must be locked.
+ */
+static int take_array_events(ALLEGRO_EVENT_QUEUE *queue,
+   ALLEGRO_EVENT *ret_events, int max, const ALLEGRO_EVENT_SOURCE *source,
+   ALLEGRO_EVENT_TYPE type)
+{
+   ALLEGRO_EVENT *event;
+   unsigned int r;
+   unsigned int w;
+   int n = 0;
+
+   if (!source && !type) {
+      while (n < max && (event = get_next_event_if_any(queue, true))) {
+         copy_event(&ret_events[n++], event);
+      }
+      return n;
+   }
+
+   r = w = queue->events_tail;
+   while (r != queue->events_head) {
+      event = _al_vector_ref(&queue->events, r);
+      if (n < max && event_matches(event, source, type)) {
+         copy_event(&ret_events[n++], event);
+      }
+      else {
+         if (w != r)
+            copy_event(_al_vector_ref(&queue->events, w), event);
+         w = circ_array_next(&queue->events, w);
+      }
+      r = circ_array_next(&queue->events, r);
+   }
+   queue->events_head = w;
+
+   return n;
+}
+
+
+
+/* Function: al_get_next_events
+ */
+int al_get_next_events(ALLEGRO_EVENT_QUEUE *queue, ALLEGRO_EVENT *ret_events,
+   int max)
+{
+   return al_get_next_events_filtered(queue, ret_events, max, NULL, 0);
+}
+
+
+
+/* Function: al_get_next_events_filtered
+ */
+int al_get_next_events_filtered(ALLEGRO_EVENT_QUEUE *queue,
+   ALLEGRO_EVENT *ret_events, int max, ALLEGRO_EVENT_SOURCE *source,
+   ALLEGRO_EVENT_TYPE type)
+{
+   int n = 0;
+   ASSERT(queue);
+   ASSERT(ret_events || max <= 0);
+
+   heartbeat();
+
+   if (max <= 0)
+      return 0;
+
+   if (queue->ring) {
+      _al_mutex_lock(&queue->reader_mutex);
+      n = take_ring_events(queue, ret_events, max, source, type);
+      if (n < max && queue->overflowed) {
+         _al_mutex_lock(&queue->mutex);
+         n += take_array_events(queue, ret_events + n, max - n, source, type);
+         if (is_events_array_empty(queue))
+            queue->overflowed = 0;
+         _al_mutex_unlock(&queue->mutex);
+      }
+      _al_mutex_unlock(&queue->reader_mutex);
+      return n;
+   }
+
+   _al_mutex_lock(&queue->mutex);
+   n = take_array_events(queue, ret_events, max, source, type);
+   _al_mutex_unlock(&queue->mutex);
+
+   return n;
+}
+
+
+
 /* Function: al_peek_next_event
  */
 bool al_peek_next_event(ALLEGRO_EVENT_QUEUE *queue, ALLEGRO_EVENT *ret_event)
@@ -326,6 +540,16 @@ bool al_peek_next_event(ALLEGRO_EVENT_QUEUE *queue, ALLEGRO_EVENT *ret_event)
 
    heartbeat();
 
+   if (queue->ring) {
+      bool found;
+      _al_mutex_lock(&queue->reader_mutex);
+      found = next_event_lock_free(queue, ret_event, false);
+      if (found)
+         ref_if_user_event(ret_event);
+      _al_mutex_unlock(&queue->reader_mutex);
+      return found;
+   }
+
    _al_mutex_lock(&queue->mutex);
 
    next_event = get_next_event_if_any(queue, false);
@@ -350,6 +574,17 @@ bool al_drop_next_event(ALLEGRO_EVENT_QUEUE *queue)
 
    heartbeat();
 
+   if (queue->ring) {
+      ALLEGRO_EVENT event;
+      bool found;
+      _al_mutex_lock(&queue->reader_mutex);
+      found = next_event_lock_free(queue, &event, true);
+      if (found)
+         unref_if_user_event(&event);
+      _al_mutex_unlock(&queue->reader_mutex);
+      return found;
+   }
+
    _al_mutex_lock(&queue->mutex);
 
    next_event = get_next_event_if_any(queue, true);
@@ -373,6 +608,14 @@ void al_flush_event_queue(ALLEGRO_EVENT_QUEUE *queue)
 
    heartbeat();
 
+   if (queue->ring) {
+      ALLEGRO_EVENT event;
+      _al_mutex_lock(&queue->reader_mutex);
+      while (next_event_lock_free(queue, &event, true)) {
+         unref_if_user_event(&event);
+      }
+   }
+
    _al_mutex_lock(&queue->mutex);
 
    /* Decrement reference counts on all user events. */
@@ -384,7 +627,12 @@ void al_flush_event_queue(ALLEGRO_EVENT_QUEUE *queue)
    }
 
    queue->events_head = queue->events_tail = 0;
+   queue->overflowed = 0;
    _al_mutex_unlock(&queue->mutex);
+
+   if (queue->ring) {
+      _al_mutex_unlock(&queue->reader_mutex);
+   }
 }
 
 
@@ -400,6 +648,11 @@ void al_wait_for_event(ALLEGRO_EVENT_QUEUE *queue, ALLEGRO_EVENT *ret_event)
 
    heartbeat();
 
+   if (queue->ring) {
+      do_wait_for_event(queue, ret_event, NULL);
+      return;
+   }
+
    _al_mutex_lock(&queue->mutex);
    {
       while (is_event_queue_empty(queue)) {
@@ -453,12 +706,62 @@ bool al_wait_for_event_until(ALLEGRO_EVENT_QUEUE *queue,
 
 
 
+/* do_wait_for_event_lock_free:
+ *  Block until an event arrives in a lock-free queue.  Producers only
+ *  signal the condition variable while the waiters count is non-zero, so
+ *  it must be raised before the final emptiness check.  A NULL timeout
+ *  means wait forever.
+ */
+static bool do_wait_for_event_lock_free(ALLEGRO_EVENT_QUEUE *queue,
+   ALLEGRO_EVENT *ret_event, ALLEGRO_TIMEOUT *timeout)
+{
+   ALLEGRO_EVENT event;
+   int result = 0;
+
+   for (;;) {
+      _al_mutex_lock(&queue->reader_mutex);
+      if (!ret_event && !is_event_queue_empty(queue)) {
+         _al_mutex_unlock(&queue->reader_mutex);
+         return true;
+      }
+      if (ret_event && next_event_lock_free(queue, &event, true)) {
+         _al_mutex_unlock(&queue->reader_mutex);
+         copy_event(ret_event, &event);
+         return true;
+      }
+      _al_mutex_unlock(&queue->reader_mutex);
+
+      if (result == -1)
+         return false;
+
+      _al_mutex_lock(&queue->mutex);
+      _al_fetch_and_add1(&queue->waiters);
+      while (is_event_queue_empty(queue) && result != -1) {
+         if (timeout)
+            result = _al_cond_timedwait(&queue->cond, &queue->mutex, timeout);
+         else
+            _al_cond_wait(&queue->cond, &queue->mutex);
+      }
+      _al_sub1_and_fetch(&queue->waiters);
+      _al_mutex_unlock(&queue->mutex);
+
+      /* Another reader may have taken the event in the meantime, in which
+       * case we go back to sleep.  After a timeout, try one last time.
+       */
+   }
+}
+
+
+
 static bool do_wait_for_event(ALLEGRO_EVENT_QUEUE *queue,
    ALLEGRO_EVENT *ret_event, ALLEGRO_TIMEOUT *timeout)
 {
    bool timed_out = false;
    ALLEGRO_EVENT *next_event = NULL;
 
+   if (queue->ring)
+      return do_wait_for_event_lock_free(queue, ret_event, timeout);
+
    _al_mutex_lock(&queue->mutex);
    {
       int result = 0;
@@ -580,6 +883,93 @@ static void unref_if_user_event(ALLEGRO_EVENT *event)
 
 
 
+/* ring_push:
+ *  Append an event to the lock-free ring without taking any locks.
+ *  Returns false if the ring is full.
+ *
+ *  [runs in background threads]
+ */
+static bool ring_push(ALLEGRO_EVENT_QUEUE *queue, const ALLEGRO_EVENT *event)
+{
+   RING_CELL *cell;
+   unsigned int pos;
+   int diff;
+
+   for (;;) {
+      pos = (unsigned int)queue->ring_head;
+      cell = &queue->ring[pos & (RING_SIZE - 1)];
+      diff = (int)((unsigned int)cell->seq - pos);
+      if (diff == 0) {
+         if (_al_atomic_compare_and_swap(&queue->ring_head,
+               (_AL_ATOMIC)pos, (_AL_ATOMIC)(pos + 1)))
+            break;
+      }
+      else if (diff < 0) {
+         /* The reader hasn't freed this slot yet. */
+         return false;
+      }
+      /* Otherwise another producer claimed the slot first. */
+   }
+
+   copy_event(&cell->event, event);
+   ref_if_user_event(&cell->event);
+
+   /* Publish the event to the reader. */
+   _al_memory_barrier();
+   cell->seq = (_AL_ATOMIC)(pos + 1);
+   return true;
+}
+
+
+
+/* ring_pop:
+ *  Release the cell returned by ring_front back to the producers.
+ *  The reader mutex must be held.
+ */
+static void ring_pop(ALLEGRO_EVENT_QUEUE *queue, RING_CELL *cell)
+{
+   _al_memory_barrier();
+   cell->seq = (_AL_ATOMIC)(queue->ring_tail + RING_SIZE);
+   queue->ring_tail++;
+}
+
+
+
+/* next_event_lock_free:
+ *  Copy the next event of a lock-free queue into RET_EVENT, optionally
+ *  removing it.  Events in the ring are always older than those in the
+ *  circular array.  The reader mutex must be held.
+ */
+static bool next_event_lock_free(ALLEGRO_EVENT_QUEUE *queue,
+   ALLEGRO_EVENT *ret_event, bool delete)
+{
+   RING_CELL *cell;
+   ALLEGRO_EVENT *event;
+
+   cell = ring_front(queue);
+   if (cell) {
+      copy_event(ret_event, &cell->event);
+      if (delete)
+         ring_pop(queue, cell);
+      return true;
+   }
+
+   if (!queue->overflowed)
+      return false;
+
+   _al_mutex_lock(&queue->mutex);
+   event = get_next_event_if_any(queue, delete);
+   if (event)
+      copy_event(ret_event, event);
+   if (is_events_array_empty(queue))
+      queue->overflowed = 0;
+   _al_mutex_unlock(&queue->mutex);
+
+   return (event ? true : false);
+}
+
+
+
 /* Internal function: _al_event_queue_push_event
  *  Event sources call this function when they have something to add to
  *  the queue.  If a queue cannot accept the event, the event's
@@ -598,11 +988,32 @@ void _al_event_queue_push_event(ALLEGRO_EVENT_QUEUE *queue,
    if (queue->paused)
       return;
 
+   if (queue->ring && !queue->overflowed && ring_push(queue, orig_event)) {
+      /* Only wake up readers if there are any.  The barrier pairs with
+       * the one implied by incrementing the waiters count.
+       */
+      _al_memory_barrier();
+      if (queue->waiters > 0) {
+         _al_mutex_lock(&queue->mutex);
+         _al_cond_broadcast(&queue->cond);
+         _al_mutex_unlock(&queue->mutex);
+      }
+      return;
+   }
+
    _al_mutex_lock(&queue->mutex);
    {
-      new_event = alloc_event(queue);
-      copy_event(new_event, orig_event);
-      ref_if_user_event(new_event);
+      /* The ring may have drained while we waited for the lock.  Once an
+       * event has gone into the circular array all later events must
+       * follow it there, until a reader empties it again.
+       */
+      if (!queue->ring || queue->overflowed || !ring_push(queue, orig_event)) {
+         if (queue->ring)
+            queue->overflowed = 1;
+         new_event = alloc_event(queue);
+         copy_event(new_event, orig_event);
+         ref_if_user_event(new_event);
+      }
 
       /* Wake up threads that are waiting for an event to be placed in
        * the queue.
@@ -698,6 +1109,62 @@ static void discard_events_of_source(ALLEGRO_EVENT_QUEUE *queue,
 
 
 
+/* take_ring_events:
+ *  Remove up to MAX of the oldest events in the lock-free ring that match
+ *  SOURCE and TYPE.  They are copied into RET_EVENTS in order or, if that
+ *  is NULL, discarded.  The surviving events are packed towards the newest
+ *  removed slot so producers, which only touch slots past the published
+ *  ones, are not disturbed.  The reader mutex must be held.
+ */
+static int take_ring_events(ALLEGRO_EVENT_QUEUE *queue,
+   ALLEGRO_EVENT *ret_events, int max, const ALLEGRO_EVENT_SOURCE *source,
+   ALLEGRO_EVENT_TYPE type)
+{
+   unsigned int end = queue->ring_tail;
+   unsigned int r;
+   unsigned int w;
+   RING_CELL *cell;
+   int n = 0;
+   int k;
+
+   /* Find the range of published slots holding the events to take. */
+   while (n < max) {
+      cell = &queue->ring[end & (RING_SIZE - 1)];
+      if ((unsigned int)cell->seq != end + 1)
+         break;
+      _al_memory_barrier();
+      if (event_matches(&cell->event, source, type))
+         n++;
+      end++;
+   }
+
+   w = end;
+   k = n;
+   for (r = end; r != queue->ring_tail; r--) {
+      cell = &queue->ring[(r - 1) & (RING_SIZE - 1)];
+      if (event_matches(&cell->event, source, type)) {
+         k--;
+         if (ret_events)
+            copy_event(&ret_events[k], &cell->event);
+         else
+            unref_if_user_event(&cell->event);
+      }
+      else {
+         w--;
+         if (w != r - 1)
+            copy_event(&queue->ring[w & (RING_SIZE - 1)].event, &cell->event);
+      }
+   }
+
+   while (queue->ring_tail != w) {
+      ring_pop(queue, &queue->ring[queue->ring_tail & (RING_SIZE - 1)]);
+   }
+
+   return n;
+}
+
+
+
 /* Function: al_unref_user_event
  */
 void al_unref_user_event(ALLEGRO_USER_EVENT *event)
@@ -18,6 +18,93 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_file.h"
 
+#include <string.h>
+
+
+/* Number of buffered bytes not read yet. This is always 0 for files without
+ * a read-ahead buffer.
+ */
+#define BUFFERED(f)  ((f)->buffer_len - (f)->buffer_pos)
+
+
+/* Refills the read-ahead buffer once it has been used up. Returns the number
+ * of bytes read into it.
+ */
+static size_t fill_buffer(ALLEGRO_FILE *f)
+{
+   ASSERT(f->buffer);
+   ASSERT(BUFFERED(f) == 0);
+
+   f->buffer_pos = ALLEGRO_UNGETC_SIZE;
+   f->buffer_len = ALLEGRO_UNGETC_SIZE +
+      f->vtable->fi_fread(f, f->buffer + ALLEGRO_UNGETC_SIZE, f->buffer_size);
+   f->buffer_eof = (BUFFERED(f) > 0 && BUFFERED(f) < f->buffer_size);
+   f->buffer_ungetc_end = 0;
+
+   return BUFFERED(f);
+}
+
+
+/* Discards the buffered bytes, seeking the underlying file back to the
+ * position the user is at.
+ */
+static bool discard_buffer(ALLEGRO_FILE *f)
+{
+   if (BUFFERED(f) > 0) {
+      if (!f->vtable->fi_fseek(f, -(int64_t)BUFFERED(f), ALLEGRO_SEEK_CUR))
+         return false;
+   }
+   f->buffer_pos = f->buffer_len = (f->buffer ? ALLEGRO_UNGETC_SIZE : 0);
+   f->buffer_eof = false;
+   f->buffer_ungetc_end = 0;
+   return true;
+}
+
+
+static size_t buffered_fread(ALLEGRO_FILE *f, unsigned char *ptr, size_t size)
+{
+   size_t done = 0;
+
+   while (done < size) {
+      size_t n = BUFFERED(f);
+
+      if (n == 0) {
+         /* Large reads bypass the buffer. */
+         if (size - done >= f->buffer_size) {
+            f->buffer_eof = false;
+            return done + f->vtable->fi_fread(f, ptr + done, size - done);
+         }
+         if (fill_buffer(f) == 0)
+            break;
+         continue;
+      }
+
+      if (n > size - done)
+         n = size - done;
+      memcpy(ptr + done, f->buffer + f->buffer_pos, n);
+      f->buffer_pos += n;
+      done += n;
+   }
+
+   return done;
+}
+
+
+/* Returns a pointer to the next n bytes of the file if they are all
+ * buffered already, and consumes them.
+ */
+static const unsigned char *take_buffered(ALLEGRO_FILE *f, size_t n)
+{
+   const unsigned char *p;
+
+   if (BUFFERED(f) < n)
+      return NULL;
+
+   p = f->buffer + f->buffer_pos;
+   f->buffer_pos += n;
+   return p;
+}
+
 
 /* Function: al_fopen
  */
@@ -47,6 +134,14 @@ ALLEGRO_FILE *al_fopen_interface(const ALLEGRO_FILE_INTERFACE *drv,
          f->vtable = drv;
          f->userdata = drv->fi_fopen(path, mode);
          f->ungetc_len = 0;
+         f->buffer = NULL;
+         f->buffer_size = 0;
+         f->buffer_pos = 0;
+         f->buffer_len = 0;
+         f->buffer_eof = false;
+         f->buffer_ungetc_end = 0;
+         f->memory = NULL;
+         f->memory_size = 0;
          if (!f->userdata) {
             al_free(f);
             f = NULL;
@@ -75,6 +170,14 @@ ALLEGRO_FILE *al_create_file_handle(const ALLEGRO_FILE_INTERFACE *drv,
       f->vtable = drv;
       f->userdata = userdata;
       f->ungetc_len = 0;
+      f->buffer = NULL;
+      f->buffer_size = 0;
+      f->buffer_pos = 0;
+      f->buffer_len = 0;
+      f->buffer_eof = false;
+      f->buffer_ungetc_end = 0;
+      f->memory = NULL;
+      f->memory_size = 0;
    }
 
    return f;
@@ -87,6 +190,7 @@ bool al_fclose(ALLEGRO_FILE *f)
 {
    if (f) {
       bool ret = f->vtable->fi_fclose(f);
+      al_free(f->buffer);
       al_free(f);
       return ret;
    }
@@ -115,6 +219,9 @@ size_t al_fread(ALLEGRO_FILE *f, void *ptr, size_t size)
 
       return bytes_ungetc + f->vtable->fi_fread(f, cptr, size);
    }
+   else if (f->buffer) {
+      return buffered_fread(f, ptr, size);
+   }
    else {
       return f->vtable->fi_fread(f, ptr, size);
    }
@@ -129,6 +236,9 @@ size_t al_fwrite(ALLEGRO_FILE *f, const void *ptr, size_t size)
    ASSERT(ptr || size == 0);
 
    f->ungetc_len = 0;
+   if (!discard_buffer(f)) {
+      return 0;
+   }
    return f->vtable->fi_fwrite(f, ptr, size);
 }
 
@@ -149,7 +259,7 @@ int64_t al_ftell(ALLEGRO_FILE *f)
 {
    ASSERT(f);
 
-   return f->vtable->fi_ftell(f) - f->ungetc_len;
+   return f->vtable->fi_ftell(f) - f->ungetc_len - (int64_t)BUFFERED(f);
 }
 
 
@@ -172,6 +282,34 @@ bool al_fseek(ALLEGRO_FILE *f, int64_t offset, int whence)
       f->ungetc_len = 0;
    }
 
+   if (f->buffer) {
+      /* Pushbacks are dropped even if the seek fails, as above. */
+      if (f->buffer_pos < f->buffer_ungetc_end) {
+         if (whence == ALLEGRO_SEEK_CUR) {
+            offset -= (int64_t)(f->buffer_ungetc_end - f->buffer_pos);
+         }
+         f->buffer_pos = f->buffer_ungetc_end;
+      }
+      f->buffer_ungetc_end = 0;
+
+      /* Short forward seeks stay within the buffer. */
+      if (whence == ALLEGRO_SEEK_CUR && offset >= 0
+            && offset <= (int64_t)BUFFERED(f) && BUFFERED(f) > 0) {
+         f->buffer_pos += offset;
+         return true;
+      }
+      if (whence == ALLEGRO_SEEK_CUR) {
+         offset -= BUFFERED(f);
+      }
+      if (!f->vtable->fi_fseek(f, offset, whence)) {
+         return false;
+      }
+      f->buffer_pos = f->buffer_len = ALLEGRO_UNGETC_SIZE;
+      f->buffer_eof = false;
+      f->buffer_ungetc_end = 0;
+      return true;
+   }
+
    return f->vtable->fi_fseek(f, offset, whence);
 }
 
@@ -182,6 +320,11 @@ bool al_feof(ALLEGRO_FILE *f)
 {
    ASSERT(f);
 
+   if (f->buffer) {
+      /* The buffer may have reached the end of the file before the user. */
+      return BUFFERED(f) == 0 && !f->buffer_eof && f->vtable->fi_feof(f);
+   }
+
    return f->ungetc_len == 0 && f->vtable->fi_feof(f);
 }
 
@@ -215,6 +358,7 @@ void al_fclearerr(ALLEGRO_FILE *f)
 {
    ASSERT(f);
 
+   f->buffer_eof = false;
    f->vtable->fi_fclearerr(f);
 }
 
@@ -226,6 +370,10 @@ int al_fgetc(ALLEGRO_FILE *f)
    uint8_t c;
    ASSERT(f);
 
+   if (BUFFERED(f) > 0) {
+      return f->buffer[f->buffer_pos++];
+   }
+
    if (al_fread(f, &c, 1) != 1) {
       return EOF;
    }
@@ -253,14 +401,19 @@ int al_fputc(ALLEGRO_FILE *f, int c)
  */
 int16_t al_fread16le(ALLEGRO_FILE *f)
 {
-   unsigned char b[2];
+   unsigned char tmp[2];
+   const unsigned char *b;
    ASSERT(f);
 
-   if (al_fread(f, b, 2) == 2) {
-      return (((int16_t)b[1] << 8) | (int16_t)b[0]);
+   b = take_buffered(f, 2);
+   if (!b) {
+      if (al_fread(f, tmp, 2) != 2) {
+         return EOF;
+      }
+      b = tmp;
    }
 
-   return EOF;
+   return (((int16_t)b[1] << 8) | (int16_t)b[0]);
 }
 
 
@@ -268,15 +421,20 @@ int16_t al_fread16le(ALLEGRO_FILE *f)
  */
 int32_t al_fread32le(ALLEGRO_FILE *f)
 {
-   unsigned char b[4];
+   unsigned char tmp[4];
+   const unsigned char *b;
    ASSERT(f);
 
-   if (al_fread(f, b, 4) == 4) {
-      return (((int32_t)b[3] << 24) | ((int32_t)b[2] << 16) |
-              ((int32_t)b[1] << 8) | (int32_t)b[0]);
+   b = take_buffered(f, 4);
+   if (!b) {
+      if (al_fread(f, tmp, 4) != 4) {
+         return EOF;
+      }
+      b = tmp;
    }
 
-   return EOF;
+   return (((int32_t)b[3] << 24) | ((int32_t)b[2] << 16) |
+           ((int32_t)b[1] << 8) | (int32_t)b[0]);
 }
 
 
@@ -332,14 +490,19 @@ size_t al_fwrite32le(ALLEGRO_FILE *f, int32_t l)
  */
 int16_t al_fread16be(ALLEGRO_FILE *f)
 {
-   unsigned char b[2];
+   unsigned char tmp[2];
+   const unsigned char *b;
    ASSERT(f);
 
-   if (al_fread(f, b, 2) == 2) {
-      return (((int16_t)b[0] << 8) | (int16_t)b[1]);
+   b = take_buffered(f, 2);
+   if (!b) {
+      if (al_fread(f, tmp, 2) != 2) {
+         return EOF;
+      }
+      b = tmp;
    }
 
-   return EOF;
+   return (((int16_t)b[0] << 8) | (int16_t)b[1]);
 }
 
 
@@ -347,15 +510,20 @@ int16_t al_fread16be(ALLEGRO_FILE *f)
  */
 int32_t al_fread32be(ALLEGRO_FILE *f)
 {
-   unsigned char b[4];
+   unsigned char tmp[4];
+   const unsigned char *b;
    ASSERT(f);
 
-   if (al_fread(f, b, 4) == 4) {
-      return (((int32_t)b[0] << 24) | ((int32_t)b[1] << 16) |
-              ((int32_t)b[2] << 8) | (int32_t)b[3]);
+   b = take_buffered(f, 4);
+   if (!b) {
+      if (al_fread(f, tmp, 4) != 4) {
+         return EOF;
+      }
+      b = tmp;
    }
 
-   return EOF;
+   return (((int32_t)b[0] << 24) | ((int32_t)b[1] << 16) |
+           ((int32_t)b[2] << 8) | (int32_t)b[3]);
 }
 
 
@@ -407,6 +575,46 @@ size_t al_fwrite32be(ALLEGRO_FILE *f, int32_t l)
 }
 
 
+/* Copies whole runs of the read-ahead buffer at a time. */
+static char *buffered_fgets(ALLEGRO_FILE *f, char * const buf, size_t max)
+{
+   size_t len = 0;
+   bool eof = false;
+
+   while (len < max - 1) {
+      size_t n;
+      const char *src = al_fpeek(f, &n);
+      const char *nl;
+
+      if (!src) {
+         eof = true;
+         break;
+      }
+
+      if (n > max - 1 - len)
+         n = max - 1 - len;
+      nl = memchr(src, '\n', n);
+      if (nl)
+         n = nl - src + 1;
+
+      memcpy(buf + len, src, n);
+      f->buffer_pos += n;
+      len += n;
+
+      if (nl)
+         break;
+   }
+
+   /* Return NULL if already at end of file, or on error. */
+   if (len == 0 || (eof && al_ferror(f))) {
+      return NULL;
+   }
+
+   buf[len] = '\0';
+   return buf;
+}
+
+
 /* Function: al_fgets
  */
 char *al_fgets(ALLEGRO_FILE *f, char * const buf, size_t max)
@@ -425,6 +633,10 @@ char *al_fgets(ALLEGRO_FILE *f, char * const buf, size_t max)
       return buf;
    }
 
+   if (f->buffer) {
+      return buffered_fgets(f, buf, max);
+   }
+
    /* Return NULL if already at end of file. */
    if ((c = al_fgetc(f)) == EOF) {
       return NULL;
@@ -452,6 +664,35 @@ char *al_fgets(ALLEGRO_FILE *f, char * const buf, size_t max)
 }
 
 
+/* Appends whole runs of the read-ahead buffer at a time, however long the
+ * line is.
+ */
+static ALLEGRO_USTR *buffered_fget_ustr(ALLEGRO_FILE *f)
+{
+   ALLEGRO_USTR *us = NULL;
+   ALLEGRO_USTR_INFO info;
+   const char *src;
+   size_t n;
+
+   while ((src = al_fpeek(f, &n))) {
+      const char *nl = memchr(src, '\n', n);
+
+      if (nl)
+         n = nl - src + 1;
+
+      if (!us)
+         us = al_ustr_new("");
+      al_ustr_append(us, al_ref_buffer(&info, src, n));
+      f->buffer_pos += n;
+
+      if (nl)
+         break;
+   }
+
+   return us;
+}
+
+
 /* Function: al_fget_ustr
  */
 ALLEGRO_USTR *al_fget_ustr(ALLEGRO_FILE *f)
@@ -459,6 +700,10 @@ ALLEGRO_USTR *al_fget_ustr(ALLEGRO_FILE *f)
    ALLEGRO_USTR *us;
    char buf[128];
 
+   if (f->buffer) {
+      return buffered_fget_ustr(f);
+   }
+
    if (!al_fgets(f, buf, sizeof(buf))) {
       return NULL;
    }
@@ -498,7 +743,23 @@ int al_fungetc(ALLEGRO_FILE *f, int c)
 {
    ASSERT(f != NULL);
 
-   if (f->vtable->fi_fungetc) {
+   if (f->buffer) {
+      /* Pushbacks go into the headroom in front of the buffered data. The
+       * end-of-file flag is left alone, so it is set again once they have
+       * been read back at the end of the file.
+       */
+      if (f->buffer_pos == 0) {
+         return EOF;
+      }
+
+      if (f->buffer_pos >= f->buffer_ungetc_end) {
+         f->buffer_ungetc_end = f->buffer_pos;
+      }
+      f->buffer[--f->buffer_pos] = (unsigned char) c;
+
+      return c;
+   }
+   else if (f->vtable->fi_fungetc) {
       return f->vtable->fi_fungetc(f, c);
    }
    else {
@@ -538,6 +799,138 @@ void *al_get_file_userdata(ALLEGRO_FILE *f)
 }
 
 
+/* Function: al_set_file_buffer_size
+ */
+bool al_set_file_buffer_size(ALLEGRO_FILE *f, size_t size)
+{
+   unsigned char *buffer;
+   size_t n;
+   int i;
+
+   ASSERT(f != NULL);
+
+   if (size == 0) {
+      if (!f->buffer) {
+         return true;
+      }
+      if (!discard_buffer(f)) {
+         /* Keep what is left of a small buffer as pushbacks instead. */
+         if (BUFFERED(f) > ALLEGRO_UNGETC_SIZE) {
+            return false;
+         }
+         while (BUFFERED(f) > 0) {
+            f->ungetc[f->ungetc_len++] = f->buffer[--f->buffer_len];
+         }
+      }
+      al_free(f->buffer);
+      f->buffer = NULL;
+      f->buffer_size = 0;
+      f->buffer_pos = 0;
+      f->buffer_len = 0;
+      return true;
+   }
+
+   if (BUFFERED(f) > size && !discard_buffer(f)) {
+      return false;
+   }
+
+   buffer = al_malloc(ALLEGRO_UNGETC_SIZE + size);
+   if (!buffer) {
+      al_set_errno(ENOMEM);
+      return false;
+   }
+
+   /* Carry over the unread bytes, and move any pushbacks in front. */
+   n = BUFFERED(f);
+   if (n > 0) {
+      memcpy(buffer + ALLEGRO_UNGETC_SIZE, f->buffer + f->buffer_pos, n);
+   }
+   f->buffer_pos = ALLEGRO_UNGETC_SIZE;
+   f->buffer_len = ALLEGRO_UNGETC_SIZE + n;
+   f->buffer_ungetc_end = f->buffer_pos;
+   for (i = 0; i < f->ungetc_len; i++) {
+      buffer[--f->buffer_pos] = f->ungetc[i];
+   }
+   f->ungetc_len = 0;
+
+   al_free(f->buffer);
+   f->buffer = buffer;
+   f->buffer_size = size;
+
+   return true;
+}
+
+
+/* Function: al_get_file_buffer_size
+ */
+size_t al_get_file_buffer_size(ALLEGRO_FILE *f)
+{
+   ASSERT(f != NULL);
+
+   return f->buffer_size;
+}
+
+
+/* Function: al_fpeek
+ */
+const void *al_fpeek(ALLEGRO_FILE *f, size_t *size)
+{
+   ASSERT(f != NULL);
+   ASSERT(size != NULL);
+
+   if (!f->buffer) {
+      *size = 0;
+      return NULL;
+   }
+
+   if (BUFFERED(f) == 0) {
+      fill_buffer(f);
+   }
+
+   *size = BUFFERED(f);
+   if (*size == 0) {
+      return NULL;
+   }
+
+   return f->buffer + f->buffer_pos;
+}
+
+
+/* Function: al_fconsume
+ */
+void al_fconsume(ALLEGRO_FILE *f, size_t size)
+{
+   ASSERT(f != NULL);
+   ASSERT(size <= BUFFERED(f));
+
+   f->buffer_pos += size;
+}
+
+
+/* Function: al_get_file_memory
+ */
+const void *al_get_file_memory(ALLEGRO_FILE *f, int64_t *size)
+{
+   ASSERT(f != NULL);
+
+   if (size) {
+      *size = f->memory ? f->memory_size : 0;
+   }
+
+   return f->memory;
+}
+
+
+/* Called by file backends which hold the whole file in memory. */
+void _al_set_file_memory(ALLEGRO_FILE *f, const void *memory, int64_t size)
+{
+   ASSERT(f != NULL);
+
+   f->memory = memory;
+   f->memory_size = size;
+}
+
+
 /* Function: al_vfprintf
  */
 int al_vfprintf(ALLEGRO_FILE *pfile, const char *format, va_list args)
@@ -0,0 +1,367 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Read-only memory mapped files.
+ *
+ *      See LICENSE.txt for copyright information.
+ */
+
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_file.h"
+
+#if defined(ALLEGRO_WINDOWS)
+   #include <windows.h>
+   #include "allegro5/internal/aintern_wunicode.h"
+#elif defined(ALLEGRO_HAVE_MMAP)
+   #include <fcntl.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <unistd.h>
+#endif
+
+ALLEGRO_DEBUG_CHANNEL("mmap")
+
+
+typedef struct MMAP_FILE
+{
+   const unsigned char *data;
+   int64_t size;
+   int64_t pos;
+   bool eof;
+} MMAP_FILE;
+
+
+#if defined(ALLEGRO_WINDOWS)
+
+static bool map_file(MMAP_FILE *mf, const char *path)
+{
+   wchar_t *wpath = _al_win_utf16(path);
+   HANDLE file;
+   HANDLE mapping;
+   LARGE_INTEGER size;
+
+   file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, NULL,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   al_free(wpath);
+   if (file == INVALID_HANDLE_VALUE) {
+      al_set_errno(ENOENT);
+      return false;
+   }
+
+   if (!GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart > SIZE_MAX) {
+      CloseHandle(file);
+      al_set_errno(EFBIG);
+      return false;
+   }
+
+   mf->size = size.QuadPart;
+   if (mf->size > 0) {
+      mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mapping) {
+         /* The view keeps the mapping alive. */
+         mf->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+         CloseHandle(mapping);
+      }
+      if (!mf->data) {
+         CloseHandle(file);
+         al_set_errno(ENOMEM);
+         return false;
+      }
+   }
+
+   CloseHandle(file);
+   return true;
+}
+
+
+static void unmap_file(MMAP_FILE *mf)
+{
+   if (mf->data)
+      UnmapViewOfFile(mf->data);
+}
+
+#elif defined(ALLEGRO_HAVE_MMAP)
+
+static bool map_file(MMAP_FILE *mf, const char *path)
+{
+   struct stat st;
+   void *data;
+   int fd;
+
+   fd = open(path, O_RDONLY);
+   if (fd == -1) {
+      al_set_errno(errno);
+      return false;
+   }
+
+   if (fstat(fd, &st) != 0 || (uint64_t)st.st_size > SIZE_MAX) {
+      close(fd);
+      al_set_errno(EFBIG);
+      return false;
+   }
+
+   mf->size = st.st_size;
+   if (mf->size > 0) {
+      data = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+         al_set_errno(errno);
+         close(fd);
+         return false;
+      }
+      mf->data = data;
+   }
+
+   /* The mapping stays valid after the descriptor is closed. */
+   close(fd);
+   return true;
+}
+
+
+static void unmap_file(MMAP_FILE *mf)
+{
+   if (mf->data)
+      munmap((void *)mf->data, mf->size);
+}
+
+#else
+
+/* Without memory mapping, read the whole file in. */
+static bool map_file(MMAP_FILE *mf, const char *path)
+{
+   ALLEGRO_FILE *fp;
+   unsigned char *data = NULL;
+
+   fp = al_fopen_interface(&_al_file_interface_stdio, path, "rb");
+   if (!fp)
+      return false;
+
+   mf->size = al_fsize(fp);
+   if (mf->size < 0 || (uint64_t)mf->size > SIZE_MAX) {
+      al_fclose(fp);
+      al_set_errno(EFBIG);
+      return false;
+   }
+
+   if (mf->size > 0) {
+      data = al_malloc(mf->size);
+      if (!data || al_fread(fp, data, mf->size) != (size_t)mf->size) {
+         al_free(data);
+         al_fclose(fp);
+         al_set_errno(ENOMEM);
+         return false;
+      }
+   }
+
+   mf->data = data;
+   al_fclose(fp);
+   return true;
+}
+
+
+static void unmap_file(MMAP_FILE *mf)
+{
+   al_free((void *)mf->data);
+}
+
+#endif
+
+
+static void *mmap_fopen(const char *path, const char *mode)
+{
+   MMAP_FILE *mf;
+
+   if (strpbrk(mode, "wa+")) {
+      ALLEGRO_ERROR("Memory mapped files are read-only, cannot open %s"
+         " with mode %s.\n", path, mode);
+      al_set_errno(EINVAL);
+      return NULL;
+   }
+
+   mf = al_calloc(1, sizeof(*mf));
+   if (!mf) {
+      al_set_errno(ENOMEM);
+      return NULL;
+   }
+
+   if (!map_file(mf, path)) {
+      ALLEGRO_ERROR("Unable to map %s.\n", path);
+      al_free(mf);
+      return NULL;
+   }
+
+   ALLEGRO_DEBUG("Mapped %s, %ld bytes.\n", path, (long)mf->size);
+
+   return mf;
+}
+
+
+static bool mmap_fclose(ALLEGRO_FILE *f)
+{
+   MMAP_FILE *mf = al_get_file_userdata(f);
+
+   unmap_file(mf);
+   al_free(mf);
+   return true;
+}
+
+
+static size_t mmap_fread(ALLEGRO_FILE *f, void *ptr, size_t size)
+{
+   MMAP_FILE *mf = al_get_file_userdata(f);
+   size_t n = size;
+
+   if (mf->size - mf->pos < (int64_t)size) {
+      n = mf->size - mf->pos;
+      mf->eof = true;
+   }
+
+   if (n > 0) {
+      memcpy(ptr, mf->data + mf->pos, n);
+      mf->pos += n;
+   }
+
+   return n;
+}
+
+
+static size_t mmap_fwrite(ALLEGRO_FILE *f, const void *ptr, size_t size)
+{
+   (void)f;
+   (void)ptr;
+   (void)size;
+   al_set_errno(EBADF);
+   return 0;
+}
+
+
+static bool mmap_fflush(ALLEGRO_FILE *f)
+{
+   (void)f;
+   return true;
+}
+
+
+static int64_t mmap_ftell(ALLEGRO_FILE *f)
+{
+   MMAP_FILE *mf = al_get_file_userdata(f);
+
+   return mf->pos;
+}
+
+
+static bool mmap_fseek(ALLEGRO_FILE *f, int64_t offset, int whence)
+{
+   MMAP_FILE *mf = al_get_file_userdata(f);
+   int64_t pos = mf->pos;
+
+   switch (whence) {
+      case ALLEGRO_SEEK_SET:
+         pos = offset;
+         break;
+
+      case ALLEGRO_SEEK_CUR:
+         pos = mf->pos + offset;
+         break;
+
+      case ALLEGRO_SEEK_END:
+         pos = mf->size + offset;
+         break;
+   }
+
+   if (pos < 0 || pos > mf->size) {
+      al_set_errno(EINVAL);
+      return false;
+   }
+
+   mf->pos = pos;
+   mf->eof = false;
+
+   return true;
+}
+
+
+static bool mmap_feof(ALLEGRO_FILE *f)
+{
+   MMAP_FILE *mf = al_get_file_userdata(f);
+
+   return mf->eof;
+}
+
+
+static int mmap_ferror(ALLEGRO_FILE *f)
+{
+   (void)f;
+   return 0;
+}
+
+
+static const char *mmap_ferrmsg(ALLEGRO_FILE *f)
+{
+   (void)f;
+   return "";
+}
+
+
+static void mmap_fclearerr(ALLEGRO_FILE *f)
+{
+   MMAP_FILE *mf = al_get_file_userdata(f);
+
+   mf->eof = false;
+}
+
+
+static off_t mmap_fsize(ALLEGRO_FILE *f)
+{
+   MMAP_FILE *mf = al_get_file_userdata(f);
+
+   return mf->size;
+}
+
+
+static const ALLEGRO_FILE_INTERFACE mmap_vtable = {
+   mmap_fopen,
+   mmap_fclose,
+   mmap_fread,
+   mmap_fwrite,
+   mmap_fflush,
+   mmap_ftell,
+   mmap_fseek,
+   mmap_feof,
+   mmap_ferror,
+   mmap_ferrmsg,
+   mmap_fclearerr,
+   NULL,    /* ungetc */
+   mmap_fsize
+};
+
+
+/* Function: al_fopen_mmap
+ */
+ALLEGRO_FILE *al_fopen_mmap(const char *path)
+{
+   ALLEGRO_FILE *f;
+   MMAP_FILE *mf;
+
+   ASSERT(path);
+
+   f = al_fopen_interface(&mmap_vtable, path, "rb");
+   if (f) {
+      mf = al_get_file_userdata(f);
+      _al_set_file_memory(f, mf->data, mf->size);
+   }
+
+   return f;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -15,6 +15,7 @@
  */
 
 #include "allegro5/allegro.h"
+#include "allegro5/internal/aintern_file.h"
 
 typedef struct SLICE_DATA SLICE_DATA;
 
@@ -205,6 +206,9 @@ static const ALLEGRO_FILE_INTERFACE fi =
 ALLEGRO_FILE *al_fopen_slice(ALLEGRO_FILE *fp, size_t initial_size, const char *mode)
 {
    SLICE_DATA *userdata = al_calloc(1, sizeof(*userdata));
+   ALLEGRO_FILE *slice;
+   const char *memory;
+   int64_t memory_size;
    
    if (!userdata) {
       return NULL;
@@ -226,6 +230,15 @@ ALLEGRO_FILE *al_fopen_slice(ALLEGRO_FILE *fp, size_t initial_size, const char *
    userdata->anchor = al_ftell(fp);
    userdata->size = initial_size;
    
-   return al_create_file_handle(&fi, userdata);
+   slice = al_create_file_handle(&fi, userdata);
+
+   /* A fixed size slice of a file in memory is in memory too. */
+   memory = al_get_file_memory(fp, &memory_size);
+   if (slice && memory && userdata->mode == SLICE_READ
+         && (int64_t)(userdata->anchor + userdata->size) <= memory_size) {
+      _al_set_file_memory(slice, memory + userdata->anchor, userdata->size);
+   }
+
+   return slice;
 }
 
@@ -0,0 +1,426 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Asynchronous asset loading.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+/* Title: Asynchronous loading
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_dtor.h"
+#include "allegro5/internal/aintern_events.h"
+#include "allegro5/internal/aintern_system.h"
+#include "allegro5/internal/aintern_thread.h"
+#include "allegro5/internal/aintern_vector.h"
+
+ALLEGRO_DEBUG_CHANNEL("loader")
+
+#define MAX_THREADS  64
+
+
+enum {
+   REQUEST_PENDING,
+   REQUEST_RUNNING,
+   REQUEST_DONE
+};
+
+
+struct ALLEGRO_LOAD_REQUEST
+{
+   ALLEGRO_LOADER *loader;
+   char *filename;
+   int priority;
+   unsigned int serial;    /* FIFO order among equal priorities */
+   int state;
+   bool cancelled;
+   void *(*load)(const char *filename, void *arg);
+   void (*finish)(void *result, void *arg);
+   void (*destroy)(void *result, void *arg);
+   void *arg;
+   void *result;
+   /* Thread local state of the thread which queued the request. */
+   const ALLEGRO_FILE_INTERFACE *file_interface;
+   const ALLEGRO_FS_INTERFACE *fs_interface;
+};
+
+
+struct ALLEGRO_LOADER
+{
+   ALLEGRO_EVENT_SOURCE *source;
+   ALLEGRO_MUTEX *mutex;
+   ALLEGRO_COND *work_cond;
+   ALLEGRO_COND *done_cond;
+   _AL_THREAD *threads;
+   int num_threads;
+   bool quit;
+   unsigned int next_serial;
+   _AL_VECTOR requests;    /* ALLEGRO_LOAD_REQUEST *, in any state */
+   _AL_LIST_ITEM *dtor_item;
+};
+
+
+
+static void free_request(ALLEGRO_LOAD_REQUEST *req)
+{
+   al_free(req->filename);
+   al_free(req);
+}
+
+
+
+/* Returns the pending request to run next, or NULL. Called with the loader
+ * mutex held.
+ */
+static ALLEGRO_LOAD_REQUEST *next_request(ALLEGRO_LOADER *loader)
+{
+   ALLEGRO_LOAD_REQUEST *best = NULL;
+   unsigned int i;
+
+   for (i = 0; i < _al_vector_size(&loader->requests); i++) {
+      ALLEGRO_LOAD_REQUEST **slot = _al_vector_ref(&loader->requests, i);
+      ALLEGRO_LOAD_REQUEST *req = *slot;
+
+      if (req->state != REQUEST_PENDING)
+         continue;
+      if (!best || req->priority > best->priority ||
+            (req->priority == best->priority &&
+               (int)(req->serial - best->serial) < 0)) {
+         best = req;
+      }
+   }
+
+   return best;
+}
+
+
+
+/* The event does not hold a reference to the request. If the request is
+ * finished before the event is taken from its queue, the program has to
+ * ignore the event, see al_finish_load.
+ */
+static void emit_finished_event(ALLEGRO_LOADER *loader,
+   ALLEGRO_LOAD_REQUEST *req)
+{
+   ALLEGRO_EVENT event;
+
+   if (!loader->source)
+      return;
+
+   _al_event_source_lock(loader->source);
+   if (_al_event_source_needs_to_generate_event(loader->source)) {
+      event.loader.type = ALLEGRO_EVENT_LOAD_FINISHED;
+      event.loader.timestamp = al_get_time();
+      event.loader.loader = loader;
+      event.loader.request = req;
+      event.loader.success = (req->result != NULL);
+      _al_event_source_emit_event(loader->source, &event);
+   }
+   _al_event_source_unlock(loader->source);
+}
+
+
+
+static void worker_proc(_AL_THREAD *thread, void *arg)
+{
+   ALLEGRO_LOADER *loader = arg;
+   ALLEGRO_LOAD_REQUEST *req;
+   void *result;
+
+   (void)thread;
+
+   al_lock_mutex(loader->mutex);
+   while (!loader->quit) {
+      req = next_request(loader);
+      if (!req) {
+         al_wait_cond(loader->work_cond, loader->mutex);
+         continue;
+      }
+
+      req->state = REQUEST_RUNNING;
+      al_unlock_mutex(loader->mutex);
+
+      al_set_new_file_interface(req->file_interface);
+      al_set_fs_interface(req->fs_interface);
+      result = req->load(req->filename, req->arg);
+      if (!result)
+         ALLEGRO_WARN("Failed to load %s.\n", req->filename);
+
+      al_lock_mutex(loader->mutex);
+      if (req->cancelled) {
+         /* Nobody holds the request any more. */
+         _al_vector_find_and_delete(&loader->requests, &req);
+         al_unlock_mutex(loader->mutex);
+         req->destroy(result, req->arg);
+         free_request(req);
+         al_lock_mutex(loader->mutex);
+         continue;
+      }
+
+      req->result = result;
+      req->state = REQUEST_DONE;
+      al_broadcast_cond(loader->done_cond);
+      emit_finished_event(loader, req);
+   }
+   al_unlock_mutex(loader->mutex);
+}
+
+
+
+/* Function: al_create_loader
+ */
+ALLEGRO_LOADER *al_create_loader(int num_threads, ALLEGRO_EVENT_SOURCE *source)
+{
+   ALLEGRO_LOADER *loader;
+   int i;
+
+   if (num_threads <= 0)
+      num_threads = al_get_cpu_count();
+   num_threads = _ALLEGRO_CLAMP(1, num_threads, MAX_THREADS);
+
+   loader = al_calloc(1, sizeof(*loader));
+   if (!loader)
+      return NULL;
+
+   loader->source = source;
+   loader->mutex = al_create_mutex();
+   loader->work_cond = al_create_cond();
+   loader->done_cond = al_create_cond();
+   loader->threads = al_calloc(num_threads, sizeof(*loader->threads));
+   if (!loader->mutex || !loader->work_cond || !loader->done_cond ||
+         !loader->threads) {
+      al_destroy_cond(loader->done_cond);
+      al_destroy_cond(loader->work_cond);
+      al_destroy_mutex(loader->mutex);
+      al_free(loader->threads);
+      al_free(loader);
+      return NULL;
+   }
+   _al_vector_init(&loader->requests, sizeof(ALLEGRO_LOAD_REQUEST *));
+
+   loader->num_threads = num_threads;
+   for (i = 0; i < num_threads; i++) {
+      _al_thread_create(&loader->threads[i], worker_proc, loader);
+   }
+
+   loader->dtor_item = _al_register_destructor(_al_dtor_list, "loader",
+      loader, (void (*)(void *)) al_destroy_loader);
+
+   ALLEGRO_DEBUG("Created loader with %d threads.\n", num_threads);
+
+   return loader;
+}
+
+
+
+/* Function: al_destroy_loader
+ */
+void al_destroy_loader(ALLEGRO_LOADER *loader)
+{
+   unsigned int i;
+
+   if (!loader)
+      return;
+
+   _al_unregister_destructor(_al_dtor_list, loader->dtor_item);
+
+   /* Requests which are being loaded right now are cleaned up by their
+    * workers, everything else is left to us.
+    */
+   al_lock_mutex(loader->mutex);
+   loader->quit = true;
+   for (i = 0; i < _al_vector_size(&loader->requests); i++) {
+      ALLEGRO_LOAD_REQUEST **slot = _al_vector_ref(&loader->requests, i);
+      (*slot)->cancelled = true;
+   }
+   al_broadcast_cond(loader->work_cond);
+   al_unlock_mutex(loader->mutex);
+
+   for (i = 0; i < (unsigned int)loader->num_threads; i++) {
+      _al_thread_join(&loader->threads[i]);
+   }
+
+   for (i = 0; i < _al_vector_size(&loader->requests); i++) {
+      ALLEGRO_LOAD_REQUEST **slot = _al_vector_ref(&loader->requests, i);
+      ALLEGRO_LOAD_REQUEST *req = *slot;
+      req->destroy(req->result, req->arg);
+      free_request(req);
+   }
+   _al_vector_free(&loader->requests);
+
+   al_destroy_cond(loader->done_cond);
+   al_destroy_cond(loader->work_cond);
+   al_destroy_mutex(loader->mutex);
+   al_free(loader->threads);
+   al_free(loader);
+}
+
+
+
+/* Function: al_queue_load
+ */
+ALLEGRO_LOAD_REQUEST *al_queue_load(ALLEGRO_LOADER *loader,
+   const char *filename, int priority,
+   void *(*load)(const char *filename, void *arg),
+   void (*finish)(void *result, void *arg),
+   void (*destroy)(void *result, void *arg),
+   void *arg)
+{
+   ALLEGRO_LOAD_REQUEST *req;
+   ALLEGRO_LOAD_REQUEST **slot;
+
+   ASSERT(loader);
+   ASSERT(filename);
+   ASSERT(load);
+   ASSERT(destroy);
+
+   req = al_calloc(1, sizeof(*req));
+   if (!req)
+      return NULL;
+
+   req->filename = al_malloc(strlen(filename) + 1);
+   if (!req->filename) {
+      al_free(req);
+      return NULL;
+   }
+   strcpy(req->filename, filename);
+
+   req->loader = loader;
+   req->priority = priority;
+   req->state = REQUEST_PENDING;
+   req->load = load;
+   req->finish = finish;
+   req->destroy = destroy;
+   req->arg = arg;
+   req->file_interface = al_get_new_file_interface();
+   req->fs_interface = al_get_fs_interface();
+
+   al_lock_mutex(loader->mutex);
+   req->serial = loader->next_serial++;
+   slot = _al_vector_alloc_back(&loader->requests);
+   *slot = req;
+   al_signal_cond(loader->work_cond);
+   al_unlock_mutex(loader->mutex);
+
+   return req;
+}
+
+
+
+/* Function: al_cancel_load
+ */
+bool al_cancel_load(ALLEGRO_LOAD_REQUEST *req)
+{
+   ALLEGRO_LOADER *loader;
+
+   ASSERT(req);
+   loader = req->loader;
+
+   al_lock_mutex(loader->mutex);
+   switch (req->state) {
+      case REQUEST_PENDING:
+         _al_vector_find_and_delete(&loader->requests, &req);
+         al_unlock_mutex(loader->mutex);
+         req->destroy(NULL, req->arg);
+         free_request(req);
+         return true;
+
+      case REQUEST_RUNNING:
+         /* The worker disposes of the request when it is done. */
+         req->cancelled = true;
+         al_unlock_mutex(loader->mutex);
+         return true;
+
+      default:
+         /* The finished event may already be in a queue. */
+         al_unlock_mutex(loader->mutex);
+         return false;
+   }
+}
+
+
+
+/* Function: al_set_load_priority
+ */
+void al_set_load_priority(ALLEGRO_LOAD_REQUEST *req, int priority)
+{
+   ASSERT(req);
+
+   al_lock_mutex(req->loader->mutex);
+   req->priority = priority;
+   al_unlock_mutex(req->loader->mutex);
+}
+
+
+
+/* Function: al_is_load_finished
+ */
+bool al_is_load_finished(ALLEGRO_LOAD_REQUEST *req)
+{
+   bool done;
+
+   ASSERT(req);
+
+   al_lock_mutex(req->loader->mutex);
+   done = (req->state == REQUEST_DONE);
+   al_unlock_mutex(req->loader->mutex);
+
+   return done;
+}
+
+
+
+/* Function: al_finish_load
+ */
+void *al_finish_load(ALLEGRO_LOAD_REQUEST *req)
+{
+   ALLEGRO_LOADER *loader;
+   void *result;
+
+   ASSERT(req);
+   loader = req->loader;
+
+   al_lock_mutex(loader->mutex);
+   /* Don't leave the request waiting behind everything else. */
+   if (req->state == REQUEST_PENDING)
+      req->priority = INT_MAX;
+   while (req->state != REQUEST_DONE) {
+      al_wait_cond(loader->done_cond, loader->mutex);
+   }
+   _al_vector_find_and_delete(&loader->requests, &req);
+   al_unlock_mutex(loader->mutex);
+
+   result = req->result;
+   if (req->finish)
+      req->finish(result, req->arg);
+   free_request(req);
+
+   return result;
+}
+
+
+
+/* Function: al_get_load_request_filename
+ */
+const char *al_get_load_request_filename(ALLEGRO_LOAD_REQUEST *req)
+{
+   ASSERT(req);
+
+   return req->filename;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -33,6 +33,9 @@ static void _al_draw_transformed_scaled_bitmap_memory(
 static void _al_draw_bitmap_region_memory_fast(ALLEGRO_BITMAP *bitmap,
    int sx, int sy, int sw, int sh,
    int dx, int dy, int flags);
+static void _al_draw_bitmap_region_memory_span(ALLEGRO_BITMAP *bitmap,
+   _AL_BLEND_SPAN span, int sx, int sy, int sw, int sh,
+   int dx, int dy);
 
 
 /* The CLIPPER macro takes pre-clipped coordinates for both the source
@@ -138,6 +141,7 @@ void _al_draw_bitmap_region_memory(ALLEGRO_BITMAP *src,
    int op, src_mode, dst_mode;
    int op_alpha, src_alpha, dst_alpha;
    float xtrans, ytrans;
+   _AL_BLEND_SPAN span;
    
    ASSERT(src->parent == NULL);
 
@@ -151,6 +155,22 @@ void _al_draw_bitmap_region_memory(ALLEGRO_BITMAP *src,
       return;
    }
 
+   /* Untinted blits at whole pixel offsets with one of the common blenders
+    * go through a span kernel a row at a time.
+    */
+   if (tint.r == 1.0f && tint.g == 1.0f && tint.b == 1.0f && tint.a == 1.0f &&
+      flags == 0 &&
+      !al_is_bitmap_locked(src) && !al_is_bitmap_locked(al_get_target_bitmap()) &&
+      al_get_bitmap_format(src) == al_get_bitmap_format(al_get_target_bitmap()) &&
+      _al_transform_is_translation(al_get_current_transform(), &xtrans, &ytrans) &&
+      xtrans == (int)xtrans && ytrans == (int)ytrans &&
+      (span = _al_get_blend_span(al_get_bitmap_format(src))))
+   {
+      _al_draw_bitmap_region_memory_span(src, span, sx, sy, sw, sh,
+         dx + xtrans, dy + ytrans);
+      return;
+   }
+
    /* We used to have special cases for translation/scaling only, but the
     * general version received much more optimisation and ended up being
     * faster.
@@ -169,6 +189,7 @@ static void _al_draw_transformed_bitmap_memory(ALLEGRO_BITMAP *src,
    int tl = 0, tr = 1, bl = 3, br = 2;
    int tmp;
    ALLEGRO_VERTEX v[4];
+   ALLEGRO_VERTEX tris[6];
 
    ASSERT(_al_pixel_format_is_real(al_get_bitmap_format(src)));
 
@@ -237,8 +258,13 @@ static void _al_draw_transformed_bitmap_memory(ALLEGRO_BITMAP *src,
 
    al_lock_bitmap(src, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
 
-   _al_triangle_2d(src, &v[tl], &v[tr], &v[br]);
-   _al_triangle_2d(src, &v[tl], &v[br], &v[bl]);
+   tris[0] = v[tl];
+   tris[1] = v[tr];
+   tris[2] = v[br];
+   tris[3] = v[tl];
+   tris[4] = v[br];
+   tris[5] = v[bl];
+   _al_triangles_2d(src, tris, 2);
 
    al_unlock_bitmap(src);
 }
@@ -302,4 +328,43 @@ static void _al_draw_bitmap_region_memory_fast(ALLEGRO_BITMAP *bitmap,
 }
 
 
+static void _al_draw_bitmap_region_memory_span(ALLEGRO_BITMAP *bitmap,
+   _AL_BLEND_SPAN span, int sx, int sy, int sw, int sh,
+   int dx, int dy)
+{
+   ALLEGRO_LOCKED_REGION *src_region;
+   ALLEGRO_LOCKED_REGION *dst_region;
+   ALLEGRO_BITMAP *dest = al_get_target_bitmap();
+   int format = al_get_bitmap_format(bitmap);
+   int dw = sw, dh = sh;
+   int flags = 0;
+   int y;
+
+   ASSERT(bitmap->parent == NULL);
+   ASSERT(al_get_bitmap_format(dest) == format);
+   (void)flags;
+
+   CLIPPER(bitmap, sx, sy, sw, sh, dest, dx, dy, dw, dh, 1, 1, flags)
+
+   if (!(src_region = al_lock_bitmap_region(bitmap, sx, sy, sw, sh,
+         format, ALLEGRO_LOCK_READONLY))) {
+      return;
+   }
+
+   if (!(dst_region = al_lock_bitmap_region(dest, dx, dy, sw, sh,
+         format, ALLEGRO_LOCK_READWRITE))) {
+      al_unlock_bitmap(bitmap);
+      return;
+   }
+
+   for (y = 0; y < sh; y++) {
+      span((const char *)src_region->data + y * src_region->pitch,
+         (char *)dst_region->data + y * dst_region->pitch, sw);
+   }
+
+   al_unlock_bitmap(bitmap);
+   al_unlock_bitmap(dest);
+}
+
+
 /* vim: set sts=3 sw=3 et: */
@@ -0,0 +1,240 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Internal worker pool for splitting up large jobs.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <stdlib.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_exitfunc.h"
+#include "allegro5/internal/aintern_parallel.h"
+#include "allegro5/internal/aintern_system.h"
+#include "allegro5/internal/aintern_thread.h"
+
+ALLEGRO_DEBUG_CHANNEL("parallel")
+
+#define MAX_THREADS        64
+#define CHUNKS_PER_THREAD  4
+
+
+typedef struct PARALLEL_JOB
+{
+   _AL_PARALLEL_FUNC func;
+   void *arg;
+   int count;
+   int chunk;
+   int next;      /* first item not handed out yet */
+   int running;   /* chunks handed out but not finished */
+} PARALLEL_JOB;
+
+
+static ALLEGRO_MUTEX *pool_mutex = NULL;
+static ALLEGRO_COND *work_cond = NULL;
+static ALLEGRO_COND *done_cond = NULL;
+static _AL_THREAD *workers = NULL;
+static int num_workers = -1;           /* not started yet */
+static bool destroy_workers = false;
+static PARALLEL_JOB *current_job = NULL;
+
+
+
+/* Runs one chunk of the job. Called and returns with pool_mutex held. */
+static void run_chunk(PARALLEL_JOB *job)
+{
+   int begin = job->next;
+   int end = _ALLEGRO_MIN(begin + job->chunk, job->count);
+
+   job->next = end;
+   job->running++;
+   al_unlock_mutex(pool_mutex);
+
+   job->func(job->arg, begin, end);
+
+   al_lock_mutex(pool_mutex);
+   job->running--;
+}
+
+
+
+static void worker_proc(_AL_THREAD *thread, void *arg)
+{
+   (void)thread;
+   (void)arg;
+
+   al_lock_mutex(pool_mutex);
+   while (!destroy_workers) {
+      PARALLEL_JOB *job = current_job;
+
+      if (!job || job->next >= job->count) {
+         al_wait_cond(work_cond, pool_mutex);
+         continue;
+      }
+
+      run_chunk(job);
+
+      if (job->next >= job->count && job->running == 0)
+         al_broadcast_cond(done_cond);
+   }
+   al_unlock_mutex(pool_mutex);
+}
+
+
+
+/* Called with pool_mutex held. */
+static void start_workers(void)
+{
+   const char *value;
+   int threads = al_get_cpu_count();
+   int i;
+
+   value = al_get_config_value(al_get_system_config(), "system",
+      "worker_threads");
+   if (value && atoi(value) > 0 && atoi(value) < threads)
+      threads = atoi(value);
+   threads = _ALLEGRO_CLAMP(1, threads, MAX_THREADS);
+
+   /* The thread calling _al_parallel_for does its share of the work. */
+   num_workers = threads - 1;
+   destroy_workers = false;
+   if (num_workers > 0) {
+      workers = al_calloc(num_workers, sizeof(*workers));
+      for (i = 0; i < num_workers; i++) {
+         _al_thread_create(&workers[i], worker_proc, NULL);
+      }
+   }
+
+   ALLEGRO_INFO("Started %d worker threads.\n", num_workers);
+}
+
+
+
+static void shutdown_parallel(void)
+{
+   int i;
+
+   if (num_workers > 0) {
+      al_lock_mutex(pool_mutex);
+      destroy_workers = true;
+      al_broadcast_cond(work_cond);
+      al_unlock_mutex(pool_mutex);
+
+      for (i = 0; i < num_workers; i++) {
+         _al_thread_join(&workers[i]);
+      }
+   }
+
+   al_free(workers);
+   workers = NULL;
+   num_workers = -1;
+
+   al_destroy_cond(done_cond);
+   al_destroy_cond(work_cond);
+   al_destroy_mutex(pool_mutex);
+   done_cond = NULL;
+   work_cond = NULL;
+   pool_mutex = NULL;
+}
+
+
+
+void _al_init_parallel(void)
+{
+   pool_mutex = al_create_mutex();
+   work_cond = al_create_cond();
+   done_cond = al_create_cond();
+
+   _al_add_exit_func(shutdown_parallel, "shutdown_parallel");
+}
+
+
+
+/* Returns the number of threads _al_parallel_for spreads work over,
+ * including the calling thread. The worker threads are started on the
+ * first call, with their number capped by the worker_threads key in the
+ * [system] section of allegro5.cfg.
+ */
+int _al_get_parallel_thread_count(void)
+{
+   int threads;
+
+   if (!pool_mutex)
+      return 1;
+
+   al_lock_mutex(pool_mutex);
+   if (num_workers < 0)
+      start_workers();
+   threads = num_workers + 1;
+   al_unlock_mutex(pool_mutex);
+
+   return threads;
+}
+
+
+
+/* Calls func for disjoint ranges covering the items [0, count), spread
+ * over the worker threads, and returns once all of them are done. No range
+ * is smaller than grain items, except possibly the last. If the pool is
+ * already busy (including calls from inside a job) func is simply called
+ * for the whole range on the current thread.
+ */
+void _al_parallel_for(int count, int grain, _AL_PARALLEL_FUNC func, void *arg)
+{
+   PARALLEL_JOB job;
+   int threads;
+
+   ASSERT(func);
+
+   if (count <= 0)
+      return;
+   if (grain < 1)
+      grain = 1;
+
+   if (count < 2 * grain
+         || (threads = _al_get_parallel_thread_count()) <= 1) {
+      func(arg, 0, count);
+      return;
+   }
+
+   al_lock_mutex(pool_mutex);
+   if (current_job) {
+      al_unlock_mutex(pool_mutex);
+      func(arg, 0, count);
+      return;
+   }
+
+   job.func = func;
+   job.arg = arg;
+   job.count = count;
+   job.chunk = _ALLEGRO_MAX(grain,
+      (count + threads * CHUNKS_PER_THREAD - 1) / (threads * CHUNKS_PER_THREAD));
+   job.next = 0;
+   job.running = 0;
+
+   current_job = &job;
+   al_broadcast_cond(work_cond);
+
+   while (job.next < job.count) {
+      run_chunk(&job);
+   }
+   while (job.running > 0) {
+      al_wait_cond(done_cond, pool_mutex);
+   }
+
+   current_job = NULL;
+   al_unlock_mutex(pool_mutex);
+}
+
+
+/* vim: set sts=3 sw=3 et: */
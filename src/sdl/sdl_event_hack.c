@@ -19,6 +19,7 @@ static void wakeup_with_fake_timer_event(void)
    event.timer.timestamp = al_get_time();
    event.timer.count = 0;
    event.timer.error = 0;
+   event.timer.ticks = 0;
    _al_event_source_emit_event(es, &event);
    _al_event_source_unlock(es);
 }
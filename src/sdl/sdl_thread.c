@@ -1,5 +1,6 @@
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_debug.h"
 #include "allegro5/internal/aintern_thread.h"
 #include "allegro5/platform/allegro_internal_sdl.h"
 
@@ -7,6 +8,7 @@ static int thread_trampoline(void* data)
 {
    _AL_THREAD *thread = data;
    (*thread->proc)(thread, thread->arg);
+   _al_trace_thread_ended();
    return 0;
 }
 
@@ -34,17 +34,26 @@
 
 
 /* forward declarations */
-static double timer_thread_handle_tick(double interval);
-static void timer_handle_tick(ALLEGRO_TIMER *timer);
+static void timer_thread_handle_tick(double now);
+static void timer_handle_tick(ALLEGRO_TIMER *timer, double now, double error,
+   int64_t ticks);
 
 
 struct ALLEGRO_TIMER
 {
    ALLEGRO_EVENT_SOURCE es;
    bool started;
+   bool coalesce;
    double speed_secs;
    int64_t count;
-   double counter;		/* counts down to zero=blastoff */
+   double counter;		/* time left when stopped */
+   double deadline;		/* al_get_time() of the next tick when started */
+   unsigned int heap_index;	/* position in active_timers */
+   int64_t stats_ticks;
+   int64_t stats_overruns;
+   double stats_last_latency;
+   double stats_max_latency;
+   double stats_total_latency;
    _AL_LIST_ITEM *dtor_item;
 };
 
@@ -55,6 +64,7 @@ struct ALLEGRO_TIMER
  */
 
 static ALLEGRO_MUTEX *timers_mutex;
+/* Binary min-heap of started timers, ordered by deadline. */
 static _AL_VECTOR active_timers = _AL_VECTOR_INITIALIZER(ALLEGRO_TIMER *);
 static _AL_THREAD * volatile timer_thread = NULL;
 static ALLEGRO_COND *timer_cond = NULL;
@@ -96,64 +106,177 @@ static void timer_thread_proc(_AL_THREAD *self, void *unused)
    }
 #endif
 
-   double old_time = al_get_time();
-   double new_time;
-   double interval = 0.032768;
+   al_lock_mutex(timers_mutex);
 
-   while (!_al_get_thread_should_stop(self)) {
-      al_lock_mutex(timers_mutex);
-      while (_al_vector_size(&active_timers) == 0 && !destroy_thread) {
+   while (!_al_get_thread_should_stop(self) && !destroy_thread) {
+      ALLEGRO_TIMER *timer;
+      ALLEGRO_TIMEOUT timeout;
+      double now;
+
+      if (_al_vector_is_empty(&active_timers)) {
          al_wait_cond(timer_cond, timers_mutex);
-         old_time = al_get_time() - interval;
+         continue;
       }
-      al_unlock_mutex(timers_mutex);
 
-      al_rest(interval);
-
-      al_lock_mutex(timers_mutex);
-      {
-         /* Calculate actual time elapsed.  */
-         new_time = al_get_time();
-         interval = new_time - old_time;
-         old_time = new_time;
-
-         /* Handle a tick.  */
-         interval = timer_thread_handle_tick(interval);
+      /* Sleep until the earliest deadline.  The condition variable is
+       * signalled whenever the set of timers changes, in which case we
+       * just start over.
+       */
+      timer = *(ALLEGRO_TIMER **)_al_vector_ref_front(&active_timers);
+      now = al_get_time();
+      if (now < timer->deadline) {
+         al_init_timeout(&timeout, timer->deadline - now);
+         al_wait_cond_until(timer_cond, timers_mutex, &timeout);
+         continue;
       }
-      al_unlock_mutex(timers_mutex);
+
+      timer_thread_handle_tick(now);
    }
 
+   al_unlock_mutex(timers_mutex);
+
    (void)unused;
 }
 
 
 
-/* timer_thread_handle_tick: [timer thread]
- *  Call handle_tick() method of every timer in active_timers, and
- *  returns the duration that the timer thread should try to sleep
- *  next time.
+/* heap_swap:
+ *  Swap two entries of the timer heap.
  */
-static double timer_thread_handle_tick(double interval)
+static void heap_swap(unsigned int i, unsigned int j)
 {
-   double new_delay = 0.032768;
-   unsigned int i;
+   ALLEGRO_TIMER **a = _al_vector_ref(&active_timers, i);
+   ALLEGRO_TIMER **b = _al_vector_ref(&active_timers, j);
+   ALLEGRO_TIMER *tmp = *a;
+
+   *a = *b;
+   *b = tmp;
+   (*a)->heap_index = i;
+   (*b)->heap_index = j;
+}
 
-   for (i = 0; i < _al_vector_size(&active_timers); i++) {
-      ALLEGRO_TIMER **slot = _al_vector_ref(&active_timers, i);
-      ALLEGRO_TIMER *timer = *slot;
 
-      timer->counter -= interval;
 
-      while (timer->counter <= 0) {
-         timer_handle_tick(timer);
-         timer->counter += timer->speed_secs;
-      }
+static double heap_deadline(unsigned int i)
+{
+   ALLEGRO_TIMER **slot = _al_vector_ref(&active_timers, i);
+   return (*slot)->deadline;
+}
+
+
+
+/* heap_sift_up, heap_sift_down:
+ *  Restore the heap property after the deadline of entry i has changed.
+ */
+static void heap_sift_up(unsigned int i)
+{
+   while (i > 0 && heap_deadline(i) < heap_deadline((i - 1) / 2)) {
+      heap_swap(i, (i - 1) / 2);
+      i = (i - 1) / 2;
+   }
+}
+
 
-      if ((timer->counter > 0) && (timer->counter < new_delay))
-         new_delay = timer->counter;
+
+static void heap_sift_down(unsigned int i)
+{
+   unsigned int size = _al_vector_size(&active_timers);
+
+   for (;;) {
+      unsigned int smallest = i;
+      unsigned int left = 2 * i + 1;
+      unsigned int right = 2 * i + 2;
+
+      if (left < size && heap_deadline(left) < heap_deadline(smallest))
+         smallest = left;
+      if (right < size && heap_deadline(right) < heap_deadline(smallest))
+         smallest = right;
+      if (smallest == i)
+         break;
+
+      heap_swap(i, smallest);
+      i = smallest;
    }
+}
+
+
+
+static void heap_update(ALLEGRO_TIMER *timer)
+{
+   heap_sift_up(timer->heap_index);
+   heap_sift_down(timer->heap_index);
+}
+
+
+
+static void heap_insert(ALLEGRO_TIMER *timer)
+{
+   ALLEGRO_TIMER **slot = _al_vector_alloc_back(&active_timers);
+
+   *slot = timer;
+   timer->heap_index = _al_vector_size(&active_timers) - 1;
+   heap_sift_up(timer->heap_index);
+}
+
+
+
+static void heap_remove(ALLEGRO_TIMER *timer)
+{
+   unsigned int i = timer->heap_index;
+   unsigned int last = _al_vector_size(&active_timers) - 1;
+
+   ASSERT(*(ALLEGRO_TIMER **)_al_vector_ref(&active_timers, i) == timer);
+
+   if (i != last) {
+      heap_swap(i, last);
+      _al_vector_delete_at(&active_timers, last);
+      heap_update(*(ALLEGRO_TIMER **)_al_vector_ref(&active_timers, i));
+   }
+   else {
+      _al_vector_delete_at(&active_timers, last);
+   }
+}
+
+
 
-   return new_delay;
+/* timer_thread_handle_tick: [timer thread]
+ *  Handle all timers whose deadline has passed.  A timer which has fallen
+ *  behind by several periods stays at the top of the heap and is ticked
+ *  once per missed period, unless it coalesces ticks, in which case all
+ *  the missed periods are handled at once.
+ */
+static void timer_thread_handle_tick(double now)
+{
+   while (!_al_vector_is_empty(&active_timers)) {
+      ALLEGRO_TIMER *timer = *(ALLEGRO_TIMER **)_al_vector_ref_front(&active_timers);
+      double latency = now - timer->deadline;
+      int64_t ticks = 1;
+
+      if (latency < 0)
+         break;
+
+      if (timer->coalesce)
+         ticks += (int64_t)(latency / timer->speed_secs);
+
+      /* The oldest tick is the latest, every following one is one period
+       * less late.
+       */
+      timer->stats_ticks += ticks;
+      timer->stats_overruns += ticks - 1;
+      if (latency >= timer->speed_secs * ticks)
+         timer->stats_overruns++;
+      if (latency > timer->stats_max_latency)
+         timer->stats_max_latency = latency;
+      timer->stats_total_latency += ticks * latency
+         - timer->speed_secs * (ticks * (ticks - 1) / 2);
+      latency -= timer->speed_secs * (ticks - 1);
+      timer->stats_last_latency = latency;
+
+      timer_handle_tick(timer, now, latency, ticks);
+
+      timer->deadline += timer->speed_secs * ticks;
+      heap_sift_down(0);
+   }
 }
 
 
@@ -195,15 +318,13 @@ static void enable_timer(ALLEGRO_TIMER *timer, bool reset_counter)
 
       al_lock_mutex(timers_mutex);
       {
-         ALLEGRO_TIMER **slot;
-
          timer->started = true;
 
          if (reset_counter)
             timer->counter = timer->speed_secs;
 
-         slot = _al_vector_alloc_back(&active_timers);
-         *slot = timer;
+         timer->deadline = al_get_time() + timer->counter;
+         heap_insert(timer);
 
          al_signal_cond(timer_cond);
       }
@@ -252,9 +373,17 @@ ALLEGRO_TIMER *al_create_timer(double speed_secs)
       if (timer) {
          _al_event_source_init(&timer->es);
          timer->started = false;
+         timer->coalesce = false;
          timer->count = 0;
          timer->speed_secs = speed_secs;
          timer->counter = 0;
+         timer->deadline = 0;
+         timer->heap_index = 0;
+         timer->stats_ticks = 0;
+         timer->stats_overruns = 0;
+         timer->stats_last_latency = 0;
+         timer->stats_max_latency = 0;
+         timer->stats_total_latency = 0;
 
          timer->dtor_item = _al_register_destructor(_al_dtor_list, "timer", timer,
             (void (*)(void *)) al_destroy_timer);
@@ -311,7 +440,8 @@ void al_stop_timer(ALLEGRO_TIMER *timer)
 
       al_lock_mutex(timers_mutex);
       {
-         _al_vector_find_and_delete(&active_timers, &timer);
+         heap_remove(timer);
+         timer->counter = timer->deadline - al_get_time();
          timer->started = false;
       }
       al_unlock_mutex(timers_mutex);
@@ -352,8 +482,10 @@ void al_set_timer_speed(ALLEGRO_TIMER *timer, double new_speed_secs)
    al_lock_mutex(timers_mutex);
    {
       if (timer->started) {
-         timer->counter -= timer->speed_secs;
-         timer->counter += new_speed_secs;
+         timer->deadline -= timer->speed_secs;
+         timer->deadline += new_speed_secs;
+         heap_update(timer);
+         al_signal_cond(timer_cond);
       }
 
       timer->speed_secs = new_speed_secs;
@@ -403,10 +535,79 @@ void al_add_timer_count(ALLEGRO_TIMER *timer, int64_t diff)
 }
 
 
+/* Function: al_get_timer_stats
+ */
+void al_get_timer_stats(ALLEGRO_TIMER *timer, ALLEGRO_TIMER_STATS *stats)
+{
+   ASSERT(timer);
+   ASSERT(stats);
+
+   al_lock_mutex(timers_mutex);
+   {
+      stats->ticks = timer->stats_ticks;
+      stats->overruns = timer->stats_overruns;
+      stats->last_latency = timer->stats_last_latency;
+      stats->max_latency = timer->stats_max_latency;
+      if (timer->stats_ticks > 0)
+         stats->mean_latency = timer->stats_total_latency / timer->stats_ticks;
+      else
+         stats->mean_latency = 0;
+   }
+   al_unlock_mutex(timers_mutex);
+}
+
+
+
+/* Function: al_reset_timer_stats
+ */
+void al_reset_timer_stats(ALLEGRO_TIMER *timer)
+{
+   ASSERT(timer);
+
+   al_lock_mutex(timers_mutex);
+   {
+      timer->stats_ticks = 0;
+      timer->stats_overruns = 0;
+      timer->stats_last_latency = 0;
+      timer->stats_max_latency = 0;
+      timer->stats_total_latency = 0;
+   }
+   al_unlock_mutex(timers_mutex);
+}
+
+
+
+/* Function: al_set_timer_coalescing
+ */
+void al_set_timer_coalescing(ALLEGRO_TIMER *timer, bool coalesce)
+{
+   ASSERT(timer);
+
+   al_lock_mutex(timers_mutex);
+   {
+      timer->coalesce = coalesce;
+   }
+   al_unlock_mutex(timers_mutex);
+}
+
+
+
+/* Function: al_get_timer_coalescing
+ */
+bool al_get_timer_coalescing(const ALLEGRO_TIMER *timer)
+{
+   ASSERT(timer);
+
+   return timer->coalesce;
+}
+
+
+
 /* timer_handle_tick: [timer thread]
- *  Handle a single tick.
+ *  Handle TICKS ticks at once.
  */
-static void timer_handle_tick(ALLEGRO_TIMER *timer)
+static void timer_handle_tick(ALLEGRO_TIMER *timer, double now, double error,
+   int64_t ticks)
 {
    /* Lock out event source helper functions (e.g. the release hook
     * could be invoked simultaneously with this function).
@@ -414,15 +615,16 @@ static void timer_handle_tick(ALLEGRO_TIMER *timer)
    _al_event_source_lock(&timer->es);
    {
       /* Update the count.  */
-      timer->count++;
+      timer->count += ticks;
 
       /* Generate an event, maybe.  */
       if (_al_event_source_needs_to_generate_event(&timer->es)) {
          ALLEGRO_EVENT event;
          event.timer.type = ALLEGRO_EVENT_TIMER;
-         event.timer.timestamp = al_get_time();
+         event.timer.timestamp = now;
          event.timer.count = timer->count;
-         event.timer.error = -timer->counter;
+         event.timer.error = error;
+         event.timer.ticks = ticks;
          _al_event_source_emit_event(&timer->es, &event);
       }
    }
@@ -39,6 +39,7 @@
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_debug.h"
 #include "allegro5/internal/aintern_display.h"
 #include "allegro5/internal/aintern_file.h"
 #include "allegro5/internal/aintern_fshook.h"
@@ -107,6 +108,9 @@ typedef struct thread_local_state {
 
    /* Destructor ownership count */
    int dtor_owner_count;
+
+   /* Log buffer of the thread, see debug.c */
+   void *trace_data;
 } thread_local_state;
 
 
@@ -171,9 +175,13 @@ static void initialize_tls_values(thread_local_state *tls)
 void _al_reinitialize_tls_values(void)
 {
    thread_local_state *tls;
+   void *trace_data;
    if ((tls = tls_get()) == NULL)
       return;
+   /* The log buffer belongs to the thread, not to the installation. */
+   trace_data = tls->trace_data;
    initialize_tls_values(tls);
+   tls->trace_data = trace_data;
 }
 
 
@@ -973,4 +981,13 @@ int *_al_tls_get_dtor_owner_count(void)
 }
 
 
+void **_al_tls_get_trace_data(void)
+{
+   thread_local_state *tls;
+
+   tls = tls_get();
+   return &tls->trace_data;
+}
+
+
 /* vim: set sts=3 sw=3 et: */
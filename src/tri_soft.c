@@ -21,8 +21,10 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_blend.h"
+#include "allegro5/internal/aintern_parallel.h"
 #include "allegro5/internal/aintern_pixels.h"
 #include "allegro5/internal/aintern_tri_soft.h"
+#include <limits.h>
 #include <math.h>
 
 ALLEGRO_DEBUG_CHANNEL("tri_soft")
@@ -35,15 +37,25 @@ typedef void (*shader_init)(uintptr_t, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*, ALLEGRO
 typedef void (*shader_first)(uintptr_t, int, int, int, int);
 typedef void (*shader_step)(uintptr_t, int);
 
+/*
+The blender is looked up once per batch of triangles rather than by every
+scanline drawer, which also lets the drawers run on worker threads
+*/
+typedef struct {
+   int op, src_mode, dst_mode;
+   int op_alpha, src_alpha, dst_alpha;
+   ALLEGRO_COLOR const_color;
+} state_blend;
+
 typedef struct {
    ALLEGRO_BITMAP *target;
+   const state_blend *blend;
    ALLEGRO_COLOR cur_color;
 } state_solid_any_2d;
 
 static void shader_solid_any_init(uintptr_t state, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3)
 {
    state_solid_any_2d* s = (state_solid_any_2d*)state;
-   s->target = al_get_target_bitmap();
    s->cur_color = v1->color;
 
    (void)v2;
@@ -131,8 +143,6 @@ static void shader_grad_any_init(uintptr_t state, ALLEGRO_VERTEX* v1, ALLEGRO_VE
 
    state_grad_any_2d* s = (state_grad_any_2d*)state;
 
-   s->solid.target = al_get_target_bitmap();
-   
    s->off_x = v1->x - 0.5f;
    s->off_y = v1->y + 0.5f;
 
@@ -207,6 +217,7 @@ static void shader_grad_any_step(uintptr_t state, int minor)
 
 typedef struct {
    ALLEGRO_BITMAP *target;
+   const state_blend *blend;
    ALLEGRO_COLOR cur_color;
 
    float du_dx, du_dy, u_const;
@@ -234,7 +245,6 @@ static void shader_texture_solid_any_init(uintptr_t state, ALLEGRO_VERTEX* v1, A
 
    state_texture_solid_any_2d* s = (state_texture_solid_any_2d*)state;
 
-   s->target = al_get_target_bitmap();
    s->cur_color = v1->color;
 
    s->off_x = v1->x - 0.5f;
@@ -319,8 +329,7 @@ static void shader_texture_grad_any_init(uintptr_t state, ALLEGRO_VERTEX* v1, AL
    PLANE_DETS(v, v1->v, v2->v, v3->v)
 
    state_texture_grad_any_2d* s = (state_texture_grad_any_2d*)state;
-   
-   s->solid.target = al_get_target_bitmap();
+
    s->solid.w = al_get_bitmap_width(s->solid.texture);
    s->solid.h = al_get_bitmap_height(s->solid.texture);
 
@@ -408,9 +417,14 @@ static void shader_texture_grad_any_step(uintptr_t state, int minor)
 #include "scanline_drawers.inc"
 
 
+/*
+Only scanlines in [clip_y1, clip_y2) are drawn, the edges are still walked
+from the top of the triangle so the result does not depend on the clipping
+*/
 static void triangle_stepper(uintptr_t state,
    shader_init init, shader_first first, shader_step step, shader_draw draw,
-   ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2, ALLEGRO_VERTEX* vtx3)
+   ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2, ALLEGRO_VERTEX* vtx3,
+   int clip_y1, int clip_y2)
 {
    float Coords[6] = {vtx1->x - 0.5f, vtx1->y + 0.5f, vtx2->x - 0.5f, vtx2->y + 0.5f, vtx3->x - 0.5f, vtx3->y + 0.5f};
    float *V1 = Coords, *V2 = &Coords[2], *V3 = &Coords[4], *s;
@@ -461,7 +475,12 @@ static void triangle_stepper(uintptr_t state,
    mid_y = ceilf(V2[1]);
    end_y = ceilf(V3[1]);
 
-   if (cur_y == end_y)
+   if (end_y > clip_y2)
+      end_y = clip_y2;
+   if (mid_y > end_y)
+      mid_y = end_y;
+
+   if (cur_y >= end_y || end_y <= clip_y1)
       return;
 
    /*
@@ -554,7 +573,7 @@ static void triangle_stepper(uintptr_t state,
 
          first(state, left_x, cur_y, left_step, left_step - 1);
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= clip_y1) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -590,7 +609,7 @@ static void triangle_stepper(uintptr_t state,
             right_x -= 1;
          }
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= clip_y1) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -644,7 +663,7 @@ static void triangle_stepper(uintptr_t state,
 
          first(state, left_x, cur_y, left_step, left_step - 1);
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= clip_y1) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -672,7 +691,7 @@ static void triangle_stepper(uintptr_t state,
             right_x -= 1;
          }
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= clip_y1) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -683,26 +702,56 @@ static void triangle_stepper(uintptr_t state,
    }
 }
 
+static int bitmap_region_is_locked(ALLEGRO_BITMAP* bmp, int x1, int y1, int w, int h)
+{
+   ASSERT(bmp);
+
+   if (!al_is_bitmap_locked(bmp))
+      return 0;
+   if (x1 + w > bmp->lock_x && y1 + h > bmp->lock_y && x1 < bmp->lock_x + bmp->lock_w && y1 < bmp->lock_y + bmp->lock_h)
+      return 1;
+   return 0;
+}
+
+/*
+State shared by all the triangles drawn by _al_triangles_2d. Big batches are
+split into horizontal bands of BAND_HEIGHT scanlines, each with the list of
+triangles touching it, and the bands are drawn in parallel. Within a band the
+triangles are drawn in order, so blending gives the same result as drawing
+them one after another.
+*/
+typedef struct {
+   ALLEGRO_BITMAP *target;
+   ALLEGRO_BITMAP *texture;
+   state_blend blend;
+   int shade;
+
+   ALLEGRO_VERTEX *vtxs;
+   int band_y;
+   int *bin_start;
+   int *bins;
+} triangle_batch;
+
+#define BAND_HEIGHT           32
+#define PARALLEL_MIN_PIXELS   (64 * 1024)
+
 /*
 This one will check to see what exactly we need to draw...
 I.e. this will call all of the actual renderers and set the appropriate callbacks
 */
-void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3)
+static void draw_triangle(const triangle_batch *batch,
+   ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3,
+   int clip_y1, int clip_y2)
 {
-   int shade = 1;
+   ALLEGRO_BITMAP *texture = batch->texture;
+   int shade = batch->shade;
    int grad = 1;
-   int op, src_mode, dst_mode, op_alpha, src_alpha, dst_alpha;
    ALLEGRO_COLOR v1c, v2c, v3c;
 
    v1c = v1->color;
    v2c = v2->color;
    v3c = v3->color;
 
-   al_get_separate_blender(&op, &src_mode, &dst_mode, &op_alpha, &src_alpha, &dst_alpha);
-   if (_AL_DEST_IS_ZERO && _AL_SRC_NOT_MODIFIED) {
-      shade = 0;
-   }
-
    if ((v1c.r == v2c.r && v2c.r == v3c.r) &&
          (v1c.g == v2c.g && v2c.g == v3c.g) &&
          (v1c.b == v2c.b && v2c.b == v3c.b) &&
@@ -710,15 +759,21 @@ void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX
       grad = 0;
    }
 
+#define STEP_TRIANGLE(shader, draw)                                          \
+   triangle_stepper((uintptr_t)&state, shader##_init, shader##_first,        \
+      shader##_step, draw, v1, v2, v3, clip_y1, clip_y2)
+
    if (texture) {
       if (grad) {
          state_texture_grad_any_2d state;
+         state.solid.target = batch->target;
+         state.solid.blend = &batch->blend;
          state.solid.texture = texture;
 
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_shade);
+            STEP_TRIANGLE(shader_texture_grad_any, shader_texture_grad_any_draw_shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_opaque);
+            STEP_TRIANGLE(shader_texture_grad_any, shader_texture_grad_any_draw_opaque);
          }
       } else {
          int white = 0;
@@ -727,49 +782,272 @@ void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX
          if (v1c.r == 1 && v1c.g == 1 && v1c.b == 1 && v1c.a == 1) {
             white = 1;
          }
+         state.target = batch->target;
+         state.blend = &batch->blend;
          state.texture = texture;
          if (shade) {
             if (white) {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade_white);
+               STEP_TRIANGLE(shader_texture_solid_any, shader_texture_solid_any_draw_shade_white);
             } else {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade);
+               STEP_TRIANGLE(shader_texture_solid_any, shader_texture_solid_any_draw_shade);
             }
          } else {
             if (white) {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque_white);
+               STEP_TRIANGLE(shader_texture_solid_any, shader_texture_solid_any_draw_opaque_white);
             } else {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque);
+               STEP_TRIANGLE(shader_texture_solid_any, shader_texture_solid_any_draw_opaque);
             }
          }
       }
    } else {
       if (grad) {
          state_grad_any_2d state;
+         state.solid.target = batch->target;
+         state.solid.blend = &batch->blend;
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_shade);
+            STEP_TRIANGLE(shader_grad_any, shader_grad_any_draw_shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_opaque);
+            STEP_TRIANGLE(shader_grad_any, shader_grad_any_draw_opaque);
          }
       } else {
          state_solid_any_2d state;
+         state.target = batch->target;
+         state.blend = &batch->blend;
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_shade);
+            STEP_TRIANGLE(shader_solid_any, shader_solid_any_draw_shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_opaque);
+            STEP_TRIANGLE(shader_solid_any, shader_solid_any_draw_opaque);
          }
       }
    }
+
+#undef STEP_TRIANGLE
 }
 
-static int bitmap_region_is_locked(ALLEGRO_BITMAP* bmp, int x1, int y1, int w, int h)
+static void draw_bands(void *arg, int begin, int end)
 {
-   ASSERT(bmp);
+   const triangle_batch *batch = arg;
+   int band, ii;
 
-   if (!al_is_bitmap_locked(bmp))
-      return 0;
-   if (x1 + w > bmp->lock_x && y1 + h > bmp->lock_y && x1 < bmp->lock_x + bmp->lock_w && y1 < bmp->lock_y + bmp->lock_h)
-      return 1;
-   return 0;
+   for (band = begin; band < end; band++) {
+      const int y1 = batch->band_y + band * BAND_HEIGHT;
+
+      for (ii = batch->bin_start[band]; ii < batch->bin_start[band + 1]; ii++) {
+         ALLEGRO_VERTEX* v = &batch->vtxs[batch->bins[ii] * 3];
+         draw_triangle(batch, v, v + 1, v + 2, y1, y1 + BAND_HEIGHT);
+      }
+   }
+}
+
+/*
+Sorts the triangles into bands covering the scanlines [y1, y2) and draws the
+bands on the worker threads
+*/
+static void draw_banded(triangle_batch *batch, const int *visible, int num_visible,
+   int y1, int y2)
+{
+   const int num_bands = (y2 - y1 + BAND_HEIGHT - 1) / BAND_HEIGHT;
+   int *bands = al_malloc(2 * num_visible * sizeof(int));
+   int *next = al_malloc(num_bands * sizeof(int));
+   int ii, band;
+
+   batch->band_y = y1;
+   batch->bin_start = al_calloc(num_bands + 1, sizeof(int));
+
+   /*
+   The scanlines are computed exactly like triangle_stepper does
+   */
+   for (ii = 0; ii < num_visible; ii++) {
+      ALLEGRO_VERTEX* v = &batch->vtxs[visible[ii] * 3];
+      int first = ceilf(MIN(v[0].y + 0.5f, MIN(v[1].y + 0.5f, v[2].y + 0.5f)));
+      int last = (int)ceilf(MAX(v[0].y + 0.5f, MAX(v[1].y + 0.5f, v[2].y + 0.5f))) - 1;
+
+      first = MAX(first, y1);
+      last = MIN(last, y2 - 1);
+      if (first > last) {
+         bands[ii * 2] = 0;
+         bands[ii * 2 + 1] = -1;
+         continue;
+      }
+
+      bands[ii * 2] = (first - y1) / BAND_HEIGHT;
+      bands[ii * 2 + 1] = (last - y1) / BAND_HEIGHT;
+      for (band = bands[ii * 2]; band <= bands[ii * 2 + 1]; band++)
+         batch->bin_start[band + 1]++;
+   }
+
+   for (band = 0; band < num_bands; band++) {
+      batch->bin_start[band + 1] += batch->bin_start[band];
+      next[band] = batch->bin_start[band];
+   }
+
+   batch->bins = al_malloc(MAX(1, batch->bin_start[num_bands]) * sizeof(int));
+   for (ii = 0; ii < num_visible; ii++) {
+      for (band = bands[ii * 2]; band <= bands[ii * 2 + 1]; band++)
+         batch->bins[next[band]++] = visible[ii];
+   }
+
+   _al_parallel_for(num_bands, 1, draw_bands, batch);
+
+   al_free(batch->bins);
+   al_free(batch->bin_start);
+   al_free(next);
+   al_free(bands);
+}
+
+/*
+Returns the region the triangle might touch, clipped to the clipping
+rectangle as x1, y1, x2, y2. Returns false if nothing is visible.
+*/
+static bool triangle_bounds(ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3,
+   const int *clip, int *bounds)
+{
+   /*
+   We are choosing the minimum and maximum possible pixels touched from the
+   formula (easily verified by following the above algorithm.
+   */
+   int min_x = (int)floorf(MIN(v1->x, MIN(v2->x, v3->x))) - 1;
+   int min_y = (int)floorf(MIN(v1->y, MIN(v2->y, v3->y))) - 1;
+   int max_x = (int)ceilf(MAX(v1->x, MAX(v2->x, v3->x))) + 1;
+   int max_y = (int)ceilf(MAX(v1->y, MAX(v2->y, v3->y))) + 1;
+
+   /*
+   Clamp to the clipping rectangle. The locked region and the bands are
+   taken from these bounds, so nothing outside of the rectangle is locked
+   or drawn.
+   */
+   if (min_x >= clip[2] || min_y >= clip[3])
+      return false;
+   if (max_x >= clip[2])
+      max_x = clip[2];
+   if (max_y >= clip[3])
+      max_y = clip[3];
+
+   if (max_x < clip[0] || max_y < clip[1])
+      return false;
+   if (min_x < clip[0])
+      min_x = clip[0];
+   if (min_y < clip[1])
+      min_y = clip[1];
+
+   bounds[0] = min_x;
+   bounds[1] = min_y;
+   bounds[2] = max_x;
+   bounds[3] = max_y;
+   return true;
+}
+
+/*
+Draws a batch of triangles, three vertices each, onto the target bitmap.
+The target is locked once for the whole batch and the blender is looked up
+once.
+*/
+void _al_triangles_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* vtxs, int num_triangles)
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+   int op, src_mode, dst_mode, op_alpha, src_alpha, dst_alpha;
+   triangle_batch batch;
+   int clip[4];
+   int region[4] = {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+   int small_visible[16];
+   int *visible = small_visible;
+   int num_visible = 0;
+   double area = 0;
+   int need_unlock = 0;
+   int ii;
+
+   if (num_triangles <= 0)
+      return;
+
+   al_get_clipping_rectangle(&clip[0], &clip[1], &clip[2], &clip[3]);
+   clip[2] += clip[0];
+   clip[3] += clip[1];
+
+   if (num_triangles > (int)(sizeof(small_visible) / sizeof(*small_visible))) {
+      visible = al_malloc(num_triangles * sizeof(int));
+      if (!visible) {
+         /* Fall back to drawing the triangles one at a time. */
+         for (ii = 0; ii < num_triangles; ii++)
+            _al_triangles_2d(texture, &vtxs[ii * 3], 1);
+         return;
+      }
+   }
+
+   for (ii = 0; ii < num_triangles; ii++) {
+      ALLEGRO_VERTEX* v = &vtxs[ii * 3];
+      int bounds[4];
+
+      if (!triangle_bounds(v, v + 1, v + 2, clip, bounds))
+         continue;
+      if (al_is_bitmap_locked(target) &&
+          !bitmap_region_is_locked(target, bounds[0], bounds[1],
+             bounds[2] - bounds[0], bounds[3] - bounds[1]))
+         continue;
+
+      visible[num_visible++] = ii;
+      area += (double)(bounds[2] - bounds[0]) * (bounds[3] - bounds[1]);
+      region[0] = MIN(region[0], bounds[0]);
+      region[1] = MIN(region[1], bounds[1]);
+      region[2] = MAX(region[2], bounds[2]);
+      region[3] = MAX(region[3], bounds[3]);
+   }
+
+   if (num_visible == 0)
+      goto done;
+
+   if (al_is_bitmap_locked(target)) {
+      if (_al_pixel_format_is_video_only(target->locked_region.format))
+         goto done;
+   } else {
+      if (!al_lock_bitmap_region(target, region[0], region[1],
+            region[2] - region[0], region[3] - region[1],
+            ALLEGRO_PIXEL_FORMAT_ANY, 0))
+         goto done;
+      need_unlock = 1;
+   }
+
+   al_get_separate_blender(&op, &src_mode, &dst_mode, &op_alpha, &src_alpha, &dst_alpha);
+   batch.target = target;
+   batch.texture = texture;
+   batch.blend.op = op;
+   batch.blend.src_mode = src_mode;
+   batch.blend.dst_mode = dst_mode;
+   batch.blend.op_alpha = op_alpha;
+   batch.blend.src_alpha = src_alpha;
+   batch.blend.dst_alpha = dst_alpha;
+   batch.blend.const_color = al_get_blend_color();
+   batch.shade = !(_AL_DEST_IS_ZERO && _AL_SRC_NOT_MODIFIED);
+   batch.vtxs = vtxs;
+
+   /*
+   The drawers are offset by one scanline, so the band range is padded to
+   cover every scanline that can land inside the locked region
+   */
+   if (area >= PARALLEL_MIN_PIXELS && _al_get_parallel_thread_count() > 1) {
+      draw_banded(&batch, visible, num_visible, region[1], region[3] + 2);
+   } else {
+      for (ii = 0; ii < num_visible; ii++) {
+         ALLEGRO_VERTEX* v = &vtxs[visible[ii] * 3];
+         draw_triangle(&batch, v, v + 1, v + 2, INT_MIN, INT_MAX);
+      }
+   }
+
+   if (need_unlock)
+      al_unlock_bitmap(target);
+
+done:
+   if (visible != small_visible)
+      al_free(visible);
+}
+
+void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3)
+{
+   ALLEGRO_VERTEX vtxs[3];
+
+   vtxs[0] = *v1;
+   vtxs[1] = *v2;
+   vtxs[2] = *v3;
+   _al_triangles_2d(texture, vtxs, 1);
 }
 
 void _al_draw_soft_triangle(
@@ -789,44 +1067,25 @@ void _al_draw_soft_triangle(
    int need_unlock = 0;
    ALLEGRO_LOCKED_REGION *lr;
    int min_x, max_x, min_y, max_y;
-   int clip_min_x, clip_min_y, clip_max_x, clip_max_y;
+   int clip[4], bounds[4];
 
-   al_get_clipping_rectangle(&clip_min_x, &clip_min_y, &clip_max_x, &clip_max_y);
-   clip_max_x += clip_min_x;
-   clip_max_y += clip_min_y;
+   al_get_clipping_rectangle(&clip[0], &clip[1], &clip[2], &clip[3]);
+   clip[2] += clip[0];
+   clip[3] += clip[1];
 
    /*
    TODO: Need to clip them first, make a copy of the vertices first then
    */
 
    /*
-   Lock the region we are drawing to. We are choosing the minimum and maximum
-   possible pixels touched from the formula (easily verified by following the
-   above algorithm.
+   Lock the region we are drawing to.
    */
-
-   min_x = (int)floorf(MIN(vtx1->x, MIN(vtx2->x, vtx3->x))) - 1;
-   min_y = (int)floorf(MIN(vtx1->y, MIN(vtx2->y, vtx3->y))) - 1;
-   max_x = (int)ceilf(MAX(vtx1->x, MAX(vtx2->x, vtx3->x))) + 1;
-   max_y = (int)ceilf(MAX(vtx1->y, MAX(vtx2->y, vtx3->y))) + 1;
-
-   /*
-   TODO: This bit is temporary, the min max's will be guaranteed to be within the bitmap
-   once clipping is implemented
-   */
-   if (min_x >= clip_max_x || min_y >= clip_max_y)
-      return;
-   if (max_x >= clip_max_x)
-      max_x = clip_max_x;
-   if (max_y >= clip_max_y)
-      max_y = clip_max_y;
-
-   if (max_x < clip_min_x || max_y < clip_min_y)
+   if (!triangle_bounds(vtx1, vtx2, vtx3, clip, bounds))
       return;
-   if (min_x < clip_min_x)
-      min_x = clip_min_x;
-   if (min_y < clip_min_y)
-      min_y = clip_min_y;
+   min_x = bounds[0];
+   min_y = bounds[1];
+   max_x = bounds[2];
+   max_y = bounds[3];
 
    if (al_is_bitmap_locked(target)) {
       if (!bitmap_region_is_locked(target, min_x, min_y, max_x - min_x, max_y - min_y) ||
@@ -838,7 +1097,7 @@ void _al_draw_soft_triangle(
       need_unlock = 1;
    }
 
-   triangle_stepper(state, init, first, step, draw, v1, v2, v3);
+   triangle_stepper(state, init, first, step, draw, v1, v2, v3, INT_MIN, INT_MAX);
 
    if (need_unlock)
       al_unlock_bitmap(target);
@@ -23,6 +23,7 @@
 
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_debug.h"
 #include "allegro5/internal/aintern_thread.h"
 #include "allegro5/platform/aintunix.h"
 
@@ -42,6 +43,7 @@ static void *thread_proc_trampoline(void *data)
    _al_android_thread_created();
 #endif
    (*thread->proc)(thread, thread->arg);
+   _al_trace_thread_ended();
 #ifdef ALLEGRO_ANDROID
    _al_android_thread_ended();
 #endif
@@ -18,6 +18,7 @@
 
 #include "allegro5/allegro.h"
 #include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_debug.h"
 #include "allegro5/internal/aintern_thread.h"
 
 #include <mmsystem.h>
@@ -31,6 +32,7 @@ static unsigned __stdcall thread_proc_trampoline(void *data)
 {
    _AL_THREAD *thread = data;
    (*thread->proc)(thread, thread->arg);
+   _al_trace_thread_ended();
 
    /* _endthreadex does not automatically close the thread handle,
     * unlike _endthread.  We rely on this in al_join_thread().
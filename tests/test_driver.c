@@ -4,6 +4,7 @@
  *    By Peter Wang.
  */
 
+#define ALLEGRO_UNSTABLE
 #include <ctype.h>
 #include <math.h>
 #include <stdarg.h>
@@ -441,6 +442,7 @@ static int get_load_font_flags(char const *v)
    return streq(v, "ALLEGRO_NO_PREMULTIPLIED_ALPHA") ? ALLEGRO_NO_PREMULTIPLIED_ALPHA
       : streq(v, "ALLEGRO_TTF_NO_KERNING") ? ALLEGRO_TTF_NO_KERNING
       : streq(v, "ALLEGRO_TTF_MONOCHROME") ? ALLEGRO_TTF_MONOCHROME
+      : streq(v, "ALLEGRO_TTF_DISTANCE_FIELD") ? ALLEGRO_TTF_DISTANCE_FIELD
       : atoi(v);
 }
 